@@ -0,0 +1,38 @@
+#pragma once
+#include "common.hpp"
+#include "array.hpp"
+#include "os.hpp"
+
+struct ArgParser {
+    struct Option {
+        const wchar_t* key = L"";
+        const wchar_t* value = L"";
+    };
+
+    Array<wchar_t*> arguments{ tmpalloc };
+    Array<wchar_t*> flags{ tmpalloc };
+    Array<Option> options{ tmpalloc };
+
+    void parse() {
+        int argc = 0;
+        const auto argv = get_command_line_args(&argc);
+
+        for (int i = 1; i < argc; ++i) {
+            auto arg = argv[i];
+            if (string_starts_with(arg, L"--")) {
+                auto option_start = arg + 2;
+                auto assign_index = string_index_of(option_start, '=');
+                if (assign_index != -1) {
+                    Option option;
+                    option.key = substring(tmpalloc, option_start, option_start + assign_index);
+                    option.value = substring(tmpalloc, option_start + assign_index + 1, option_start + wcslen(option_start));
+                    options.push(option);
+                } else {
+                    flags.push(option_start);
+                }
+            } else {
+                arguments.push(arg);
+            }
+        }
+    }
+};
@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <exception>
+#include <bit>
+#include <emmintrin.h>
 
 #ifdef _DEBUG
 #pragma comment(lib, "zlibstatic-ngd.lib")
@@ -19,6 +21,9 @@ __declspec(allocator) void* tmpalloc_exec(Allocator& self_, MemoryOperation op,
             verify(self.now + size <= self.end);
             auto result = self.now;
             self.now += size;// +(size % 16);
+            if (self.now > self.high_water) {
+                self.high_water = self.now;
+            }
             return result;
         } break;
 
@@ -54,11 +59,27 @@ __declspec(allocator) void* stdalloc_exec(Allocator& self, MemoryOperation op, v
 LinearAllocator tmpalloc{ tmpalloc_exec };
 Allocator stdalloc{ stdalloc_exec };
 
+LinearAllocator create_linear_allocator(size_t size) {
+    auto data = allocate_virtual_memory(size);
+    LinearAllocator allocator{ tmpalloc_exec };
+    allocator.start = data.start;
+    allocator.now = data.now;
+    allocator.end = data.end;
+    allocator.high_water = data.now;
+    return allocator;
+}
+
+void free_linear_allocator(LinearAllocator* allocator) {
+    Slice data;
+    data.start = allocator->start;
+    data.now = allocator->now;
+    data.end = allocator->end;
+    free_virtual_memory(&data);
+    *allocator = LinearAllocator{ tmpalloc_exec };
+}
+
 void memory_init() {
-    auto data = allocate_virtual_memory(1024 * 1024 * 512);
-    tmpalloc.start = data.start;
-    tmpalloc.now = data.now;
-    tmpalloc.end = data.end;
+    tmpalloc = create_linear_allocator(1024 * 1024 * 512);
 }
 
 __declspec(noreturn) void verify_impl(const char* msg, const char* file, int line) {
@@ -116,6 +137,14 @@ int string_index_of(const wchar_t* str, wchar_t c) {
     return -1;
 }
 
+uint32_t hash_string_ignore_case(const char* str, size_t count) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < count; ++i) {
+        hash = (hash ^ (uint8_t)to_lower_ascii(str[i])) * 16777619u;
+    }
+    return hash;
+}
+
 wchar_t* substring(Allocator& allocator, const wchar_t* start, const wchar_t* end) {
     auto count = end - start;
     verify(count >= 0);
@@ -176,13 +205,41 @@ void operator delete[](void* block, Allocator& allocator) {
 }
 
 int String::index_of(const String& str) const {
-    if (count >= str.count) {
-        for (int i = 0; i < count - str.count; ++i) {
-            if (0 == memcmp(&chars[i], str.chars, str.count)) {
-                return i;
+    if (str.count == 0) {
+        return 0;
+    } else if (str.count > count) {
+        return -1;
+    } else if (str.count == 1) {
+        const auto found = (const char*)memchr(chars, str.chars[0], count);
+        return found ? (int)(found - chars) : -1;
+    }
+
+    // Compare first and last bytes of "str" at 16 positions at once, full comparison is done only for positions
+    // where both bytes match.
+    const auto last_start = count - str.count;
+    const auto first_byte = _mm_set1_epi8(str.chars[0]);
+    const auto last_byte = _mm_set1_epi8(str.chars[str.count - 1]);
+
+    int i = 0;
+    for (; i + 16 <= last_start + 1; i += 16) {
+        const auto first = _mm_loadu_si128((const __m128i*)&chars[i]);
+        const auto last = _mm_loadu_si128((const __m128i*)&chars[i + str.count - 1]);
+        auto mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, first_byte), _mm_cmpeq_epi8(last, last_byte)));
+        while (mask) {
+            const auto index = i + std::countr_zero(mask);
+            if (0 == memcmp(&chars[index + 1], &str.chars[1], str.count - 2)) {
+                return index;
             }
+            mask &= mask - 1;
         }
     }
+
+    for (; i <= last_start; ++i) {
+        if (chars[i] == str.chars[0] && 0 == memcmp(&chars[i + 1], &str.chars[1], str.count - 1)) {
+            return i;
+        }
+    }
+
     return -1;
 }
 
@@ -14,6 +14,7 @@ struct LinearAllocator : Allocator {
     uint8_t* start = nullptr;
     uint8_t* now = nullptr;
     const uint8_t* end = nullptr;
+    uint8_t* high_water = nullptr; // Highest "now" ever reached, TEMP_SCOPE doesn't reset it.
 
     inline size_t remaining_size() const {
         return end - now;
@@ -23,6 +24,11 @@ struct LinearAllocator : Allocator {
 extern Allocator stdalloc;
 extern LinearAllocator tmpalloc;
 
+// Linear allocator with its own memory, for threads that can't allocate from "tmpalloc". Memory is freed all at
+// once by resetting "now" or by "free_linear_allocator".
+LinearAllocator create_linear_allocator(size_t size);
+void free_linear_allocator(LinearAllocator* allocator);
+
 void* operator new(size_t size, Allocator& allocator);
 void* operator new[](size_t size, Allocator& allocator);
 void operator delete(void* block, Allocator& allocator);
@@ -64,6 +70,7 @@ bool string_starts_with(const wchar_t* a, const wchar_t* b);
 int string_index_of(const wchar_t* str, wchar_t c);
 wchar_t* substring(Allocator& allocator, const wchar_t* start, const wchar_t* end);
 wchar_t* string_replace_extension(Allocator& allocator, const wchar_t* path, const wchar_t* new_extension);
+uint32_t hash_string_ignore_case(const char* str, size_t count); // ASCII only.
 
 #pragma pack(push, 1)
 struct WString {
@@ -149,6 +156,20 @@ inline bool is_bit_set(const T& obj, const T& bit) {
     return (obj & bit) != (T)0;
 }
 
+inline char to_lower_ascii(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Mixes all bits of value, so hashes of sequential values can be used as hash table slot index.
+inline uint32_t hash_uint32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
 // @TODO: split into EspParserOptions, TextToEspOptions, etc.
 enum class ProgramOptions : uint32_t {
     None = 0,
@@ -157,6 +178,7 @@ enum class ProgramOptions : uint32_t {
     PreserveJunk = 0x4,
     DebugZLib = 0x8,
     ExportRelatedFiles = 0x10,
+    BuildRecordLookup = 0x20, // Build EspObjectModel::lookup.
 };
 ENUM_BIT_OPS(uint32_t, ProgramOptions);
 
@@ -0,0 +1,516 @@
+#include "esp_conflicts.hpp"
+#include "esp_to_text.hpp"
+#include "parallel.hpp"
+#include "array.hpp"
+#include "os.hpp"
+#include "profiler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+static constexpr int ObjectIndexBits = 24;
+
+struct ConflictEntry {
+    uint64_t key = 0; // Load order index of plugin that defines record in upper bits, object index in lower 24 bits.
+    uint32_t offset = 0; // Offset of RawRecord from the start of plugin data.
+    uint32_t plugin = 0; // Load order index of plugin that contains this version of record.
+};
+
+struct ConflictPlugin {
+    const wchar_t* name = nullptr;
+    StaticArray<uint8_t> data; // Empty for masters which are not in load order.
+    bool light = false;
+    bool localized = false;
+    Array<uint32_t> masters{ tmpalloc }; // Load order index of each master.
+    Array<ConflictEntry> entries; // Sorted by key. Filled by worker thread.
+};
+
+struct FieldBlock {
+    RecordFieldType type = (RecordFieldType)0;
+    int occurrence = 0; // Number of blocks of the same type before this one.
+    int start = 0;
+    int count = 0;
+};
+
+struct RecordVersion {
+    uint32_t plugin = 0;
+    const RawRecord* raw = nullptr;
+    Record* record = nullptr;
+    Array<FieldBlock> blocks{ tmpalloc };
+};
+
+static bool plugin_name_equals(const wchar_t* name, const char* master, size_t master_length) {
+    for (size_t i = 0; i < master_length; ++i) {
+        if (!name[i] || towlower(name[i]) != towlower((uint8_t)master[i])) {
+            return false;
+        }
+    }
+    return name[master_length] == L'\0';
+}
+
+static bool has_light_plugin_extension(const wchar_t* name) {
+    const auto length = wcslen(name);
+    return length >= 4 && name[length - 4] == L'.' && towlower(name[length - 3]) == L'e' && towlower(name[length - 2]) == L's' && towlower(name[length - 1]) == L'l';
+}
+
+static const wchar_t* get_plugin_name(const wchar_t* path) {
+    for (int i = (int)wcslen(path) - 1; i >= 0; --i) {
+        if (path[i] == L'\\' || path[i] == L'/') {
+            return &path[i + 1];
+        }
+    }
+    return path;
+}
+
+static bool raw_records_equal(const RawRecord* a, const RawRecord* b) {
+    return a->type == b->type
+        && a->flags == b->flags
+        && a->data_size == b->data_size
+        && memory_equals(a + 1, b + 1, a->data_size);
+}
+
+static bool blocks_equal(const RecordVersion& a, const FieldBlock* block_a, const RecordVersion& b, const FieldBlock* block_b) {
+    if (!block_a || !block_b) {
+        return block_a == block_b;
+    }
+    if (block_a->count != block_b->count) {
+        return false;
+    }
+    for (int i = 0; i < block_a->count; ++i) {
+        const auto field_a = a.record->fields.data[block_a->start + i];
+        const auto field_b = b.record->fields.data[block_b->start + i];
+        if (field_a->type != field_b->type || field_a->data.count != field_b->data.count || !memory_equals(field_a->data.data, field_b->data.data, field_a->data.count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const FieldBlock* find_block(const RecordVersion& version, RecordFieldType type, int occurrence) {
+    for (const auto& block : version.blocks) {
+        if (block.type == type && block.occurrence == occurrence) {
+            return &block;
+        }
+    }
+    return nullptr;
+}
+
+struct ConflictScanner {
+    ProgramOptions options = ProgramOptions::None;
+    Array<ConflictPlugin> plugins{ tmpalloc }; // In load order, followed by masters which are not in load order.
+    int loaded_count = 0;
+    Array<ConflictEntry> index; // Entries of all plugins sorted by key and plugin.
+    EspParser parser;
+    TextRecordWriter writer;
+    EspConflictStats stats;
+
+    void init(ProgramOptions options, const StaticArray<const wchar_t*> plugin_paths) {
+        this->options = options;
+        parser.init(tmpalloc, options);
+        writer.init(options);
+
+        for (const auto path : plugin_paths) {
+            ConflictPlugin plugin;
+            plugin.name = get_plugin_name(path);
+            plugin.data = try_map_file(path);
+            if (!plugin.data.count) {
+                exit_error(L"failed to open plugin \"%s\": %s", path, get_last_error());
+            }
+            plugins.push(plugin);
+        }
+        loaded_count = plugins.count;
+        stats.plugin_count = loaded_count;
+
+        for (int i = 0; i < loaded_count; ++i) {
+            read_plugin_header(i);
+        }
+    }
+
+    void dispose() {
+        index.free();
+        for (auto& plugin : plugins) {
+            plugin.entries.free();
+            unmap_file(&plugin.data);
+        }
+        writer.dispose();
+        parser.dispose();
+    }
+
+    uint32_t find_or_add_master(const char* name, size_t length, int plugin_index) {
+        for (int i = 0; i < plugins.count; ++i) {
+            if (plugin_name_equals(plugins.data[i].name, name, length)) {
+                return i;
+            }
+        }
+
+        const auto wide_name = (wchar_t*)memalloc(tmpalloc, sizeof(wchar_t) * (length + 1));
+        for (size_t i = 0; i < length; ++i) {
+            wide_name[i] = (uint8_t)name[i];
+        }
+        wide_name[length] = L'\0';
+        wprintf(L"warning: master \"%s\" of \"%s\" is not in load order\n", wide_name, plugins.data[plugin_index].name);
+
+        ConflictPlugin master;
+        master.name = wide_name;
+        plugins.push(master);
+        return plugins.count - 1;
+    }
+
+    void read_plugin_header(int plugin_index) {
+        const auto& data = plugins.data[plugin_index].data;
+        verify(data.count >= sizeof(RawRecord));
+
+        const auto tes4 = (const RawRecord*)data.data;
+        verify(tes4->type == RecordType::TES4);
+        verify(!tes4->is_compressed());
+        verify(sizeof(RawRecord) + tes4->data_size <= data.count);
+
+        plugins.data[plugin_index].light = is_bit_set(tes4->flags, RecordFlags::TES4_Light) || has_light_plugin_extension(plugins.data[plugin_index].name);
+        plugins.data[plugin_index].localized = is_bit_set(tes4->flags, RecordFlags::TES4_Localized);
+
+        const uint8_t* now = (const uint8_t*)(tes4 + 1);
+        const uint8_t* end = now + tes4->data_size;
+        while (now < end) {
+            const auto field = (const RawRecordField*)now;
+            verify(now + sizeof(RawRecordField) + field->size <= end);
+
+            if (field->type == RecordFieldType::MAST) {
+                const auto master_name = (const char*)(field + 1);
+                const auto master = find_or_add_master(master_name, strnlen(master_name, field->size), plugin_index);
+                plugins.data[plugin_index].masters.push(master); // "plugins" may be reallocated by the call above.
+            }
+            now += sizeof(RawRecordField) + field->size;
+        }
+    }
+
+    // Called from worker threads, writes only to entries of specified plugin.
+    void index_plugin(uint32_t plugin_index) {
+        auto& plugin = plugins.data[plugin_index];
+        TraceScope trace{ "plugin", plugin.name };
+        PROFILE_SCOPE(RecordWalk, plugin.data.count);
+
+        const uint8_t* now = plugin.data.data;
+        const uint8_t* end = plugin.data.data + plugin.data.count;
+
+        while (now < end) {
+            verify(now + sizeof(RawRecord) <= end);
+            const auto record = (const RawRecord*)now;
+
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                verify(group->group_size >= sizeof(RawGrupRecord) && now + group->group_size <= end);
+                now += sizeof(RawGrupRecord);
+                continue;
+            }
+
+            verify(now + sizeof(RawRecord) + record->data_size <= end);
+            if (record->type != RecordType::TES4) {
+                // Top byte of Form ID is index in master list, plugin's own records have index past the last master.
+                const uint32_t master_index = record->id.value >> ObjectIndexBits;
+                const uint32_t owner = master_index < (uint32_t)plugin.masters.count ? plugin.masters.data[master_index] : plugin_index;
+                const uint32_t object_mask = plugins.data[owner].light ? 0xfff : 0xffffff;
+                plugin.entries.push({ ((uint64_t)owner << ObjectIndexBits) | (record->id.value & object_mask), static_cast<uint32_t>(now - plugin.data.data), plugin_index });
+            }
+            now += sizeof(RawRecord) + record->data_size;
+        }
+
+        qsort(plugin.entries.data, plugin.entries.count, sizeof(plugin.entries.data[0]), [](void const* aa, void const* bb) -> int {
+            const auto a = (const ConflictEntry*)aa;
+            const auto b = (const ConflictEntry*)bb;
+            if (a->key != b->key) {
+                return a->key < b->key ? -1 : 1;
+            }
+            return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+        });
+    }
+
+    void build_index() {
+        WorkCounter counter{ loaded_count };
+        run_on_threads(get_thread_count(loaded_count), [&]() {
+            for (;;) {
+                const int plugin_index = counter.take();
+                if (plugin_index == -1) {
+                    break;
+                }
+                index_plugin(plugin_index);
+            }
+        });
+
+        merge_entries();
+    }
+
+    // Merges sorted entries of all plugins into "index", versions of the same record end up next to each other in load order.
+    void merge_entries() {
+        TEMP_SCOPE();
+
+        const auto positions = (int*)memalloc(tmpalloc, sizeof(int) * loaded_count);
+        const auto heap = (int*)memalloc(tmpalloc, sizeof(int) * loaded_count); // Binary min-heap of plugin indices.
+        int heap_count = 0;
+
+        for (int i = 0; i < loaded_count; ++i) {
+            positions[i] = 0;
+            if (plugins.data[i].entries.count) {
+                heap[heap_count++] = i;
+            }
+            stats.record_count += plugins.data[i].entries.count;
+        }
+
+        const auto less = [&](int a, int b) {
+            const auto key_a = plugins.data[a].entries.data[positions[a]].key;
+            const auto key_b = plugins.data[b].entries.data[positions[b]].key;
+            return key_a != key_b ? key_a < key_b : a < b;
+        };
+
+        const auto sift_down = [&](int i) {
+            for (;;) {
+                int smallest = i;
+                const int left = 2 * i + 1;
+                const int right = 2 * i + 2;
+                if (left < heap_count && less(heap[left], heap[smallest])) {
+                    smallest = left;
+                }
+                if (right < heap_count && less(heap[right], heap[smallest])) {
+                    smallest = right;
+                }
+                if (smallest == i) {
+                    break;
+                }
+                const int temp = heap[i];
+                heap[i] = heap[smallest];
+                heap[smallest] = temp;
+                i = smallest;
+            }
+        };
+
+        for (int i = heap_count / 2 - 1; i >= 0; --i) {
+            sift_down(i);
+        }
+
+        while (heap_count) {
+            const int plugin_index = heap[0];
+            const auto& entries = plugins.data[plugin_index].entries;
+            index.push(entries.data[positions[plugin_index]++]);
+
+            if (positions[plugin_index] == entries.count) {
+                heap[0] = heap[--heap_count];
+            }
+            sift_down(0);
+        }
+    }
+
+    void report() {
+        int i = 0;
+        while (i < index.count) {
+            int j = i + 1;
+            while (j < index.count && index.data[j].key == index.data[i].key) {
+                ++j;
+            }
+            report_record({ &index.data[i], (size_t)(j - i) });
+            i = j;
+        }
+    }
+
+    void split_blocks(RecordVersion* version) {
+        const auto record = version->record;
+        auto def = get_record_def(record->type);
+        if (!def) {
+            def = &Record_Common;
+        }
+
+        for (int i = 0; i < record->fields.count;) {
+            const auto type = record->fields.data[i]->type;
+
+            int count = static_cast<int>(get_field_block_size(def, type));
+            if (count > record->fields.count - i) {
+                count = record->fields.count - i;
+            }
+
+            int occurrence = 0;
+            for (const auto& block : version->blocks) {
+                if (block.type == type) {
+                    ++occurrence;
+                }
+            }
+
+            version->blocks.push({ type, occurrence, i, count });
+            i += count;
+        }
+    }
+
+    // Returns empty array if version doesn't have specified block.
+    StaticArray<char> format_block(const RecordVersion& version, const FieldBlock& key) {
+        const auto block = find_block(version, key.type, key.occurrence);
+        if (!block) {
+            return {};
+        }
+
+        auto def = get_record_def(version.record->type);
+        if (!def) {
+            def = &Record_Common;
+        }
+
+        writer.output_buffer.now = writer.output_buffer.start;
+        writer.indent = 0;
+        writer.current_record_type = version.record->type;
+        writer.localized_strings = plugins.data[version.plugin].localized;
+        writer.write_field_block(def, { &version.record->fields.data[block->start], (size_t)block->count });
+
+        const auto size = writer.output_buffer.size();
+        const auto text = (char*)memalloc(tmpalloc, size);
+        memcpy(text, writer.output_buffer.start, size);
+        return { text, size };
+    }
+
+    void report_record(const StaticArray<ConflictEntry> entries) {
+        TEMP_SCOPE();
+
+        const auto owner = (uint32_t)(entries.data[0].key >> ObjectIndexBits);
+
+        // Plugin may contain several records with the same Form ID, only first one is compared.
+        Array<RecordVersion> versions{ tmpalloc };
+        int override_count = 0;
+        for (size_t i = 0; i < entries.count; ++i) {
+            const auto& entry = entries.data[i];
+            if (i > 0 && entries.data[i - 1].plugin == entry.plugin) {
+                continue;
+            }
+
+            RecordVersion version;
+            version.plugin = entry.plugin;
+            version.raw = (const RawRecord*)(plugins.data[entry.plugin].data.data + entry.offset);
+            versions.push(version);
+
+            if (entry.plugin != owner) {
+                ++override_count;
+            }
+        }
+
+        if (override_count < 2) {
+            return;
+        }
+        ++stats.overridden_count;
+
+        bool all_equal = true;
+        for (const auto& version : versions) {
+            if (!raw_records_equal(versions.data[0].raw, version.raw)) {
+                all_equal = false;
+                break;
+            }
+        }
+        if (all_equal) {
+            return;
+        }
+
+        // Raw data differs, but records may still differ only in compression.
+        for (auto& version : versions) {
+            version.record = parser.parse_record(version.raw);
+            split_blocks(&version);
+        }
+
+        bool flags_differ = false;
+        for (const auto& version : versions) {
+            if (clear_bit(version.raw->flags, RecordFlags::Compressed) != clear_bit(versions.data[0].raw->flags, RecordFlags::Compressed)) {
+                flags_differ = true;
+            }
+        }
+
+        struct DifferingBlock {
+            FieldBlock key;
+            StaticArray<char>* texts = nullptr; // Formatted block of each version.
+        };
+
+        Array<FieldBlock> checked_blocks{ tmpalloc };
+        Array<DifferingBlock> differing_blocks{ tmpalloc };
+        for (const auto& version : versions) {
+            for (const auto& block : version.blocks) {
+                if (find_block_key(checked_blocks, block)) {
+                    continue;
+                }
+                checked_blocks.push(block);
+
+                bool bytes_differ = false;
+                const auto first_block = find_block(versions.data[0], block.type, block.occurrence);
+                for (const auto& other : versions) {
+                    if (!blocks_equal(versions.data[0], first_block, other, find_block(other, block.type, block.occurrence))) {
+                        bytes_differ = true;
+                        break;
+                    }
+                }
+                if (!bytes_differ) {
+                    continue;
+                }
+
+                // Blocks may differ only in junk data which is not written to text.
+                DifferingBlock differing;
+                differing.key = block;
+                differing.texts = (StaticArray<char>*)memalloc(tmpalloc, sizeof(StaticArray<char>) * versions.count);
+
+                bool texts_differ = false;
+                for (int i = 0; i < versions.count; ++i) {
+                    differing.texts[i] = format_block(versions.data[i], block);
+                    const auto& text = differing.texts[i];
+                    const auto& first_text = differing.texts[0];
+                    if (!text.data != !first_text.data || text.count != first_text.count || !memory_equals(text.data, first_text.data, text.count)) {
+                        texts_differ = true;
+                    }
+                }
+                if (texts_differ) {
+                    differing_blocks.push(differing);
+                }
+            }
+        }
+
+        if (!flags_differ && !differing_blocks.count) {
+            return;
+        }
+        ++stats.conflict_count;
+
+        printf("@@ %.4s [%06X] from %ls, overridden by", (const char*)&versions.data[0].raw->type, (uint32_t)(entries.data[0].key & 0xffffff), plugins.data[owner].name);
+        bool first_override = true;
+        for (const auto& version : versions) {
+            if (version.plugin != owner) {
+                printf(first_override ? " %ls" : ", %ls", plugins.data[version.plugin].name);
+                first_override = false;
+            }
+        }
+        printf("\n");
+
+        for (int i = 0; i < versions.count; ++i) {
+            const auto& version = versions.data[i];
+            printf("%ls\n", plugins.data[version.plugin].name);
+            if (flags_differ) {
+                printf("  Flags %08X\n", (uint32_t)clear_bit(version.raw->flags, RecordFlags::Compressed));
+            }
+            for (const auto& differing : differing_blocks) {
+                const auto& text = differing.texts[i];
+                if (text.data) {
+                    fwrite(text.data, 1, text.count, stdout);
+                } else {
+                    printf("  %.4s (missing)\n", (const char*)&differing.key.type);
+                }
+            }
+        }
+    }
+
+    static bool find_block_key(const Array<FieldBlock>& blocks, const FieldBlock& key) {
+        for (const auto& block : blocks) {
+            if (block.type == key.type && block.occurrence == key.occurrence) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+EspConflictStats scan_conflicts(ProgramOptions options, const StaticArray<const wchar_t*> plugin_paths) {
+    TEMP_SCOPE();
+
+    ConflictScanner scanner;
+    scanner.init(options, plugin_paths);
+    defer(scanner.dispose());
+
+    scanner.build_index();
+    scanner.report();
+    return scanner.stats;
+}
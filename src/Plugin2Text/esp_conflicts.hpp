@@ -0,0 +1,15 @@
+#pragma once
+#include "esp_parser.hpp"
+
+struct EspConflictStats {
+    size_t plugin_count = 0;
+    size_t record_count = 0;
+    size_t overridden_count = 0; // Records overridden by more than one plugin.
+    size_t conflict_count = 0; // Overridden records which are not the same in all plugins.
+};
+
+// Finds records that are overridden by more than one plugin and writes fields that differ between
+// plugins to stdout. "plugin_paths" must be sorted in load order. Form IDs are resolved to load order
+// using master list of each plugin. Plugins are memory mapped and indexed in parallel, records are
+// parsed and formatted only if their raw data differs.
+EspConflictStats scan_conflicts(ProgramOptions options, const StaticArray<const wchar_t*> plugin_paths);
@@ -0,0 +1,407 @@
+#include "esp_diff.hpp"
+#include "esp_to_text.hpp"
+#include "array.hpp"
+#include "profiler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct DiffGroup {
+    RecordGroupType group_type = RecordGroupType::Top;
+    uint32_t label = 0;
+    int parent = -1; // Index in DiffPlugin::groups, -1 for top groups.
+};
+
+struct DiffEntry {
+    FormID id;
+    uint32_t offset = 0;
+    uint64_t path_hash = 0; // Hash of group types and labels of all parent groups.
+    int group = -1;
+};
+
+static constexpr uint64_t DiffPathHashStart = 14695981039346656037ULL; // FNV-1a
+
+static uint64_t hash_group(uint64_t hash, RecordGroupType group_type, uint32_t label) {
+    const uint32_t values[2]{ (uint32_t)group_type, label };
+    const auto bytes = (const uint8_t*)values;
+    for (size_t i = 0; i < sizeof(values); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Plugin records with their group paths. Only record and group headers are read.
+struct DiffPlugin {
+    StaticArray<uint8_t> data;
+    Array<DiffGroup> groups{ tmpalloc };
+    Array<DiffEntry> entries{ tmpalloc };
+
+    void walk(const StaticArray<uint8_t> data) {
+        PROFILE_SCOPE(RecordWalk, data.count);
+        verify(data.count <= UINT32_MAX);
+
+        this->data = data;
+
+        struct OpenGroup {
+            const uint8_t* end = nullptr;
+            int index = -1;
+            uint64_t path_hash = 0;
+        };
+        Array<OpenGroup> open_groups{ tmpalloc };
+
+        const uint8_t* now = data.data;
+        const uint8_t* end = data.data + data.count;
+
+        while (now < end) {
+            while (open_groups.count && now >= open_groups.data[open_groups.count - 1].end) {
+                verify(now == open_groups.data[open_groups.count - 1].end);
+                --open_groups.count;
+            }
+
+            verify(now + sizeof(RawRecord) <= end);
+            const auto record = (const RawRecord*)now;
+            const auto parent = open_groups.count ? &open_groups.data[open_groups.count - 1] : nullptr;
+            const auto parent_index = parent ? parent->index : -1;
+            const auto parent_path_hash = parent ? parent->path_hash : DiffPathHashStart;
+
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                verify(group->group_size >= sizeof(RawGrupRecord) && now + group->group_size <= end);
+
+                groups.push({ group->group_type, group->label, parent_index });
+                open_groups.push({ now + group->group_size, groups.count - 1, hash_group(parent_path_hash, group->group_type, group->label) });
+                now += sizeof(RawGrupRecord);
+            } else {
+                verify(now + sizeof(RawRecord) + record->data_size <= end);
+                entries.push({ record->id, static_cast<uint32_t>(now - data.data), parent_path_hash, parent_index });
+                now += sizeof(RawRecord) + record->data_size;
+            }
+        }
+
+        qsort(entries.data, entries.count, sizeof(entries.data[0]), [](void const* aa, void const* bb) -> int {
+            const auto a = (const DiffEntry*)aa;
+            const auto b = (const DiffEntry*)bb;
+            if (a->id.value != b->id.value) {
+                return a->id.value < b->id.value ? -1 : 1;
+            }
+            if (a->path_hash != b->path_hash) {
+                return a->path_hash < b->path_hash ? -1 : 1;
+            }
+            return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+        });
+    }
+
+    const RawRecord* get_record(const DiffEntry& entry) const {
+        return (const RawRecord*)(data.data + entry.offset);
+    }
+
+    void write_group_path(int group_index) const {
+        if (group_index == -1) {
+            return;
+        }
+
+        const auto& group = groups.data[group_index];
+        if (group.parent != -1) {
+            write_group_path(group.parent);
+            printf(" / ");
+        }
+
+        switch (group.group_type) {
+            case RecordGroupType::Top: {
+                printf("%.4s", (const char*)&group.label);
+            } break;
+
+            case RecordGroupType::ExteriorCellBlock:
+            case RecordGroupType::ExteriorCellSubBlock: {
+                const auto grid = (const int16_t*)&group.label;
+                printf("%s (%d; %d)", record_group_type_to_string(group.group_type), grid[1], grid[0]);
+            } break;
+
+            case RecordGroupType::InteriorCellBlock:
+            case RecordGroupType::InteriorCellSubBlock: {
+                printf("%s %d", record_group_type_to_string(group.group_type), (int)group.label);
+            } break;
+
+            default: {
+                printf("%s [%08X]", record_group_type_to_string(group.group_type), group.label);
+            } break;
+        }
+    }
+};
+
+static int compare_diff_entries(const DiffEntry& a, const DiffEntry& b) {
+    if (a.id.value != b.id.value) {
+        return a.id.value < b.id.value ? -1 : 1;
+    }
+    if (a.path_hash != b.path_hash) {
+        return a.path_hash < b.path_hash ? -1 : 1;
+    }
+    return 0;
+}
+
+static bool lines_equal(const StaticArray<char>& a, const StaticArray<char>& b) {
+    return a.count == b.count && memory_equals(a.data, b.data, a.count);
+}
+
+static Array<StaticArray<char>> split_lines(const StaticArray<char> text) {
+    Array<StaticArray<char>> lines{ tmpalloc };
+
+    const char* line_start = text.data;
+    const char* end = text.data + text.count;
+    for (const char* now = text.data; now < end; ++now) {
+        if (*now == '\n') {
+            lines.push({ (char*)line_start, (size_t)(now - line_start) });
+            line_start = now + 1;
+        }
+    }
+    if (line_start < end) {
+        lines.push({ (char*)line_start, (size_t)(end - line_start) });
+    }
+
+    return lines;
+}
+
+struct DiffLine {
+    char op = ' '; // ' ', '-' or '+'.
+    StaticArray<char> line;
+};
+
+// Line-level diff of two formatted records. Uses LCS over lines which differ after
+// common prefix and suffix are skipped, very large records fall back to "remove all, add all".
+static Array<DiffLine> diff_lines(const Array<StaticArray<char>>& a, const Array<StaticArray<char>>& b) {
+    Array<DiffLine> result{ tmpalloc };
+
+    int prefix = 0;
+    while (prefix < a.count && prefix < b.count && lines_equal(a.data[prefix], b.data[prefix])) {
+        result.push({ ' ', a.data[prefix] });
+        ++prefix;
+    }
+
+    int suffix = 0;
+    while (suffix < a.count - prefix && suffix < b.count - prefix && lines_equal(a.data[a.count - suffix - 1], b.data[b.count - suffix - 1])) {
+        ++suffix;
+    }
+
+    const size_t n = a.count - prefix - suffix;
+    const size_t m = b.count - prefix - suffix;
+    const auto a_lines = a.data + prefix;
+    const auto b_lines = b.data + prefix;
+
+    constexpr size_t MaxLcsTableSize = 16 * 1024 * 1024;
+    if (n * m <= MaxLcsTableSize) {
+        // lcs[i * (m + 1) + j] is length of LCS of a_lines[i..n) and b_lines[j..m).
+        const auto lcs = (uint32_t*)memalloc(tmpalloc, sizeof(uint32_t) * (n + 1) * (m + 1));
+        for (size_t i = n + 1; i-- > 0;) {
+            for (size_t j = m + 1; j-- > 0;) {
+                uint32_t value = 0;
+                if (i < n && j < m) {
+                    if (lines_equal(a_lines[i], b_lines[j])) {
+                        value = lcs[(i + 1) * (m + 1) + j + 1] + 1;
+                    } else {
+                        const auto down = lcs[(i + 1) * (m + 1) + j];
+                        const auto right = lcs[i * (m + 1) + j + 1];
+                        value = down > right ? down : right;
+                    }
+                }
+                lcs[i * (m + 1) + j] = value;
+            }
+        }
+
+        size_t i = 0;
+        size_t j = 0;
+        while (i < n || j < m) {
+            if (i < n && j < m && lines_equal(a_lines[i], b_lines[j])) {
+                result.push({ ' ', a_lines[i] });
+                ++i;
+                ++j;
+            } else if (i < n && (j == m || lcs[(i + 1) * (m + 1) + j] >= lcs[i * (m + 1) + j + 1])) {
+                result.push({ '-', a_lines[i++] });
+            } else {
+                result.push({ '+', b_lines[j++] });
+            }
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            result.push({ '-', a_lines[i] });
+        }
+        for (size_t j = 0; j < m; ++j) {
+            result.push({ '+', b_lines[j] });
+        }
+    }
+
+    for (int i = a.count - suffix; i < a.count; ++i) {
+        result.push({ ' ', a.data[i] });
+    }
+
+    return result;
+}
+
+static void write_line(char op, const StaticArray<char>& line) {
+    putchar(op);
+    fwrite(line.data, 1, line.count, stdout);
+    putchar('\n');
+}
+
+struct EspDiffer {
+    ProgramOptions options = ProgramOptions::None;
+    DiffPlugin a;
+    DiffPlugin b;
+    EspParser parser;
+    TextRecordWriter writer_a;
+    TextRecordWriter writer_b;
+    EspDiffStats stats;
+
+    static constexpr int ContextLines = 3;
+
+    void init(ProgramOptions options, const StaticArray<uint8_t> a_data, const StaticArray<uint8_t> b_data) {
+        this->options = options;
+        a.walk(a_data);
+        b.walk(b_data);
+
+        parser.init(tmpalloc, options);
+        writer_a.init(options);
+        writer_b.init(options);
+        writer_a.localized_strings = is_localized(a_data);
+        writer_b.localized_strings = is_localized(b_data);
+    }
+
+    void dispose() {
+        writer_b.dispose();
+        writer_a.dispose();
+        parser.dispose();
+    }
+
+    static bool is_localized(const StaticArray<uint8_t> data) {
+        verify(data.count >= sizeof(RawRecord));
+        const auto tes4 = (const RawRecord*)data.data;
+        verify(tes4->type == RecordType::TES4);
+        return is_bit_set(tes4->flags, RecordFlags::TES4_Localized);
+    }
+
+    // Compares headers and raw data, compressed records are compared without inflating.
+    bool raw_records_equal(const RawRecord* ra, const RawRecord* rb) const {
+        if (ra->type != rb->type || ra->flags != rb->flags || ra->version != rb->version || ra->unknown != rb->unknown || ra->data_size != rb->data_size) {
+            return false;
+        }
+        if (is_bit_set(options, ProgramOptions::ExportTimestamp) && ra->timestamp != rb->timestamp) {
+            return false;
+        }
+        return memory_equals(ra + 1, rb + 1, ra->data_size);
+    }
+
+    StaticArray<char> format_record(TextRecordWriter& writer, const Record* record) {
+        writer.output_buffer.now = writer.output_buffer.start;
+        writer.write_record(record);
+        return { (char*)writer.output_buffer.start, writer.output_buffer.size() };
+    }
+
+    void write_header(const char* kind, const DiffPlugin& plugin, const DiffEntry& entry) {
+        const auto record = plugin.get_record(entry);
+        printf("@@ %s %.4s [%08X]", kind, (const char*)&record->type, record->id.value);
+        if (entry.group != -1) {
+            printf(" in ");
+            plugin.write_group_path(entry.group);
+        }
+        printf("\n");
+    }
+
+    void write_whole_record(char op, TextRecordWriter& writer, const DiffPlugin& plugin, const DiffEntry& entry) {
+        TEMP_SCOPE();
+        const auto text = format_record(writer, parser.parse_record(plugin.get_record(entry)));
+        for (const auto& line : split_lines(text)) {
+            write_line(op, line);
+        }
+    }
+
+    void removed(const DiffEntry& entry) {
+        ++stats.removed;
+        write_header("removed", a, entry);
+        write_whole_record('-', writer_a, a, entry);
+    }
+
+    void added(const DiffEntry& entry) {
+        ++stats.added;
+        write_header("added", b, entry);
+        write_whole_record('+', writer_b, b, entry);
+    }
+
+    void compare(const DiffEntry& entry_a, const DiffEntry& entry_b) {
+        if (raw_records_equal(a.get_record(entry_a), b.get_record(entry_b))) {
+            return;
+        }
+
+        TEMP_SCOPE();
+
+        // Records may differ only in compression or in junk data which is not written to text.
+        const auto text_a = format_record(writer_a, parser.parse_record(a.get_record(entry_a)));
+        const auto text_b = format_record(writer_b, parser.parse_record(b.get_record(entry_b)));
+        if (lines_equal(text_a, text_b)) {
+            return;
+        }
+
+        ++stats.changed;
+        write_header("changed", b, entry_b);
+
+        const auto lines = diff_lines(split_lines(text_a), split_lines(text_b));
+        int skipped_from = -1;
+        for (int i = 0; i < lines.count; ++i) {
+            bool near_change = false;
+            for (int j = i - ContextLines; j <= i + ContextLines; ++j) {
+                if (j >= 0 && j < lines.count && lines.data[j].op != ' ') {
+                    near_change = true;
+                    break;
+                }
+            }
+
+            if (!near_change) {
+                if (skipped_from == -1) {
+                    skipped_from = i;
+                }
+                continue;
+            }
+            if (skipped_from != -1) {
+                printf(" ...\n");
+                skipped_from = -1;
+            }
+            write_line(lines.data[i].op, lines.data[i].line);
+        }
+        if (skipped_from != -1) {
+            printf(" ...\n");
+        }
+    }
+
+    void run() {
+        int i = 0;
+        int j = 0;
+        while (i < a.entries.count || j < b.entries.count) {
+            int order = 0;
+            if (i == a.entries.count) {
+                order = 1;
+            } else if (j == b.entries.count) {
+                order = -1;
+            } else {
+                order = compare_diff_entries(a.entries.data[i], b.entries.data[j]);
+            }
+
+            if (order < 0) {
+                removed(a.entries.data[i++]);
+            } else if (order > 0) {
+                added(b.entries.data[j++]);
+            } else {
+                compare(a.entries.data[i++], b.entries.data[j++]);
+            }
+        }
+    }
+};
+
+EspDiffStats diff_esps(ProgramOptions options, const StaticArray<uint8_t> a, const StaticArray<uint8_t> b, const wchar_t* a_name, const wchar_t* b_name) {
+    TEMP_SCOPE();
+
+    EspDiffer differ;
+    differ.init(options, a, b);
+    defer(differ.dispose());
+
+    printf("--- %ls\n+++ %ls\n", a_name, b_name);
+
+    differ.run();
+    return differ.stats;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "esp_parser.hpp"
+
+struct EspDiffStats {
+    size_t added = 0;
+    size_t removed = 0;
+    size_t changed = 0;
+};
+
+// Compares two plugins record by record, matching records by group path and Form ID, and writes
+// differences to stdout. Records are formatted to text only if their raw bytes differ.
+EspDiffStats diff_esps(ProgramOptions options, const StaticArray<uint8_t> a, const StaticArray<uint8_t> b, const wchar_t* a_name, const wchar_t* b_name);
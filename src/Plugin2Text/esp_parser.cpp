@@ -1,9 +1,12 @@
 #include "esp_parser.hpp"
 #include "os.hpp"
 #include "array.hpp"
+#include "profiler.hpp"
 #include <stdlib.h>
 #include <zlib-ng.h>
 #include <stdio.h>
+#include <thread>
+#include <barrier>
 
 void EspParser::init(Allocator& allocator, ProgramOptions options) {
     this->allocator = &allocator;
@@ -14,6 +17,8 @@ void EspParser::dispose() {
 }
 
 EspObjectModel EspParser::parse(const StaticArray<uint8_t> data) {
+    PROFILE_SCOPE(RecordWalk, data.count);
+
     source_data_start = data.data;
 
     const uint8_t* now = data.data;
@@ -21,16 +26,35 @@ EspObjectModel EspParser::parse(const StaticArray<uint8_t> data) {
     
     EspObjectModel model;
     model.records.allocator = allocator;
+
+    lookup = nullptr;
+    if (is_bit_set(options, ProgramOptions::BuildRecordLookup)) {
+        lookup = memnew(*allocator) RecordLookup();
+        lookup->init(*allocator);
+        model.lookup = lookup;
+    }
     
     while (now < end) {
         auto record = (RawRecord*)now;
+        const auto label = record->type == RecordType::GRUP ? ((const RawGrupRecord*)record)->label : (uint32_t)record->type;
+        TraceScope trace{ "group", (const char*)&label, sizeof(label) };
+
         model.records.push(process_record(record));
         now += record->data_size + (record->type == RecordType::GRUP ? 0 : sizeof(RawRecord));
     }
 
+    if (lookup) {
+        profiler.record_lookup_bytes += lookup->memory_size();
+    }
+
     return model;
 }
 
+Record* EspParser::parse_record(const RawRecord* record) {
+    verify(record->type != RecordType::GRUP);
+    return (Record*)process_record(record);
+}
+
 RecordBase* EspParser::process_record(const RawRecord* record) {
     auto result_base = record->type == RecordType::GRUP
         ? static_cast<RecordBase*>(memnew(*allocator) GrupRecord(*allocator))
@@ -43,6 +67,8 @@ RecordBase* EspParser::process_record(const RawRecord* record) {
     result_base->current_user_id = record->current_user_id;
 
     if (record->type == RecordType::GRUP) {
+        ++profiler.group_count;
+
         const auto grup_record = (const RawGrupRecord*)record;
         auto result = (GrupRecord*)result_base;
 
@@ -90,18 +116,11 @@ RecordBase* EspParser::process_record(const RawRecord* record) {
         }
 
         if (sort) {
-            qsort(result->records.data, result->records.count, sizeof(result->records.data[0]), [](void const* aa, void const* bb) -> int {
-                const Record* a = *(const Record**)aa;
-                const Record* b = *(const Record**)bb;
-
-                verify(a->type != RecordType::GRUP);
-                verify(b->type != RecordType::GRUP);
-
-                verify(a->id.value != b->id.value);
-                return static_cast<int>(a->id.value) - static_cast<int>(b->id.value);
-            });
+            sort_records_by_form_id({ result->records.data, (size_t)result->records.count });
         }
     } else {
+        ++profiler.record_count;
+
         auto result = (Record*)result_base;
 
         result->id = record->id;
@@ -112,6 +131,8 @@ RecordBase* EspParser::process_record(const RawRecord* record) {
         const uint8_t* now;
         const uint8_t* end;
         if (record->is_compressed()) {
+            ++profiler.compressed_record_count;
+
             uint32_t size = 0;
             now = uncompress_record((RawRecordCompressed*)record, &size);
             end = now + size;
@@ -126,9 +147,13 @@ RecordBase* EspParser::process_record(const RawRecord* record) {
 
         while (now < end) {
             const auto field = (const RawRecordField*)now;
-            result->fields.push(process_field(result, field));
+            result->add_field(process_field(result, field));
             now += sizeof(RawRecordField) + field->size;
         }
+
+        if (lookup) {
+            lookup->add(result);
+        }
     }
 
     return result_base;
@@ -138,6 +163,7 @@ RecordField* EspParser::process_field(Record* record, const RawRecordField* fiel
     auto result = memnew(*allocator) RecordField();
 
     verify(record->type != RecordType::GRUP);
+    ++profiler.field_count;
 
     result->type = field->type;
     result->data.count = field->size;
@@ -150,6 +176,8 @@ uint8_t* EspParser::uncompress_record(const RawRecordCompressed* record, uint32_
     size_t uncompressed_data_size = record->uncompressed_data_size;
     uint8_t* compressed_data = (uint8_t*)(record + 1);
 
+    PROFILE_SCOPE(ZLibInflate, uncompressed_data_size);
+
     auto uncompressed_data = (uint8_t*)memalloc(*allocator, uncompressed_data_size);
     auto result = ::zng_uncompress(uncompressed_data, &uncompressed_data_size, compressed_data, record->data_size - sizeof(record->uncompressed_data_size));
     verify(result == Z_OK);
@@ -167,7 +195,15 @@ void EspParser::export_zlib_chunk(const RawRecordCompressed* record) const {
     wprintf(L">>> exported %s\n", file_path);
 }
 
+void Record::add_field(RecordField* field) {
+    fields.push(field);
+    field_mask |= field_mask_bit(field->type);
+}
+
 RecordField* Record::find_field(RecordFieldType type) const {
+    if (!(field_mask & field_mask_bit(type))) {
+        return nullptr;
+    }
     for (const auto field : fields) {
         if (field->type == type) {
             return field;
@@ -175,3 +211,369 @@ RecordField* Record::find_field(RecordFieldType type) const {
     }
     return nullptr;
 }
+
+struct FormIDSortEntry {
+    uint32_t id;
+    RecordBase* record;
+};
+
+constexpr int RadixBits = 8;
+constexpr int RadixPassCount = 32 / RadixBits;
+constexpr size_t RadixBucketCount = 1 << RadixBits;
+
+// Below this count sorting is faster than starting threads.
+constexpr size_t ParallelSortMinCount = 1 << 16;
+
+static size_t get_radix_digit(uint32_t id, int pass) {
+    return (id >> (pass * RadixBits)) & (RadixBucketCount - 1);
+}
+
+// Returns buffer that contains sorted entries, either "entries" or "scratch".
+static FormIDSortEntry* radix_sort(FormIDSortEntry* entries, FormIDSortEntry* scratch, size_t count, const int* passes, int pass_count) {
+    auto src = entries;
+    auto dst = scratch;
+    for (int i = 0; i < pass_count; ++i) {
+        const auto pass = passes[i];
+
+        size_t offsets[RadixBucketCount]{};
+        for (size_t j = 0; j < count; ++j) {
+            ++offsets[get_radix_digit(src[j].id, pass)];
+        }
+
+        size_t offset = 0;
+        for (auto& bucket : offsets) {
+            const auto bucket_count = bucket;
+            bucket = offset;
+            offset += bucket_count;
+        }
+
+        for (size_t j = 0; j < count; ++j) {
+            dst[offsets[get_radix_digit(src[j].id, pass)]++] = src[j];
+        }
+
+        const auto temp = src;
+        src = dst;
+        dst = temp;
+    }
+    return src;
+}
+
+// Each thread counts and scatters its own contiguous chunk. Buckets are filled in chunk order, so
+// sort stays stable.
+static FormIDSortEntry* radix_sort_parallel(FormIDSortEntry* entries, FormIDSortEntry* scratch, size_t count, const int* passes, int pass_count, int thread_count) {
+    TEMP_SCOPE();
+    const auto offsets = (size_t(*)[RadixBucketCount])memalloc(tmpalloc, sizeof(size_t) * RadixBucketCount * thread_count);
+
+    int current_pass = 0;
+    const auto compute_offsets = [&]() noexcept {
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < RadixBucketCount; ++bucket) {
+            for (int thread = 0; thread < thread_count; ++thread) {
+                const auto bucket_count = offsets[thread][bucket];
+                offsets[thread][bucket] = offset;
+                offset += bucket_count;
+            }
+        }
+    };
+    std::barrier counted{ thread_count, compute_offsets };
+    std::barrier scattered{ thread_count };
+
+    const auto work = [&](int thread) {
+        const auto chunk_start = count * thread / thread_count;
+        const auto chunk_end = count * (thread + 1) / thread_count;
+        auto src = entries;
+        auto dst = scratch;
+
+        for (int i = 0; i < pass_count; ++i) {
+            const auto pass = passes[i];
+            auto& thread_offsets = offsets[thread];
+
+            memset(thread_offsets, 0, sizeof(thread_offsets));
+            for (size_t j = chunk_start; j < chunk_end; ++j) {
+                ++thread_offsets[get_radix_digit(src[j].id, pass)];
+            }
+
+            counted.arrive_and_wait();
+
+            for (size_t j = chunk_start; j < chunk_end; ++j) {
+                dst[thread_offsets[get_radix_digit(src[j].id, pass)]++] = src[j];
+            }
+
+            // Next pass reads entries written by other threads and reuses "offsets".
+            scattered.arrive_and_wait();
+
+            const auto temp = src;
+            src = dst;
+            dst = temp;
+        }
+    };
+
+    const int worker_count = thread_count - 1;
+    const auto workers = (std::thread*)memalloc(tmpalloc, sizeof(std::thread) * worker_count);
+    for (int i = 0; i < worker_count; ++i) {
+        new(&workers[i]) std::thread(work, i + 1);
+    }
+    work(0);
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i].join();
+        workers[i].~thread();
+    }
+
+    return (pass_count % 2) == 0 ? entries : scratch;
+}
+
+void sort_records_by_form_id(StaticArray<RecordBase*> records) {
+    if (records.count < 2) {
+        return;
+    }
+
+    TEMP_SCOPE();
+    const auto entries = (FormIDSortEntry*)memalloc(tmpalloc, sizeof(FormIDSortEntry) * records.count * 2);
+    const auto scratch = entries + records.count;
+
+    // Digit counts of all passes are collected in one go to skip passes where all records have the same
+    // digit. Records of one plugin usually share load order byte and often the next one.
+    uint32_t digit_counts[RadixPassCount][RadixBucketCount]{};
+    for (size_t i = 0; i < records.count; ++i) {
+        const auto record = records.data[i];
+        verify(record->type != RecordType::GRUP);
+
+        const auto id = static_cast<const Record*>(record)->id.value;
+        entries[i] = { id, record };
+        for (int pass = 0; pass < RadixPassCount; ++pass) {
+            ++digit_counts[pass][get_radix_digit(id, pass)];
+        }
+    }
+
+    int passes[RadixPassCount];
+    int pass_count = 0;
+    for (int pass = 0; pass < RadixPassCount; ++pass) {
+        if (digit_counts[pass][get_radix_digit(entries[0].id, pass)] != records.count) {
+            passes[pass_count++] = pass;
+        }
+    }
+
+    int thread_count = 1;
+    if (records.count >= ParallelSortMinCount) {
+        thread_count = (int)std::thread::hardware_concurrency();
+        if (thread_count < 1) {
+            thread_count = 1;
+        }
+    }
+
+    const auto sorted = thread_count > 1
+        ? radix_sort_parallel(entries, scratch, records.count, passes, pass_count, thread_count)
+        : radix_sort(entries, scratch, records.count, passes, pass_count);
+
+    for (size_t i = 0; i < records.count; ++i) {
+        verify(i == 0 || sorted[i - 1].id != sorted[i].id);
+        records.data[i] = sorted[i].record;
+    }
+}
+
+void EspRecordIndex::build(const StaticArray<uint8_t> data) {
+    PROFILE_SCOPE(RecordWalk, data.count);
+    verify(data.count <= UINT32_MAX);
+
+    this->data = data;
+    offsets.count = 0;
+
+    // Groups are just headers followed by their records, so there is no need to
+    // track nesting: step into every group and step over every record.
+    const uint8_t* now = data.data;
+    const uint8_t* end = data.data + data.count;
+
+    while (now < end) {
+        verify(now + sizeof(RawRecord) <= end);
+        const auto record = (const RawRecord*)now;
+
+        if (record->type == RecordType::GRUP) {
+            const auto group = (const RawGrupRecord*)record;
+            verify(group->group_size >= sizeof(RawGrupRecord) && now + group->group_size <= end);
+            now += sizeof(RawGrupRecord);
+        } else {
+            offsets.push({ record->id, static_cast<uint32_t>(now - data.data) });
+            now += sizeof(RawRecord) + record->data_size;
+        }
+    }
+    verify(now == end);
+
+    qsort(offsets.data, offsets.count, sizeof(offsets.data[0]), [](void const* aa, void const* bb) -> int {
+        const auto a = (const EspRecordOffset*)aa;
+        const auto b = (const EspRecordOffset*)bb;
+        if (a->id.value != b->id.value) {
+            return a->id.value < b->id.value ? -1 : 1;
+        }
+        return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+    });
+}
+
+void EspRecordIndex::dispose() {
+    offsets.free();
+    data = {};
+}
+
+StaticArray<EspRecordOffset> EspRecordIndex::find(FormID id) const {
+    int low = 0;
+    int high = offsets.count;
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        if (offsets.data[middle].id.value < id.value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    int count = 0;
+    while (low + count < offsets.count && offsets.data[low + count].id.value == id.value) {
+        ++count;
+    }
+
+    return { offsets.data + low, (size_t)count };
+}
+
+const RawRecord* EspRecordIndex::get_record(const EspRecordOffset& offset) const {
+    verify(offset.offset + sizeof(RawRecord) <= data.count);
+    return (const RawRecord*)(data.data + offset.offset);
+}
+
+static uint32_t hash_form_id(FormID id) {
+    // Low bits of Form IDs are mostly sequential, mix all bits so they can be used as slot index.
+    return hash_uint32(id.value);
+}
+
+static bool editor_id_equals(const char* a, const char* b, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (to_lower_ascii(a[i]) != to_lower_ascii(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+static StaticArray<T> allocate_slots(Allocator& allocator, size_t count) {
+    return { memnew(allocator) T[count], count };
+}
+
+static size_t get_slot_index(uint32_t hash, size_t capacity) {
+    return (size_t)hash & (capacity - 1);
+}
+
+void RecordLookup::init(Allocator& allocator) {
+    constexpr size_t InitialCapacity = 1024;
+
+    this->allocator = &allocator;
+    form_ids = allocate_slots<FormIDSlot>(allocator, InitialCapacity);
+    editor_ids = allocate_slots<EditorIDSlot>(allocator, InitialCapacity);
+    form_id_count = 0;
+    editor_id_count = 0;
+}
+
+void RecordLookup::dispose() {
+    memdelete(*allocator, form_ids.data);
+    memdelete(*allocator, editor_ids.data);
+    form_ids = {};
+    editor_ids = {};
+    form_id_count = 0;
+    editor_id_count = 0;
+}
+
+static void insert_form_id(StaticArray<RecordLookup::FormIDSlot>& slots, const RecordLookup::FormIDSlot& slot) {
+    auto index = get_slot_index(hash_form_id(slot.id), slots.count);
+    while (slots.data[index].record) {
+        index = (index + 1) & (slots.count - 1);
+    }
+    slots.data[index] = slot;
+}
+
+static void insert_editor_id(StaticArray<RecordLookup::EditorIDSlot>& slots, const RecordLookup::EditorIDSlot& slot) {
+    auto index = get_slot_index(slot.hash, slots.count);
+    while (slots.data[index].editor_id) {
+        index = (index + 1) & (slots.count - 1);
+    }
+    slots.data[index] = slot;
+}
+
+void RecordLookup::add(Record* record) {
+    if (find(record->id)) {
+        return;
+    }
+
+    if ((form_id_count + 1) * 2 > form_ids.count) {
+        const auto old_slots = form_ids;
+        form_ids = allocate_slots<FormIDSlot>(*allocator, old_slots.count * 2);
+        for (const auto& slot : old_slots) {
+            if (slot.record) {
+                insert_form_id(form_ids, slot);
+            }
+        }
+        memdelete(*allocator, old_slots.data);
+    }
+    insert_form_id(form_ids, { record->id, record });
+    ++form_id_count;
+
+    const auto edid = record->find_field(RecordFieldType::EDID);
+    if (!edid || edid->data.count <= 1) {
+        return;
+    }
+
+    EditorIDSlot slot;
+    slot.editor_id = (const char*)edid->data.data;
+    slot.length = (uint32_t)edid->data.count - (edid->data.data[edid->data.count - 1] == '\0' ? 1 : 0);
+    slot.hash = hash_string_ignore_case(slot.editor_id, slot.length);
+    slot.id = record->id;
+
+    FormID existing_id;
+    if (find_editor_id(slot.editor_id, slot.length, &existing_id)) {
+        return;
+    }
+
+    if ((editor_id_count + 1) * 2 > editor_ids.count) {
+        const auto old_slots = editor_ids;
+        editor_ids = allocate_slots<EditorIDSlot>(*allocator, old_slots.count * 2);
+        for (const auto& old_slot : old_slots) {
+            if (old_slot.editor_id) {
+                insert_editor_id(editor_ids, old_slot);
+            }
+        }
+        memdelete(*allocator, old_slots.data);
+    }
+    insert_editor_id(editor_ids, slot);
+    ++editor_id_count;
+}
+
+Record* RecordLookup::find(FormID id) const {
+    auto index = get_slot_index(hash_form_id(id), form_ids.count);
+    while (true) {
+        const auto& slot = form_ids.data[index];
+        if (!slot.record) {
+            return nullptr;
+        }
+        if (slot.id.value == id.value) {
+            return slot.record;
+        }
+        index = (index + 1) & (form_ids.count - 1);
+    }
+}
+
+bool RecordLookup::find_editor_id(const char* editor_id, size_t length, FormID* out_id) const {
+    const auto hash = hash_string_ignore_case(editor_id, length);
+    auto index = get_slot_index(hash, editor_ids.count);
+    while (true) {
+        const auto& slot = editor_ids.data[index];
+        if (!slot.editor_id) {
+            return false;
+        }
+        if (slot.hash == hash && slot.length == length && editor_id_equals(slot.editor_id, editor_id, length)) {
+            *out_id = slot.id;
+            return true;
+        }
+        index = (index + 1) & (editor_ids.count - 1);
+    }
+}
+
+size_t RecordLookup::memory_size() const {
+    return sizeof(*this) + form_ids.count * sizeof(FormIDSlot) + editor_ids.count * sizeof(EditorIDSlot);
+}
@@ -16,14 +16,37 @@ struct RecordBase {
     uint8_t current_user_id = 0;
 };
 
+// Bit of "Record::field_mask" for field type.
+constexpr uint64_t field_mask_bit(RecordFieldType type) {
+    return 1ull << (((uint32_t)type * 0x9E3779B1u) >> 26);
+}
+
 struct Record : RecordBase {
     FormID id;
     Array<RecordField*> fields;
+    uint64_t field_mask = 0; // "field_mask_bit" of every field type in "fields", lets "find_field" skip missing fields.
     uint16_t version = 0;
     uint16_t unknown = 0;
 
+    void add_field(RecordField* field);
     RecordField* find_field(RecordFieldType type) const;
 
+    // Returns field data as view "T" from tes.hpp without copying, or nullptr if record doesn't have the field,
+    // or field has different size.
+    template<typename T>
+    const T* get() const {
+        for (const auto record_type : T::record_types) {
+            if (type == record_type) {
+                const auto field = find_field(T::field_type);
+                if (!field || field->data.count != sizeof(T)) {
+                    return nullptr;
+                }
+                return (const T*)field->data.data;
+            }
+        }
+        return nullptr;
+    }
+
     inline Record(Allocator& allocator) {
         fields.allocator = &allocator;
     }
@@ -46,13 +69,46 @@ struct GrupRecord : RecordBase {
     }
 };
 
+// Form ID -> record and editor ID -> Form ID hash tables with open addressing and linear probing.
+// Editor IDs are compared case-insensitively, like the game does.
+struct RecordLookup {
+    struct FormIDSlot {
+        FormID id;
+        Record* record = nullptr; // nullptr if slot is empty.
+    };
+
+    struct EditorIDSlot {
+        uint32_t hash = 0;
+        uint32_t length = 0;
+        const char* editor_id = nullptr; // nullptr if slot is empty. Points to EDID field data.
+        FormID id;
+    };
+
+    Allocator* allocator = &stdalloc;
+    StaticArray<FormIDSlot> form_ids; // Capacity is power of two, load factor is at most 1/2.
+    StaticArray<EditorIDSlot> editor_ids;
+    size_t form_id_count = 0;
+    size_t editor_id_count = 0;
+
+    void init(Allocator& allocator);
+    void dispose();
+
+    // If plugin contains several records with the same Form ID, first one is kept.
+    void add(Record* record);
+    Record* find(FormID id) const;
+    bool find_editor_id(const char* editor_id, size_t length, FormID* out_id) const;
+    size_t memory_size() const;
+};
+
 struct EspObjectModel {
     Array<RecordBase*> records;
+    RecordLookup* lookup = nullptr; // Set only if parsed with ProgramOptions::BuildRecordLookup.
 };
 
 struct EspParser {
     Allocator* allocator = &stdalloc;
     const uint8_t* source_data_start = nullptr;
+    RecordLookup* lookup = nullptr;
 
     ProgramOptions options = ProgramOptions::None;
 
@@ -60,6 +116,7 @@ struct EspParser {
     void dispose();
 
     EspObjectModel parse(const StaticArray<uint8_t> data);
+    Record* parse_record(const RawRecord* record);
 private:
     RecordField* process_field(Record* record, const RawRecordField* field);
     RecordBase* process_record(const RawRecord* record);
@@ -67,6 +124,29 @@ private:
     void export_zlib_chunk(const RawRecordCompressed* record) const;
 };
 
+struct EspRecordOffset {
+    FormID id;
+    uint32_t offset = 0; // Offset of RawRecord from the start of plugin data.
+};
+
+// Form ID -> record offset index. Built by walking only record and group headers, record data
+// is skipped without parsing or decompression.
+struct EspRecordIndex {
+    StaticArray<uint8_t> data;
+    Array<EspRecordOffset> offsets; // Sorted by Form ID.
+
+    void build(const StaticArray<uint8_t> data);
+    void dispose();
+
+    // Plugin may contain several records with the same Form ID, returns all of them.
+    StaticArray<EspRecordOffset> find(FormID id) const;
+    const RawRecord* get_record(const EspRecordOffset& offset) const;
+};
+
+// Sorts records by Form ID with stable LSD radix sort, large groups are sorted on several threads.
+// Records can't be groups and their Form IDs must be unique.
+void sort_records_by_form_id(StaticArray<RecordBase*> records);
+
 template<typename Func>
 void foreach_record(const Array<RecordBase*>& records, Func func) {
     for (const auto record : records) {
@@ -0,0 +1,801 @@
+#include "esp_query.hpp"
+#include "esp_to_text.hpp"
+#include "formid_layout.hpp"
+#include "parallel.hpp"
+#include "typeinfo.hpp"
+#include "array.hpp"
+#include "os.hpp"
+#include "profiler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib-ng.h>
+
+static bool chars_equal_ignore_case(const char* a, const char* b, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (to_lower_ascii(a[i]) != to_lower_ascii(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool contains_ignore_case(const char* text, size_t count, const char* part, size_t part_count) {
+    for (size_t i = 0; i + part_count <= count; ++i) {
+        if (chars_equal_ignore_case(text + i, part, part_count)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static void resolve_clause_field_defs(QueryClause* clause) {
+    clause->common_field_def = Record_Common.get_value_field_def(clause->field_type);
+
+    Array<QueryFieldDef> field_defs{ tmpalloc };
+    for (const auto def : get_record_defs()) {
+        const auto field_def = def->get_value_field_def(clause->field_type);
+        if (field_def && field_def != clause->common_field_def) {
+            field_defs.push({ def->type, field_def });
+        }
+    }
+
+    qsort(field_defs.data, field_defs.count, sizeof(field_defs.data[0]), [](void const* aa, void const* bb) -> int {
+        const auto a = (const QueryFieldDef*)aa;
+        const auto b = (const QueryFieldDef*)bb;
+        return a->record_type < b->record_type ? -1 : (a->record_type > b->record_type ? 1 : 0);
+    });
+    clause->field_defs = { field_defs.data, (size_t)field_defs.count };
+}
+
+static QueryValue parse_query_value(const char* text, size_t length) {
+    QueryValue value;
+    value.text = text;
+    value.length = length;
+
+    // Form IDs are written as "[0001B1D8]" in text format, brackets are optional.
+    auto digits = text;
+    auto digit_count = length;
+    if (digit_count >= 2 && digits[0] == '[' && digits[digit_count - 1] == ']') {
+        ++digits;
+        digit_count -= 2;
+    }
+    if (digit_count >= 1 && digit_count <= 8) {
+        uint32_t formid = 0;
+        size_t i = 0;
+        for (; i < digit_count; ++i) {
+            const auto c = to_lower_ascii(digits[i]);
+            if (c >= '0' && c <= '9') {
+                formid = formid * 16 + (c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                formid = formid * 16 + (c - 'a' + 10);
+            } else {
+                break;
+            }
+        }
+        value.is_formid = i == digit_count;
+        value.formid = { formid };
+    }
+
+    if (length == 4 && chars_equal_ignore_case(text, "true", 4)) {
+        value.is_number = true;
+        value.number = 1;
+    } else if (length == 5 && chars_equal_ignore_case(text, "false", 5)) {
+        value.is_number = true;
+        value.number = 0;
+    } else if (length) {
+        char* number_end = nullptr;
+        value.number = strtod(text, &number_end); // "text" is null-terminated.
+        value.is_number = number_end == text + length;
+    }
+    return value;
+}
+
+struct QueryCompiler {
+    const wchar_t* source = nullptr;
+    char* text = nullptr; // "source" converted to 8-bit characters, indices are the same.
+    size_t length = 0;
+    Query* query = nullptr;
+
+    [[noreturn]] void error(size_t start, size_t end, const wchar_t* message) {
+        exit_error(L"%s in query clause \"%.*s\"", message, (int)(end - start), source + start);
+    }
+
+    void compile(const wchar_t* source, Query* query) {
+        this->source = source;
+        this->query = query;
+
+        length = wcslen(source);
+        text = (char*)memalloc(tmpalloc, length + 1);
+        for (size_t i = 0; i < length; ++i) {
+            text[i] = source[i] < 256 ? (char)source[i] : '?';
+        }
+        text[length] = '\0';
+
+        query->groups.push(QueryGroup{});
+        size_t start = 0;
+        bool quoted = false;
+        for (size_t i = 0; i <= length; ++i) {
+            if (i < length && text[i] == '"') {
+                quoted = !quoted;
+            }
+            if (i == length || (!quoted && (text[i] == '&' || text[i] == '|'))) {
+                compile_clause(start, i, &query->groups.data[query->groups.count - 1]);
+                if (i < length && text[i] == '|') {
+                    query->groups.push(QueryGroup{});
+                }
+                start = i + 1;
+            }
+        }
+    }
+
+    void compile_clause(size_t start, size_t end, QueryGroup* group) {
+        size_t key_end = start;
+        while (key_end < end && !strchr("=!~<>", text[key_end])) {
+            ++key_end;
+        }
+        if (key_end == end) {
+            error(start, end, L"operator is missing");
+        }
+
+        QueryClause clause;
+        auto values_start = key_end + 1;
+        switch (text[key_end]) {
+            case '=': clause.op = QueryOperator::Equal; break;
+            case '~': clause.op = QueryOperator::Contains; break;
+            case '<': clause.op = QueryOperator::Less; break;
+            case '>': clause.op = QueryOperator::Greater; break;
+            case '!': {
+                if (values_start >= end || text[values_start] != '=') {
+                    error(start, end, L"unknown operator");
+                }
+                clause.op = QueryOperator::NotEqual;
+                ++values_start;
+            } break;
+        }
+
+        auto key = text + start;
+        auto key_length = key_end - start;
+        while (key_length && is_space(*key)) {
+            ++key;
+            --key_length;
+        }
+        while (key_length && is_space(key[key_length - 1])) {
+            --key_length;
+        }
+
+        if (key_length == 4 && chars_equal_ignore_case(key, "type", 4)) {
+            clause.key = QueryKey::RecordType;
+        } else if (key_length == 2 && chars_equal_ignore_case(key, "id", 2)) {
+            clause.key = QueryKey::FormID;
+        } else if (key_length == 3 && chars_equal_ignore_case(key, "ref", 3)) {
+            clause.key = QueryKey::Reference;
+        } else if (key_length == 4 || (key_length > 5 && key[4] == '.')) {
+            clause.key = QueryKey::Field;
+            memcpy(&clause.field_type, key, 4);
+            if (key_length > 5) {
+                clause.member = key + 5;
+                clause.member_length = key_length - 5;
+            }
+            resolve_clause_field_defs(&clause);
+            if (!clause.field_defs.count && !clause.common_field_def) {
+                error(start, end, L"field is not defined for any record type");
+            }
+        } else {
+            error(start, end, L"unknown key, expected \"type\", \"id\", \"ref\", field type or \"<field type>.<member>\"");
+        }
+
+        Array<QueryValue> values{ tmpalloc };
+        size_t value_start = values_start;
+        bool quoted = false;
+        for (size_t i = values_start; i <= end; ++i) {
+            if (i < end && text[i] == '"') {
+                quoted = !quoted;
+            }
+            if (i < end && (quoted || text[i] != ',')) {
+                continue;
+            }
+
+            auto value_end = i;
+            while (value_start < value_end && is_space(text[value_start])) {
+                ++value_start;
+            }
+            while (value_start < value_end && is_space(text[value_end - 1])) {
+                --value_end;
+            }
+            if (value_end - value_start >= 2 && text[value_start] == '"' && text[value_end - 1] == '"') {
+                ++value_start;
+                --value_end;
+            }
+
+            // Values are copied to be null-terminated, so they can be parsed with "strtod".
+            const auto value_length = value_end - value_start;
+            const auto value_text = (char*)memalloc(tmpalloc, value_length + 1);
+            memcpy(value_text, text + value_start, value_length);
+            value_text[value_length] = '\0';
+            values.push(parse_query_value(value_text, value_length));
+
+            value_start = i + 1;
+        }
+        clause.values = { values.data, (size_t)values.count };
+
+        for (const auto& value : clause.values) {
+            if (clause.key == QueryKey::RecordType && value.length != 4) {
+                error(start, end, L"record type must have 4 characters");
+            }
+            if ((clause.key == QueryKey::FormID || clause.key == QueryKey::Reference) && !value.is_formid) {
+                error(start, end, L"expected hexadecimal Form ID");
+            }
+        }
+
+        const auto is_header_clause = clause.key == QueryKey::RecordType || clause.key == QueryKey::FormID;
+        if (is_header_clause) {
+            group->clauses.push(QueryClause{});
+            memmove(&group->clauses.data[group->header_clause_count + 1], &group->clauses.data[group->header_clause_count], sizeof(QueryClause) * (group->clauses.count - group->header_clause_count - 1));
+            group->clauses.data[group->header_clause_count++] = clause;
+        } else {
+            group->clauses.push(clause);
+        }
+    }
+};
+
+// Consecutive records and groups of one plugin, walked by one thread.
+struct QueryUnit {
+    int plugin = 0;
+    const uint8_t* start = nullptr;
+    const uint8_t* end = nullptr;
+    Array<const RawRecord*> matches; // Filled by worker thread.
+    size_t record_count = 0;
+    size_t inflated_count = 0;
+};
+
+struct QueryPlugin {
+    const wchar_t* path = nullptr;
+    StaticArray<uint8_t> data;
+    bool localized = false;
+};
+
+// Checks one record at a time, data of compressed record is inflated on first access to fields.
+struct QueryMatcher {
+    const Query* query = nullptr;
+    Array<uint8_t> uncompressed; // Buffer for records of this thread.
+    size_t inflated_count = 0;
+    bool localized = false; // LString fields of current plugin are string IDs.
+
+    const RawRecord* record = nullptr;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    void dispose() {
+        uncompressed.free();
+    }
+
+    void load_fields() {
+        if (data) {
+            return;
+        }
+
+        if (!record->is_compressed()) {
+            data = (const uint8_t*)(record + 1);
+            size = record->data_size;
+            return;
+        }
+
+        const auto compressed = (const RawRecordCompressed*)record;
+        size = compressed->uncompressed_data_size;
+        grow(&uncompressed, (int)size);
+
+        PROFILE_SCOPE(ZLibInflate, size);
+        const auto result = ::zng_uncompress(uncompressed.data, &size, (const uint8_t*)(compressed + 1), record->data_size - sizeof(compressed->uncompressed_data_size));
+        verify(result == Z_OK);
+        data = uncompressed.data;
+        ++inflated_count;
+    }
+
+    static bool match_string(const QueryClause& clause, QueryOperator op, const char* chars, size_t count) {
+        for (const auto& value : clause.values) {
+            if (op == QueryOperator::Equal && count == value.length && chars_equal_ignore_case(chars, value.text, count)) {
+                return true;
+            }
+            if (op == QueryOperator::Contains && contains_ignore_case(chars, count, value.text, value.length)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool match_number(const QueryClause& clause, QueryOperator op, double number) {
+        for (const auto& value : clause.values) {
+            if (!value.is_number) {
+                continue;
+            }
+            if ((op == QueryOperator::Equal && number == value.number) || (op == QueryOperator::Less && number < value.number) || (op == QueryOperator::Greater && number > value.number)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool match_formid(const QueryClause& clause, QueryOperator op, const void* formid) {
+        if (op != QueryOperator::Equal) {
+            return false;
+        }
+
+        FormID id;
+        memcpy(&id, formid, sizeof(id));
+        for (const auto& value : clause.values) {
+            if (value.is_formid && value.formid.value == id.value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool match_enum(const QueryClause& clause, QueryOperator op, const TypeEnum* enum_type, uint32_t enum_value) {
+        if (!enum_type->flags) {
+            const auto field = enum_type->get_field_by_value(enum_value);
+            return (field && match_string(clause, op, field->name, field->name_length)) || match_number(clause, op, enum_value);
+        }
+
+        for (size_t i = 0; i < enum_type->field_count; ++i) {
+            const auto& field = enum_type->fields[i];
+            if ((enum_value & field.value) && match_string(clause, op, field.name, field.name_length)) {
+                return true;
+            }
+        }
+
+        // Flags are equal to number if all bits of number are set.
+        if (op == QueryOperator::Equal) {
+            for (const auto& value : clause.values) {
+                if (value.is_number && value.number >= 1 && value.number <= UINT32_MAX && value.number == (uint32_t)value.number && (enum_value & (uint32_t)value.number) == (uint32_t)value.number) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return match_number(clause, op, enum_value);
+    }
+
+    bool is_member_selected(const QueryClause& clause, const char* name, size_t name_length) const {
+        return clause.member && clause.member_length == name_length && chars_equal_ignore_case(clause.member, name, name_length);
+    }
+
+    // Returns true if any value in "value" matches clause. "selected" is set if value is member selected by clause or is inside of it.
+    bool match_value(const QueryClause& clause, QueryOperator op, const Type* type, const uint8_t* value, size_t size, bool selected) const {
+        switch (type->kind) {
+            case TypeKind::Struct: {
+                const auto struct_type = static_cast<const TypeStruct*>(type);
+                size_t offset = 0;
+                for (size_t i = 0; i < struct_type->field_count; ++i) {
+                    const auto& field = struct_type->fields[i];
+                    auto field_type = field.type;
+                    if (offset + field_type->size > size) {
+                        break; // Older versions of records may have shorter fields.
+                    }
+
+                    if (field_type->kind == TypeKind::Constant) {
+                        const auto constant_type = static_cast<const TypeConstant*>(field_type);
+                        if (!constant_type->fallback || memory_equals(constant_type->bytes, value + offset, field_type->size)) {
+                            offset += field_type->size;
+                            continue;
+                        }
+                        field_type = constant_type->fallback;
+                    }
+
+                    const auto field_selected = selected || is_member_selected(clause, field.name, field.name_length);
+                    if (match_value(clause, op, field_type, value + offset, field_type->size, field_selected)) {
+                        return true;
+                    }
+                    offset += field_type->size;
+                }
+                return false;
+            }
+
+            case TypeKind::Filter: {
+                return match_value(clause, op, static_cast<const TypeFilter*>(type)->inner_type, value, size, selected);
+            }
+
+            case TypeKind::Constant: {
+                const auto constant_type = static_cast<const TypeConstant*>(type);
+                if (!constant_type->fallback || memory_equals(constant_type->bytes, value, type->size)) {
+                    return false;
+                }
+                return match_value(clause, op, constant_type->fallback, value, size, selected);
+            }
+
+            case TypeKind::Vector3: {
+                if (size != sizeof(Vector3)) {
+                    return false;
+                }
+                static const char* const names[]{ "X", "Y", "Z" };
+                for (size_t i = 0; i < _countof(names); ++i) {
+                    float component = 0;
+                    memcpy(&component, value + i * sizeof(float), sizeof(float));
+                    if ((selected || is_member_selected(clause, names[i], 1)) && match_number(clause, op, component)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        }
+
+        if (!selected) {
+            return false;
+        }
+
+        switch (type->kind) {
+            case TypeKind::ZString: {
+                return match_string(clause, op, (const char*)value, strnlen((const char*)value, size));
+            }
+
+            case TypeKind::LString: {
+                if (localized) {
+                    uint32_t id = 0;
+                    memcpy(&id, value, size < sizeof(id) ? size : sizeof(id));
+                    return match_number(clause, op, id); // String ID, strings of string tables are not loaded.
+                }
+                return match_string(clause, op, (const char*)value, strnlen((const char*)value, size));
+            }
+
+            case TypeKind::FormID: {
+                return size >= sizeof(FormID) && match_formid(clause, op, value);
+            }
+
+            case TypeKind::FormIDArray: {
+                for (size_t i = 0; i + sizeof(FormID) <= size; i += sizeof(FormID)) {
+                    if (match_formid(clause, op, value + i)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            case TypeKind::Integer: {
+                if (size != type->size) {
+                    return false;
+                }
+
+                const auto integer_type = static_cast<const TypeInteger*>(type);
+                int64_t signed_value = 0;
+                uint64_t unsigned_value = 0;
+                switch (size) {
+                    case 1: signed_value = *(const int8_t*)value; unsigned_value = *(const uint8_t*)value; break;
+                    case 2: signed_value = *(const int16_t*)value; unsigned_value = *(const uint16_t*)value; break;
+                    case 4: signed_value = *(const int32_t*)value; unsigned_value = *(const uint32_t*)value; break;
+                    case 8: signed_value = *(const int64_t*)value; unsigned_value = *(const uint64_t*)value; break;
+                    default: return false;
+                }
+                return match_number(clause, op, integer_type->is_unsigned ? (double)unsigned_value : (double)signed_value);
+            }
+
+            case TypeKind::Float: {
+                if (size == sizeof(float)) {
+                    return match_number(clause, op, *(const float*)value);
+                } else if (size == sizeof(double)) {
+                    return match_number(clause, op, *(const double*)value);
+                }
+                return false;
+            }
+
+            case TypeKind::Enum: {
+                uint32_t enum_value = 0;
+                switch (size) {
+                    case 1: enum_value = *(const uint8_t*)value; break;
+                    case 2: enum_value = *(const uint16_t*)value; break;
+                    case 4: enum_value = *(const uint32_t*)value; break;
+                    default: return false;
+                }
+                return match_enum(clause, op, static_cast<const TypeEnum*>(type), enum_value);
+            }
+
+            case TypeKind::Boolean: {
+                return size == sizeof(bool) && match_number(clause, op, *value ? 1 : 0);
+            }
+        }
+        return false;
+    }
+
+    bool match_field(const QueryClause& clause, QueryOperator op, const RecordFieldDef* field_def, const RawRecordField* field) const {
+        const auto value = (const uint8_t*)(field + 1);
+        const size_t size = field->size;
+
+        auto type = field_def->data_type;
+        while (type->kind == TypeKind::Filter) {
+            type = static_cast<const TypeFilter*>(type)->inner_type;
+        }
+
+        bool found = false;
+        switch (type->kind) {
+            case TypeKind::VMAD: {
+                if (!clause.member || is_member_selected(clause, "Script", 6)) {
+                    scan_vmad_script_names(value, size, record->type, [&](const WString* name) {
+                        found = found || match_string(clause, op, name->data, name->count);
+                    });
+                }
+                if (!found && (!clause.member || is_member_selected(clause, "Property", 8))) {
+                    scan_vmad_property_names(value, size, record->type, [&](const WString* name) {
+                        found = found || match_string(clause, op, name->data, name->count);
+                    });
+                }
+                if (!found && (!clause.member || is_member_selected(clause, "Object", 6))) {
+                    scan_vmad_objects(value, size, record->type, [&](const FormID* form_id) {
+                        found = found || match_formid(clause, op, form_id);
+                    });
+                }
+            } break;
+
+            case TypeKind::CTDA: {
+                uint16_t function_index = 0;
+                if (size >= 10) {
+                    memcpy(&function_index, value + 8, sizeof(function_index));
+                }
+                if ((!clause.member || is_member_selected(clause, "Function", 8)) && function_index < _countof(CTDA_Functions) && CTDA_Functions[function_index].name) {
+                    const auto name = CTDA_Functions[function_index].name;
+                    found = match_string(clause, op, name, strlen(name));
+                }
+            } [[fallthrough]];
+
+            case TypeKind::NVPP: {
+                if (!found && !clause.member) {
+                    scan_record_formids(record->type, (const uint8_t*)field, sizeof(RawRecordField) + size, [&](const FormID* form_id, RecordFieldType) {
+                        found = found || match_formid(clause, op, form_id);
+                    });
+                }
+            } break;
+
+            default: {
+                found = match_value(clause, op, type, value, size, !clause.member);
+            } break;
+        }
+        return found;
+    }
+
+    bool match_clause(const QueryClause& clause) {
+        // "!=" matches if no value is equal.
+        const auto negate = clause.op == QueryOperator::NotEqual;
+        const auto op = negate ? QueryOperator::Equal : clause.op;
+
+        bool found = false;
+        switch (clause.key) {
+            case QueryKey::RecordType: {
+                for (const auto& value : clause.values) {
+                    found = found || 0 == memcmp(&record->type, value.text, 4);
+                }
+            } break;
+
+            case QueryKey::FormID: {
+                found = match_formid(clause, op, &record->id);
+            } break;
+
+            case QueryKey::Reference: {
+                load_fields();
+                scan_record_formids(record->type, data, size, [&](const FormID* form_id, RecordFieldType) {
+                    found = found || match_formid(clause, op, form_id);
+                });
+            } break;
+
+            case QueryKey::Field: {
+                const auto field_def = clause.find_field_def(record->type);
+                if (!field_def) {
+                    break;
+                }
+
+                load_fields();
+                const uint8_t* now = data;
+                const uint8_t* end = data + size;
+                while (now < end && !found) {
+                    const auto field = (const RawRecordField*)now;
+                    verify(now + sizeof(RawRecordField) + field->size <= end);
+                    if (field->type == clause.field_type) {
+                        found = match_field(clause, op, field_def, field);
+                    }
+                    now += sizeof(RawRecordField) + field->size;
+                }
+            } break;
+        }
+        return found != negate;
+    }
+
+    // Clauses of group are checked in order until one of them doesn't match, so record is not inflated if header
+    // doesn't match. Field clauses don't inflate record if field is not defined for record type.
+    bool matches(const RawRecord* record) {
+        this->record = record;
+        data = nullptr;
+        size = 0;
+
+        for (const auto& group : query->groups) {
+            bool group_matches = true;
+            for (int i = 0; i < group.clauses.count && group_matches; ++i) {
+                group_matches = match_clause(group.clauses.data[i]);
+            }
+            if (group_matches) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Returns number of records between "start" and "end", records that match are added to "matches".
+static size_t walk_records(QueryMatcher* matcher, const uint8_t* start, const uint8_t* end, Array<const RawRecord*>* matches) {
+    size_t record_count = 0;
+    const uint8_t* now = start;
+    while (now < end) {
+        const auto record = (const RawRecord*)now;
+        if (record->type == RecordType::GRUP) {
+            now += sizeof(RawGrupRecord);
+            continue;
+        }
+
+        now += sizeof(RawRecord) + record->data_size;
+        ++record_count;
+        if (matcher->matches(record)) {
+            matches->push(record);
+        }
+    }
+    return record_count;
+}
+
+static bool is_plugin_localized(const StaticArray<uint8_t> data) {
+    verify(data.count >= sizeof(RawRecord));
+    const auto tes4 = (const RawRecord*)data.data;
+    verify(tes4->type == RecordType::TES4);
+    return is_bit_set(tes4->flags, RecordFlags::TES4_Localized);
+}
+
+static const wchar_t* get_plugin_name(const wchar_t* path) {
+    auto name = path;
+    for (auto c = path; *c; ++c) {
+        if (*c == L'\\' || *c == L'/') {
+            name = c + 1;
+        }
+    }
+    return name;
+}
+
+struct QueryScanner {
+    ProgramOptions options = ProgramOptions::None;
+    Query query;
+    Array<QueryPlugin> plugins{ tmpalloc };
+    Array<QueryUnit> units{ tmpalloc };
+    EspQueryStats stats;
+
+    void init(ProgramOptions options, const wchar_t* query_text, const StaticArray<const wchar_t*> plugin_paths) {
+        this->options = options;
+
+        compile_query(query_text, &query);
+
+        for (const auto path : plugin_paths) {
+            QueryPlugin plugin;
+            plugin.path = path;
+            plugin.data = try_map_file(path);
+            if (!plugin.data.count) {
+                exit_error(L"failed to open plugin \"%s\": %s", path, get_last_error());
+            }
+
+            plugin.localized = is_plugin_localized(plugin.data);
+
+            plugins.push(plugin);
+        }
+        stats.plugin_count = plugins.count;
+    }
+
+    void dispose() {
+        for (auto& unit : units) {
+            unit.matches.free();
+        }
+        for (auto& plugin : plugins) {
+            unmap_file(&plugin.data);
+        }
+    }
+
+    // Called from worker threads, writes only to specified unit.
+    void walk_unit(QueryUnit* unit, QueryMatcher* matcher) {
+        PROFILE_SCOPE(RecordWalk, unit->end - unit->start);
+        matcher->localized = plugins.data[unit->plugin].localized;
+        unit->record_count += walk_records(matcher, unit->start, unit->end, &unit->matches);
+    }
+
+    void find_matches() {
+        size_t total_size = 0;
+        for (const auto& plugin : plugins) {
+            total_size += plugin.data.count;
+        }
+        const auto max_unit_size = get_max_unit_size(total_size);
+        for (int i = 0; i < plugins.count; ++i) {
+            const auto& data = plugins.data[i].data;
+            split_plugin_units(data.data, data.data + data.count, max_unit_size, [this, i](const uint8_t* start, const uint8_t* end, StaticArray<const RawGrupRecord*>) {
+                QueryUnit unit;
+                unit.plugin = i;
+                unit.start = start;
+                unit.end = end;
+                units.push(unit);
+            });
+        }
+
+        WorkCounter counter{ units.count };
+        run_on_threads(get_thread_count(units.count), [&]() {
+            QueryMatcher matcher;
+            matcher.query = &query;
+            for (;;) {
+                const int unit_index = counter.take();
+                if (unit_index == -1) {
+                    break;
+                }
+
+                const auto unit = &units.data[unit_index];
+                const auto inflated_count = matcher.inflated_count;
+                walk_unit(unit, &matcher);
+                unit->inflated_count = matcher.inflated_count - inflated_count;
+            }
+            matcher.dispose();
+        });
+
+        for (const auto& unit : units) {
+            stats.record_count += unit.record_count;
+            stats.inflated_count += unit.inflated_count;
+            stats.match_count += unit.matches.count;
+        }
+    }
+
+    // Matches are parsed and written on this thread in load order, parser and writer use "tmpalloc".
+    void write_matches(const wchar_t* text_path) {
+        EspParser parser;
+        parser.init(tmpalloc, options);
+        defer(parser.dispose());
+
+        TextRecordWriter writer;
+        writer.init(options);
+        defer(writer.dispose());
+
+        ProfileScope profile{ ProfilePhase::TextFormat };
+        int written_plugin = -1;
+        for (const auto& unit : units) {
+            for (const auto record : unit.matches) {
+                if (written_plugin != unit.plugin) {
+                    written_plugin = unit.plugin;
+                    writer.localized_strings = plugins.data[unit.plugin].localized;
+                    if (plugins.count > 1) {
+                        writer.write_format("@@ %ls\n", get_plugin_name(plugins.data[unit.plugin].path));
+                    }
+                }
+                writer.write_record(parser.parse_record(record));
+            }
+        }
+        profile.bytes = writer.output_buffer.size();
+
+        if (text_path) {
+            write_file(text_path, { writer.output_buffer.start, writer.output_buffer.size() });
+        } else {
+            fwrite(writer.output_buffer.start, 1, writer.output_buffer.size(), stdout);
+        }
+    }
+};
+
+void compile_query(const wchar_t* text, Query* query) {
+    QueryCompiler compiler;
+    compiler.compile(text, query);
+}
+
+void find_query_matches(const Query* query, const StaticArray<uint8_t> data, Array<const RawRecord*>* matches) {
+    QueryMatcher matcher;
+    matcher.query = query;
+    matcher.localized = is_plugin_localized(data);
+    defer(matcher.dispose());
+
+    walk_records(&matcher, data.data, data.data + data.count, matches);
+}
+
+EspQueryStats query_records(ProgramOptions options, const wchar_t* query, const StaticArray<const wchar_t*> plugin_paths, const wchar_t* text_path) {
+    QueryScanner scanner;
+    scanner.init(options, query, plugin_paths);
+    defer(scanner.dispose());
+
+    scanner.find_matches();
+    scanner.write_matches(text_path);
+    return scanner.stats;
+}
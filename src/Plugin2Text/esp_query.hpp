@@ -0,0 +1,108 @@
+#pragma once
+#include "esp_parser.hpp"
+#include "typeinfo.hpp"
+
+enum class QueryKey : uint8_t {
+    RecordType,
+    FormID,
+    Reference,
+    Field,
+};
+
+enum class QueryOperator : uint8_t {
+    Equal,
+    NotEqual,
+    Contains,
+    Less,
+    Greater,
+};
+
+struct QueryValue {
+    const char* text = nullptr;
+    size_t length = 0;
+    bool is_number = false;
+    double number = 0;
+    bool is_formid = false;
+    FormID formid;
+};
+
+struct QueryFieldDef {
+    RecordType record_type = (RecordType)0;
+    const RecordFieldDef* field_def = nullptr;
+};
+
+struct QueryClause {
+    QueryKey key = QueryKey::Field;
+    QueryOperator op = QueryOperator::Equal;
+    RecordFieldType field_type = (RecordFieldType)0;
+    const char* member = nullptr; // Null if clause checks all values of field.
+    size_t member_length = 0;
+    StaticArray<QueryValue> values;
+
+    // Definitions of field in records that have it, sorted by record type. Field is matched only in these
+    // records, or in all records if it's defined in "Record_Common".
+    StaticArray<QueryFieldDef> field_defs;
+    const RecordFieldDef* common_field_def = nullptr;
+
+    // Returns null if field is not defined for record type, then record can't have values of field.
+    const RecordFieldDef* find_field_def(RecordType record_type) const {
+        size_t low = 0;
+        size_t high = field_defs.count;
+        while (low < high) {
+            const auto middle = (low + high) / 2;
+            const auto& entry = field_defs.data[middle];
+            if (entry.record_type == record_type) {
+                return entry.field_def;
+            }
+            if (entry.record_type < record_type) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return common_field_def;
+    }
+};
+
+// Clauses that need only record header go first, so fields are not looked at if header doesn't match.
+struct QueryGroup {
+    Array<QueryClause> clauses{ tmpalloc };
+    int header_clause_count = 0;
+};
+
+struct Query {
+    Array<QueryGroup> groups{ tmpalloc };
+};
+
+struct EspQueryStats {
+    size_t plugin_count = 0;
+    size_t record_count = 0;
+    size_t inflated_count = 0; // Compressed records that had to be decompressed to check their fields.
+    size_t match_count = 0;
+};
+
+// Writes records of plugins that match "query" in text format to "text_path", or to stdout if "text_path" is null.
+// Query is one or more clauses separated by "&" (all must match), groups of clauses are separated by "|" (any
+// group must match). Clause is "<key><operator><value>[,<value>...]", record matches clause if any value matches:
+//
+//     type                record type, e.g. "type=REFR,ACHR"
+//     id                  Form ID of record, e.g. "id=00012E46"
+//     ref                 any Form ID referenced by record (see "scan_record_formids")
+//     <FIELD>             value of field, e.g. "EDID~Sword" or "NAME=0001B1D8"
+//     <FIELD>.<member>    value of struct member with specified name, e.g. "DATA.Damage>10". Script, property and
+//                         object Form IDs of VMAD are "VMAD.Script", "VMAD.Property" and "VMAD.Object", CTDA
+//                         function name is "CTDA.Function".
+//
+// Operators are "=", "!=", "~" (contains) for strings and "<", ">" for numbers. Strings and enum names are compared
+// case-insensitively, flags match if flag with specified name is set. Form IDs are hexadecimal numbers. "!=" matches
+// if no value of field is equal to any of values, including records without field. Values may be enclosed in double quotes.
+//
+// Plugins are memory-mapped and walked in parallel, compressed records are inflated only if record type and Form ID
+// match and query checks their fields.
+EspQueryStats query_records(ProgramOptions options, const wchar_t* query, const StaticArray<const wchar_t*> plugin_paths, const wchar_t* text_path);
+
+// Parses "text" into "query", exits with error if query is not valid. Clauses and values are allocated with "tmpalloc".
+void compile_query(const wchar_t* text, Query* query);
+
+// Adds records of plugin "data" that match "query" to "matches", in plugin order. Records are checked on this thread.
+void find_query_matches(const Query* query, const StaticArray<uint8_t> data, Array<const RawRecord*>* matches);
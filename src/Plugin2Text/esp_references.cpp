@@ -0,0 +1,329 @@
+#include "esp_references.hpp"
+#include "formid_layout.hpp"
+#include "parallel.hpp"
+#include "array.hpp"
+#include "profiler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib-ng.h>
+
+// Form IDs below this object index are reserved for forms hardcoded in engine (e.g. PlayerRef), they
+// are not defined by any plugin.
+static constexpr uint32_t FirstPluginObjectIndex = 0x800;
+
+struct ReferenceNode {
+    FormID id;
+    RecordType type = (RecordType)0;
+    bool child = false; // Record is in nested group, e.g. cell block or children group of cell, world or topic.
+    uint32_t edge_count = 0;
+    uint32_t inbound_count = 0;
+};
+
+struct ReferenceEdge {
+    FormID target;
+    RecordFieldType field_type = (RecordFieldType)0; // Field that contains reference, if several fields reference target, field with lowest type value.
+};
+
+// Consecutive records and groups of file, walked by one thread.
+struct ReferenceUnit {
+    const uint8_t* start = nullptr;
+    const uint8_t* end = nullptr;
+    int depth = 0; // Number of groups that contain unit.
+    Array<ReferenceNode> nodes; // Filled by worker thread.
+    Array<ReferenceEdge> edges; // Edges of each node follow edges of previous node.
+};
+
+// Edges of node "i" in CSR (compressed sparse row) form are "edges[edge_starts[i]]" .. "edges[edge_starts[i + 1] - 1]".
+struct ReferenceGraph {
+    StaticArray<ReferenceNode> nodes; // In file order.
+    StaticArray<uint32_t> edge_starts; // "nodes.count + 1" elements.
+    StaticArray<ReferenceEdge> edges;
+};
+
+struct NodeIndexEntry {
+    FormID id;
+    uint32_t node = 0;
+};
+
+struct ReferenceScanner {
+    StaticArray<uint8_t> file;
+    uint32_t master_count = 0;
+    Array<ReferenceUnit> units{ tmpalloc };
+    ReferenceGraph graph;
+    StaticArray<NodeIndexEntry> node_index; // Sorted by Form ID.
+    EspReferenceStats stats;
+
+    void init(const StaticArray<uint8_t> file) {
+        this->file = file;
+
+        verify(file.count >= sizeof(RawRecord));
+        const auto tes4 = (const RawRecord*)file.data;
+        verify(tes4->type == RecordType::TES4);
+        verify(!tes4->is_compressed());
+        verify(sizeof(RawRecord) + tes4->data_size <= file.count);
+
+        const uint8_t* now = (const uint8_t*)(tes4 + 1);
+        const uint8_t* end = now + tes4->data_size;
+        while (now < end) {
+            const auto field = (const RawRecordField*)now;
+            verify(now + sizeof(RawRecordField) + field->size <= end);
+            if (field->type == RecordFieldType::MAST) {
+                ++master_count;
+            }
+            now += sizeof(RawRecordField) + field->size;
+        }
+    }
+
+    void dispose() {
+        for (auto& unit : units) {
+            unit.nodes.free();
+            unit.edges.free();
+        }
+    }
+
+    // Top byte of Form ID is index in master list, plugin's own records have index past the last master.
+    bool is_own_form(FormID id) const {
+        return (id.value >> 24) >= master_count;
+    }
+
+    // Called from worker threads, writes only to nodes and edges of specified unit.
+    void walk_unit(ReferenceUnit* unit, Array<uint8_t>* uncompressed) {
+        PROFILE_SCOPE(RecordWalk, unit->end - unit->start);
+
+        const uint8_t* group_ends[16];
+        int group_count = 0;
+
+        const uint8_t* now = unit->start;
+        while (now < unit->end) {
+            while (group_count && now >= group_ends[group_count - 1]) {
+                --group_count;
+            }
+
+            const auto record = (const RawRecord*)now;
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                verify(group_count < _countof(group_ends));
+                group_ends[group_count++] = now + group->group_size;
+                now += sizeof(RawGrupRecord);
+                continue;
+            }
+
+            now += sizeof(RawRecord) + record->data_size;
+            if (record->type == RecordType::TES4) {
+                continue;
+            }
+
+            ReferenceNode node;
+            node.id = record->id;
+            node.type = record->type;
+            node.child = unit->depth + group_count >= 2;
+
+            const uint8_t* data = (const uint8_t*)(record + 1);
+            size_t size = record->data_size;
+            if (record->is_compressed()) {
+                const auto compressed = (const RawRecordCompressed*)record;
+                size = compressed->uncompressed_data_size;
+                grow(uncompressed, (int)size);
+
+                PROFILE_SCOPE(ZLibInflate, size);
+                const auto result = ::zng_uncompress(uncompressed->data, &size, (const uint8_t*)(compressed + 1), record->data_size - sizeof(compressed->uncompressed_data_size));
+                verify(result == Z_OK);
+                data = uncompressed->data;
+            }
+
+            const auto first_edge = unit->edges.count;
+            scan_record_formids(record->type, data, size, [&](const FormID* form_id, RecordFieldType field_type) {
+                FormID target;
+                memcpy(&target, form_id, sizeof(target));
+                if (target.value && target.value != node.id.value) {
+                    unit->edges.push({ target, field_type });
+                }
+            });
+
+            // Record may reference the same form several times, it is counted once.
+            const auto edges = &unit->edges.data[first_edge];
+            const auto edge_count = (size_t)(unit->edges.count - first_edge);
+            qsort(edges, edge_count, sizeof(edges[0]), [](void const* aa, void const* bb) -> int {
+                const auto a = (const ReferenceEdge*)aa;
+                const auto b = (const ReferenceEdge*)bb;
+                if (a->target.value != b->target.value) {
+                    return a->target.value < b->target.value ? -1 : 1;
+                }
+                return a->field_type < b->field_type ? -1 : (a->field_type > b->field_type ? 1 : 0);
+            });
+
+            size_t unique_count = 0;
+            for (size_t i = 0; i < edge_count; ++i) {
+                if (unique_count == 0 || edges[unique_count - 1].target.value != edges[i].target.value) {
+                    edges[unique_count++] = edges[i];
+                }
+            }
+            unit->edges.count = first_edge + (int)unique_count;
+
+            node.edge_count = (uint32_t)unique_count;
+            unit->nodes.push(node);
+        }
+    }
+
+    void build_graph() {
+        const auto max_unit_size = get_max_unit_size(file.count);
+        split_plugin_units(file.data, file.data + file.count, max_unit_size, [this](const uint8_t* start, const uint8_t* end, StaticArray<const RawGrupRecord*> groups) {
+            ReferenceUnit unit;
+            unit.start = start;
+            unit.end = end;
+            unit.depth = (int)groups.count;
+            units.push(unit);
+        });
+
+        WorkCounter counter{ units.count };
+        run_on_threads(get_thread_count(units.count), [&]() {
+            Array<uint8_t> uncompressed; // Buffer for records of this thread.
+            for (;;) {
+                const int unit_index = counter.take();
+                if (unit_index == -1) {
+                    break;
+                }
+                walk_unit(&units.data[unit_index], &uncompressed);
+            }
+            uncompressed.free();
+        });
+
+        merge_units();
+    }
+
+    // Concatenates nodes and edges of units in file order, units already store edges of each node contiguously.
+    void merge_units() {
+        size_t node_count = 0;
+        size_t edge_count = 0;
+        for (const auto& unit : units) {
+            node_count += unit.nodes.count;
+            edge_count += unit.edges.count;
+        }
+        verify(edge_count <= UINT32_MAX);
+
+        graph.nodes = { (ReferenceNode*)memalloc(tmpalloc, sizeof(ReferenceNode) * node_count), node_count };
+        graph.edge_starts = { (uint32_t*)memalloc(tmpalloc, sizeof(uint32_t) * (node_count + 1)), node_count + 1 };
+        graph.edges = { (ReferenceEdge*)memalloc(tmpalloc, sizeof(ReferenceEdge) * edge_count), edge_count };
+
+        size_t node = 0;
+        uint32_t edge = 0;
+        for (const auto& unit : units) {
+            memcpy(&graph.edges.data[edge], unit.edges.data, sizeof(ReferenceEdge) * unit.edges.count);
+            for (const auto& unit_node : unit.nodes) {
+                graph.nodes.data[node] = unit_node;
+                graph.edge_starts.data[node] = edge;
+                edge += unit_node.edge_count;
+                ++node;
+            }
+        }
+        graph.edge_starts.data[node_count] = edge;
+
+        stats.record_count = node_count;
+        stats.reference_count = edge_count;
+    }
+
+    void build_node_index() {
+        node_index = { (NodeIndexEntry*)memalloc(tmpalloc, sizeof(NodeIndexEntry) * graph.nodes.count), graph.nodes.count };
+        for (size_t i = 0; i < graph.nodes.count; ++i) {
+            node_index.data[i] = { graph.nodes.data[i].id, (uint32_t)i };
+        }
+
+        qsort(node_index.data, node_index.count, sizeof(node_index.data[0]), [](void const* aa, void const* bb) -> int {
+            const auto a = (const NodeIndexEntry*)aa;
+            const auto b = (const NodeIndexEntry*)bb;
+            if (a->id.value != b->id.value) {
+                return a->id.value < b->id.value ? -1 : 1;
+            }
+            return a->node < b->node ? -1 : (a->node > b->node ? 1 : 0);
+        });
+    }
+
+    // Returns first node with specified Form ID or nullptr.
+    ReferenceNode* find_node(FormID id) {
+        size_t low = 0;
+        size_t high = node_index.count;
+        while (low < high) {
+            const auto middle = (low + high) / 2;
+            if (node_index.data[middle].id.value < id.value) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low < node_index.count && node_index.data[low].id.value == id.value ? &graph.nodes.data[node_index.data[low].node] : nullptr;
+    }
+
+    void report() {
+        build_node_index();
+
+        bool printed_header = false;
+        for (size_t i = 0; i < graph.nodes.count; ++i) {
+            const auto& source = graph.nodes.data[i];
+            for (uint32_t j = graph.edge_starts.data[i]; j < graph.edge_starts.data[i + 1]; ++j) {
+                const auto& edge = graph.edges.data[j];
+                const auto target = find_node(edge.target);
+                if (target) {
+                    ++target->inbound_count;
+                } else if (!is_own_form(edge.target)) {
+                    ++stats.master_reference_count;
+                } else if ((edge.target.value & 0xffffff) >= FirstPluginObjectIndex) {
+                    ++stats.missing_count;
+                    if (!printed_header) {
+                        printf("Missing references:\n");
+                        printed_header = true;
+                    }
+                    printf("  %.4s [%08X] %.4s -> [%08X]\n", (const char*)&source.type, source.id.value, (const char*)&edge.field_type, edge.target.value);
+                }
+            }
+        }
+
+        printed_header = false;
+        for (const auto& node : graph.nodes) {
+            if (node.inbound_count || node.child || !is_own_form(node.id)) {
+                continue;
+            }
+            ++stats.unreferenced_count;
+            if (!printed_header) {
+                printf("Unreferenced records:\n");
+                printed_header = true;
+            }
+            printf("  %.4s [%08X]\n", (const char*)&node.type, node.id.value);
+        }
+
+        TEMP_SCOPE();
+        Array<const ReferenceNode*> referenced{ tmpalloc };
+        for (const auto& node : graph.nodes) {
+            if (node.inbound_count) {
+                referenced.push(&node);
+            }
+        }
+
+        qsort(referenced.data, referenced.count, sizeof(referenced.data[0]), [](void const* aa, void const* bb) -> int {
+            const auto a = *(const ReferenceNode* const*)aa;
+            const auto b = *(const ReferenceNode* const*)bb;
+            if (a->inbound_count != b->inbound_count) {
+                return a->inbound_count > b->inbound_count ? -1 : 1;
+            }
+            return a->id.value < b->id.value ? -1 : (a->id.value > b->id.value ? 1 : 0);
+        });
+
+        if (referenced.count) {
+            printf("Inbound references:\n");
+        }
+        for (const auto node : referenced) {
+            printf("  %.4s [%08X] %u\n", (const char*)&node->type, node->id.value, node->inbound_count);
+        }
+    }
+};
+
+EspReferenceStats scan_references(const StaticArray<uint8_t> file) {
+    TEMP_SCOPE();
+
+    ReferenceScanner scanner;
+    scanner.init(file);
+    defer(scanner.dispose());
+
+    scanner.build_graph();
+    scanner.report();
+    return scanner.stats;
+}
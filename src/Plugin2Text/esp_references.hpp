@@ -0,0 +1,17 @@
+#pragma once
+#include "esp_parser.hpp"
+
+struct EspReferenceStats {
+    size_t record_count = 0;
+    size_t reference_count = 0; // Distinct Form IDs referenced by each record, summed over all records.
+    size_t master_reference_count = 0; // References to records of masters, they can't be checked.
+    size_t missing_count = 0; // References to plugin's own Form IDs which are not defined in plugin.
+    size_t unreferenced_count = 0; // Plugin's own records which are not referenced by other records.
+};
+
+// Builds graph of Form ID references between records of plugin and writes references to missing records,
+// records which are not referenced by any other record and number of inbound references of each referenced
+// record to stdout. Groups are walked in parallel, Form IDs are extracted with "scan_record_formids"
+// without parsing records. Records in nested groups (cell blocks, cell, world and topic children) are
+// placed by group hierarchy instead of Form ID references, so they are not reported as unreferenced.
+EspReferenceStats scan_references(const StaticArray<uint8_t> file);
@@ -0,0 +1,409 @@
+#include "esp_remap.hpp"
+#include "formid_layout.hpp"
+#include "array.hpp"
+#include "os.hpp"
+#include "profiler.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib-ng.h>
+
+static constexpr uint32_t LightFirstObjectIndex = 0x800;
+static constexpr uint32_t LightLastObjectIndex = 0xfff;
+
+FormIDMap::FormIDMap() {
+    for (int i = 0; i < _countof(master_indices); ++i) {
+        master_indices[i] = (uint8_t)i;
+    }
+}
+
+void FormIDMap::dispose() {
+    stddelete(slots.data);
+    slots = {};
+    count = 0;
+}
+
+bool FormIDMap::add(FormID from, FormID to) {
+    verify(from.value);
+
+    if ((count + 1) * 2 > slots.count) {
+        const auto old_slots = slots;
+        const auto capacity = old_slots.count ? old_slots.count * 2 : 1024;
+        slots = { stdnew Slot[capacity], capacity };
+        for (const auto& slot : old_slots) {
+            if (slot.from.value) {
+                auto index = hash_uint32(slot.from.value) & (slots.count - 1);
+                while (slots.data[index].from.value) {
+                    index = (index + 1) & (slots.count - 1);
+                }
+                slots.data[index] = slot;
+            }
+        }
+        stddelete(old_slots.data);
+    }
+
+    auto index = hash_uint32(from.value) & (slots.count - 1);
+    while (slots.data[index].from.value) {
+        if (slots.data[index].from.value == from.value) {
+            return false;
+        }
+        index = (index + 1) & (slots.count - 1);
+    }
+    slots.data[index] = { from, to };
+    ++count;
+    return true;
+}
+
+FormID FormIDMap::translate(FormID id) const {
+    if (!id.value) {
+        return id;
+    }
+
+    if (count) {
+        auto index = hash_uint32(id.value) & (slots.count - 1);
+        while (slots.data[index].from.value) {
+            if (slots.data[index].from.value == id.value) {
+                return slots.data[index].to;
+            }
+            index = (index + 1) & (slots.count - 1);
+        }
+    }
+
+    return { ((uint32_t)master_indices[id.value >> 24] << 24) | (id.value & 0xffffff) };
+}
+
+// Parses hexadecimal number that takes whole token, returns number of digits or 0 if token is not a number.
+static size_t parse_hex_token(const char* token, size_t length, uint32_t* out_value) {
+    if (length == 0 || length > 8) {
+        return 0;
+    }
+
+    uint32_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        const auto c = to_lower_ascii(token[i]);
+        if (c >= '0' && c <= '9') {
+            value = value * 16 + (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value = value * 16 + (c - 'a' + 10);
+        } else {
+            return 0;
+        }
+    }
+
+    *out_value = value;
+    return length;
+}
+
+void load_formid_map(FormIDMap* map, const wchar_t* path) {
+    TEMP_SCOPE();
+    const auto text = try_read_file(tmpalloc, path);
+    if (!text.count) {
+        exit_error(L"failed to read Form ID map \"%s\" or file is empty", path);
+    }
+
+    const auto end = (const char*)text.data + text.count;
+    int line_number = 0;
+    for (auto now = (const char*)text.data; now < end;) {
+        ++line_number;
+        auto line_end = now;
+        while (line_end < end && *line_end != '\n') {
+            ++line_end;
+        }
+        const auto next_line = line_end + 1;
+
+        StaticArray<const char> tokens[3];
+        size_t token_count = 0;
+        for (auto c = now; c < line_end && *c != '#';) {
+            if (*c == ' ' || *c == '\t' || *c == '\r') {
+                ++c;
+                continue;
+            }
+
+            const auto token_start = c;
+            while (c < line_end && *c != ' ' && *c != '\t' && *c != '\r' && *c != '#') {
+                ++c;
+            }
+            if (token_count == _countof(tokens)) {
+                exit_error(L"too many values on line %d of Form ID map \"%s\"", line_number, path);
+            }
+            tokens[token_count++] = { token_start, (size_t)(c - token_start) };
+        }
+        now = next_line;
+
+        if (token_count == 0) {
+            continue;
+        }
+
+        uint32_t from = 0;
+        uint32_t to = 0;
+        const auto from_digits = token_count == 2 ? parse_hex_token(tokens[0].data, tokens[0].count, &from) : 0;
+        const auto to_digits = token_count == 2 ? parse_hex_token(tokens[1].data, tokens[1].count, &to) : 0;
+
+        if (from_digits == 8 && to_digits == 8 && from != 0 && to != 0) {
+            if (!map->add({ from }, { to })) {
+                exit_error(L"Form ID %08X is mapped more than once in Form ID map \"%s\" (line %d)", from, path, line_number);
+            }
+        } else if (from_digits == 2 && to_digits == 2) {
+            map->master_indices[from] = (uint8_t)to;
+        } else {
+            exit_error(L"invalid line %d in Form ID map \"%s\", expected pair of hexadecimal Form IDs (8 digits) or master indices (2 digits)", line_number, path);
+        }
+    }
+}
+
+// Calls "func" with every record header of plugin, including headers of compressed records.
+template<typename Func>
+static void foreach_raw_record(const StaticArray<uint8_t> file, Func func) {
+    const uint8_t* now = file.data;
+    const uint8_t* end = file.data + file.count;
+    while (now < end) {
+        verify(now + sizeof(RawRecord) <= end);
+        const auto record = (const RawRecord*)now;
+        if (record->type == RecordType::GRUP) {
+            verify(((const RawGrupRecord*)record)->group_size >= sizeof(RawGrupRecord));
+            now += sizeof(RawGrupRecord);
+            continue;
+        }
+
+        verify(now + sizeof(RawRecord) + record->data_size <= end);
+        func(record);
+        now += sizeof(RawRecord) + record->data_size;
+    }
+}
+
+static uint32_t get_master_count(const RawRecord* tes4) {
+    verify(tes4->type == RecordType::TES4);
+    verify(!tes4->is_compressed());
+
+    uint32_t master_count = 0;
+    const uint8_t* now = (const uint8_t*)(tes4 + 1);
+    const uint8_t* end = now + tes4->data_size;
+    while (now < end) {
+        const auto field = (const RawRecordField*)now;
+        verify(now + sizeof(RawRecordField) + field->size <= end);
+        if (field->type == RecordFieldType::MAST) {
+            ++master_count;
+        }
+        now += sizeof(RawRecordField) + field->size;
+    }
+    return master_count;
+}
+
+uint32_t build_compact_esl_map(FormIDMap* map, const StaticArray<uint8_t> file) {
+    TEMP_SCOPE();
+
+    verify(file.count >= sizeof(RawRecord));
+    const auto own_index = get_master_count((const RawRecord*)file.data);
+    constexpr auto SlotCount = LightLastObjectIndex - LightFirstObjectIndex + 1;
+
+    // Object indices that stay in place are reserved first, then other records take free indices in file order.
+    bool used[SlotCount]{};
+    Array<uint32_t> moved{ tmpalloc };
+    foreach_raw_record(file, [&](const RawRecord* record) {
+        const auto id = record->id.value;
+        if (record->type == RecordType::TES4 || (id >> 24) != own_index) {
+            return;
+        }
+
+        const auto object_index = id & 0xffffff;
+        if (object_index >= LightFirstObjectIndex && object_index <= LightLastObjectIndex) {
+            used[object_index - LightFirstObjectIndex] = true;
+        } else {
+            moved.push(id);
+        }
+    });
+
+    uint32_t next_slot = 0;
+    uint32_t last_object_index = LightFirstObjectIndex - 1;
+    for (uint32_t i = 0; i < SlotCount; ++i) {
+        if (used[i]) {
+            last_object_index = LightFirstObjectIndex + i;
+        }
+    }
+
+    for (const auto id : moved) {
+        if (map->translate({ id }).value != id) {
+            continue; // Plugin contains several records with the same Form ID.
+        }
+
+        while (next_slot < SlotCount && used[next_slot]) {
+            ++next_slot;
+        }
+        if (next_slot == SlotCount) {
+            exit_error(L"plugin has too many records to fit into Form ID range of light plugins (%X-%X)", LightFirstObjectIndex, LightLastObjectIndex);
+        }
+
+        used[next_slot] = true;
+        const auto object_index = LightFirstObjectIndex + next_slot;
+        if (object_index > last_object_index) {
+            last_object_index = object_index;
+        }
+        verify(map->add({ id }, { (own_index << 24) | object_index }));
+    }
+
+    return last_object_index + 1;
+}
+
+struct FormIDRemapper {
+    const FormIDMap* map = nullptr;
+    uint32_t next_object_id = 0;
+    Slice output;
+    Array<uint8_t> uncompressed{ tmpalloc };
+    EspRemapStats stats;
+
+    void translate(FormID* id) {
+        const auto translated = map->translate(*id);
+        if (translated.value != id->value) {
+            *id = translated;
+            ++stats.changed_count;
+        }
+    }
+
+    // Translates Form IDs in fields, returns true if any Form ID was changed.
+    bool translate_fields(RecordType record_type, uint8_t* data, size_t size) {
+        const auto changed_count = stats.changed_count;
+        scan_record_formids(record_type, data, size, [&](const FormID* form_id, RecordFieldType field_type) {
+            // Next Object ID of plugin header is object counter, not reference.
+            if (record_type == RecordType::TES4 && field_type == RecordFieldType::HEDR) {
+                return;
+            }
+
+            FormID id;
+            memcpy(&id, form_id, sizeof(id));
+            translate(&id);
+            memcpy((void*)form_id, &id, sizeof(id)); // Points into "data", which is writable.
+        });
+        return stats.changed_count != changed_count;
+    }
+
+    void write_header_fields(uint8_t* data, size_t size) {
+        if (!next_object_id) {
+            return;
+        }
+
+        uint8_t* now = data;
+        uint8_t* end = data + size;
+        while (now < end) {
+            const auto field = (RawRecordField*)now;
+            if (field->type == RecordFieldType::HEDR && field->size == sizeof(TES4_HEDR)) {
+                ((TES4_HEDR*)(field + 1))->next_object_id = next_object_id;
+            }
+            now += sizeof(RawRecordField) + field->size;
+        }
+    }
+
+    void remap_record(const RawRecord* source) {
+        ++stats.record_count;
+
+        if (!source->is_compressed()) {
+            const auto record = (RawRecord*)output.advance(sizeof(RawRecord) + source->data_size);
+            memcpy(record, source, sizeof(RawRecord) + source->data_size);
+            translate(&record->id);
+            translate_fields(record->type, (uint8_t*)(record + 1), record->data_size);
+            if (record->type == RecordType::TES4) {
+                write_header_fields((uint8_t*)(record + 1), record->data_size);
+            }
+            return;
+        }
+
+        const auto compressed = (const RawRecordCompressed*)source;
+        const auto compressed_size = source->data_size - sizeof(compressed->uncompressed_data_size);
+        size_t size = compressed->uncompressed_data_size;
+        grow(&uncompressed, (int)size);
+        {
+            PROFILE_SCOPE(ZLibInflate, size);
+            const auto result = ::zng_uncompress(uncompressed.data, &size, (const uint8_t*)(compressed + 1), compressed_size);
+            verify(result == Z_OK);
+        }
+
+        const auto record = (RawRecordCompressed*)output.advance(sizeof(RawRecordCompressed));
+        memcpy(record, compressed, sizeof(RawRecordCompressed));
+        translate(&record->id);
+
+        if (!translate_fields(record->type, uncompressed.data, size)) {
+            memcpy(output.advance(compressed_size), compressed + 1, compressed_size);
+            return;
+        }
+
+        PROFILE_SCOPE(ZLibDeflate, size);
+        size_t new_compressed_size = output.remaining_size();
+        const auto result = ::zng_compress2(output.now, &new_compressed_size, uncompressed.data, size, SkyrimZLibCompressionLevel);
+        verify(result == Z_OK);
+        output.advance(new_compressed_size);
+
+        record->data_size = (uint32_t)(new_compressed_size + sizeof(record->uncompressed_data_size));
+        ++stats.recompressed_count;
+    }
+
+    void remap(const StaticArray<uint8_t> file) {
+        PROFILE_SCOPE(RecordWalk, file.count);
+
+        // Output offsets of group headers which are not closed yet and ends of these groups in source.
+        struct OpenGroup {
+            size_t output_offset = 0;
+            const uint8_t* source_end = nullptr;
+        };
+        Array<OpenGroup> groups{ tmpalloc };
+
+        const uint8_t* now = file.data;
+        const uint8_t* end = file.data + file.count;
+        while (true) {
+            // Recompressed records may change size of groups.
+            while (groups.count && (now >= groups.data[groups.count - 1].source_end || now >= end)) {
+                const auto group = groups.data[--groups.count];
+                const auto header = (RawGrupRecord*)(output.start + group.output_offset);
+                header->group_size = (uint32_t)(output.now - (uint8_t*)header);
+            }
+            if (now >= end) {
+                break;
+            }
+
+            verify(now + sizeof(RawRecord) <= end);
+            const auto record = (const RawRecord*)now;
+            if (record->type == RecordType::GRUP) {
+                const auto source_group = (const RawGrupRecord*)record;
+                verify(source_group->group_size >= sizeof(RawGrupRecord) && now + source_group->group_size <= end);
+
+                const auto group = (RawGrupRecord*)output.advance(sizeof(RawGrupRecord));
+                *group = *source_group;
+                switch (group->group_type) {
+                    case RecordGroupType::WorldChildren:
+                    case RecordGroupType::CellChildren:
+                    case RecordGroupType::TopicChildren:
+                    case RecordGroupType::CellPersistentChildren:
+                    case RecordGroupType::CellTemporaryChildren: {
+                        // Label is Form ID of parent record.
+                        translate((FormID*)&group->label);
+                    } break;
+                }
+
+                groups.push({ (size_t)((uint8_t*)group - output.start), now + source_group->group_size });
+                now += sizeof(RawGrupRecord);
+                continue;
+            }
+
+            verify(now + sizeof(RawRecord) + record->data_size <= end);
+            remap_record(record);
+            now += sizeof(RawRecord) + record->data_size;
+        }
+    }
+};
+
+EspRemapStats remap_formids(const StaticArray<uint8_t> file, const FormIDMap& map, uint32_t next_object_id, const wchar_t* destination_path) {
+    TEMP_SCOPE();
+
+    FormIDRemapper remapper;
+    remapper.map = &map;
+    remapper.next_object_id = next_object_id;
+
+    // Recompressed records may be larger than original ones.
+    remapper.output = allocate_virtual_memory(file.count * 2 + 1024 * 1024);
+    defer(free_virtual_memory(&remapper.output));
+
+    remapper.remap(file);
+
+    {
+        PROFILE_SCOPE(FileWrite, remapper.output.now - remapper.output.start);
+        write_file(destination_path, { remapper.output.start, (size_t)(remapper.output.now - remapper.output.start) });
+    }
+    return remapper.stats;
+}
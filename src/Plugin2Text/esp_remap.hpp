@@ -0,0 +1,43 @@
+#pragma once
+#include "esp_parser.hpp"
+
+// Translation table of Form IDs. Form IDs without entry keep their object index, but their master
+// index is translated with "master_indices".
+struct FormIDMap {
+    struct Slot {
+        FormID from; // Null if slot is empty.
+        FormID to;
+    };
+
+    StaticArray<Slot> slots; // Allocated with "stdalloc". Capacity is power of two, load factor is at most 1/2.
+    size_t count = 0;
+    uint8_t master_indices[256];
+
+    FormIDMap();
+    void dispose();
+
+    // Returns false if "from" already has entry.
+    bool add(FormID from, FormID to);
+    FormID translate(FormID id) const;
+};
+
+struct EspRemapStats {
+    size_t record_count = 0;
+    size_t changed_count = 0; // Form IDs that were changed, including Form IDs of records and group labels.
+    size_t recompressed_count = 0;
+};
+
+// Reads Form ID map file. Each line is "<old> <new>" pair of hexadecimal Form IDs, or pair of
+// two digit master indices to change master index of Form IDs without own entry. Lines starting
+// with "#" are ignored.
+void load_formid_map(FormIDMap* map, const wchar_t* path);
+
+// Adds entries that renumber plugin's own records into object index range of light plugins
+// (800-FFF). Form IDs which are already in the range are kept. Returns next free object index.
+uint32_t build_compact_esl_map(FormIDMap* map, const StaticArray<uint8_t> file);
+
+// Writes copy of plugin with Form IDs translated with "map" in record headers, group labels and
+// record fields (see "scan_record_formids"). Master list is not changed. Compressed records are
+// recompressed only if their Form IDs changed, other data is copied as is. If "next_object_id"
+// is not zero, it is written to header of plugin.
+EspRemapStats remap_formids(const StaticArray<uint8_t> file, const FormIDMap& map, uint32_t next_object_id, const wchar_t* destination_path);
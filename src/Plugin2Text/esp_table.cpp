@@ -0,0 +1,568 @@
+#include "esp_table.hpp"
+#include "parallel.hpp"
+#include "typeinfo.hpp"
+#include "array.hpp"
+#include "os.hpp"
+#include "profiler.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <charconv>
+#include <zlib-ng.h>
+
+// Column of table, value of scalar type at fixed offset in field data.
+struct TableColumn {
+    const char* name = nullptr;
+    const Type* type = nullptr;
+    size_t offset = 0;
+    const TypeConstant* constant = nullptr; // If set, column is empty when value is equal to constant.
+};
+
+// Filter that is applied to part of field data before values are written.
+struct TableFilter {
+    const TypeFilter* type = nullptr;
+    size_t offset = 0;
+};
+
+struct TableLayout {
+    Array<TableColumn> columns{ tmpalloc };
+    Array<TableFilter> filters{ tmpalloc };
+};
+
+static const char* join_column_name(const char* prefix, const char* name, size_t name_length) {
+    const auto prefix_length = prefix ? strlen(prefix) : 0;
+    const auto result = (char*)memalloc(tmpalloc, prefix_length + 1 + name_length + 1);
+    auto now = result;
+    if (prefix_length) {
+        memcpy(now, prefix, prefix_length);
+        now += prefix_length;
+        *now++ = '.';
+    }
+    memcpy(now, name, name_length);
+    now[name_length] = '\0';
+    return result;
+}
+
+// Returns false if type can't be written as columns.
+static bool add_columns(TableLayout* layout, const Type* type, const char* name, size_t offset, bool top_level) {
+    switch (type->kind) {
+        case TypeKind::Struct: {
+            const auto struct_type = static_cast<const TypeStruct*>(type);
+            for (size_t i = 0; i < struct_type->field_count; ++i) {
+                const auto& field = struct_type->fields[i];
+                const auto field_name = join_column_name(top_level ? nullptr : name, field.name, field.name_length);
+
+                if (field.type->kind == TypeKind::Constant) {
+                    const auto constant_type = static_cast<const TypeConstant*>(field.type);
+                    if (constant_type->fallback) {
+                        const auto first_column = layout->columns.count;
+                        if (!add_columns(layout, constant_type->fallback, field_name, offset, false)) {
+                            return false;
+                        }
+                        if (layout->columns.count > first_column) {
+                            layout->columns.data[first_column].constant = constant_type;
+                        }
+                    }
+                } else if (!add_columns(layout, field.type, field_name, offset, false)) {
+                    return false;
+                }
+                offset += field.type->size;
+            }
+            return true;
+        }
+
+        case TypeKind::Filter: {
+            const auto filter_type = static_cast<const TypeFilter*>(type);
+            layout->filters.push({ filter_type, offset });
+            return add_columns(layout, filter_type->inner_type, name, offset, top_level);
+        }
+
+        case TypeKind::Vector3: {
+            layout->columns.push({ join_column_name(name, "X", 1), &Type_float, offset });
+            layout->columns.push({ join_column_name(name, "Y", 1), &Type_float, offset + sizeof(float) });
+            layout->columns.push({ join_column_name(name, "Z", 1), &Type_float, offset + sizeof(float) * 2 });
+            return true;
+        }
+
+        case TypeKind::Integer:
+        case TypeKind::Float:
+        case TypeKind::FormID:
+        case TypeKind::Enum:
+        case TypeKind::Boolean:
+        case TypeKind::ByteArrayFixed: {
+            layout->columns.push({ name, type, offset });
+            return true;
+        }
+
+        // Types of variable size take whole field.
+        case TypeKind::ZString:
+        case TypeKind::LString:
+        case TypeKind::FormIDArray:
+        case TypeKind::ByteArray: {
+            if (!top_level) {
+                return false;
+            }
+            layout->columns.push({ name, type, offset });
+            return true;
+        }
+    }
+    return false;
+}
+
+// Formats rows of one unit into its own buffer.
+struct TableRowWriter {
+    Array<uint8_t>* output = nullptr;
+    char separator = ',';
+    bool localized_strings = false;
+    const StringTables* strings = nullptr;
+
+    void write_bytes(const void* data, size_t size) {
+        grow(output, (int)size);
+        memcpy(output->data + output->count, data, size);
+        output->count += (int)size;
+    }
+
+    void write_char(char c) {
+        output->push((uint8_t)c);
+    }
+
+    template<typename T>
+    void write_number(T value) {
+        constexpr int MaxNumberLength = 32;
+        grow(output, MaxNumberLength);
+        const auto now = (char*)output->data + output->count;
+        const auto result = std::to_chars(now, now + MaxNumberLength, value);
+        verify(result.ec == std::errc{});
+        output->count += (int)(result.ptr - now);
+    }
+
+    void write_formid(FormID formid) {
+        char buffer[1 + 8 + 1]; // [DEADBEEF]
+        buffer[0] = '[';
+        format_hex_uint32(buffer + 1, formid.value);
+        buffer[9] = ']';
+        write_bytes(buffer, sizeof(buffer));
+    }
+
+    void write_hex(const uint8_t* data, size_t size) {
+        grow(output, (int)(size * 2));
+        format_hex_bytes((char*)output->data + output->count, data, size);
+        output->count += (int)(size * 2);
+    }
+
+    void write_string(const char* chars, size_t count) {
+        bool needs_quotes = false;
+        for (size_t i = 0; i < count && !needs_quotes; ++i) {
+            needs_quotes = chars[i] == separator || chars[i] == '"' || chars[i] == '\n' || chars[i] == '\r';
+        }
+
+        if (!needs_quotes) {
+            write_bytes(chars, count);
+            return;
+        }
+
+        write_char('"');
+        for (size_t i = 0; i < count; ++i) {
+            if (chars[i] == '"') {
+                write_char('"');
+            }
+            write_char(chars[i]);
+        }
+        write_char('"');
+    }
+
+    void write_value(const TableColumn& column, const uint8_t* data, size_t size) {
+        const auto value = data + column.offset;
+        const auto type = column.type;
+
+        // Fields of older record versions may be shorter, missing values are left empty.
+        if (column.offset > size || (type->size && column.offset + type->size > size)) {
+            return;
+        }
+        if (column.constant && memory_equals(value, column.constant->bytes, column.constant->size)) {
+            return;
+        }
+
+        const auto value_size = type->size ? type->size : size - column.offset;
+        switch (type->kind) {
+            case TypeKind::Integer: {
+                const auto integer_type = static_cast<const TypeInteger*>(type);
+                switch (value_size) {
+                    case 1: integer_type->is_unsigned ? write_number(*(const uint8_t*)value) : write_number(*(const int8_t*)value); break;
+                    case 2: integer_type->is_unsigned ? write_number(*(const uint16_t*)value) : write_number(*(const int16_t*)value); break;
+                    case 4: integer_type->is_unsigned ? write_number(*(const uint32_t*)value) : write_number(*(const int32_t*)value); break;
+                    case 8: integer_type->is_unsigned ? write_number(*(const uint64_t*)value) : write_number(*(const int64_t*)value); break;
+                }
+            } break;
+
+            case TypeKind::Float: {
+                if (value_size == sizeof(float)) {
+                    write_number(*(const float*)value);
+                } else if (value_size == sizeof(double)) {
+                    write_number(*(const double*)value);
+                }
+            } break;
+
+            case TypeKind::FormID: {
+                write_formid(*(const FormID*)value);
+            } break;
+
+            case TypeKind::Enum: {
+                const auto enum_type = static_cast<const TypeEnum*>(type);
+                uint32_t enum_value = 0;
+                switch (value_size) {
+                    case 1: enum_value = *(const uint8_t*)value; break;
+                    case 2: enum_value = *(const uint16_t*)value; break;
+                    case 4: enum_value = *(const uint32_t*)value; break;
+                    default: return;
+                }
+
+                if (!enum_type->flags) {
+                    const auto field = enum_type->get_field_by_value(enum_value);
+                    if (field) {
+                        write_string(field->name, field->name_length);
+                    } else {
+                        write_number(enum_value);
+                    }
+                    return;
+                }
+
+                // Flags are joined with "|", unknown bits are written as hexadecimal number.
+                bool first = true;
+                for (size_t i = 0; i < enum_type->field_count && enum_value; ++i) {
+                    const auto& field = enum_type->fields[i];
+                    if (enum_value & field.value) {
+                        if (!first) {
+                            write_char('|');
+                        }
+                        write_string(field.name, field.name_length);
+                        enum_value = clear_bit(enum_value, field.value);
+                        first = false;
+                    }
+                }
+                if (enum_value) {
+                    if (!first) {
+                        write_char('|');
+                    }
+                    // Unknown bits are written as hexadecimal number, so they are not mistaken for decimal values.
+                    char buffer[16] = { '0', 'x' };
+                    const auto result = std::to_chars(buffer + 2, buffer + sizeof(buffer), enum_value, 16);
+                    write_bytes(buffer, result.ptr - buffer);
+                }
+            } break;
+
+            case TypeKind::Boolean: {
+                if (*value) {
+                    write_bytes("True", 4);
+                } else {
+                    write_bytes("False", 5);
+                }
+            } break;
+
+            case TypeKind::ByteArrayFixed:
+            case TypeKind::ByteArray: {
+                write_hex(value, value_size);
+            } break;
+
+            case TypeKind::LString: {
+                if (localized_strings) {
+                    if (value_size != sizeof(uint32_t)) {
+                        return;
+                    }
+                    const auto id = *(const uint32_t*)value;
+                    const auto string = strings ? strings->find(static_cast<const TypeLString*>(type)->table_type, id) : LocalizedString{};
+                    if (string.data) {
+                        write_string(string.data, string.count);
+                    } else {
+                        write_number(id);
+                    }
+                    return;
+                }
+                write_string((const char*)value, strnlen((const char*)value, value_size));
+            } break;
+
+            case TypeKind::ZString: {
+                write_string((const char*)value, strnlen((const char*)value, value_size));
+            } break;
+
+            case TypeKind::FormIDArray: {
+                for (size_t i = 0; i + sizeof(FormID) <= value_size; i += sizeof(FormID)) {
+                    if (i != 0) {
+                        write_char(' ');
+                    }
+                    write_formid(*(const FormID*)(value + i));
+                }
+            } break;
+
+            default: {
+                verify(false);
+            } break;
+        }
+    }
+};
+
+// Consecutive records and groups of file, formatted by one thread.
+struct TableUnit {
+    const uint8_t* start = nullptr;
+    const uint8_t* end = nullptr;
+    Array<uint8_t> output; // Filled by worker thread.
+    size_t record_count = 0;
+    size_t row_count = 0;
+};
+
+struct TableExporter {
+    ProgramOptions options = ProgramOptions::None;
+    StaticArray<uint8_t> file;
+    const StringTables* strings = nullptr;
+    RecordType record_type = (RecordType)0;
+    RecordFieldType field_type = (RecordFieldType)0;
+    char separator = ',';
+    bool localized = false;
+    TableLayout layout;
+    Array<TableUnit> units{ tmpalloc };
+    EspTableStats stats;
+
+    void init(RecordType record_type, RecordFieldType field_type) {
+        this->record_type = record_type;
+        this->field_type = field_type;
+
+        const auto def = get_record_def(record_type);
+        if (!def) {
+            exit_error(L"record type \"%.4S\" is not defined", (const char*)&record_type);
+        }
+
+        auto field_def = def->get_value_field_def(field_type);
+        if (!field_def) {
+            field_def = Record_Common.get_value_field_def(field_type);
+        }
+        if (!field_def) {
+            exit_error(L"field \"%.4S\" is not defined for record type \"%.4S\"", (const char*)&field_type, (const char*)&record_type);
+        }
+
+        char field_name[5]{};
+        memcpy(field_name, &field_type, 4);
+        if (!add_columns(&layout, field_def->data_type, field_def->data_type->kind == TypeKind::Struct ? nullptr : join_column_name(nullptr, field_name, 4), 0, true)) {
+            exit_error(L"field \"%.4S\" of \"%.4S\" can't be exported as table, it's not struct of numbers, Form IDs, enums and strings", (const char*)&field_type, (const char*)&record_type);
+        }
+        stats.column_count = 2 + layout.columns.count;
+
+        verify(file.count >= sizeof(RawRecord));
+        const auto tes4 = (const RawRecord*)file.data;
+        verify(tes4->type == RecordType::TES4);
+        localized = is_bit_set(tes4->flags, RecordFlags::TES4_Localized);
+    }
+
+    void dispose() {
+        for (auto& unit : units) {
+            unit.output.free();
+        }
+    }
+
+    // Records of most types are stored in top-level group labeled with their type, other top-level groups are
+    // skipped. Records which are stored in groups of other records (e.g. REFR in CELL) are looked up in all groups.
+    void add_top_level_units(size_t max_unit_size) {
+        bool has_own_group = false;
+        for (const uint8_t* now = file.data; now < file.data + file.count;) {
+            verify(now + sizeof(RawRecord) <= file.data + file.count);
+            const auto record = (const RawRecord*)now;
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                verify(group->group_size >= sizeof(RawGrupRecord));
+                has_own_group |= group->group_type == RecordGroupType::Top && group->label == (uint32_t)record_type;
+                now += group->group_size;
+            } else {
+                now += sizeof(RawRecord) + record->data_size;
+            }
+        }
+
+        for (const uint8_t* now = file.data; now < file.data + file.count;) {
+            const auto record = (const RawRecord*)now;
+            size_t size = sizeof(RawRecord) + record->data_size;
+            bool selected = record->type == record_type;
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                size = group->group_size;
+                selected = !has_own_group || group->label == (uint32_t)record_type;
+            }
+
+            if (selected) {
+                split_plugin_units(now, now + size, max_unit_size, [this](const uint8_t* start, const uint8_t* end, StaticArray<const RawGrupRecord*>) {
+                    TableUnit unit;
+                    unit.start = start;
+                    unit.end = end;
+                    units.push(unit);
+                });
+            }
+            now += size;
+        }
+    }
+
+    // Called from worker threads, writes only to specified unit.
+    void write_unit(TableUnit* unit, Array<uint8_t>* uncompressed, Array<uint8_t>* filtered) {
+        PROFILE_SCOPE(RecordWalk, unit->end - unit->start);
+
+        TableRowWriter writer;
+        writer.output = &unit->output;
+        writer.separator = separator;
+        writer.localized_strings = localized;
+        writer.strings = strings;
+
+        const uint8_t* now = unit->start;
+        while (now < unit->end) {
+            const auto record = (const RawRecord*)now;
+            if (record->type == RecordType::GRUP) {
+                now += sizeof(RawGrupRecord);
+                continue;
+            }
+
+            now += sizeof(RawRecord) + record->data_size;
+            if (record->type != record_type) {
+                continue;
+            }
+            ++unit->record_count;
+
+            const uint8_t* data = (const uint8_t*)(record + 1);
+            size_t size = record->data_size;
+            if (record->is_compressed()) {
+                const auto compressed = (const RawRecordCompressed*)record;
+                size = compressed->uncompressed_data_size;
+                grow(uncompressed, (int)size);
+
+                PROFILE_SCOPE(ZLibInflate, size);
+                const auto result = ::zng_uncompress(uncompressed->data, &size, (const uint8_t*)(compressed + 1), record->data_size - sizeof(compressed->uncompressed_data_size));
+                verify(result == Z_OK);
+                data = uncompressed->data;
+            }
+
+            const char* editor_id = nullptr;
+            size_t editor_id_length = 0;
+            for (const uint8_t* field_now = data; field_now < data + size;) {
+                const auto field = (const RawRecordField*)field_now;
+                verify(field_now + sizeof(RawRecordField) + field->size <= data + size);
+                if (field->type == RecordFieldType::EDID) {
+                    editor_id = (const char*)(field + 1);
+                    editor_id_length = strnlen(editor_id, field->size);
+                    break;
+                }
+                field_now += sizeof(RawRecordField) + field->size;
+            }
+
+            for (const uint8_t* field_now = data; field_now < data + size;) {
+                const auto field = (const RawRecordField*)field_now;
+                field_now += sizeof(RawRecordField) + field->size;
+                if (field->type != field_type) {
+                    continue;
+                }
+
+                const uint8_t* value = (const uint8_t*)(field + 1);
+                if (layout.filters.count && !is_bit_set(options, ProgramOptions::PreserveJunk)) {
+                    filtered->count = 0;
+                    grow(filtered, field->size);
+                    memcpy(filtered->data, value, field->size);
+                    for (const auto& filter : layout.filters) {
+                        if (filter.offset + filter.type->size <= field->size) {
+                            filter.type->preprocess(filtered->data + filter.offset, filter.type->size ? filter.type->size : field->size - filter.offset);
+                        }
+                    }
+                    value = filtered->data;
+                }
+
+                writer.write_formid(record->id);
+                writer.write_char(separator);
+                writer.write_string(editor_id ? editor_id : "", editor_id_length);
+                for (const auto& column : layout.columns) {
+                    writer.write_char(separator);
+                    writer.write_value(column, value, field->size);
+                }
+                writer.write_char('\n');
+                ++unit->row_count;
+            }
+        }
+    }
+
+    void write_units() {
+        add_top_level_units(get_max_unit_size(file.count));
+
+        WorkCounter counter{ units.count };
+        run_on_threads(get_thread_count(units.count), [&]() {
+            Array<uint8_t> uncompressed; // Buffers for records of this thread.
+            Array<uint8_t> filtered;
+            for (;;) {
+                const int unit_index = counter.take();
+                if (unit_index == -1) {
+                    break;
+                }
+                write_unit(&units.data[unit_index], &uncompressed, &filtered);
+            }
+            uncompressed.free();
+            filtered.free();
+        });
+
+        for (const auto& unit : units) {
+            stats.record_count += unit.record_count;
+            stats.row_count += unit.row_count;
+        }
+    }
+
+    void write_table(const wchar_t* table_path) {
+        Array<uint8_t> header;
+        defer(header.free());
+
+        TableRowWriter writer;
+        writer.output = &header;
+        writer.separator = separator;
+        writer.write_string("Form ID", 7);
+        writer.write_char(separator);
+        writer.write_string("Editor ID", 9);
+        for (const auto& column : layout.columns) {
+            writer.write_char(separator);
+            writer.write_string(column.name, strlen(column.name));
+        }
+        writer.write_char('\n');
+
+        PROFILE_SCOPE(FileWrite, 0);
+        if (!table_path) {
+            fwrite(header.data, 1, header.count, stdout);
+            for (const auto& unit : units) {
+                fwrite(unit.output.data, 1, unit.output.count, stdout);
+            }
+            return;
+        }
+
+        // Units are concatenated in file order.
+        size_t size = header.count;
+        for (const auto& unit : units) {
+            size += unit.output.count;
+        }
+
+        const auto table = (uint8_t*)memalloc(stdalloc, size);
+        defer(memdelete(stdalloc, table));
+
+        auto now = table;
+        memcpy(now, header.data, header.count);
+        now += header.count;
+        for (const auto& unit : units) {
+            memcpy(now, unit.output.data, unit.output.count);
+            now += unit.output.count;
+        }
+        write_file(table_path, { table, size });
+    }
+};
+
+EspTableStats export_table(ProgramOptions options, const StaticArray<uint8_t> file, const StringTables* strings, RecordType record_type, RecordFieldType field_type, char separator, const wchar_t* table_path) {
+    TableExporter exporter;
+    exporter.options = options;
+    exporter.file = file;
+    exporter.strings = strings;
+    exporter.separator = separator;
+    exporter.init(record_type, field_type);
+    defer(exporter.dispose());
+
+    exporter.write_units();
+    exporter.write_table(table_path);
+    return exporter.stats;
+}
+
+char get_table_separator(const wchar_t* table_path) {
+    const auto extension_index = table_path ? string_last_index_of(table_path, '.') : -1;
+    return extension_index != -1 && string_equals(&table_path[extension_index], L".tsv") ? '\t' : ',';
+}
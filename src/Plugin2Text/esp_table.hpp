@@ -0,0 +1,21 @@
+#pragma once
+#include "esp_parser.hpp"
+#include "string_table.hpp"
+
+struct EspTableStats {
+    size_t record_count = 0; // Records of exported type.
+    size_t row_count = 0;
+    size_t column_count = 0;
+};
+
+// Writes values of "field_type" fields of "record_type" records as table, one row per field. Columns are Form ID
+// and editor ID of record, followed by members of field struct, nested structs are flattened into columns named
+// "<struct>.<member>". Values are separated with "separator" (',' for CSV or '\t' for TSV), values that contain
+// separator, quotes or line breaks are quoted. Set flags are written as names separated with "|", flag bits without
+// name as hexadecimal number with "0x" prefix. If "table_path" is null, table is written to stdout. Groups are
+// split into parts that are formatted in parallel, rows are written in the same order as records in plugin.
+// "strings" may be null, then LString fields of localized plugin are written as string IDs.
+EspTableStats export_table(ProgramOptions options, const StaticArray<uint8_t> file, const StringTables* strings, RecordType record_type, RecordFieldType field_type, char separator, const wchar_t* table_path);
+
+// Returns '\t' if "table_path" has TSV extension, ',' otherwise, including when table is written to stdout ("table_path" is null).
+char get_table_separator(const wchar_t* table_path);
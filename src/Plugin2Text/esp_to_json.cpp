@@ -0,0 +1,1268 @@
+#include "esp_to_json.hpp"
+#include "parallel.hpp"
+#include "array.hpp"
+#include "os.hpp"
+#include "profiler.hpp"
+#include <stdio.h>
+#include <math.h>
+#include <zlib-ng.h>
+#include <charconv>
+#include <type_traits>
+#include <new>
+
+// Size of arena of each worker thread. Only one parsed VMAD field is kept in it at a time.
+static constexpr size_t WorkerArenaSize = 16 * 1024 * 1024;
+
+void JsonRecordWriter::dispose() {
+    fields.free();
+}
+
+void JsonRecordWriter::write_bytes(const void* data, size_t size) {
+    grow(output, (int)size);
+    memcpy(output->data + output->count, data, size);
+    output->count += (int)size;
+}
+
+void JsonRecordWriter::write_char(char c) {
+    output->push((uint8_t)c);
+}
+
+void JsonRecordWriter::write_separator() {
+    if (output->count == 0) {
+        return;
+    }
+    const auto last = output->data[output->count - 1];
+    if (last != '{' && last != '[' && last != ':' && last != '\n') {
+        write_char(',');
+    }
+}
+
+void JsonRecordWriter::write_key(const char* name, size_t length) {
+    write_separator();
+    write_string(name, length);
+    write_char(':');
+}
+
+void JsonRecordWriter::write_key(const char* name) {
+    write_key(name, strlen(name));
+}
+
+// Returns length of valid UTF-8 sequence that starts at "now", or 0 if there is none.
+static size_t get_utf8_sequence_length(const uint8_t* now, const uint8_t* end) {
+    const auto remaining = (size_t)(end - now);
+    const auto c = now[0];
+    auto is_continuation = [&](size_t i, uint8_t min = 0x80, uint8_t max = 0xBF) {
+        return i < remaining && now[i] >= min && now[i] <= max;
+    };
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        return is_continuation(1) ? 2 : 0;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        const uint8_t min = c == 0xE0 ? 0xA0 : 0x80;
+        const uint8_t max = c == 0xED ? 0x9F : 0xBF;
+        return is_continuation(1, min, max) && is_continuation(2) ? 3 : 0;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        const uint8_t min = c == 0xF0 ? 0x90 : 0x80;
+        const uint8_t max = c == 0xF4 ? 0x8F : 0xBF;
+        return is_continuation(1, min, max) && is_continuation(2) && is_continuation(3) ? 4 : 0;
+    }
+    return 0;
+}
+
+// Code points of Windows-1252 characters 0x80 - 0x9F, undefined characters are mapped to C1 controls.
+static const uint16_t Windows1252_C1[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+// Plugin strings are usually Windows-1252, but some plugins and string tables store UTF-8. Bytes that form
+// valid UTF-8 sequences are copied as is, other bytes >= 128 are converted from Windows-1252.
+void JsonRecordWriter::write_string(const char* text, size_t count) {
+    auto now = text;
+    const auto end = text + count;
+
+    write_char('"');
+    while (true) {
+        const auto special = find_special_char(now, end, '"', '\\');
+        write_bytes(now, special - now);
+        now = special;
+        if (now == end) {
+            break;
+        }
+
+        const auto c = (uint8_t)*now;
+        if (c >= 128) {
+            const auto length = get_utf8_sequence_length((const uint8_t*)now, (const uint8_t*)end);
+            if (length) {
+                write_bytes(now, length);
+                now += length;
+                continue;
+            }
+
+            const uint32_t code_point = c < 0xA0 ? Windows1252_C1[c - 0x80] : c;
+            if (code_point < 0x800) {
+                write_char((char)(0xC0 | (code_point >> 6)));
+                write_char((char)(0x80 | (code_point & 0x3F)));
+            } else {
+                write_char((char)(0xE0 | (code_point >> 12)));
+                write_char((char)(0x80 | ((code_point >> 6) & 0x3F)));
+                write_char((char)(0x80 | (code_point & 0x3F)));
+            }
+        } else if (c == '"') {
+            write_literal("\\\"");
+        } else if (c == '\\') {
+            write_literal("\\\\");
+        } else if (c == '\n') {
+            write_literal("\\n");
+        } else if (c == '\r') {
+            write_literal("\\r");
+        } else if (c == '\t') {
+            write_literal("\\t");
+        } else {
+            char escaped[6] = { '\\', 'u', '0', '0' };
+            format_hex_bytes(escaped + 4, &c, 1);
+            write_bytes(escaped, sizeof(escaped));
+        }
+        ++now;
+    }
+    write_char('"');
+}
+
+void JsonRecordWriter::write_string(const char* str) {
+    write_string(str, strlen(str));
+}
+
+void JsonRecordWriter::write_wstring(const WString* wstr) {
+    write_string(wstr->data, wstr->count);
+}
+
+// Formats number straight into output buffer. Floats are written in shortest form that is parsed back to the
+// same value, NaN and infinity are not allowed in JSON and are written as strings.
+template<typename T>
+static void write_number(Array<uint8_t>* output, T value) {
+    constexpr int MaxNumberLength = 32;
+    grow(output, MaxNumberLength + 2);
+    auto now = (char*)output->data + output->count;
+
+    bool quoted = false;
+    if constexpr (std::is_floating_point_v<T>) {
+        quoted = !isfinite(value);
+    }
+    if (quoted) {
+        *now++ = '"';
+    }
+    const auto result = std::to_chars(now, now + MaxNumberLength, value);
+    verify(result.ec == std::errc{});
+    now = result.ptr;
+    if (quoted) {
+        *now++ = '"';
+    }
+    output->count = (int)((uint8_t*)now - output->data);
+}
+
+void JsonRecordWriter::write_float(float value) {
+    write_number(output, value);
+}
+
+void JsonRecordWriter::write_int32(int value) {
+    write_number(output, value);
+}
+
+void JsonRecordWriter::write_formid(FormID formid) {
+    char buffer[1 + 8 + 1]; // "DEADBEEF"
+    buffer[0] = '"';
+    format_hex_uint32(buffer + 1, formid.value);
+    buffer[9] = '"';
+    write_bytes(buffer, sizeof(buffer));
+}
+
+void JsonRecordWriter::write_byte_array(const uint8_t* data, size_t size) {
+    PROFILE_SCOPE(ByteArrayCoding, size);
+
+    grow(output, (int)(size * 2 + 2));
+    auto now = (char*)output->data + output->count;
+    *now++ = '"';
+    now = format_hex_bytes(now, data, size);
+    *now++ = '"';
+    output->count = (int)((uint8_t*)now - output->data);
+}
+
+static inline void fix_negative_zero(float* value) {
+    if (*(uint32_t*)value == 0x80000000) {
+        // Clear negative zero.
+        *(uint32_t*)value = 0;
+    }
+}
+
+static const RecordFieldDefBase* find_field_def(const RecordDef* def, RecordFieldType type) {
+    auto field_def = def->get_field_def(type);
+    if (!field_def) {
+        field_def = Record_Common.get_field_def(type);
+    }
+    return field_def;
+}
+
+void JsonRecordWriter::write_record(const RawRecord* record, const uint8_t* data, size_t size, FormID parent) {
+    current_record_type = record->type;
+
+    write_literal("{\"type\":");
+    write_string((const char*)&record->type, 4);
+    write_key("id");
+    write_formid(record->id);
+    if (parent.value) {
+        write_key("parent");
+        write_formid(parent);
+    }
+    if (record->version != 44) {
+        write_key("version");
+        write_int32(record->version);
+    }
+
+    auto def = get_record_def(record->type);
+    if (record->flags != RecordFlags::None) {
+        write_key("flags");
+        write_char('[');
+        write_flags(record->flags, def);
+        write_char(']');
+    }
+
+    if (record->timestamp && is_bit_set(options, ProgramOptions::ExportTimestamp)) {
+        int y = (record->timestamp & 0b1111111'0000'00000) >> 9;
+        int m = (record->timestamp & 0b0000000'1111'00000) >> 5;
+        int d = (record->timestamp & 0b0000000'0000'11111);
+        verify(m >= 1 && m <= 12);
+
+        char buffer[32];
+        const auto count = snprintf(buffer, sizeof(buffer), "%d %s 20%d", d, month_to_short_string(m), y);
+        verify(count > 0);
+        write_key("timestamp");
+        write_string(buffer, count);
+    }
+
+    if (record->unknown) {
+        write_key("unknown");
+        write_int32(record->unknown);
+    }
+
+    if (!def) {
+        def = &Record_Common;
+    }
+
+    fields.count = 0;
+    for (const uint8_t* now = data; now < data + size;) {
+        const auto field = (const RawRecordField*)now;
+        verify(now + sizeof(RawRecordField) + field->size <= data + size);
+        fields.push(field);
+        now += sizeof(RawRecordField) + field->size;
+    }
+
+    // Fields are written in the same blocks as in text format: field that starts subrecord is followed by
+    // fields of subrecord, their types are taken from subrecord definition.
+    write_key("fields");
+    write_char('[');
+    for (int i = 0; i < fields.count;) {
+        const auto field_def = find_field_def(def, fields.data[i]->type);
+        if (!field_def || field_def->def_type == RecordFieldDefType::Field) {
+            write_field(fields.data[i++], static_cast<const RecordFieldDef*>(field_def));
+            continue;
+        }
+
+        verify(field_def->def_type == RecordFieldDefType::Subrecord);
+        const auto subrecord_field_def = static_cast<const RecordFieldDefSubrecord*>(field_def);
+        for (size_t j = 0; j < subrecord_field_def->fields.count && i < fields.count; ++j) {
+            const auto inner_field_def = (const RecordFieldDef*)subrecord_field_def->fields.data[j];
+            verify(inner_field_def->def_type == RecordFieldDefType::Field);
+
+            const auto field = fields.data[i++];
+            if (inner_field_def->data_type->kind != TypeKind::Constant) {
+                write_field(field, inner_field_def);
+            }
+        }
+    }
+    write_literal("]}\n");
+}
+
+void JsonRecordWriter::write_flags(RecordFlags flags, const RecordDef* def) {
+    for (const auto flags_def : { def, (const RecordDef*)&Record_Common }) {
+        if (!flags_def) {
+            continue;
+        }
+        for (size_t i = 0; i < flags_def->flags.count; ++i) {
+            const auto& flag = flags_def->flags.data[i];
+            if (is_bit_set(flags, flag.bit)) {
+                write_separator();
+                write_string(flag.name, flag.name_length);
+                flags = clear_bit(flags, flag.bit);
+            }
+        }
+    }
+
+    if (flags != RecordFlags::None) {
+        write_separator();
+        write_number(output, (uint32_t)flags);
+    }
+}
+
+void JsonRecordWriter::write_field(const RawRecordField* field, const RecordFieldDef* field_def) {
+    write_separator();
+    write_literal("{\"type\":");
+    write_string((const char*)&field->type, 4);
+    write_key("value");
+
+    const auto data_type = field_def ? field_def->data_type : &Type_ByteArray;
+    write_type(data_type, field + 1, field->size);
+    write_char('}');
+}
+
+void JsonRecordWriter::write_custom_field(const char* field_name, const Type* type, const void* value, size_t size) {
+    write_key(field_name);
+    write_type(type, value, size);
+}
+
+void JsonRecordWriter::write_type(const Type* type, const void* value, size_t size) {
+    write_separator();
+
+    switch (type->kind) {
+        case TypeKind::ZString: {
+            zstring:
+            if (size == 0) {
+                write_literal("\"\"");
+            } else {
+                write_string((const char*)value, size - 1);
+            }
+        } break;
+
+        case TypeKind::LString: {
+            if (!localized_strings) {
+                goto zstring;
+            }
+
+            verify(size == sizeof(uint32_t));
+            const auto id = *(const uint32_t*)value;
+            write_literal("{\"id\":");
+            write_number(output, id);
+
+            const auto string = strings ? strings->find(static_cast<const TypeLString*>(type)->table_type, id) : LocalizedString{};
+            if (string.data) {
+                write_key("string");
+                write_string(string.data, string.count);
+            }
+            write_char('}');
+        } break;
+
+        case TypeKind::WString: {
+            write_wstring((const WString*)value);
+        } break;
+
+        // Compression and RLE only make text format shorter, JSON consumers get plain bytes.
+        case TypeKind::ByteArray:
+        case TypeKind::ByteArrayCompressed:
+        case TypeKind::ByteArrayRLE: {
+            write_byte_array((const uint8_t*)value, size);
+        } break;
+
+        case TypeKind::ByteArrayFixed: {
+            verify(type->size == size);
+            write_byte_array((const uint8_t*)value, size);
+        } break;
+
+        case TypeKind::Integer: {
+            verify(type->size == size);
+            auto integer_type = (const TypeInteger*)type;
+            if (integer_type->is_unsigned) {
+                switch (size) {
+                    case 1: write_number(output, *(const uint8_t*)value); break;
+                    case 2: write_number(output, *(const uint16_t*)value); break;
+                    case 4: write_number(output, *(const uint32_t*)value); break;
+                    case 8: write_number(output, *(const uint64_t*)value); break;
+                }
+            } else {
+                switch (size) {
+                    case 1: write_number(output, *(const int8_t*)value); break;
+                    case 2: write_number(output, *(const int16_t*)value); break;
+                    case 4: write_number(output, *(const int32_t*)value); break;
+                    case 8: write_number(output, *(const int64_t*)value); break;
+                }
+            }
+        } break;
+
+        case TypeKind::Float: {
+            verify(type->size == size);
+            switch (size) {
+                case sizeof(float): write_number(output, *(const float*)value); break;
+                case sizeof(double): write_number(output, *(const double*)value); break;
+            }
+        } break;
+
+        case TypeKind::Struct: {
+            verify(type->size == size);
+            auto struct_type = (const TypeStruct*)type;
+            size_t offset = 0;
+            write_char('{');
+            for (int i = 0; i < struct_type->field_count; ++i) {
+                const auto value_in_struct = (const uint8_t*)value + offset;
+
+                const auto& field = struct_type->fields[i];
+                auto field_type = field.type;
+
+                if (field_type->kind == TypeKind::Constant) {
+                    const auto constant_type = static_cast<const TypeConstant*>(field_type);
+                    if (memory_equals(constant_type->bytes, value_in_struct, field_type->size)) {
+                        offset += field_type->size;
+                        continue;
+                    }
+
+                    field_type = constant_type->fallback;
+                    verify(field_type); // No fallback!
+                }
+
+                write_key(field.name, field.name_length);
+                write_type(field_type, value_in_struct, field_type->size);
+                offset += field_type->size;
+            }
+            verify(offset == size);
+            write_char('}');
+        } break;
+
+        case TypeKind::FormID: {
+            verify(type->size == size);
+            verify(size == sizeof(FormID));
+            write_formid(*(const FormID*)value);
+        } break;
+
+        case TypeKind::FormIDArray: {
+            verify((size % sizeof(FormID)) == 0);
+            write_char('[');
+            for (size_t i = 0; i < size / sizeof(FormID); ++i) {
+                write_separator();
+                write_formid(((const FormID*)value)[i]);
+            }
+            write_char(']');
+        } break;
+
+        case TypeKind::Enum: {
+            verify(type->size == size);
+            const auto enum_type = (const TypeEnum*)type;
+
+            uint32_t enum_value = 0;
+            switch (size) {
+                case 1: enum_value = *(const uint8_t*)value; break;
+                case 2: enum_value = *(const uint16_t*)value; break;
+                case 4: enum_value = *(const uint32_t*)value; break;
+                default: verify(false); break;
+            }
+
+            if (enum_type->flags) {
+                // Flags are array of names, unknown bits are written as number.
+                write_char('[');
+                for (size_t i = 0; i < enum_type->field_count && enum_value; ++i) {
+                    const auto& field = enum_type->fields[i];
+                    if (enum_value & field.value) {
+                        write_separator();
+                        write_string(field.name, field.name_length);
+                        enum_value = clear_bit(enum_value, field.value);
+                    }
+                }
+                if (enum_value) {
+                    write_separator();
+                    write_number(output, enum_value);
+                }
+                write_char(']');
+            } else {
+                const auto field = enum_type->get_field_by_value(enum_value);
+                if (field) {
+                    write_string(field->name, field->name_length);
+                } else {
+                    write_number(output, enum_value);
+                }
+            }
+        } break;
+
+        case TypeKind::Boolean: {
+            verify(type->size == sizeof(bool));
+            if (*(const bool*)value) {
+                write_literal("true");
+            } else {
+                write_literal("false");
+            }
+        } break;
+
+        case TypeKind::VMAD: {
+            write_vmad((const uint8_t*)value, size);
+        } break;
+
+        case TypeKind::Constant: {
+            // Value of constant field is always the same, it's written only to keep field in output.
+            verify(type->size == size);
+            write_byte_array((const uint8_t*)value, size);
+        } break;
+
+        case TypeKind::Filter: {
+            const auto filter_type = (const TypeFilter*)type;
+            if (is_bit_set(options, ProgramOptions::PreserveJunk)) {
+                write_type(filter_type->inner_type, value, size);
+                break;
+            }
+
+            uint8_t buffer[256];
+            const auto preprocessed_value = size <= sizeof(buffer) ? buffer : (uint8_t*)memalloc(stdalloc, size);
+            defer(if (preprocessed_value != buffer) memdelete(stdalloc, preprocessed_value));
+
+            memcpy(preprocessed_value, value, size);
+            filter_type->preprocess(preprocessed_value, size);
+            write_type(filter_type->inner_type, preprocessed_value, size);
+        } break;
+
+        case TypeKind::Vector3: {
+            verify(size == sizeof(Vector3));
+            auto vector = *(const Vector3*)value;
+            fix_negative_zero(&vector.x);
+            fix_negative_zero(&vector.y);
+            fix_negative_zero(&vector.z);
+            write_char('[');
+            write_float(vector.x);
+            write_char(',');
+            write_float(vector.y);
+            write_char(',');
+            write_float(vector.z);
+            write_char(']');
+        } break;
+
+        case TypeKind::NVPP: {
+            write_nvpp((const uint8_t*)value, size);
+        } break;
+
+        case TypeKind::VTXT: {
+            struct VTXT_Point {
+                uint16_t position;
+                uint8_t unk0;
+                uint8_t unk1;
+                float opacity;
+            };
+            static_assert(sizeof(VTXT_Point) == 8, "invalid VTXT_Point size");
+
+            const auto points = (const VTXT_Point*)value;
+            verify((size % sizeof(VTXT_Point)) == 0);
+
+            write_char('[');
+            for (size_t i = 0; i < size / sizeof(VTXT_Point); ++i) {
+                const auto& point = points[i];
+                write_separator();
+                write_char('{');
+                write_custom_field("Position", point.position);
+                write_custom_field("Unk0", point.unk0);
+                write_custom_field("Unk1", point.unk1);
+                write_custom_field("Opacity", point.opacity);
+                write_char('}');
+            }
+            write_char(']');
+        } break;
+
+        case TypeKind::XCLW: {
+            verify(size == sizeof(float));
+            switch (*(const uint32_t*)value) {
+                case 0x7F7FFFFF: write_literal("\"No Water\""); break;
+                case 0x4F7FFFC9: write_literal("\"No Water (0x4F7FFFC9)\""); break;
+                case 0xCF000000: write_literal("\"No Water (0xCF000000)\""); break;
+                default: write_float(*(const float*)value); break;
+            }
+        } break;
+
+        case TypeKind::CTDA: {
+            write_ctda((const uint8_t*)value, size);
+        } break;
+
+        case TypeKind::VHGT: {
+            if (size != sizeof(VHGT_Field)) {
+                write_byte_array((const uint8_t*)value, size);
+                break;
+            }
+
+            const auto vhgt = (const VHGT_Field*)value;
+            write_char('{');
+            write_custom_field("Offset", vhgt->offset);
+            write_key("Gradients");
+            write_char('[');
+            for (const auto& row : vhgt->gradients) {
+                write_separator();
+                write_char('[');
+                for (const auto gradient : row) {
+                    write_separator();
+                    write_int32(gradient);
+                }
+                write_char(']');
+            }
+            write_char(']');
+            write_key("Unused");
+            write_byte_array(vhgt->unused, sizeof(vhgt->unused));
+            write_char('}');
+        } break;
+
+        case TypeKind::VNML: {
+            if (size != sizeof(VNML_Field)) {
+                write_byte_array((const uint8_t*)value, size);
+                break;
+            }
+
+            const auto vnml = (const VNML_Field*)value;
+            write_char('{');
+            write_key("Normals");
+            write_char('[');
+            for (const auto& row : vnml->normals) {
+                write_separator();
+                write_char('[');
+                for (const auto& normal : row) {
+                    write_separator();
+                    write_char('[');
+                    write_int32(normal[0]);
+                    write_char(',');
+                    write_int32(normal[1]);
+                    write_char(',');
+                    write_int32(normal[2]);
+                    write_char(']');
+                }
+                write_char(']');
+            }
+            write_char(']');
+            write_char('}');
+        } break;
+
+        case TypeKind::NVNM: {
+            NVNM_Field nvnm;
+            if (!nvnm.parse((const uint8_t*)value, size)) {
+                write_byte_array((const uint8_t*)value, size);
+                break;
+            }
+            write_nvnm(nvnm);
+        } break;
+
+        default: {
+            verify(false);
+        } break;
+    }
+}
+
+void JsonRecordWriter::write_papyrus_value(const VMAD_Field& vmad, const VMAD_ScriptPropertyValue& value, PapyrusPropertyType type) {
+    verify(vmad.object_format == 2);
+
+    switch (type) {
+        case PapyrusPropertyType::Object: {
+            write_separator();
+            write_char('{');
+            write_custom_field("Form ID", value.as_object.form_id);
+            write_custom_field("Alias", value.as_object.alias);
+            write_char('}');
+        } break;
+
+        case PapyrusPropertyType::String: {
+            write_type(resolve_type<WString>(), value.as_string, sizeof(WString));
+        } break;
+
+        case PapyrusPropertyType::Int: {
+            write_type(resolve_type<int32_t>(), &value.as_int, sizeof(value.as_int));
+        } break;
+
+        case PapyrusPropertyType::Float: {
+            write_type(resolve_type<float>(), &value.as_float, sizeof(value.as_float));
+        } break;
+
+        case PapyrusPropertyType::Bool: {
+            write_type(resolve_type<bool>(), &value.as_bool, sizeof(value.as_bool));
+        } break;
+
+        case PapyrusPropertyType::ObjectArray:
+        case PapyrusPropertyType::StringArray:
+        case PapyrusPropertyType::IntArray:
+        case PapyrusPropertyType::FloatArray:
+        case PapyrusPropertyType::BoolArray: {
+            write_separator();
+            write_char('[');
+            const auto inner_type = (PapyrusPropertyType)((uint32_t)type - 10);
+            for (uint32_t i = 0; i < value.as_array.count; ++i) {
+                write_papyrus_value(vmad, value.as_array.values[i], inner_type);
+            }
+            write_char(']');
+        } break;
+
+        default: {
+            verify(false);
+        } break;
+    }
+}
+
+void JsonRecordWriter::write_papyrus_scripts(const VMAD_Field& vmad, const Array<VMAD_Script>& scripts) {
+    write_key("Scripts");
+    write_char('[');
+    for (const auto& script : scripts) {
+        write_separator();
+        write_char('{');
+        write_custom_field("Name", script.name);
+
+        if (vmad.version >= 4) {
+            write_custom_field("Status", script.status);
+        }
+
+        write_key("Properties");
+        write_char('[');
+        for (const auto& property : script.properties) {
+            write_separator();
+            write_char('{');
+            write_custom_field("Name", property.name);
+
+            if (vmad.version >= 4) {
+                write_custom_field("Status", property.status);
+            }
+
+            const auto type_field = Type_PapyrusPropertyType.get_field_by_value((uint32_t)property.type);
+            verify(type_field);
+            write_key(type_field->name, type_field->name_length);
+            write_papyrus_value(vmad, property.value, property.type);
+            write_char('}');
+        }
+        write_char(']');
+        write_char('}');
+    }
+    write_char(']');
+}
+
+void JsonRecordWriter::write_papyrus_info_record_fragment(const char* name, const VMAD_INFO_Fragment& fragment) {
+    write_key(name);
+    write_char('{');
+    write_custom_field("Script Name", fragment.script_name);
+    write_custom_field("Fragment Name", fragment.fragment_name);
+    write_char('}');
+}
+
+void JsonRecordWriter::write_papyrus_scen_record_fragment(const char* name, const VMAD_SCEN_BeginEndFragment& fragment) {
+    write_key(name);
+    write_char('{');
+    write_custom_field("Unknown", fragment.unk);
+    write_custom_field("Script Name", fragment.script_name);
+    write_custom_field("Fragment Name", fragment.fragment_name);
+    write_char('}');
+}
+
+void JsonRecordWriter::write_vmad(const uint8_t* value, size_t size) {
+    verify(arena);
+    const auto arena_start = arena->now;
+    defer(arena->now = arena_start);
+
+    VMAD_Field vmad;
+    vmad.parse(*arena, value, size, current_record_type, is_bit_set(options, ProgramOptions::PreserveOrder));
+
+    write_char('{');
+    write_custom_field("Version", vmad.version);
+    write_custom_field("Object Format", vmad.object_format);
+    write_papyrus_scripts(vmad, vmad.scripts);
+
+    if (vmad.contains_record_specific_info) {
+        switch (current_record_type) {
+            case RecordType::INFO: {
+                write_custom_field("Fragment Script File Name", vmad.info.script_name);
+
+                if (is_bit_set(vmad.info.flags, PapyrusFragmentFlags::HasBeginScript)) {
+                    write_papyrus_info_record_fragment("Start Fragment", vmad.info.start_fragment);
+                }
+                if (is_bit_set(vmad.info.flags, PapyrusFragmentFlags::HasEndScript)) {
+                    write_papyrus_info_record_fragment("End Fragment", vmad.info.end_fragment);
+                }
+            } break;
+
+            case RecordType::QUST: {
+                write_custom_field("File Name", vmad.qust.file_name);
+
+                write_key("Fragments");
+                write_char('[');
+                for (const auto& fragment : vmad.qust.fragments) {
+                    write_separator();
+                    write_char('{');
+                    write_custom_field("Index", fragment.index);
+                    write_custom_field("Log Entry", fragment.log_entry);
+                    write_custom_field("Script Name", fragment.script_name);
+                    write_custom_field("Function Name", fragment.function_name);
+                    write_char('}');
+                }
+                write_char(']');
+
+                write_key("Aliases");
+                write_char('[');
+                for (const auto& alias : vmad.qust.aliases) {
+                    write_separator();
+                    write_char('{');
+                    write_key("Object");
+
+                    VMAD_ScriptPropertyValue value;
+                    value.as_object = alias.object;
+                    write_papyrus_value(vmad, value, PapyrusPropertyType::Object);
+
+                    write_papyrus_scripts(vmad, alias.scripts);
+                    write_char('}');
+                }
+                write_char(']');
+            } break;
+
+            case RecordType::PACK: {
+                write_custom_field("File Name", vmad.pack.file_name);
+
+                if (is_bit_set(vmad.pack.flags, VMAD_PACK_Flags::OnBegin)) {
+                    write_papyrus_info_record_fragment("Begin Fragment", vmad.pack.begin_fragment);
+                }
+                if (is_bit_set(vmad.pack.flags, VMAD_PACK_Flags::OnEnd)) {
+                    write_papyrus_info_record_fragment("End Fragment", vmad.pack.end_fragment);
+                }
+                if (is_bit_set(vmad.pack.flags, VMAD_PACK_Flags::OnChange)) {
+                    write_papyrus_info_record_fragment("Change Fragment", vmad.pack.change_fragment);
+                }
+            } break;
+
+            case RecordType::PERK: {
+                write_custom_field("File Name", vmad.perk.file_name);
+
+                write_key("Fragments");
+                write_char('[');
+                for (const auto& fragment : vmad.perk.fragments) {
+                    write_separator();
+                    write_char('{');
+                    write_custom_field("Index", fragment.index);
+                    write_custom_field("Unknown 0", fragment.unk0);
+                    write_custom_field("Unknown 1", fragment.unk1);
+                    write_custom_field("Script Name", fragment.script_name);
+                    write_custom_field("Fragment Name", fragment.fragment_name);
+                    write_char('}');
+                }
+                write_char(']');
+            } break;
+
+            case RecordType::SCEN: {
+                write_custom_field("File Name", vmad.scen.file_name);
+
+                if (is_bit_set(vmad.scen.flags, PapyrusFragmentFlags::HasBeginScript)) {
+                    write_papyrus_scen_record_fragment("Begin Fragment", vmad.scen.begin_fragment);
+                }
+                if (is_bit_set(vmad.scen.flags, PapyrusFragmentFlags::HasEndScript)) {
+                    write_papyrus_scen_record_fragment("End Fragment", vmad.scen.end_fragment);
+                }
+
+                write_key("Fragments");
+                write_char('[');
+                for (const auto& fragment : vmad.scen.phase_fragments) {
+                    write_separator();
+                    write_char('{');
+                    write_custom_field("Unknown 0", fragment.unk0);
+                    write_custom_field("Phase", fragment.phase);
+                    write_custom_field("Unknown 1", fragment.unk1);
+                    write_custom_field("Script Name", fragment.script_name);
+                    write_custom_field("Fragment Name", fragment.fragment_name);
+                    write_char('}');
+                }
+                write_char(']');
+            } break;
+        }
+    }
+    write_char('}');
+}
+
+// Unlike "NVPP_Field::parse", reads paths and nodes straight from field data and keeps nodes in file order.
+void JsonRecordWriter::write_nvpp(const uint8_t* value, size_t size) {
+    BinaryReader r{ value, size };
+
+    write_literal("{\"Paths\":[");
+    const auto path_count = r.read<uint32_t>();
+    for (uint32_t i = 0; i < path_count; ++i) {
+        const auto formid_count = r.read<uint32_t>();
+        const auto formids = r.advance(sizeof(FormID) * formid_count);
+        write_type(&Type_FormIDArray, formids, sizeof(FormID) * formid_count);
+    }
+
+    write_literal("],\"Nodes\":[");
+    const auto node_count = r.read<uint32_t>();
+    for (uint32_t i = 0; i < node_count; ++i) {
+        const auto formid = r.read<FormID>();
+        const auto index = r.read<uint32_t>();
+        write_separator();
+        write_char('{');
+        write_custom_field("Form ID", formid);
+        write_custom_field("Index", index);
+        write_char('}');
+    }
+    write_literal("]}");
+}
+
+void JsonRecordWriter::write_ctda(const uint8_t* value, size_t size) {
+    BinaryReader r{ value, size };
+
+    const auto val = r.read<CTDA_OperatorFlagsUnion>();
+    const auto op = val.op;
+    const auto flags = val.flags;
+
+    r.advance(3); // Junk.
+
+    union ComparisonValue {
+        FormID formid;
+        float value;
+    };
+    static_assert(sizeof(ComparisonValue) == 4, "invalid ComparisonValue size");
+
+    const auto comparison_value = r.read<ComparisonValue>();
+    const auto function_index = r.read<uint16_t>();
+    verify(function_index >= 0 && function_index < _countof(CTDA_Functions));
+
+    const auto& function = CTDA_Functions[function_index];
+
+    r.advance(2); // Junk.
+
+    const auto arg1 = r.read<CTDA_Argument>();
+    const auto arg2 = r.read<CTDA_Argument>();
+
+    const auto run_on_type = r.read<CTDA_RunOnType>();
+    const auto reference = r.read<FormID>();
+    const auto unknown = r.read<int>();
+
+    write_char('{');
+    write_custom_field("Flags", flags);
+    write_custom_field("Run On Type", run_on_type);
+    write_custom_field("Unknown", unknown);
+    if (reference.value) {
+        write_custom_field("Reference", reference);
+    }
+
+    write_key("Function");
+    write_string(function.name);
+
+    write_key("Arguments");
+    write_char('[');
+    if (function.arg1 != CTDA_ArgumentType::None) {
+        write_ctda_argument(arg1, function.arg1);
+        if (function.arg2 != CTDA_ArgumentType::None) {
+            write_ctda_argument(arg2, function.arg2);
+        }
+    }
+    write_char(']');
+
+    write_key("Operator");
+    write_string(ctda_operator_string(op));
+    // Value is global variable if "Use Global" flag is set.
+    if (is_bit_set(flags, CTDA_Flags::UseGlobal)) {
+        write_custom_field("Value", comparison_value.formid);
+    } else {
+        write_custom_field("Value", comparison_value.value);
+    }
+    write_char('}');
+}
+
+void JsonRecordWriter::write_ctda_argument(const CTDA_Argument& argument, CTDA_ArgumentType type) {
+    write_separator();
+    switch (type) {
+        case CTDA_ArgumentType::FormID: {
+            write_formid(argument.formid);
+        } break;
+
+        case CTDA_ArgumentType::Int: {
+            write_int32(argument.number);
+        } break;
+
+        case CTDA_ArgumentType::ActorValue: {
+            verify(argument.number >= 0 && argument.number < _countof(ActorValues));
+            write_string(ActorValues[argument.number].name);
+        } break;
+
+        default: {
+            verify(false);
+        } break;
+    }
+}
+
+void JsonRecordWriter::write_nvnm(const NVNM_Field& nvnm) {
+    auto write_numbers = [this]<typename T>(const T* values, size_t count) {
+        write_separator();
+        write_char('[');
+        for (size_t i = 0; i < count; ++i) {
+            if (i != 0) {
+                write_char(',');
+            }
+            write_number(output, values[i]);
+        }
+        write_char(']');
+    };
+
+    write_char('{');
+    write_custom_field("Version", nvnm.version);
+    write_custom_field("CRC", nvnm.crc);
+    write_custom_field("Parent Worldspace", nvnm.worldspace);
+    if (nvnm.worldspace.value == 0) {
+        write_custom_field("Parent Cell", nvnm.cell);
+    } else {
+        write_custom_field("Grid X", nvnm.grid_x);
+        write_custom_field("Grid Y", nvnm.grid_y);
+    }
+
+    write_key("Vertices");
+    write_char('[');
+    for (const auto& vertex : nvnm.vertices) {
+        write_numbers(&vertex.x, 3);
+    }
+    write_char(']');
+
+    // Vertices, edges, flags, cover flags.
+    write_key("Triangles");
+    write_char('[');
+    for (const auto& triangle : nvnm.triangles) {
+        const int values[] = {
+            triangle.vertices[0], triangle.vertices[1], triangle.vertices[2],
+            triangle.edges[0], triangle.edges[1], triangle.edges[2],
+            triangle.flags, triangle.cover_flags,
+        };
+        write_numbers(values, _countof(values));
+    }
+    write_char(']');
+
+    write_key("Edge Links");
+    write_char('[');
+    for (const auto& link : nvnm.edge_links) {
+        write_separator();
+        write_char('{');
+        write_custom_field("Type", link.type);
+        write_custom_field("Navmesh", link.navmesh);
+        write_custom_field("Triangle", link.triangle);
+        write_char('}');
+    }
+    write_char(']');
+
+    write_key("Door Triangles");
+    write_char('[');
+    for (const auto& door : nvnm.door_triangles) {
+        write_separator();
+        write_char('{');
+        write_custom_field("Triangle", door.triangle);
+        write_custom_field("CRC", door.crc);
+        write_custom_field("Door", door.door);
+        write_char('}');
+    }
+    write_char(']');
+
+    write_key("Cover Triangles");
+    write_numbers(nvnm.cover_triangles.data, nvnm.cover_triangles.count);
+
+    write_custom_field("Grid Size", nvnm.grid_size);
+    write_custom_field("Max X Distance", nvnm.max_x_distance);
+    write_custom_field("Max Y Distance", nvnm.max_y_distance);
+    write_key("Min");
+    write_numbers(&nvnm.min.x, 3);
+    write_key("Max");
+    write_numbers(&nvnm.max.x, 3);
+
+    // Only cells that have triangles are written, as "<cell index>": <triangles>.
+    write_key("Grid Cells");
+    write_char('{');
+    BinaryReader r{ nvnm.grid_cells.data, nvnm.grid_cells.count };
+    for (uint32_t cell = 0; cell < nvnm.grid_size * nvnm.grid_size; ++cell) {
+        const auto count = r.read<uint32_t>();
+        const auto triangles = (const int16_t*)r.advance(count * sizeof(int16_t));
+        if (count == 0) {
+            continue;
+        }
+
+        char key[16];
+        const auto key_end = std::to_chars(key, key + sizeof(key), cell).ptr;
+        write_key(key, key_end - key);
+        write_numbers(triangles, count);
+    }
+    write_char('}');
+    write_char('}');
+}
+
+// Consecutive records and groups of file, formatted by one thread.
+struct JsonUnit {
+    const uint8_t* start = nullptr;
+    const uint8_t* end = nullptr;
+    FormID parent; // Owner of innermost group that contains unit.
+    Array<uint8_t> output; // Filled by worker thread.
+    size_t record_count = 0;
+    size_t compressed_count = 0;
+};
+
+static bool is_children_group(RecordGroupType type) {
+    switch (type) {
+        case RecordGroupType::WorldChildren:
+        case RecordGroupType::CellChildren:
+        case RecordGroupType::TopicChildren:
+        case RecordGroupType::CellPersistentChildren:
+        case RecordGroupType::CellTemporaryChildren:
+            return true;
+    }
+    return false;
+}
+
+struct JsonExporter {
+    ProgramOptions options = ProgramOptions::None;
+    StaticArray<uint8_t> file;
+    const StringTables* strings = nullptr;
+    bool localized_strings = false;
+    Array<JsonUnit> units{ tmpalloc };
+    std::atomic<bool>* units_done = nullptr;
+    EspJsonStats stats;
+
+    void dispose() {
+        for (auto& unit : units) {
+            unit.output.free();
+        }
+    }
+
+    // Called from worker threads, writes only to specified unit.
+    void write_unit(JsonUnit* unit, JsonRecordWriter* writer, Array<uint8_t>* uncompressed) {
+        PROFILE_SCOPE(TextFormat, unit->end - unit->start);
+
+        writer->output = &unit->output;
+
+        // Groups that were entered inside of unit, records after end of group belong to outer group.
+        struct OpenGroup {
+            const uint8_t* end = nullptr;
+            FormID parent;
+        };
+        OpenGroup groups[8];
+        int group_count = 0;
+        FormID parent = unit->parent;
+
+        const uint8_t* now = unit->start;
+        while (now < unit->end) {
+            while (group_count > 0 && now >= groups[group_count - 1].end) {
+                --group_count;
+                parent = group_count > 0 ? groups[group_count - 1].parent : unit->parent;
+            }
+
+            const auto record = (const RawRecord*)now;
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                verify(group_count < _countof(groups));
+                if (is_children_group(group->group_type)) {
+                    parent = { group->label };
+                }
+                groups[group_count++] = { now + group->group_size, parent };
+                now += sizeof(RawGrupRecord);
+                continue;
+            }
+
+            now += sizeof(RawRecord) + record->data_size;
+            ++unit->record_count;
+
+            const uint8_t* data = (const uint8_t*)(record + 1);
+            size_t size = record->data_size;
+            if (record->is_compressed()) {
+                ++unit->compressed_count;
+
+                const auto compressed = (const RawRecordCompressed*)record;
+                size = compressed->uncompressed_data_size;
+                uncompressed->count = 0;
+                grow(uncompressed, (int)size);
+
+                PROFILE_SCOPE(ZLibInflate, size);
+                const auto result = ::zng_uncompress(uncompressed->data, &size, (const uint8_t*)(compressed + 1), record->data_size - sizeof(compressed->uncompressed_data_size));
+                verify(result == Z_OK);
+                data = uncompressed->data;
+            }
+
+            writer->write_record(record, data, size, parent);
+        }
+    }
+
+    // Units are written in file order as soon as all units before them are written, so output can be consumed
+    // while the rest of plugin is formatted.
+    void write(const wchar_t* json_path) {
+        split_plugin_units(file.data, file.data + file.count, get_max_unit_size(file.count), [this](const uint8_t* start, const uint8_t* end, StaticArray<const RawGrupRecord*> groups) {
+            JsonUnit unit;
+            unit.start = start;
+            unit.end = end;
+            for (const auto group : groups) {
+                if (is_children_group(group->group_type)) {
+                    unit.parent = { group->label };
+                }
+            }
+            units.push(unit);
+        });
+
+        units_done = (std::atomic<bool>*)memalloc(tmpalloc, sizeof(std::atomic<bool>) * units.count);
+        for (int i = 0; i < units.count; ++i) {
+            new(&units_done[i]) std::atomic<bool>(false);
+        }
+
+        WorkCounter counter{ units.count };
+        const auto work = [&]() {
+            JsonRecordWriter writer;
+            writer.options = options;
+            writer.localized_strings = localized_strings;
+            writer.strings = strings;
+            defer(writer.dispose());
+
+            Array<uint8_t> uncompressed; // Buffer for records of this thread.
+            defer(uncompressed.free());
+
+            auto arena = create_linear_allocator(WorkerArenaSize);
+            defer(free_linear_allocator(&arena));
+            writer.arena = &arena;
+
+            for (;;) {
+                const int unit_index = counter.take();
+                if (unit_index == -1) {
+                    break;
+                }
+                write_unit(&units.data[unit_index], &writer, &uncompressed);
+                units_done[unit_index].store(true);
+                units_done[unit_index].notify_one();
+            }
+        };
+
+        // Main thread only writes units, so output is not delayed by unit that main thread is formatting.
+        WorkerThreads workers;
+        workers.start(get_thread_count(units.count), work);
+
+        Array<uint8_t> json;
+        defer(json.free());
+
+        for (int i = 0; i < units.count; ++i) {
+            units_done[i].wait(false);
+
+            auto& unit = units.data[i];
+            stats.record_count += unit.record_count;
+            stats.compressed_count += unit.compressed_count;
+
+            PROFILE_SCOPE(FileWrite, unit.output.count);
+            if (json_path) {
+                grow(&json, unit.output.count);
+                memcpy(json.data + json.count, unit.output.data, unit.output.count);
+                json.count += unit.output.count;
+            } else {
+                fwrite(unit.output.data, 1, unit.output.count, stdout);
+            }
+            unit.output.free();
+        }
+
+        workers.join();
+
+        if (json_path) {
+            write_file(json_path, { json.data, (size_t)json.count });
+        } else {
+            fflush(stdout);
+        }
+    }
+};
+
+EspJsonStats esp_to_json(ProgramOptions options, const StaticArray<uint8_t> file, const StringTables* strings, const wchar_t* json_path) {
+    TEMP_SCOPE();
+
+    JsonExporter exporter;
+    exporter.options = options;
+    exporter.file = file;
+    exporter.strings = strings;
+    defer(exporter.dispose());
+
+    {
+        verify(file.count >= sizeof(RawRecord));
+        const auto tes4 = (const RawRecord*)file.data;
+        verify(tes4->type == RecordType::TES4);
+
+        exporter.localized_strings = (bool)(tes4->flags & RecordFlags::TES4_Localized);
+    }
+
+    exporter.write(json_path);
+    return exporter.stats;
+}
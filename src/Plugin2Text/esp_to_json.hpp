@@ -0,0 +1,81 @@
+#pragma once
+#include "esp_parser.hpp"
+#include "typeinfo.hpp"
+#include "string_table.hpp"
+
+// Writes records as JSON objects, one record per line, by walking the same type definitions as "TextRecordWriter".
+// Records are written from raw plugin data, so several writers can format different parts of plugin in parallel.
+struct JsonRecordWriter {
+    Array<uint8_t>* output = nullptr;
+
+    bool localized_strings = false; // LString fields are string IDs, set from TES4 record flags.
+    const StringTables* strings = nullptr; // If set, localized strings are written next to string IDs.
+
+    RecordType current_record_type = (RecordType)0; // Sometimes ESP deserialization depends on record type.
+    ProgramOptions options = ProgramOptions::None;
+
+    Array<const RawRecordField*> fields; // Fields of current record.
+    LinearAllocator* arena = nullptr; // Owned by thread that uses writer, VMAD fields are parsed into it.
+
+    void dispose();
+
+    void write_bytes(const void* data, size_t size);
+    void write_char(char c);
+
+    template<size_t N>
+    void write_literal(const char(&data)[N]) {
+        write_bytes(data, N - 1);
+    }
+
+    // Writes "," unless value is the first one in object or array.
+    void write_separator();
+    void write_key(const char* name, size_t length);
+    void write_key(const char* name);
+    void write_string(const char* text, size_t count);
+    void write_string(const char* str);
+    void write_wstring(const WString* wstr);
+    void write_float(float value);
+    void write_int32(int value);
+    void write_formid(FormID formid);
+    void write_byte_array(const uint8_t* data, size_t size);
+
+    // "data" is uncompressed record data. "parent" is Form ID of record that owns group of this record
+    // (world, cell or topic), or zero if record is in top-level group.
+    void write_record(const RawRecord* record, const uint8_t* data, size_t size, FormID parent);
+    void write_flags(RecordFlags flags, const RecordDef* def);
+    void write_field(const RawRecordField* field, const RecordFieldDef* field_def);
+    void write_type(const Type* type, const void* value, size_t size);
+    void write_papyrus_value(const VMAD_Field& vmad, const VMAD_ScriptPropertyValue& value, PapyrusPropertyType type);
+    void write_papyrus_scripts(const VMAD_Field& vmad, const Array<VMAD_Script>& scripts);
+    void write_papyrus_info_record_fragment(const char* name, const VMAD_INFO_Fragment& fragment);
+    void write_papyrus_scen_record_fragment(const char* name, const VMAD_SCEN_BeginEndFragment& fragment);
+    void write_vmad(const uint8_t* value, size_t size);
+    void write_nvpp(const uint8_t* value, size_t size);
+    void write_ctda(const uint8_t* value, size_t size);
+    void write_ctda_argument(const CTDA_Argument& argument, CTDA_ArgumentType type);
+    void write_nvnm(const NVNM_Field& nvnm);
+
+    void write_custom_field(const char* field_name, const Type* type, const void* value, size_t size);
+
+    template<typename T>
+    void write_custom_field(const char* field_name, const T* value) {
+        write_custom_field(field_name, resolve_type<T>(), value, sizeof(T));
+    }
+
+    template<typename T>
+    void write_custom_field(const char* field_name, const T& value) {
+        write_custom_field(field_name, resolve_type<T>(), &value, sizeof(T));
+    }
+};
+
+struct EspJsonStats {
+    size_t record_count = 0;
+    size_t compressed_count = 0;
+};
+
+// Writes all records of plugin in NDJSON format to "json_path", or to stdout if "json_path" is null. Each line is
+// object with "type", "id" and "fields" of record, records of world, cell and topic children groups also have
+// "parent" with Form ID of their owner. Groups are split into parts that are formatted in parallel, parts are written
+// in plugin order as soon as they are ready. "strings" may be null, then LString fields of localized plugin are
+// written as string IDs only.
+EspJsonStats esp_to_json(ProgramOptions options, const StaticArray<uint8_t> file, const StringTables* strings, const wchar_t* json_path);
@@ -1,7 +1,9 @@
 #include "esp_to_text.hpp"
 #include "os.hpp"
 #include "base64.hpp"
+#include "profiler.hpp"
 #include <stdio.h>
+#include <math.h>
 #include <zlib-ng.h>
 #include <charconv>
 
@@ -24,14 +26,9 @@ void TextRecordWriter::write_format(_Printf_format_string_ const char* format, .
 }
 
 void TextRecordWriter::write_byte_array(const uint8_t* data, size_t size) {
-    auto buffer = output_buffer.advance(size * 2);
-    static const char alphabet[17] = "0123456789abcdef";
+    PROFILE_SCOPE(ByteArrayCoding, size);
 
-    for (size_t i = 0; i < size; ++i) {
-        uint8_t c = data[i];
-        buffer[(i * 2) + 0] = alphabet[c / 16];
-        buffer[(i * 2) + 1] = alphabet[c % 16];
-    }
+    format_hex_bytes((char*)output_buffer.advance(size * 2), data, size);
 }
 
 void TextRecordWriter::write_indent() {
@@ -56,6 +53,9 @@ void TextRecordWriter::write_bytes(const void* data, size_t size) {
 
 void TextRecordWriter::write_records(const Array<RecordBase*> records) {
     TEMP_SCOPE();
+    ProfileScope profile{ ProfilePhase::TextFormat };
+    const auto output_start = output_buffer.now;
+    defer(profile.bytes = output_buffer.now - output_start);
 
     write_literal("plugin2text version 1.00\n---\n");
 
@@ -68,6 +68,9 @@ void TextRecordWriter::write_records(const Array<RecordBase*> records) {
     }
 
     for (const auto record : records) {
+        const auto label = record->type == RecordType::GRUP ? static_cast<const GrupRecord*>(record)->label : (uint32_t)record->type;
+        TraceScope trace{ "group", (const char*)&label, sizeof(label) };
+
         write_record(record);
     }
 }
@@ -111,7 +114,7 @@ RecordFlags TextRecordWriter::write_flags(RecordFlags flags, const RecordDef* de
             write_newline();
             write_indent();
             write_literal("+ ");
-            write_string(flag.name);
+            write_bytes(flag.name, flag.name_length);
             flags = clear_bit(flags, flag.bit);
         }
     }
@@ -153,7 +156,8 @@ void TextRecordWriter::write_record(const RecordBase* record_base) {
     }
 
     auto record = (const Record*)record_base;
-    write_format(" [%08X]", record->id.value);
+    write_literal(" ");
+    write_formid(record->id);
     if (record->version != 44) {
         write_format(",v%d", record->version);
     }
@@ -189,23 +193,41 @@ void TextRecordWriter::write_record(const RecordBase* record_base) {
     write_newline();
 
     for (int i = 0; i < record->fields.count;) {
-        const auto field = record->fields[i];
+        i += static_cast<int>(write_field_block(def, { &record->fields.data[i], static_cast<size_t>(record->fields.count - i) }));
+    }
+}
 
-        auto field_def = def->get_field_def(field->type);
-        if (!field_def) {
-            field_def = Record_Common.get_field_def(field->type);
-        }
+static const RecordFieldDefBase* find_field_def(const RecordDef* def, RecordFieldType type) {
+    auto field_def = def->get_field_def(type);
+    if (!field_def) {
+        field_def = Record_Common.get_field_def(type);
+    }
+    return field_def;
+}
 
-        if (!field_def || field_def->def_type == RecordFieldDefType::Field) {
-            write_field(field, static_cast<const RecordFieldDef*>(field_def));
-            ++i;
-        } else if (field_def->def_type == RecordFieldDefType::Subrecord) {
-            const auto subrecord_field_def = static_cast<const RecordFieldDefSubrecord*>(field_def);
-            write_subrecord_fields(subrecord_field_def, { &record->fields.data[i], static_cast<size_t>(record->fields.count - i) });
-            i += static_cast<int>(subrecord_field_def->fields.count);
-        } else {
-            verify(false);
-        }
+size_t get_field_block_size(const RecordDef* def, RecordFieldType type) {
+    const auto field_def = find_field_def(def, type);
+    if (!field_def || field_def->def_type == RecordFieldDefType::Field) {
+        return 1;
+    }
+    verify(field_def->def_type == RecordFieldDefType::Subrecord);
+    return static_cast<const RecordFieldDefSubrecord*>(field_def)->fields.count;
+}
+
+size_t TextRecordWriter::write_field_block(const RecordDef* def, StaticArray<RecordField*> fields) {
+    verify(fields.count > 0);
+    const auto field_def = find_field_def(def, fields.data[0]->type);
+
+    if (!field_def || field_def->def_type == RecordFieldDefType::Field) {
+        write_field(fields.data[0], static_cast<const RecordFieldDef*>(field_def));
+        return 1;
+    } else if (field_def->def_type == RecordFieldDefType::Subrecord) {
+        const auto subrecord_field_def = static_cast<const RecordFieldDefSubrecord*>(field_def);
+        write_subrecord_fields(subrecord_field_def, fields);
+        return subrecord_field_def->fields.count;
+    } else {
+        verify(false);
+        return 0;
     }
 }
 
@@ -220,11 +242,45 @@ static bool has_custom_indent_rules(TypeKind kind) {
         case TypeKind::VTXT:
         case TypeKind::XCLW:
         case TypeKind::CTDA:
+        case TypeKind::VHGT:
+        case TypeKind::VNML:
+        case TypeKind::NVNM:
             return true;
     }
     return false;
 }
 
+static bool nvnm_has_nan(const NVNM_Field& nvnm) {
+    auto is_nan = [](const NVNM_Vertex& vertex) {
+        return isnan(vertex.x) || isnan(vertex.y) || isnan(vertex.z);
+    };
+
+    for (const auto& vertex : nvnm.vertices) {
+        if (is_nan(vertex)) {
+            return true;
+        }
+    }
+    return is_nan(nvnm.min) || is_nan(nvnm.max) || isnan(nvnm.max_x_distance) || isnan(nvnm.max_y_distance);
+}
+
+// Formats numbers separated by spaces straight into output buffer. Floats are written in shortest form
+// that is parsed back to the same value.
+template<typename T>
+static void write_numbers(Slice* output, const T* values, size_t count) {
+    auto now = (char*)output->now;
+    const auto end = (char*)output->end;
+    for (size_t i = 0; i < count; ++i) {
+        if (i != 0) {
+            verify(now < end);
+            *now++ = ' ';
+        }
+        const auto result = std::to_chars(now, end, values[i]);
+        verify(result.ec == std::errc{});
+        now = result.ptr;
+    }
+    output->now = (uint8_t*)now;
+}
+
 static size_t count_bytes(const uint8_t* start, const uint8_t* end, uint8_t byte) {
     auto now = start;
     while (now < end) {
@@ -337,20 +393,28 @@ void TextRecordWriter::write_string(const char* text, size_t count) {
     auto now = text;
     const auto end = now + count;
     auto multiline = false;
-    while (now < end) {
+    while ((now = find_special_char(now, end, '"', 127)) < end) {
         const auto c = *now++;
-        if (c == '\r' || c == '\n' || c == '"') {
-            multiline = true;
+        // Bytes >= 128 are written as is, text has the same encoding as plugin or string table.
+        if ((uint8_t)c >= 128) {
             continue;
         }
-        verify(c >= 32 && c < 127);
+        verify(c == '\r' || c == '\n' || c == '"');
+        multiline = true;
     }
 
     now = text;
     if (multiline) {
         write_literal("\"\"\"\n");
         write_indent();
-        while (now < end) {
+        while (true) {
+            const auto special = find_special_char(now, end, '"', 127);
+            write_bytes(now, special - now);
+            now = special;
+            if (now == end) {
+                break;
+            }
+
             const auto c = *now++;
             if (c == '\r') {
                 verify(now < end && *now == '\n');
@@ -385,6 +449,13 @@ void TextRecordWriter::write_int32(int value) {
     output_buffer.now = (uint8_t*)result.ptr;
 }
 
+void TextRecordWriter::write_formid(FormID formid) {
+    auto buffer = (char*)output_buffer.advance(1 + 8 + 1); // [DEADBEEF]
+    buffer[0] = '[';
+    format_hex_uint32(buffer + 1, formid.value);
+    buffer[9] = ']';
+}
+
 static inline void fix_negative_zero(float* value) {
     if (*(uint32_t*)value == 0x80000000) {
         // Clear negative zero.
@@ -393,6 +464,7 @@ static inline void fix_negative_zero(float* value) {
 }
 
 void TextRecordWriter::write_type(const Type* type, const void* value, size_t size) {
+    TYPE_PROFILE_KIND(type_profile_write, type->kind, &output_buffer.now);
     ++indent;
 
     if (!has_custom_indent_rules(type->kind)) {
@@ -414,9 +486,24 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
                 goto zstring;
             }
 
-            // @TODO @Test
-            verify(size == sizeof(int));
-            write_int32(*(int*)value);
+            verify(size == sizeof(uint32_t));
+            const auto id = *(const uint32_t*)value;
+            write_int32((int)id);
+
+            const auto table_type = static_cast<const TypeLString*>(type)->table_type;
+            const auto string = strings ? strings->find(table_type, id) : LocalizedString{};
+            if (string.data) {
+                // Table is written if it's not STRINGS, or if string was found in other table than field's one.
+                if (string.type == StringTableType::DLStrings) {
+                    write_literal(" DL");
+                } else if (string.type == StringTableType::ILStrings) {
+                    write_literal(" IL");
+                } else if (table_type != StringTableType::Strings) {
+                    write_literal(" ST");
+                }
+                write_literal(" ");
+                write_string(string.data, string.count);
+            }
         } break;
 
         case TypeKind::WString: {
@@ -438,11 +525,15 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
             auto buffer = tmpalloc.now;
 
             auto compressed_size = tmpalloc.remaining_size();
-            auto result = ::zng_compress(buffer, &compressed_size, (const uint8_t*)value, static_cast<uLong>(size));
-            verify(result == Z_OK);
+            {
+                PROFILE_SCOPE(ZLibDeflate, size);
+                auto result = ::zng_compress(buffer, &compressed_size, (const uint8_t*)value, static_cast<uLong>(size));
+                verify(result == Z_OK);
+            }
 
-            tmpalloc.now += compressed_size;
+            memalloc(tmpalloc, compressed_size); // Advance tmpalloc.
 
+            PROFILE_SCOPE(ByteArrayCoding, compressed_size);
             auto output_size = base64_encode(buffer, compressed_size, (char*)tmpalloc.now, tmpalloc.remaining_size());
             write_bytes(tmpalloc.now, output_size);
 
@@ -455,9 +546,9 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
         } break;
 
         case TypeKind::ByteArrayRLE: {
+            PROFILE_SCOPE(ByteArrayCoding, size);
             auto buffer = output_buffer.advance(size * 2); // We actually may need less than "size * 2", but whatever.
             auto data = (uint8_t*)value;
-            static const char alphabet[17] = "0123456789abcdef";
             size_t bytes_written = 0;
 
             for (size_t i = 0; i < size; ++i) {
@@ -476,8 +567,8 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
                     }
                 }
 
-                buffer[bytes_written++] = alphabet[c / 16];
-                buffer[bytes_written++] = alphabet[c % 16];
+                format_hex_bytes((char*)&buffer[bytes_written], &c, 1);
+                bytes_written += 2;
             }
 
             output_buffer.now = buffer + bytes_written;
@@ -488,17 +579,17 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
             auto integer_type = (const TypeInteger*)type;
             if (integer_type->is_unsigned) {
                 switch (size) {
-                    case 1: write_format("%u", *(uint8_t*)value); break;
-                    case 2: write_format("%u", *(uint16_t*)value); break;
-                    case 4: write_format("%u", *(uint32_t*)value); break;
-                    case 8: write_format("%llu", *(uint64_t*)value); break;
+                    case 1: write_numbers(&output_buffer, (const uint8_t*)value, 1); break;
+                    case 2: write_numbers(&output_buffer, (const uint16_t*)value, 1); break;
+                    case 4: write_numbers(&output_buffer, (const uint32_t*)value, 1); break;
+                    case 8: write_numbers(&output_buffer, (const uint64_t*)value, 1); break;
                 }
             } else {
                 switch (size) {
-                    case 1: write_format("%d", *(int8_t*)value); break;
-                    case 2: write_format("%d", *(int16_t*)value); break;
-                    case 4: write_format("%d", *(int32_t*)value); break;
-                    case 8: write_format("%lld", *(int64_t*)value); break;
+                    case 1: write_numbers(&output_buffer, (const int8_t*)value, 1); break;
+                    case 2: write_numbers(&output_buffer, (const int16_t*)value, 1); break;
+                    case 4: write_numbers(&output_buffer, (const int32_t*)value, 1); break;
+                    case 8: write_numbers(&output_buffer, (const int64_t*)value, 1); break;
                 }
             }
         } break;
@@ -540,7 +631,7 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
                 }
 
                 write_indent();
-                write_string(field.name);
+                write_bytes(field.name, field.name_length);
                 write_newline();
 
                 write_type(field_type, value_in_struct, field_type->size);
@@ -551,15 +642,15 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
 
         case TypeKind::FormID: {
             verify(type->size == size);
-            verify(size == sizeof(int));
-            write_format("[%08X]", *(int*)value);
+            verify(size == sizeof(FormID));
+            write_formid(*(const FormID*)value);
         } break;
 
         case TypeKind::FormIDArray: {
-            verify((size % sizeof(int)) == 0);
-            const size_t keyword_count = size / sizeof(int);
+            verify((size % sizeof(FormID)) == 0);
+            const size_t keyword_count = size / sizeof(FormID);
             for (size_t i = 0; i < keyword_count; ++i) {
-                write_format("[%08X]", ((int*)value)[i]);
+                write_formid(((const FormID*)value)[i]);
                 if (i != keyword_count - 1) {
                     write_newline();
                     write_indent();
@@ -587,7 +678,7 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
                     const auto& field = enum_type->fields[i];
                     if (enum_value & field.value) {
                         write_literal("+ ");
-                        write_string(field.name);
+                        write_bytes(field.name, field.name_length);
 
                         enum_value = clear_bit(enum_value, field.value);
                         if (enum_value == 0) {
@@ -606,7 +697,7 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
                 for (size_t i = 0; i < enum_type->field_count; ++i) {
                     const auto& field = enum_type->fields[i];
                     if (field.value == enum_value) {
-                        write_string(field.name);
+                        write_bytes(field.name, field.name_length);
                         goto ok;
                     }
                 }
@@ -627,7 +718,7 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
 
         case TypeKind::VMAD: {
             VMAD_Field vmad;
-            vmad.parse(static_cast<const uint8_t*>(value), size, current_record_type, is_bit_set(options, ProgramOptions::PreserveOrder));
+            vmad.parse(tmpalloc, static_cast<const uint8_t*>(value), size, current_record_type, is_bit_set(options, ProgramOptions::PreserveOrder));
 
             write_custom_field("Version", vmad.version);
             write_custom_field("Object Format", vmad.object_format);
@@ -915,6 +1006,55 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
             }
         } break;
 
+        case TypeKind::VHGT: {
+            if (size != sizeof(VHGT_Field)) {
+                --indent;
+                write_type(&Type_ByteArray, value, size);
+                ++indent;
+                break;
+            }
+
+            const auto vhgt = (const VHGT_Field*)value;
+            write_custom_field("Offset", vhgt->offset);
+
+            begin_custom_struct("Gradients");
+            for (const auto& row : vhgt->gradients) {
+                write_grid_row(row, LAND_GridSize, 1);
+            }
+            end_custom_struct();
+
+            write_custom_field("Unused", &Type_ByteArray, vhgt->unused, sizeof(vhgt->unused));
+        } break;
+
+        case TypeKind::VNML: {
+            if (size != sizeof(VNML_Field)) {
+                --indent;
+                write_type(&Type_ByteArray, value, size);
+                ++indent;
+                break;
+            }
+
+            const auto vnml = (const VNML_Field*)value;
+            begin_custom_struct("Normals");
+            for (const auto& row : vnml->normals) {
+                write_grid_row(&row[0][0], LAND_GridSize, 3);
+            }
+            end_custom_struct();
+        } break;
+
+        case TypeKind::NVNM: {
+            NVNM_Field nvnm;
+            if (!nvnm.parse((const uint8_t*)value, size) || nvnm_has_nan(nvnm)) {
+                // Unknown layout, or NaN floats that can't be written as text without losing bits.
+                --indent;
+                write_type(&Type_ByteArrayRLE, value, size);
+                ++indent;
+                break;
+            }
+
+            write_nvnm(nvnm);
+        } break;
+
         default: {
             verify(false);
         } break;
@@ -928,22 +1068,171 @@ void TextRecordWriter::write_type(const Type* type, const void* value, size_t si
 }
 
 void TextRecordWriter::write_field(const RecordField* field, const RecordFieldDef* field_def) {
+    TYPE_PROFILE_FIELD(type_profile_write, current_record_type, field->type, &output_buffer.now);
     ++indent;
     write_indent();
 
-    write_bytes(&field->type, 4);
+    if (field_def && field_def->header) {
+        write_bytes(field_def->header, field_def->header_length);
+    } else {
+        write_bytes(&field->type, 4);
 
-    if (field_def && field_def->comment) {
-        write_literal(" - ");
-        write_string(field_def->comment);
+        if (field_def && field_def->comment) {
+            write_literal(" - ");
+            write_string(field_def->comment);
+        }
+
+        write_newline();
     }
 
+    if (!field_def || !write_direct_field_value(field, field_def)) {
+        const auto data_type = field_def ? field_def->data_type : &Type_ByteArray;
+        write_type(data_type, field->data.data, field->data.count);
+    }
+        
+    --indent;
+}
+
+// "write_direct_value" writes values the same way as "write_type" does for corresponding types.
+template<typename T>
+void TextRecordWriter::write_direct_value(T value) {
+    static_assert(is_direct_type<T>, "not a direct type");
+
+    if constexpr (std::is_same_v<T, Vector3>) {
+        fix_negative_zero(&value.x);
+        fix_negative_zero(&value.y);
+        fix_negative_zero(&value.z);
+        write_direct_value(value.x);
+        write_direct_value(value.y);
+        write_direct_value(value.z);
+    } else {
+        ++indent;
+        write_indent();
+        if constexpr (std::is_same_v<T, FormID>) {
+            write_formid(value);
+        } else if constexpr (std::is_same_v<T, float>) {
+            write_float(value);
+        } else {
+            write_numbers(&output_buffer, &value, 1);
+        }
+        write_newline();
+        --indent;
+    }
+}
+
+template<typename T>
+void TextRecordWriter::write_direct_field(const TypeStructField& field, T value) {
+    write_indent();
+    write_bytes(field.name, field.name_length);
     write_newline();
+    write_direct_value(value);
+}
 
-    const auto data_type = field_def ? field_def->data_type : &Type_ByteArray;
-    write_type(data_type, field->data.data, field->data.count);
-        
+// Same as "Struct" case of "write_type" for one member of field view.
+template<typename T>
+void TextRecordWriter::write_field_view_member(const TypeStructField& field, const T& value) {
+    auto type = field.type;
+    if (type->kind == TypeKind::Constant) {
+        const auto constant_type = static_cast<const TypeConstant*>(type);
+        if (memory_equals(constant_type->bytes, &value, sizeof(T))) {
+            return;
+        }
+
+        type = constant_type->fallback;
+        verify(type); // No fallback!
+    }
+
+    if constexpr (is_direct_type<T>) {
+        if (type == resolve_type<T>()) {
+            write_direct_field(field, value);
+            return;
+        }
+    }
+
+    write_indent();
+    write_bytes(field.name, field.name_length);
+    write_newline();
+    write_type(type, &value, sizeof(T));
+}
+
+// Writes struct field as field view "T". Member loop is unrolled at compile time and members of direct types
+// are formatted without going through "write_type". Returns false if field doesn't match "T".
+template<typename T>
+bool TextRecordWriter::write_field_view(const RecordField* field, const Type* type) {
+    if (field->data.count != sizeof(T) || !is_field_view_layout<T>(type)) {
+        return false;
+    }
+
+    const auto& value = *(const T*)field->data.data;
+    const auto fields = static_cast<const TypeStruct*>(type)->fields;
+
+    ++indent;
+    std::apply([&](auto... members) {
+        size_t i = 0;
+        (write_field_view_member(fields[i++], value.*members), ...);
+    }, T::members());
     --indent;
+
+    return true;
+}
+
+// Placed references outnumber all other records in worldspace and cell plugins, and every base object has
+// object bounds, so these fields are formatted here directly, without walking type info. Output is the same
+// as with "write_type".
+bool TextRecordWriter::write_direct_field_value(const RecordField* field, const RecordFieldDef* field_def) {
+    const auto type = field_def->data_type;
+    const auto data = field->data.data;
+    const auto size = field->data.count;
+
+    switch (field->type) {
+        case RecordFieldType::OBND: {
+            return write_field_view<Common_OBND>(field, type);
+        }
+
+        case RecordFieldType::NAME: {
+            if (!is_placed_reference(current_record_type) || type != &Type_FormID || size != sizeof(FormID)) {
+                return false;
+            }
+            write_direct_value(*(const FormID*)data);
+            return true;
+        }
+
+        case RecordFieldType::XSCL: {
+            if (!is_placed_reference(current_record_type) || type != &Type_float || size != sizeof(float)) {
+                return false;
+            }
+            write_direct_value(*(const float*)data);
+            return true;
+        }
+
+        case RecordFieldType::DATA: {
+            return is_placed_reference(current_record_type) && write_field_view<REFR_DATA>(field, type);
+        }
+
+        case RecordFieldType::XLKR: {
+            return is_placed_reference(current_record_type) && write_field_view<REFR_XLKR>(field, type);
+        }
+
+        case RecordFieldType::XNDP: {
+            return is_placed_reference(current_record_type) && write_field_view<REFR_XNDP>(field, type);
+        }
+
+        case RecordFieldType::XTEL: {
+            return is_placed_reference(current_record_type) && write_field_view<REFR_XTEL>(field, type);
+        }
+
+        case RecordFieldType::XCLC: {
+            return current_record_type == RecordType::CELL && write_field_view<CELL_XCLC>(field, type);
+        }
+
+        case RecordFieldType::ACBS: {
+            return current_record_type == RecordType::NPC_ && write_field_view<NPC__ACBS>(field, type);
+        }
+
+        default: {
+            return false;
+        }
+    }
 }
 
 void TextRecordWriter::write_subrecord_fields(const RecordFieldDefSubrecord* field_def, StaticArray<RecordField*> fields) {
@@ -979,6 +1268,131 @@ void TextRecordWriter::write_custom_field(const char* field_name, const Type* ty
     write_type(type, value, size);
 }
 
+// Writes one row of landscape grid. Element is "element_size" numbers separated by commas, elements are separated
+// by spaces. Element repeated several times is written once with "*<count>" suffix, e.g. "0,0,127*33".
+void TextRecordWriter::write_grid_row(const int8_t* values, int count, int element_size) {
+    write_indent();
+    for (int i = 0; i < count;) {
+        const auto element = &values[i * element_size];
+        int repeat = 1;
+        while (i + repeat < count && memory_equals(element, &values[(i + repeat) * element_size], element_size)) {
+            ++repeat;
+        }
+
+        if (i != 0) {
+            write_literal(" ");
+        }
+
+        for (int j = 0; j < element_size; ++j) {
+            if (j != 0) {
+                write_literal(",");
+            }
+            write_int32(element[j]);
+        }
+
+        if (repeat > 1) {
+            write_literal("*");
+            write_int32(repeat);
+        }
+
+        i += repeat;
+    }
+    write_newline();
+}
+
+void TextRecordWriter::write_nvnm(const NVNM_Field& nvnm) {
+    write_custom_field("Version", nvnm.version);
+    write_custom_field("CRC", nvnm.crc);
+    write_custom_field("Parent Worldspace", nvnm.worldspace);
+    if (nvnm.worldspace.value == 0) {
+        write_custom_field("Parent Cell", nvnm.cell);
+    } else {
+        write_custom_field("Grid X", nvnm.grid_x);
+        write_custom_field("Grid Y", nvnm.grid_y);
+    }
+
+    begin_custom_struct("Vertices");
+    for (const auto& vertex : nvnm.vertices) {
+        write_indent();
+        write_numbers(&output_buffer, &vertex.x, 3);
+        write_newline();
+    }
+    end_custom_struct();
+
+    // Vertices, edges, flags, cover flags.
+    begin_custom_struct("Triangles");
+    for (const auto& triangle : nvnm.triangles) {
+        const int values[] = {
+            triangle.vertices[0], triangle.vertices[1], triangle.vertices[2],
+            triangle.edges[0], triangle.edges[1], triangle.edges[2],
+            triangle.flags, triangle.cover_flags,
+        };
+        write_indent();
+        write_numbers(&output_buffer, values, _countof(values));
+        write_newline();
+    }
+    end_custom_struct();
+
+    begin_custom_struct("Edge Links");
+    for (const auto& link : nvnm.edge_links) {
+        write_indent();
+        write_format("%u [%08X] %d", link.type, link.navmesh.value, link.triangle);
+        write_newline();
+    }
+    end_custom_struct();
+
+    begin_custom_struct("Door Triangles");
+    for (const auto& door : nvnm.door_triangles) {
+        write_indent();
+        write_format("%d %u [%08X]", door.triangle, door.crc, door.door.value);
+        write_newline();
+    }
+    end_custom_struct();
+
+    begin_custom_struct("Cover Triangles");
+    constexpr size_t CoverTrianglesPerLine = 16;
+    for (size_t i = 0; i < nvnm.cover_triangles.count; i += CoverTrianglesPerLine) {
+        const auto remaining = nvnm.cover_triangles.count - i;
+        write_indent();
+        write_numbers(&output_buffer, &nvnm.cover_triangles.data[i], remaining < CoverTrianglesPerLine ? remaining : CoverTrianglesPerLine);
+        write_newline();
+    }
+    end_custom_struct();
+
+    write_custom_field("Grid Size", nvnm.grid_size);
+    write_custom_field("Max X Distance", nvnm.max_x_distance);
+    write_custom_field("Max Y Distance", nvnm.max_y_distance);
+
+    begin_custom_struct("Min");
+    write_indent();
+    write_numbers(&output_buffer, &nvnm.min.x, 3);
+    write_newline();
+    end_custom_struct();
+
+    begin_custom_struct("Max");
+    write_indent();
+    write_numbers(&output_buffer, &nvnm.max.x, 3);
+    write_newline();
+    end_custom_struct();
+
+    // Only cells that have triangles are written, as "<cell index>: <triangles>".
+    begin_custom_struct("Grid Cells");
+    BinaryReader r{ nvnm.grid_cells.data, nvnm.grid_cells.count };
+    for (uint32_t cell = 0; cell < nvnm.grid_size * nvnm.grid_size; ++cell) {
+        const auto count = r.read<uint32_t>();
+        const auto triangles = (const int16_t*)r.advance(count * sizeof(int16_t));
+        if (count == 0) {
+            continue;
+        }
+
+        write_indent();
+        write_format("%u: ", cell);
+        write_numbers(&output_buffer, triangles, count);
+        write_newline();
+    }
+    end_custom_struct();
+}
+
 void TextRecordWriter::write_ctda_argument(const CTDA_Argument& argument, CTDA_ArgumentType type) {
     switch (type) {
         case CTDA_ArgumentType::FormID: {
@@ -1001,11 +1415,56 @@ void TextRecordWriter::write_ctda_argument(const CTDA_Argument& argument, CTDA_A
     }
 }
 
-void esp_to_text(ProgramOptions options, const EspObjectModel& model, const wchar_t* text_path) {
+void esp_to_text(ProgramOptions options, const EspObjectModel& model, const StringTables* strings, const wchar_t* text_path) {
     TextRecordWriter writer;
     writer.init(options);
     defer(writer.dispose());
 
+    writer.strings = strings;
+
     writer.write_records(model.records);
     write_file(text_path, { writer.output_buffer.start, writer.output_buffer.size() });
 }
+
+void esp_records_to_text(ProgramOptions options, const StaticArray<uint8_t> data, const StringTables* strings, const StaticArray<FormID> ids, const wchar_t* text_path) {
+    EspRecordIndex index;
+    index.build(data);
+    defer(index.dispose());
+
+    EspParser parser;
+    parser.init(tmpalloc, options);
+    defer(parser.dispose());
+
+    TextRecordWriter writer;
+    writer.init(options);
+    defer(writer.dispose());
+
+    writer.strings = strings;
+
+    {
+        verify(data.count >= sizeof(RawRecord));
+        const auto tes4 = (const RawRecord*)data.data;
+        verify(tes4->type == RecordType::TES4);
+
+        writer.localized_strings = (bool)(tes4->flags & RecordFlags::TES4_Localized);
+    }
+
+    ProfileScope profile{ ProfilePhase::TextFormat };
+    for (const auto id : ids) {
+        const auto offsets = index.find(id);
+        if (offsets.count == 0) {
+            exit_error(L"record [%08X] not found", id.value);
+        }
+
+        for (const auto& offset : offsets) {
+            writer.write_record(parser.parse_record(index.get_record(offset)));
+        }
+    }
+    profile.bytes = writer.output_buffer.size();
+
+    if (text_path) {
+        write_file(text_path, { writer.output_buffer.start, writer.output_buffer.size() });
+    } else {
+        fwrite(writer.output_buffer.start, 1, writer.output_buffer.size(), stdout);
+    }
+}
@@ -1,12 +1,14 @@
 #pragma once
 #include "esp_parser.hpp"
 #include "typeinfo.hpp"
+#include "string_table.hpp"
 
 struct TextRecordWriter {
     Slice output_buffer;
 
     int indent = 0;
-    bool localized_strings = false; // @TODO: load value from TES4 record
+    bool localized_strings = false; // LString fields are string IDs, set from TES4 record flags.
+    const StringTables* strings = nullptr; // If set, localized strings are written next to string IDs.
 
     RecordType current_record_type = (RecordType)0; // Sometimes ESP deserialization depends on record type.
     ProgramOptions options = ProgramOptions::None;
@@ -39,9 +41,13 @@ struct TextRecordWriter {
     void write_string(const char* text, size_t count);
     void write_float(float value);
     void write_int32(int value);
+    void write_formid(FormID formid);
     void write_type(const Type* type, const void* value, size_t size);
     void write_field(const RecordField* field, const RecordFieldDef* field_def);
     void write_subrecord_fields(const RecordFieldDefSubrecord* field_def, StaticArray<RecordField*> fields);
+
+    // Writes first field, or all fields of subrecord if first field starts one. Returns number of consumed fields.
+    size_t write_field_block(const RecordDef* def, StaticArray<RecordField*> fields);
     
     void begin_custom_struct(const char* header_name);
     void end_custom_struct();
@@ -58,6 +64,32 @@ struct TextRecordWriter {
     }
 
     void write_ctda_argument(const CTDA_Argument& argument, CTDA_ArgumentType type);
+    void write_grid_row(const int8_t* values, int count, int element_size);
+    void write_nvnm(const NVNM_Field& nvnm);
+
+    // Writes value of frequent field without going through "write_type". Returns false if field should be
+    // written with "write_type".
+    bool write_direct_field_value(const RecordField* field, const RecordFieldDef* field_def);
+
+    template<typename T>
+    bool write_field_view(const RecordField* field, const Type* type);
+
+    template<typename T>
+    void write_field_view_member(const TypeStructField& field, const T& value);
+
+    template<typename T>
+    void write_direct_value(T value);
+
+    template<typename T>
+    void write_direct_field(const TypeStructField& field, T value);
 };
 
-void esp_to_text(ProgramOptions options, const EspObjectModel& model, const wchar_t* text_path);
+// Returns number of fields that "TextRecordWriter::write_field_block" writes if first field has specified type.
+size_t get_field_block_size(const RecordDef* def, RecordFieldType type);
+
+// "strings" may be null, then LString fields of localized plugin are written as string IDs only.
+void esp_to_text(ProgramOptions options, const EspObjectModel& model, const StringTables* strings, const wchar_t* text_path);
+
+// Converts only records with specified Form IDs, other records are not parsed. Output has no
+// "plugin2text" header, so it can't be converted back. If "text_path" is null, output is written to stdout.
+void esp_records_to_text(ProgramOptions options, const StaticArray<uint8_t> data, const StringTables* strings, const StaticArray<FormID> ids, const wchar_t* text_path);
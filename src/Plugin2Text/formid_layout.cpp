@@ -0,0 +1,380 @@
+#include "formid_layout.hpp"
+#include "typeinfo.hpp"
+#include "array.hpp"
+#include <stdlib.h>
+
+enum class FormIDLayoutKind : uint8_t {
+    None,
+    Offsets, // Form IDs at fixed offsets, e.g. Form ID field or struct with Form ID members.
+    Array, // Whole field is array of Form IDs.
+    VMAD,
+    CTDA,
+    NVPP,
+    NVNM,
+};
+
+// Locations of Form IDs in data of one field.
+struct FormIDLayout {
+    FormIDLayoutKind kind = FormIDLayoutKind::None;
+    StaticArray<uint16_t> offsets; // Used by "Offsets" kind.
+};
+
+// Layouts of fields in block that starts with field of "type". Subrecord block has layout for each field
+// which is not constant, in the same order as fields are written by "TextRecordWriter::write_subrecord_fields".
+struct FormIDBlockLayout {
+    RecordFieldType type = (RecordFieldType)0;
+    size_t block_size = 1; // Number of fields in block, see "get_field_block_size".
+    StaticArray<FormIDLayout> layouts;
+};
+
+struct FormIDRecordLayout {
+    RecordType type = (RecordType)0;
+    StaticArray<FormIDBlockLayout> blocks; // Sorted by field type. Blocks without Form IDs are omitted.
+};
+
+struct FormIDLayouts {
+    StaticArray<FormIDRecordLayout> records; // Sorted by record type.
+    FormIDRecordLayout common; // For records without definition.
+};
+
+#pragma pack(push, 1)
+// Layout of CTDA field, same as read by "TextRecordWriter::write_type".
+struct CTDA_Data {
+    CTDA_OperatorFlagsUnion operator_flags;
+    uint8_t unused0[3];
+    FormID comparison_value; // Global variable if "UseGlobal" flag is set, float otherwise.
+    uint16_t function_index;
+    uint16_t unused1;
+    CTDA_Argument arg1;
+    CTDA_Argument arg2;
+    CTDA_RunOnType run_on_type;
+    FormID reference;
+    int32_t unknown;
+};
+#pragma pack(pop)
+static_assert(sizeof(CTDA_Data) == 32, "invalid CTDA_Data size");
+
+static void collect_formid_offsets(const Type* type, size_t base, Array<uint16_t>* offsets) {
+    switch (type->kind) {
+        case TypeKind::FormID: {
+            verify(base <= UINT16_MAX);
+            offsets->push(static_cast<uint16_t>(base));
+        } break;
+
+        case TypeKind::Struct: {
+            const auto struct_type = static_cast<const TypeStruct*>(type);
+            size_t offset = 0;
+            for (size_t i = 0; i < struct_type->field_count; ++i) {
+                collect_formid_offsets(struct_type->fields[i].type, base + offset, offsets);
+                offset += struct_type->fields[i].type->size;
+            }
+        } break;
+
+        case TypeKind::Filter: {
+            collect_formid_offsets(static_cast<const TypeFilter*>(type)->inner_type, base, offsets);
+        } break;
+
+        case TypeKind::Constant: {
+            const auto fallback = static_cast<const TypeConstant*>(type)->fallback;
+            if (fallback) {
+                collect_formid_offsets(fallback, base, offsets);
+            }
+        } break;
+    }
+}
+
+static FormIDLayout build_field_layout(const Type* type) {
+    while (type->kind == TypeKind::Filter) {
+        type = static_cast<const TypeFilter*>(type)->inner_type;
+    }
+
+    FormIDLayout layout;
+    switch (type->kind) {
+        case TypeKind::FormIDArray: {
+            layout.kind = FormIDLayoutKind::Array;
+        } break;
+
+        case TypeKind::VMAD: {
+            layout.kind = FormIDLayoutKind::VMAD;
+        } break;
+
+        case TypeKind::CTDA: {
+            layout.kind = FormIDLayoutKind::CTDA;
+        } break;
+
+        case TypeKind::NVPP: {
+            layout.kind = FormIDLayoutKind::NVPP;
+        } break;
+
+        case TypeKind::NVNM: {
+            layout.kind = FormIDLayoutKind::NVNM;
+        } break;
+
+        default: {
+            Array<uint16_t> offsets;
+            collect_formid_offsets(type, 0, &offsets);
+            if (offsets.count) {
+                layout.kind = FormIDLayoutKind::Offsets;
+                layout.offsets = { offsets.data, (size_t)offsets.count };
+            }
+        } break;
+    }
+    return layout;
+}
+
+// Returns false if block doesn't contain Form IDs and doesn't need to be looked up.
+static bool build_block_layout(const RecordFieldDefBase* field_def, FormIDBlockLayout* block) {
+    Array<FormIDLayout> layouts;
+    bool has_formids = false;
+
+    block->type = field_def->type;
+    if (field_def->def_type == RecordFieldDefType::Subrecord) {
+        const auto subrecord = static_cast<const RecordFieldDefSubrecord*>(field_def);
+        block->block_size = subrecord->fields.count;
+        for (const auto inner_field_def : subrecord->fields) {
+            if (inner_field_def->data_type->kind == TypeKind::Constant) {
+                continue;
+            }
+            layouts.push(build_field_layout(inner_field_def->data_type));
+            has_formids |= layouts.data[layouts.count - 1].kind != FormIDLayoutKind::None;
+        }
+    } else {
+        block->block_size = 1;
+        layouts.push(build_field_layout(static_cast<const RecordFieldDef*>(field_def)->data_type));
+        has_formids = layouts.data[0].kind != FormIDLayoutKind::None;
+    }
+
+    block->layouts = { layouts.data, (size_t)layouts.count };
+    return has_formids || block->block_size > 1;
+}
+
+// Field definitions are looked up in record definition first and then in "Record_Common", as in "find_field_def".
+static FormIDRecordLayout build_record_layout(RecordType type, const RecordDef* def) {
+    Array<FormIDBlockLayout> blocks;
+    Array<RecordFieldType> seen_types;
+
+    const RecordDef* defs[]{ def, &Record_Common };
+    for (const auto current_def : defs) {
+        if (!current_def) {
+            continue;
+        }
+        for (const auto field_def : current_def->fields) {
+            if (seen_types.index_of(field_def->type) != -1) {
+                continue;
+            }
+            seen_types.push(field_def->type);
+
+            FormIDBlockLayout block;
+            if (build_block_layout(field_def, &block)) {
+                blocks.push(block);
+            }
+        }
+    }
+    seen_types.free();
+
+    qsort(blocks.data, blocks.count, sizeof(blocks.data[0]), [](void const* aa, void const* bb) -> int {
+        const auto a = (const FormIDBlockLayout*)aa;
+        const auto b = (const FormIDBlockLayout*)bb;
+        return a->type < b->type ? -1 : (a->type > b->type ? 1 : 0);
+    });
+
+    FormIDRecordLayout layout;
+    layout.type = type;
+    layout.blocks = { blocks.data, (size_t)blocks.count };
+    return layout;
+}
+
+// Tables live until the end of program, they are allocated with "stdalloc" because "tmpalloc" may be reset by TEMP_SCOPE.
+static FormIDLayouts build_formid_layouts() {
+    const auto defs = get_record_defs();
+
+    Array<FormIDRecordLayout> records;
+    for (const auto def : defs) {
+        records.push(build_record_layout(def->type, def));
+    }
+
+    qsort(records.data, records.count, sizeof(records.data[0]), [](void const* aa, void const* bb) -> int {
+        const auto a = (const FormIDRecordLayout*)aa;
+        const auto b = (const FormIDRecordLayout*)bb;
+        return a->type < b->type ? -1 : (a->type > b->type ? 1 : 0);
+    });
+
+    FormIDLayouts layouts;
+    layouts.records = { records.data, (size_t)records.count };
+    layouts.common = build_record_layout((RecordType)0, nullptr);
+    return layouts;
+}
+
+static const FormIDRecordLayout* find_record_layout(RecordType type) {
+    static const FormIDLayouts layouts = build_formid_layouts();
+
+    size_t low = 0;
+    size_t high = layouts.records.count;
+    while (low < high) {
+        const auto middle = (low + high) / 2;
+        const auto& record = layouts.records.data[middle];
+        if (record.type == type) {
+            return &record;
+        }
+        if (record.type < type) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return &layouts.common;
+}
+
+static const FormIDBlockLayout* find_block_layout(const FormIDRecordLayout* record, RecordFieldType type) {
+    size_t low = 0;
+    size_t high = record->blocks.count;
+    while (low < high) {
+        const auto middle = (low + high) / 2;
+        const auto& block = record->blocks.data[middle];
+        if (block.type == type) {
+            return &block;
+        }
+        if (block.type < type) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return nullptr;
+}
+
+static void scan_ctda_formids(const uint8_t* value, size_t size, RecordFieldType field_type, RecordFormIDCallback callback, void* context) {
+    if (size < sizeof(CTDA_Data)) {
+        return;
+    }
+
+    const auto ctda = (const CTDA_Data*)value;
+    const auto flags = ctda->operator_flags.flags;
+    if (is_bit_set(flags, CTDA_Flags::UseGlobal)) {
+        callback(context, &ctda->comparison_value, field_type);
+    }
+
+    // Arguments are alias or package data indices if these flags are set.
+    if (ctda->function_index < _countof(CTDA_Functions) && !is_bit_set(flags, CTDA_Flags::ParametersUseAliases | CTDA_Flags::UsePackData)) {
+        const auto& function = CTDA_Functions[ctda->function_index];
+        if (function.arg1 == CTDA_ArgumentType::FormID) {
+            callback(context, &ctda->arg1.formid, field_type);
+        }
+        if (function.arg1 != CTDA_ArgumentType::None && function.arg2 == CTDA_ArgumentType::FormID) {
+            callback(context, &ctda->arg2.formid, field_type);
+        }
+    }
+
+    if (ctda->run_on_type == CTDA_RunOnType::Reference) {
+        callback(context, &ctda->reference, field_type);
+    }
+}
+
+// Same layout as read by "NVPP_Field::parse".
+static void scan_nvpp_formids(const uint8_t* value, size_t size, RecordFieldType field_type, RecordFormIDCallback callback, void* context) {
+    BinaryReader r{ value, size };
+
+    const auto path_count = r.read<uint32_t>();
+    for (uint32_t i = 0; i < path_count; ++i) {
+        const auto formid_count = r.read<uint32_t>();
+        const auto formids = (const FormID*)r.advance(sizeof(FormID) * formid_count);
+        for (uint32_t j = 0; j < formid_count; ++j) {
+            callback(context, &formids[j], field_type);
+        }
+    }
+
+    const auto node_count = r.read<uint32_t>();
+    for (uint32_t i = 0; i < node_count; ++i) {
+        callback(context, r.advance<FormID>(), field_type);
+        r.advance(sizeof(uint32_t)); // index
+    }
+}
+
+// Navmesh with unknown layout is skipped, it has no known Form ID locations.
+static void scan_nvnm_formids(const uint8_t* value, size_t size, RecordFieldType field_type, RecordFormIDCallback callback, void* context) {
+    NVNM_Field nvnm;
+    if (!nvnm.parse(value, size)) {
+        return;
+    }
+
+    // "worldspace" and "cell" are copies, report locations in field data instead.
+    const auto worldspace = (const FormID*)(value + 2 * sizeof(uint32_t));
+    callback(context, worldspace, field_type);
+    if (!nvnm.worldspace.value) {
+        callback(context, worldspace + 1, field_type);
+    }
+
+    for (const auto& edge_link : nvnm.edge_links) {
+        callback(context, &edge_link.navmesh, field_type);
+    }
+    for (const auto& door_triangle : nvnm.door_triangles) {
+        callback(context, &door_triangle.door, field_type);
+    }
+}
+
+static void scan_field_formids(RecordType record_type, const FormIDLayout& layout, const RawRecordField* field, RecordFormIDCallback callback, void* context) {
+    const auto value = (const uint8_t*)(field + 1);
+    const size_t size = field->size;
+
+    switch (layout.kind) {
+        case FormIDLayoutKind::Offsets: {
+            // Older versions of records may have shorter fields, missing members are skipped.
+            for (const auto offset : layout.offsets) {
+                if (offset + sizeof(FormID) <= size) {
+                    callback(context, (const FormID*)(value + offset), field->type);
+                }
+            }
+        } break;
+
+        case FormIDLayoutKind::Array: {
+            for (size_t i = 0; i + sizeof(FormID) <= size; i += sizeof(FormID)) {
+                callback(context, (const FormID*)(value + i), field->type);
+            }
+        } break;
+
+        case FormIDLayoutKind::VMAD: {
+            scan_vmad_objects(value, size, record_type, [&](const FormID* form_id) {
+                callback(context, form_id, field->type);
+            });
+        } break;
+
+        case FormIDLayoutKind::CTDA: {
+            scan_ctda_formids(value, size, field->type, callback, context);
+        } break;
+
+        case FormIDLayoutKind::NVPP: {
+            scan_nvpp_formids(value, size, field->type, callback, context);
+        } break;
+
+        case FormIDLayoutKind::NVNM: {
+            scan_nvnm_formids(value, size, field->type, callback, context);
+        } break;
+    }
+}
+
+void scan_record_formids(RecordType record_type, const uint8_t* data, size_t size, RecordFormIDCallback callback, void* context) {
+    const auto record = find_record_layout(record_type);
+
+    const uint8_t* now = data;
+    const uint8_t* end = data + size;
+    while (now < end) {
+        auto field = (const RawRecordField*)now;
+        verify(now + sizeof(RawRecordField) + field->size <= end);
+
+        const auto block = find_block_layout(record, field->type);
+        if (!block) {
+            now += sizeof(RawRecordField) + field->size;
+            continue;
+        }
+
+        for (size_t i = 0; i < block->block_size && now < end; ++i) {
+            field = (const RawRecordField*)now;
+            verify(now + sizeof(RawRecordField) + field->size <= end);
+
+            if (i < block->layouts.count) {
+                scan_field_formids(record_type, block->layouts.data[i], field, callback, context);
+            }
+            now += sizeof(RawRecordField) + field->size;
+        }
+    }
+}
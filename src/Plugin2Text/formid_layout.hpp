@@ -0,0 +1,19 @@
+#pragma once
+#include "tes.hpp"
+
+using RecordFormIDCallback = void(*)(void* context, const FormID* form_id, RecordFieldType field_type);
+
+// Calls "callback" for every Form ID stored in fields of record: fields and struct members of Form ID
+// type, Form ID arrays, VMAD objects, CTDA arguments and references, NVPP paths and nodes, NVNM parent
+// worldspace or cell, edge links and doors. "data" is uncompressed field data of record, Form ID of
+// record itself is not reported. Locations of Form IDs are taken from offset tables which are built
+// from record definitions once, so types are not interpreted for each record. "form_id" points into
+// "data" and may be unaligned. Null Form IDs are reported too. Thread safe.
+void scan_record_formids(RecordType record_type, const uint8_t* data, size_t size, RecordFormIDCallback callback, void* context);
+
+template<typename Func>
+void scan_record_formids(RecordType record_type, const uint8_t* data, size_t size, Func func) {
+    scan_record_formids(record_type, data, size, [](void* context, const FormID* form_id, RecordFieldType field_type) {
+        (*(Func*)context)(form_id, field_type);
+    }, &func);
+}
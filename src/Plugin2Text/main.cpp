@@ -3,30 +3,89 @@
 #include "text_to_esp.hpp"
 #include "common.hpp"
 #include "esp_parser.hpp"
+#include "esp_diff.hpp"
+#include "esp_conflicts.hpp"
+#include "esp_references.hpp"
+#include "esp_remap.hpp"
+#include "esp_query.hpp"
+#include "esp_table.hpp"
+#include "esp_to_json.hpp"
 #include <stdio.h>
 #include "os.hpp"
 #include <stdarg.h>
 #include "array.hpp"
 #include "xml.hpp"
 #include "papyrus.hpp"
+#include "args.hpp"
+#include "profiler.hpp"
+#include <thread>
+#include <atomic>
 
 static void print_usage(const char* hint) {
     puts(hint);
     puts(
         "Usage: plugin2text.exe <source file> [destination file]\n"
+        "       plugin2text.exe --diff <old plugin> <new plugin>\n"
+        "       plugin2text.exe --conflicts <load order file>\n"
+        "       plugin2text.exe --references <plugin>\n"
+        "       plugin2text.exe --remap-formids=<map file> <plugin> <destination plugin>\n"
+        "       plugin2text.exe --compact-esl <plugin> <destination plugin>\n"
+        "       plugin2text.exe --query=<query> <plugin or load order file> [destination file]\n"
+        "       plugin2text.exe --export-table=<RECORD>:<FIELD> <plugin> [destination file]\n"
+        "       plugin2text.exe --json <plugin> [destination file]\n"
         "\n"
         "    <source file>              file to convert (*.esp, *.esm, *.esl, *.txt)\n"
         "    [destination file]         output path\n"
         "\n"
         "Options:\n"
         "\n"
-        "    --time                     output elapsed time in stdout\n"
+        "    --time[=text|json]         output elapsed time, per-phase timings and counters\n"
+        "                               in stdout (default: text)\n"
+        "    --trace=<path>             write Chrome trace event file (chrome://tracing,\n"
+        "                               ui.perfetto.dev) with timeline of conversion phases\n"
+        "    --diff                     print records that were added, removed or changed\n"
+        "                               between two plugins in text format to stdout\n"
+        "    --conflicts                print records overridden by more than one plugin and\n"
+        "                               fields that differ between them. <load order file>\n"
+        "                               lists plugin file names in load order, one per line\n"
+        "                               (plugins.txt format). Plugins are read from Data folder,\n"
+        "                               see --data-folder\n"
+        "    --references               print references to Form IDs that are missing in plugin,\n"
+        "                               records that are not referenced by other records and\n"
+        "                               number of references to each referenced record\n"
+        "    --remap-formids=<map file> write copy of plugin with Form IDs renumbered in record\n"
+        "                               headers and fields. Each line of <map file> is pair of\n"
+        "                               hexadecimal Form IDs \"<old> <new>\", or pair of two digit\n"
+        "                               master indices to change master of other Form IDs\n"
+        "    --compact-esl              write copy of plugin with own records renumbered into\n"
+        "                               Form ID range of light plugins (800-FFF)\n"
+        "    --query=<query>            print records that match query in text format. Query is\n"
+        "                               clauses \"<key><op><value>[,<value>...]\" joined with \"&\"\n"
+        "                               (and) or \"|\" (or). Key is \"type\", \"id\", \"ref\" (any\n"
+        "                               referenced Form ID), field type or \"<field>.<member>\",\n"
+        "                               operator is one of =, !=, ~ (contains), <, >. Output is\n"
+        "                               written to stdout if [destination file] is omitted\n"
+        "    --export-table=<RECORD>:<FIELD>\n"
+        "                               write members of <FIELD> field of <RECORD> records as\n"
+        "                               table, one row per field. Values are tab-separated if\n"
+        "                               [destination file] has TSV extension, comma-separated\n"
+        "                               otherwise. Output is written to stdout if [destination\n"
+        "                               file] is omitted\n"
+        "    --json                     write records of plugin as JSON, one object per line\n"
+        "                               (NDJSON). Output is written to stdout if [destination\n"
+        "                               file] is omitted\n"
+        "    --record=<FormID>          convert only record with specified hexadecimal Form ID\n"
+        "                               to text without parsing the rest of plugin. Can be\n"
+        "                               used multiple times. Output is written to stdout if\n"
+        "                               [destination file] is omitted\n"
         "\n"
         "Text serialization options:\n"
         "\n"
         "    --export-timestamp         write timestamps for records\n"
         "    --preserve-order           always write records/fields in the same order as in ESP\n"
         "    --preserve-junk            do not clear fields that may contain junk data\n"
+        "    --language=<name>          language of string tables of localized plugins\n"
+        "                               (Strings\\<plugin>_<name>.STRINGS, default: english)\n"
         "    --export-related-files     export files required for mod to function (scripts,\n"
         "                               facegen textures, SEQ file). --data-folder and \n"
         "                               --export-folder options must be set\n"
@@ -50,6 +109,33 @@ static void print_usage(const char* hint) {
         "\n"
         "    plugin2text.exe Dawnguard.txt Dawnguard.esm\n"
         "        convert Dawnguard.txt to TES plugin and write resulting file to Dawnguard.esm\n"
+        "\n"
+        "    plugin2text.exe Skyrim.esm --record=00012E46 --record=0001A26F\n"
+        "        print records 00012E46 and 0001A26F from Skyrim.esm in text format\n"
+        "\n"
+        "    plugin2text.exe --diff MyMod_old.esp MyMod.esp\n"
+        "        print records changed in MyMod.esp compared to MyMod_old.esp\n"
+        "\n"
+        "    plugin2text.exe --conflicts plugins.txt\n"
+        "        print conflicting records of plugins enabled in plugins.txt\n"
+        "\n"
+        "    plugin2text.exe --references MyMod.esp\n"
+        "        print unreferenced records and missing references of MyMod.esp\n"
+        "\n"
+        "    plugin2text.exe --compact-esl MyMod.esp MyMod_compacted.esp\n"
+        "        renumber records of MyMod.esp so it can be flagged as light plugin\n"
+        "\n"
+        "    plugin2text.exe --query=\"type=REFR & NAME=0001B1D8\" plugins.txt\n"
+        "        print placed references of base form 0001B1D8 in plugins enabled in plugins.txt\n"
+        "\n"
+        "    plugin2text.exe --query=\"VMAD.Property=PlayerRef\" MyMod.esp\n"
+        "        print records of MyMod.esp with scripts that have PlayerRef property\n"
+        "\n"
+        "    plugin2text.exe --export-table=WEAP:DNAM Skyrim.esm weapons.csv\n"
+        "        write weapon data of Skyrim.esm to weapons.csv\n"
+        "\n"
+        "    plugin2text.exe --json Skyrim.esm Skyrim.ndjson\n"
+        "        write records of Skyrim.esm to Skyrim.ndjson, one JSON object per line\n"
     );
 }
 
@@ -58,6 +144,34 @@ static const wchar_t* get_file_extension(const wchar_t* string) {
     return index == -1 ? L"" : &string[index];
 }
 
+static bool is_plugin_file_extension(const wchar_t* extension) {
+    return string_equals(extension, L".esp") || string_equals(extension, L".esm") || string_equals(extension, L".esl");
+}
+
+// Parses "<RECORD>:<FIELD>" pair of four character codes, e.g. "WEAP:DNAM".
+static bool parse_record_field_pair(const wchar_t* value, RecordType* record_type, RecordFieldType* field_type) {
+    if (wcslen(value) != 9 || value[4] != ':') {
+        return false;
+    }
+
+    char chars[8];
+    for (int i = 0; i < 8; ++i) {
+        const auto c = value[i < 4 ? i : i + 1];
+        if (c < 0x20 || c > 0x7E) {
+            return false;
+        }
+        chars[i] = (char)c;
+    }
+
+    uint32_t record = 0;
+    uint32_t field = 0;
+    memcpy(&record, &chars[0], 4);
+    memcpy(&field, &chars[4], 4);
+    *record_type = (RecordType)record;
+    *field_type = (RecordFieldType)field;
+    return true;
+}
+
 static const wchar_t* get_filespec(const wchar_t* string) {
     int index = string_last_index_of(string, '\\');
     if (index == -1) {
@@ -82,45 +196,28 @@ static const wchar_t* replace_destination_file_extension(const wchar_t* source_f
     return destination_file;
 }
 
-struct ArgParser {
-    struct Option {
-        const wchar_t* key = L"";
-        const wchar_t* value = L"";
-    };
-
-    Array<wchar_t*> arguments{ tmpalloc };
-    Array<wchar_t*> flags{ tmpalloc };
-    Array<Option> options{ tmpalloc };
-
-    void parse() {
-        int argc = 0;
-        const auto argv = get_command_line_args(&argc);
-
-        for (int i = 1; i < argc; ++i) {
-            auto arg = argv[i];
-            if (string_starts_with(arg, L"--")) {
-                auto option_start = arg + 2;
-                auto assign_index = string_index_of(option_start, '=');
-                if (assign_index != -1) {
-                    Option option;
-                    option.key = substring(tmpalloc, option_start, option_start + assign_index);
-                    option.value = substring(tmpalloc, option_start + assign_index + 1, option_start + assign_index + wcslen(option_start));
-                    options.push(option);
-                } else {
-                    flags.push(option_start);
-                }
-            } else {
-                arguments.push(arg);
-            }
-        }
-    }
+enum class TimeOutput {
+    None,
+    Text,
+    Json,
 };
 
 struct Args {
     const wchar_t* source_file = nullptr;
     const wchar_t* destination_file = nullptr;
     ProgramOptions options = ProgramOptions::None;
-    bool time = false;
+    TimeOutput time = TimeOutput::None;
+    bool diff = false;
+    bool conflicts = false;
+    bool references = false;
+    bool compact_esl = false;
+    bool json = false;
+    const wchar_t* remap_formids = nullptr;
+    const wchar_t* query = nullptr;
+    const wchar_t* export_table = nullptr;
+    const wchar_t* trace_file = nullptr;
+    const wchar_t* language = L"english";
+    Array<FormID> records{ tmpalloc };
 
     const wchar_t* data_folder = nullptr;
     const wchar_t* export_folder = nullptr;
@@ -143,7 +240,17 @@ struct Args {
             if (string_equals(flag, L"export-timestamp") || string_equals(flag, L"export-timestamps")) {
                 options |= ProgramOptions::ExportTimestamp;
             } else if (string_equals(flag, L"time")) {
-                time = true;
+                time = TimeOutput::Text;
+            } else if (string_equals(flag, L"diff")) {
+                diff = true;
+            } else if (string_equals(flag, L"conflicts")) {
+                conflicts = true;
+            } else if (string_equals(flag, L"references")) {
+                references = true;
+            } else if (string_equals(flag, L"compact-esl")) {
+                compact_esl = true;
+            } else if (string_equals(flag, L"json")) {
+                json = true;
             } else if (string_equals(flag, L"preserve-order")) {
                 options |= ProgramOptions::PreserveOrder;
             } else if (string_equals(flag, L"preserve-junk")) {
@@ -162,6 +269,32 @@ struct Args {
                 data_folder = option.value;
             } else if (string_equals(option.key, L"export-folder")) {
                 export_folder = option.value;
+            } else if (string_equals(option.key, L"record")) {
+                wchar_t* value_end = nullptr;
+                const auto value = wcstoul(option.value, &value_end, 16);
+                if (!*option.value || *value_end || value > UINT32_MAX) {
+                    exit_error(L"invalid Form ID \"%s\" in --record option, expected hexadecimal number", option.value);
+                }
+                records.push({ (uint32_t)value });
+            } else if (string_equals(option.key, L"query")) {
+                query = option.value;
+            } else if (string_equals(option.key, L"export-table")) {
+                export_table = option.value;
+            } else if (string_equals(option.key, L"remap-formids")) {
+                remap_formids = option.value;
+            } else if (string_equals(option.key, L"trace")) {
+                trace_file = option.value;
+            } else if (string_equals(option.key, L"language")) {
+                language = option.value;
+            } else if (string_equals(option.key, L"time")) {
+                if (string_equals(option.value, L"text")) {
+                    time = TimeOutput::Text;
+                } else if (string_equals(option.value, L"json")) {
+                    time = TimeOutput::Json;
+                } else {
+                    wprintf(L"warning: unknown --time format \"%s\", expected \"text\" or \"json\"\n", option.value);
+                    time = TimeOutput::Text;
+                }
             } else {
                 wprintf(L"warning: unknown option \"--%s=%s\"\n", option.key, option.value);
             }
@@ -187,23 +320,99 @@ static wchar_t* twprintf(const wchar_t* format, ...) {
     return buffer;
 }
 
-static void push_if_not_duplicate(Array<const WString*>& paths, const WString* str) {
-    if (str->count == 0) {
-        return;
-    }
-    
-    for (const auto path : paths) {
-        if (path->count == str->count && 0 == _strnicmp(path->data, str->data, path->count)) {
+// Script names in order of first use. The same scripts are attached to many records, names are deduplicated
+// with case-insensitive hash set instead of comparing with every collected name.
+struct ScriptNameList {
+    Array<const WString*> names{ tmpalloc };
+    StaticArray<const WString*> slots; // Open addressing, count is power of two.
+
+    void push_if_not_duplicate(const WString* name) {
+        if (name->count == 0) {
             return;
         }
+
+        if ((size_t)(names.count + 1) * 2 > slots.count) {
+            const auto capacity = slots.count ? slots.count * 2 : 64;
+            slots = { (const WString**)memalloc(tmpalloc, sizeof(const WString*) * capacity), capacity };
+            memset(slots.data, 0, sizeof(const WString*) * capacity);
+            for (const auto existing : names) {
+                *find_slot(existing) = existing;
+            }
+        }
+
+        const auto slot = find_slot(name);
+        if (!*slot) {
+            *slot = name;
+            names.push(name);
+        }
     }
-    paths.push(str);
-}
 
-static void export_related_files(const Args& args, const wchar_t* esp_name, const Array<RecordBase*>& records) {
-    const auto data_path = args.data_folder && wcslen(args.data_folder)
+private:
+    // Returns slot that contains name or empty slot where it should be inserted.
+    const WString** find_slot(const WString* name) {
+        auto index = hash_string_ignore_case(name->data, name->count) & (slots.count - 1);
+        while (true) {
+            const auto slot = &slots.data[index];
+            if (!*slot || ((*slot)->count == name->count && 0 == _strnicmp((*slot)->data, name->data, name->count))) {
+                return slot;
+            }
+            index = (index + 1) & (slots.count - 1);
+        }
+    }
+};
+
+static Path get_data_folder(const Args& args) {
+    return args.data_folder && wcslen(args.data_folder)
         ? Path{ args.data_folder }
         : Path{ get_skyrim_se_install_path(), L"Data" };
+}
+
+// Returns paths of plugins listed in load order file. If some lines are marked with "*" like
+// in plugins.txt, other lines are plugins which are not enabled and they are skipped.
+static Array<const wchar_t*> read_load_order(const Args& args, const wchar_t* load_order_path) {
+    const auto data_path = get_data_folder(args);
+    const auto text = read_file(tmpalloc, load_order_path);
+
+    Array<StaticArray<char>> lines{ tmpalloc };
+    bool has_enabled_marks = false;
+
+    const auto end = (const char*)text.data + text.count;
+    for (auto now = (const char*)text.data; now < end;) {
+        auto line_end = now;
+        while (line_end < end && *line_end != '\n') {
+            ++line_end;
+        }
+        const auto next_line = line_end + 1;
+        while (line_end > now && (line_end[-1] == '\r' || line_end[-1] == ' ')) {
+            --line_end;
+        }
+
+        if (line_end > now && *now != '#') {
+            has_enabled_marks |= *now == '*';
+            lines.push({ (char*)now, (size_t)(line_end - now) });
+        }
+        now = next_line;
+    }
+
+    Array<const wchar_t*> paths{ tmpalloc };
+    for (const auto& line : lines) {
+        auto name = line;
+        if (*name.data == '*') {
+            ++name.data;
+            --name.count;
+        } else if (has_enabled_marks) {
+            continue;
+        }
+
+        const auto path = memnew(tmpalloc) Path{ data_path.path, twprintf(L"%.*S", (int)name.count, name.data) };
+        paths.push(path->path);
+    }
+
+    return paths;
+}
+
+static void export_related_files(const Args& args, const wchar_t* esp_name, const Array<RecordBase*>& records) {
+    const auto data_path = get_data_folder(args);
     const auto export_path = args.export_folder && wcslen(args.export_folder)
         ? Path{ args.export_folder }
         : Path{ get_current_directory() };
@@ -217,7 +426,7 @@ static void export_related_files(const Args& args, const wchar_t* esp_name, cons
 
     Array<FormID> facegens{ tmpalloc };
     Array<FormID> seq_formids{ tmpalloc };
-    Array<const WString*> script_paths{ tmpalloc }; // @TODO: Remove built-in scripts.
+    ScriptNameList script_paths; // @TODO: Remove built-in scripts.
     Array<FormID> dialogue_views{ tmpalloc };
 
     foreach_record(records, [&facegens, &seq_formids, &script_paths, &dialogue_views](Record* record) -> void {
@@ -227,17 +436,9 @@ static void export_related_files(const Args& args, const wchar_t* esp_name, cons
             } break;
 
             case RecordType::QUST: {
-                const auto dnam = record->find_field(RecordFieldType::DNAM);
-
-                enum class Flags : uint16_t {
-                    StartGameEnabled = 0x1,
-                };
-
-                if (dnam && dnam->data.count >= sizeof(Flags)) {
-                    auto flags = *(Flags*)dnam->data.data;
-                    if ((uint16_t)flags & (uint16_t)Flags::StartGameEnabled) {
-                        seq_formids.push(record->id);
-                    }
+                const auto dnam = record->get<QUST_DNAM>();
+                if (dnam && is_bit_set(dnam->flags, QUST_Flags::StartGameEnabled)) {
+                    seq_formids.push(record->id);
                 }
             } break;
 
@@ -248,47 +449,25 @@ static void export_related_files(const Args& args, const wchar_t* esp_name, cons
 
         const auto vmad_field = record->find_field(RecordFieldType::VMAD);
         if (vmad_field) {
-            VMAD_Field vmad;
-            vmad.parse(vmad_field->data.data, vmad_field->data.count, record->type, true);
-
-            for (const auto& script : vmad.scripts) {
-                push_if_not_duplicate(script_paths, script.name);
-            }
-
-            if (vmad.contains_record_specific_info) {
-                switch (record->type) {
-                    case RecordType::INFO: {
-                        if (is_bit_set(vmad.info.flags, PapyrusFragmentFlags::HasBeginScript)) {
-                            push_if_not_duplicate(script_paths, vmad.info.start_fragment.script_name);
-                        }
-                        if (is_bit_set(vmad.info.flags, PapyrusFragmentFlags::HasEndScript)) {
-                            push_if_not_duplicate(script_paths, vmad.info.end_fragment.script_name);
-                        }
-                    } break;
-
-                    case RecordType::QUST: {
-                        for (const auto& fragment : vmad.qust.fragments) {
-                            push_if_not_duplicate(script_paths, fragment.script_name);
-                        }
-                        for (const auto& alias : vmad.qust.aliases) {
-                            for (const auto& script : alias.scripts) {
-                                push_if_not_duplicate(script_paths, script.name);
-                            }
-                        }
-                    } break;
-
-                    // @TODO: Handle rest of RecordTypes's.
-                }
-            }
+            scan_vmad_script_names(vmad_field->data.data, vmad_field->data.count, record->type, [&script_paths](const WString* name) {
+                script_paths.push_if_not_duplicate(name);
+            });
         }
     });
 
-    struct ItemPath {
+    enum class ExportKind {
+        Copy,
+        PapyrusSource, // Fragments are sorted, see "papyrus_sort_fragments".
+        DialogueView, // XML is formatted.
+    };
+
+    struct ExportItem {
         wchar_t* path = nullptr;
-        bool is_papyrus_source = false;
+        ExportKind kind = ExportKind::Copy;
+        const wchar_t* error = nullptr; // Set if export failed.
     };
 
-    Array<ItemPath> paths{ tmpalloc };
+    Array<ExportItem> items{ tmpalloc };
     if (facegens.count > 0) {
         const auto folder_path = Path{
             export_path.path,
@@ -303,45 +482,109 @@ static void export_related_files(const Args& args, const wchar_t* esp_name, cons
                 esp_name,
                 twprintf(L"%08X.dds", facegen.value)
             };
-            paths.push({ path->path });
+            items.push({ path->path });
         }
     }
 
     // @TODO: Read paths from Creation Kit INI.
-    if (script_paths.count > 0) {
+    if (script_paths.names.count > 0) {
         const auto folder_path = Path{
             export_path.path,
             L"Scripts\\Source",
         };
         create_folder(folder_path.path);
 
-        for (const auto script_path : script_paths) {
-            paths.push({ twprintf(L"Scripts\\Source\\%.*S.psc", script_path->count, script_path->data), true });
-            paths.push({ twprintf(L"Scripts\\%.*S.pex", script_path->count, script_path->data) });
+        for (const auto script_path : script_paths.names) {
+            items.push({ twprintf(L"Scripts\\Source\\%.*S.psc", script_path->count, script_path->data), ExportKind::PapyrusSource });
+            items.push({ twprintf(L"Scripts\\%.*S.pex", script_path->count, script_path->data) });
         }
     }
 
-    for (const auto path : paths) {
-        const auto src_path = Path{ data_path.path, path.path };
-        const auto dst_path = Path{ export_path.path, path.path };
+    if (dialogue_views.count > 0) {
+        const auto folder_path = Path{
+            export_path.path,
+            L"DialogueViews",
+        };
+        create_folder(folder_path.path);
 
-        if (path.is_papyrus_source) {
-            auto source = try_read_file(tmpalloc, src_path.path);
-            if (!source.count) {
-                wprintf(L"[ERROR] \"%s\": %s\n", path.path, get_last_error());
-                continue;
+        for (const auto dialogue_view : dialogue_views) {
+            items.push({ twprintf(L"DialogueViews\\%08X.xml", dialogue_view.value), ExportKind::DialogueView });
+        }
+    }
+
+    // Plain copies run on worker threads. Transforms use tmpalloc, which is not thread safe, so they run
+    // on this thread while copies are in progress. Results are printed afterwards in collection order.
+    Array<ExportItem*> copies{ tmpalloc };
+    for (auto& item : items) {
+        if (item.kind == ExportKind::Copy) {
+            copies.push(&item);
+        }
+    }
+
+    std::atomic<int> next_copy = 0;
+    const auto copy_work = [&data_path, &export_path, &copies, &next_copy]() {
+        while (true) {
+            const auto index = next_copy.fetch_add(1);
+            if (index >= copies.count) {
+                break;
             }
 
-            auto sorted = papyrus_sort_fragments({ (char*)source.data, (int)source.count });
-            write_file(dst_path.path, { (uint8_t*)sorted.chars, (size_t)sorted.count });
-            wprintf(L"[OK] \"%s\"\n", path.path);
-        } else {
-            if (copy_file(src_path.path, dst_path.path)) {
-                wprintf(L"[OK] \"%s\"\n", path.path);
-            } else {
-                wprintf(L"[ERROR] \"%s\": %s\n", path.path, get_last_error());
+            const auto item = copies.data[index];
+            const auto src_path = Path{ data_path.path, item->path };
+            const auto dst_path = Path{ export_path.path, item->path };
+            if (!copy_file(src_path.path, dst_path.path)) {
+                item->error = get_last_error();
             }
         }
+    };
+
+    int worker_count = (int)std::thread::hardware_concurrency();
+    if (worker_count > copies.count) {
+        worker_count = copies.count;
+    }
+
+    const auto workers = (std::thread*)memalloc(tmpalloc, sizeof(std::thread) * worker_count);
+    for (int i = 0; i < worker_count; ++i) {
+        new(&workers[i]) std::thread(copy_work);
+    }
+
+    for (auto& item : items) {
+        if (item.kind == ExportKind::Copy) {
+            continue;
+        }
+
+        TEMP_SCOPE();
+
+        const auto src_path = Path{ data_path.path, item.path };
+        const auto dst_path = Path{ export_path.path, item.path };
+        const auto source = try_read_file(tmpalloc, src_path.path);
+        if (!source.count) {
+            item.error = get_last_error();
+            continue;
+        }
+
+        String output;
+        if (item.kind == ExportKind::PapyrusSource) {
+            output = papyrus_sort_fragments({ (char*)source.data, (int)source.count });
+        } else {
+            XmlFormatter formatter;
+            output = formatter.format({ (char*)source.data, (int)source.count });
+        }
+        write_file(dst_path.path, { (uint8_t*)output.chars, (size_t)output.count });
+    }
+
+    copy_work();
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i].join();
+        workers[i].~thread();
+    }
+
+    for (const auto& item : items) {
+        if (item.error) {
+            wprintf(L"[ERROR] \"%s\": %s\n", item.path, item.error);
+        } else {
+            wprintf(L"[OK] \"%s\"\n", item.path);
+        }
     }
 
     if (seq_formids.count > 0) {
@@ -351,37 +594,29 @@ static void export_related_files(const Args& args, const wchar_t* esp_name, cons
         write_file(dst_path.path, { (uint8_t*)seq_formids.data, seq_formids.count * sizeof(seq_formids.data[0]) });
         wprintf(L"[OK] \"%s\"\n", path.path);
     }
+}
 
-    if (dialogue_views.count > 0) {
-        const auto folder_path = Path{
-            export_path.path,
-            L"DialogueViews",
-        };
-        create_folder(folder_path.path);
-
-        for (const auto dialogue_view : dialogue_views) {
-            TEMP_SCOPE();
-
-            const auto name = twprintf(L"DialogueViews\\%08X.xml", dialogue_view.value);
-            const auto src_path = Path{ data_path.path, name };
-            const auto dst_path = Path{ export_path.path, name };
-            const auto xml_data = try_read_file(tmpalloc, src_path.path);
-            if (!xml_data.count) {
-                wprintf(L"[ERROR] \"%s\": %s\n", name, get_last_error());
-                continue;
-            }
+// LString fields of localized plugins are written as string IDs if string tables can't be loaded.
+static void load_string_tables(const Args& args, const wchar_t* plugin_path, const StaticArray<uint8_t> file, StringTables* strings) {
+    verify(file.count >= sizeof(RawRecord));
+    const auto tes4 = (const RawRecord*)file.data;
+    if (tes4->type != RecordType::TES4 || !is_bit_set(tes4->flags, RecordFlags::TES4_Localized)) {
+        return;
+    }
 
-            XmlFormatter formatter;
-            const auto formatted_xml_data = formatter.format({ (char*)xml_data.data, (int)xml_data.count });
-            write_file(dst_path.path, { (uint8_t*)formatted_xml_data.chars, (size_t)formatted_xml_data.count });
-            wprintf(L"[OK] \"%s\"\n", name);
-        }
+    if (!strings->load(plugin_path, args.language)) {
+        const auto path = get_string_table_path(plugin_path, args.language, StringTableType::Strings);
+        wprintf(L"warning: string tables for \"%s\" are missing (\"%s\"), localized strings will be written as string IDs\n", get_filespec(plugin_path), path.path);
     }
 }
 
 int main() {
     void memory_init();
     memory_init();
+
+#if PLUGIN2TEXT_TYPE_PROFILE
+    atexit(print_type_profile);
+#endif
     
     Args args;
     args.parse();
@@ -397,11 +632,136 @@ int main() {
         ? Path{ args.destination_file }
         : Path{ replace_destination_file_extension(source_file.path, source_file_extension) };
 
-    const auto start = args.time ? get_current_timestamp() : 0;
+    profiler.enabled = args.time != TimeOutput::None || args.trace_file != nullptr;
+    profiler.tracing = args.trace_file != nullptr;
+    const auto start = profiler.enabled ? get_current_timestamp() : 0;
+    profiler.trace_start = start;
 
-    if (string_equals(source_file_extension, L".txt")) {
-        text_to_esp(source_file.path, destination_file.path);
-    } else if (string_equals(source_file_extension, L".esp") || string_equals(source_file_extension, L".esm") || string_equals(source_file_extension, L".esl")) {
+    defer(if (args.trace_file) write_trace(args.trace_file));
+    TraceScope file_trace{ "file", get_filespec(source_file.path) };
+
+    int exit_code = 0;
+    if (args.diff) {
+        if (!args.destination_file) {
+            exit_error(L"--diff option requires two plugin files");
+        }
+        if (!is_plugin_file_extension(source_file_extension) || !is_plugin_file_extension(get_file_extension(args.destination_file))) {
+            exit_error(L"--diff option requires plugin files (*.esp, *.esm, *.esl)");
+        }
+
+        const auto old_file = read_file(tmpalloc, source_file.path);
+        const auto new_file = read_file(tmpalloc, args.destination_file);
+        const auto stats = diff_esps(args.options, old_file, new_file, source_file.path, args.destination_file);
+
+        printf("%zu added, %zu removed, %zu changed\n", stats.added, stats.removed, stats.changed);
+        exit_code = stats.added || stats.removed || stats.changed ? 1 : 0;
+    } else if (args.conflicts) {
+        const auto plugin_paths = read_load_order(args, source_file.path);
+        if (!plugin_paths.count) {
+            exit_error(L"no plugins found in load order file \"%s\"", source_file.path);
+        }
+
+        const auto stats = scan_conflicts(args.options, { (const wchar_t**)plugin_paths.data, (size_t)plugin_paths.count });
+        printf("%zu plugins, %zu records, %zu overridden by more than one plugin, %zu conflicts\n", stats.plugin_count, stats.record_count, stats.overridden_count, stats.conflict_count);
+    } else if (args.references) {
+        if (!is_plugin_file_extension(source_file_extension)) {
+            exit_error(L"--references option requires plugin source file (*.esp, *.esm, *.esl)");
+        }
+
+        const auto file = read_file(tmpalloc, source_file.path);
+        const auto stats = scan_references(file);
+        printf("%zu records, %zu references (%zu to masters), %zu missing, %zu unreferenced\n", stats.record_count, stats.reference_count, stats.master_reference_count, stats.missing_count, stats.unreferenced_count);
+    } else if (args.remap_formids || args.compact_esl) {
+        const auto option_name = args.compact_esl ? L"--compact-esl" : L"--remap-formids";
+        if (args.remap_formids && args.compact_esl) {
+            exit_error(L"--remap-formids and --compact-esl options can't be used together");
+        }
+        if (!is_plugin_file_extension(source_file_extension)) {
+            exit_error(L"%s option requires plugin source file (*.esp, *.esm, *.esl)", option_name);
+        }
+        if (!args.destination_file || !is_plugin_file_extension(get_file_extension(args.destination_file))) {
+            exit_error(L"%s option requires destination plugin file (*.esp, *.esm, *.esl)", option_name);
+        }
+
+        const auto file = read_file(tmpalloc, source_file.path);
+
+        FormIDMap map;
+        defer(map.dispose());
+        uint32_t next_object_id = 0;
+        if (args.compact_esl) {
+            next_object_id = build_compact_esl_map(&map, file);
+        } else {
+            load_formid_map(&map, args.remap_formids);
+        }
+
+        const auto stats = remap_formids(file, map, next_object_id, args.destination_file);
+        printf("%zu records, %zu Form IDs changed, %zu records recompressed\n", stats.record_count, stats.changed_count, stats.recompressed_count);
+    } else if (args.query) {
+        Array<const wchar_t*> plugin_paths{ tmpalloc };
+        if (is_plugin_file_extension(source_file_extension)) {
+            plugin_paths.push(source_file.path);
+        } else if (string_equals(source_file_extension, L".txt")) {
+            plugin_paths = read_load_order(args, source_file.path);
+            if (!plugin_paths.count) {
+                exit_error(L"no plugins found in load order file \"%s\"", source_file.path);
+            }
+        } else {
+            exit_error(L"--query option requires plugin source file (*.esp, *.esm, *.esl) or load order file (*.txt)");
+        }
+
+        const auto stats = query_records(args.options, args.query, { (const wchar_t**)plugin_paths.data, (size_t)plugin_paths.count }, args.destination_file);
+        printf("%zu plugins, %zu records, %zu inflated, %zu matches\n", stats.plugin_count, stats.record_count, stats.inflated_count, stats.match_count);
+        exit_code = stats.match_count ? 0 : 1;
+    } else if (args.export_table) {
+        RecordType record_type;
+        RecordFieldType field_type;
+        if (!parse_record_field_pair(args.export_table, &record_type, &field_type)) {
+            exit_error(L"invalid --export-table value \"%s\", expected \"<RECORD>:<FIELD>\", e.g. \"WEAP:DNAM\"", args.export_table);
+        }
+        if (!is_plugin_file_extension(source_file_extension)) {
+            exit_error(L"--export-table option requires plugin source file (*.esp, *.esm, *.esl)");
+        }
+
+        const auto file = read_file(tmpalloc, source_file.path);
+
+        StringTables strings;
+        load_string_tables(args, source_file.path, file, &strings);
+        defer(strings.dispose());
+
+        const auto stats = export_table(args.options, file, &strings, record_type, field_type, get_table_separator(args.destination_file), args.destination_file);
+        if (args.destination_file) {
+            printf("%zu records, %zu rows, %zu columns\n", stats.record_count, stats.row_count, stats.column_count);
+        }
+    } else if (args.json) {
+        if (!is_plugin_file_extension(source_file_extension)) {
+            exit_error(L"--json option requires plugin source file (*.esp, *.esm, *.esl)");
+        }
+
+        const auto file = read_file(tmpalloc, source_file.path);
+
+        StringTables strings;
+        load_string_tables(args, source_file.path, file, &strings);
+        defer(strings.dispose());
+
+        const auto stats = esp_to_json(args.options, file, &strings, args.destination_file);
+        if (args.destination_file) {
+            printf("%zu records, %zu compressed\n", stats.record_count, stats.compressed_count);
+        }
+    } else if (args.records.count) {
+        if (!is_plugin_file_extension(source_file_extension)) {
+            exit_error(L"--record option requires plugin source file (*.esp, *.esm, *.esl)");
+        }
+
+        const auto file = read_file(tmpalloc, source_file.path);
+
+        StringTables strings;
+        load_string_tables(args, source_file.path, file, &strings);
+        defer(strings.dispose());
+
+        esp_records_to_text(args.options, file, &strings, { args.records.data, (size_t)args.records.count }, args.destination_file);
+    } else if (string_equals(source_file_extension, L".txt")) {
+        text_to_esp(source_file.path, destination_file.path, args.language);
+    } else if (is_plugin_file_extension(source_file_extension)) {
         EspParser parser;
         parser.init(tmpalloc, args.options);
         defer(parser.dispose());
@@ -409,18 +769,27 @@ int main() {
         const auto file = read_file(tmpalloc, source_file.path);
         const auto model = parser.parse(file);
 
+        StringTables strings;
+        load_string_tables(args, source_file.path, file, &strings);
+        defer(strings.dispose());
+
         if (is_bit_set(args.options, ProgramOptions::ExportRelatedFiles)) {
             export_related_files(args, get_filespec(source_file.path), model.records);
         }
 
-        esp_to_text(args.options, model, destination_file.path);
+        esp_to_text(args.options, model, &strings, destination_file.path);
     } else {
         exit_error(L"unrecognized source file extension \"%s\" (\"%s\")", source_file_extension, source_file);
     }
 
-    if (args.time) {
-        printf("Time elapsed: %f seconds\n", timestamp_to_seconds(start, get_current_timestamp()));
+    if (args.time != TimeOutput::None) {
+        const auto total_seconds = timestamp_to_seconds(start, get_current_timestamp());
+        if (args.time == TimeOutput::Json) {
+            profiler.print_json(total_seconds);
+        } else {
+            profiler.print_text(total_seconds);
+        }
     }
     
-    return 0;
+    return exit_code;
 }
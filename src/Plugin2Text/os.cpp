@@ -5,11 +5,13 @@
 #include <ShlObj_core.h>
 #include "common.hpp"
 #include "os.hpp"
+#include "profiler.hpp"
 #include <PathCch.h>
 
 #pragma comment(lib, "pathcch.lib")
 
 StaticArray<uint8_t> try_read_file(Allocator& allocator, const wchar_t* path) {
+    ProfileScope profile{ ProfilePhase::FileRead };
     StaticArray<uint8_t> result;
     
     auto handle = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
@@ -36,6 +38,7 @@ StaticArray<uint8_t> try_read_file(Allocator& allocator, const wchar_t* path) {
     }
 
     result = { buffer, read };
+    profile.bytes = read;
     return result;
 }
 
@@ -45,6 +48,49 @@ StaticArray<uint8_t> read_file(Allocator& allocator, const wchar_t* path) {
     return result;
 }
 
+StaticArray<uint8_t> try_map_file(const wchar_t* path) {
+    StaticArray<uint8_t> result;
+
+    auto handle = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return result;
+    }
+    defer(CloseHandle(handle));
+
+    uint64_t size = 0;
+    if (!GetFileSizeEx(handle, (LARGE_INTEGER*)&size)) {
+        return result;
+    } else if (size <= 0) {
+        return result;
+    } else if (size > 0xffffffff) {
+        SetLastError(ERROR_FILE_TOO_LARGE);
+        return result;
+    }
+
+    // View keeps file mapping alive after handles are closed.
+    auto mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        return result;
+    }
+    defer(CloseHandle(mapping));
+
+    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        return result;
+    }
+
+    result = { (uint8_t*)view, (size_t)size };
+    return result;
+}
+
+void unmap_file(StaticArray<uint8_t>* data) {
+    verify(data);
+    if (data->data) {
+        verify(UnmapViewOfFile(data->data));
+    }
+    *data = {};
+}
+
 Slice allocate_virtual_memory(size_t size) {
     Slice slice;
     slice.start = (uint8_t*)VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
@@ -61,6 +107,8 @@ void free_virtual_memory(Slice* slice) {
 }
 
 void write_file(const wchar_t* path, const StaticArray<uint8_t>& data) {
+    PROFILE_SCOPE(FileWrite, data.count);
+
     auto handle = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
     verify(handle != INVALID_HANDLE_VALUE);
     verify(data.count <= 0xffffffff);
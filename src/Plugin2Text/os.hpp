@@ -6,6 +6,11 @@
 StaticArray<uint8_t> try_read_file(Allocator& allocator, const wchar_t* path);
 StaticArray<uint8_t> read_file(Allocator& allocator, const wchar_t* path);
 
+// Maps whole file into memory as read-only, pages are read on first access. Returns empty
+// array if file can't be opened or is empty.
+StaticArray<uint8_t> try_map_file(const wchar_t* path);
+void unmap_file(StaticArray<uint8_t>* data);
+
 Slice allocate_virtual_memory(size_t size);
 void free_virtual_memory(Slice* slice);
 void write_file(const wchar_t* path, const StaticArray<uint8_t>& data);
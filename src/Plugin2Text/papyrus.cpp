@@ -56,13 +56,19 @@ static void expect(String& str, const String& substr) {
     str.advance(substr.count);
 }
 
+// Returns index of first '\r', or of first '\n' if there are no '\r' characters.
+static int index_of_newline(const String& source) {
+    auto found = (const char*)memchr(source.chars, '\r', source.count);
+    if (!found) {
+        found = (const char*)memchr(source.chars, '\n', source.count);
+    }
+    return found ? (int)(found - source.chars) : -1;
+}
+
 static String string_until_newline(String& source) {
-    auto index = source.index_of("\r");
+    auto index = index_of_newline(source);
     if (index == -1) {
-        index = source.index_of("\n");
-        if (index == -1) {
-            index = source.count;
-        }
+        index = source.count;
     }
 
     auto result = String{ source.chars, index };
@@ -95,11 +101,8 @@ struct Fragment {
 
     void parse(String source) {
         {
-            auto index = source.index_of("\r");
-            if (index == -1) {
-                index = source.index_of("\n");
-                verify(index != -1);
-            }
+            const auto index = index_of_newline(source);
+            verify(index != -1);
 
             name = String{ &source.chars[0], index };
             source.advance(index);
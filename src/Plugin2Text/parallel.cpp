@@ -0,0 +1,107 @@
+#include "parallel.hpp"
+#include <new>
+
+static constexpr size_t UnitsPerThread = 8;
+static constexpr size_t MinUnitSize = 64 * 1024;
+static constexpr int MaxGroupDepth = 16;
+
+int get_thread_count(int item_count) {
+    int thread_count = (int)std::thread::hardware_concurrency();
+    if (thread_count > item_count) {
+        thread_count = item_count;
+    }
+    return thread_count < 1 ? 1 : thread_count;
+}
+
+size_t get_max_unit_size(size_t total_size) {
+    int thread_count = (int)std::thread::hardware_concurrency();
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    const auto max_unit_size = total_size / ((size_t)thread_count * UnitsPerThread);
+    return max_unit_size < MinUnitSize ? MinUnitSize : max_unit_size;
+}
+
+struct UnitSplitter {
+    size_t max_unit_size = 0;
+    PluginUnitCallback callback = nullptr;
+    void* context = nullptr;
+    const RawGrupRecord* groups[MaxGroupDepth];
+    int group_count = 0;
+
+    void add_unit(const uint8_t* start, const uint8_t* end) {
+        callback(context, start, end, { groups, (size_t)group_count });
+    }
+
+    void split(const uint8_t* start, const uint8_t* end) {
+        const uint8_t* unit_start = start;
+        const uint8_t* now = start;
+
+        while (now < end) {
+            verify(now + sizeof(RawRecord) <= end);
+            const auto record = (const RawRecord*)now;
+
+            size_t size = 0;
+            if (record->type == RecordType::GRUP) {
+                const auto group = (const RawGrupRecord*)record;
+                verify(group->group_size >= sizeof(RawGrupRecord) && now + group->group_size <= end);
+                size = group->group_size;
+
+                if (size > max_unit_size) {
+                    if (unit_start < now) {
+                        add_unit(unit_start, now);
+                    }
+
+                    verify(group_count < MaxGroupDepth);
+                    groups[group_count++] = group;
+                    split(now + sizeof(RawGrupRecord), now + size);
+                    --group_count;
+
+                    now += size;
+                    unit_start = now;
+                    continue;
+                }
+            } else {
+                size = sizeof(RawRecord) + record->data_size;
+                verify(now + size <= end);
+            }
+
+            now += size;
+            if ((size_t)(now - unit_start) >= max_unit_size) {
+                add_unit(unit_start, now);
+                unit_start = now;
+            }
+        }
+
+        if (unit_start < end) {
+            add_unit(unit_start, end);
+        }
+    }
+};
+
+void split_plugin_units(const uint8_t* start, const uint8_t* end, size_t max_unit_size, PluginUnitCallback callback, void* context) {
+    UnitSplitter splitter;
+    splitter.max_unit_size = max_unit_size;
+    splitter.callback = callback;
+    splitter.context = context;
+    splitter.split(start, end);
+}
+
+void WorkerThreads::start(int thread_count, ThreadCallback callback, void* context) {
+    verify(!threads);
+    count = thread_count;
+    threads = (std::thread*)memalloc(tmpalloc, sizeof(std::thread) * count);
+    for (int i = 0; i < count; ++i) {
+        new(&threads[i]) std::thread(callback, context);
+    }
+}
+
+void WorkerThreads::join() {
+    for (int i = 0; i < count; ++i) {
+        threads[i].join();
+        threads[i].~thread();
+    }
+    threads = nullptr;
+    count = 0;
+}
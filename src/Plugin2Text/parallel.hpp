@@ -0,0 +1,73 @@
+#pragma once
+#include "tes.hpp"
+#include <atomic>
+#include <thread>
+
+// Plugins are walked on several threads by splitting them into units, consecutive records and groups that
+// are walked by one thread. Threads take units one by one in file order, so threads that got small units
+// take more of them.
+
+// "groups" are groups that contain unit, outermost first. Array is valid only during the call.
+using PluginUnitCallback = void(*)(void* context, const uint8_t* start, const uint8_t* end, StaticArray<const RawGrupRecord*> groups);
+
+// Returns number of threads to process "item_count" items with, at most one thread per item.
+int get_thread_count(int item_count);
+
+// Returns size of units that "total_size" bytes of plugins should be split into. There are several units
+// per thread, so one slow unit doesn't hold up the rest.
+size_t get_max_unit_size(size_t total_size);
+
+// Splits records and groups between "start" and "end" into units of about "max_unit_size" bytes and calls
+// "callback" for each unit in file order. Groups that are larger than "max_unit_size" are split into their
+// records and subgroups, so one large world doesn't end up on one thread.
+void split_plugin_units(const uint8_t* start, const uint8_t* end, size_t max_unit_size, PluginUnitCallback callback, void* context);
+
+template<typename Func>
+void split_plugin_units(const uint8_t* start, const uint8_t* end, size_t max_unit_size, Func func) {
+    split_plugin_units(start, end, max_unit_size, [](void* context, const uint8_t* start, const uint8_t* end, StaticArray<const RawGrupRecord*> groups) {
+        (*(Func*)context)(start, end, groups);
+    }, &func);
+}
+
+// Counter that threads take work items from, items are taken in order.
+struct WorkCounter {
+    std::atomic<int> next_index{ 0 };
+    int count = 0;
+
+    explicit WorkCounter(int count) : count(count) { }
+
+    // Returns index of next item, or -1 if all items are taken.
+    int take() {
+        const int index = next_index++;
+        return index < count ? index : -1;
+    }
+};
+
+using ThreadCallback = void(*)(void* context);
+
+// Threads that run the same function, e.g. loop that takes items from "WorkCounter".
+struct WorkerThreads {
+    std::thread* threads = nullptr; // Allocated with "tmpalloc".
+    int count = 0;
+
+    void start(int thread_count, ThreadCallback callback, void* context);
+
+    // "func" must live until "join" returns.
+    template<typename Func>
+    void start(int thread_count, Func& func) {
+        start(thread_count, [](void* context) {
+            (*(Func*)context)();
+        }, (void*)&func);
+    }
+
+    void join();
+};
+
+// Runs "func" on "thread_count" threads, calling thread is one of them, and waits until all of them return.
+template<typename Func>
+void run_on_threads(int thread_count, Func func) {
+    WorkerThreads workers;
+    workers.start(thread_count > 1 ? thread_count - 1 : 0, func);
+    func();
+    workers.join();
+}
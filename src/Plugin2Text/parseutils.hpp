@@ -1,6 +1,26 @@
 #pragma once
 #include "common.hpp"
 #include <string.h>
+#include <bit>
+#include <emmintrin.h>
+
+// Writes "value" as 8 uppercase hexadecimal digits, the way Form IDs are formatted, e.g. "0001B1D8".
+inline void format_hex_uint32(char* buffer, uint32_t value) {
+    static const char alphabet[17] = "0123456789ABCDEF";
+    for (int i = 0; i < 8; ++i) {
+        buffer[i] = alphabet[(value >> (28 - i * 4)) & 0xF];
+    }
+}
+
+// Writes each byte of "data" as 2 lowercase hexadecimal digits, returns end of written characters.
+inline char* format_hex_bytes(char* buffer, const uint8_t* data, size_t size) {
+    static const char alphabet[17] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i) {
+        *buffer++ = alphabet[data[i] / 16];
+        *buffer++ = alphabet[data[i] % 16];
+    }
+    return buffer;
+}
 
 struct Slice {
     uint8_t* start = nullptr;
@@ -83,4 +103,30 @@ struct Slice {
     size_t size() const {
         return now - start;
     }
-};
\ No newline at end of file
+};
+
+// Returns pointer to first control character, byte >= 128, "stop0" or "stop1", or "end" if there are none.
+// Writers copy strings as is up to such character, so it's searched for 16 bytes at a time.
+inline const char* find_special_char(const char* now, const char* end, char stop0, char stop1) {
+    const auto space = _mm_set1_epi8(' ');
+    const auto stop0_chars = _mm_set1_epi8(stop0);
+    const auto stop1_chars = _mm_set1_epi8(stop1);
+    while (end - now >= 16) {
+        const auto chars = _mm_loadu_si128((const __m128i*)now);
+        // Signed comparison catches both control characters and bytes >= 128.
+        const auto special = _mm_or_si128(_mm_cmplt_epi8(chars, space), _mm_or_si128(_mm_cmpeq_epi8(chars, stop0_chars), _mm_cmpeq_epi8(chars, stop1_chars)));
+        const auto mask = (uint32_t)_mm_movemask_epi8(special);
+        if (mask) {
+            return now + std::countr_zero(mask);
+        }
+        now += 16;
+    }
+
+    for (; now < end; ++now) {
+        const auto c = (uint8_t)*now;
+        if (c < 32 || c >= 128 || c == (uint8_t)stop0 || c == (uint8_t)stop1) {
+            return now;
+        }
+    }
+    return end;
+}
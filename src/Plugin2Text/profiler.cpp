@@ -0,0 +1,446 @@
+#include "profiler.hpp"
+#include "array.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <atomic>
+
+Profiler profiler;
+
+static const char* const ProfilePhaseNames[(int)ProfilePhase::Count]{
+    "file read",
+    "record walk",
+    "zlib inflate",
+    "text formatting",
+    "text parsing",
+    "zlib deflate",
+    "base64/hex coding",
+    "file write",
+};
+
+static const char* const ProfilePhaseJsonNames[(int)ProfilePhase::Count]{
+    "file_read",
+    "record_walk",
+    "zlib_inflate",
+    "text_formatting",
+    "text_parsing",
+    "zlib_deflate",
+    "byte_array_coding",
+    "file_write",
+};
+
+static thread_local ProfileScope* current_profile_scope = nullptr;
+
+void ProfileScope::begin() {
+    parent = current_profile_scope;
+    current_profile_scope = this;
+    if (profiler.tracing) {
+        const auto name = ProfilePhaseNames[(int)phase];
+        trace_begin("phase", name, strlen(name));
+    }
+    start = get_current_timestamp();
+}
+
+void ProfileScope::end() {
+    const auto elapsed = get_current_timestamp() - start;
+    if (profiler.tracing) {
+        trace_end();
+    }
+
+    // Phases may be measured on several threads at once.
+    auto& stats = profiler.phases[(int)phase];
+    std::atomic_ref<int64_t>(stats.ticks) += elapsed - child_ticks;
+    std::atomic_ref<uint64_t>(stats.bytes) += bytes;
+    ++std::atomic_ref<uint64_t>(stats.calls);
+
+    if (parent) {
+        parent->child_ticks += elapsed;
+    }
+    verify(current_profile_scope == this);
+    current_profile_scope = parent;
+}
+
+struct TraceBuffer {
+    static constexpr uint64_t Capacity = 64 * 1024;
+
+    TraceEvent events[Capacity];
+    uint64_t count = 0; // Total number of recorded events, may be larger than capacity.
+    uint32_t thread_id = 0;
+    TraceBuffer* next = nullptr;
+};
+
+static std::atomic<TraceBuffer*> trace_buffers{ nullptr };
+static std::atomic<uint32_t> trace_thread_count{ 0 };
+static thread_local TraceBuffer* trace_buffer = nullptr;
+
+static TraceBuffer* get_trace_buffer() {
+    if (!trace_buffer) {
+        trace_buffer = memnew(stdalloc) TraceBuffer();
+        trace_buffer->thread_id = trace_thread_count++;
+
+        trace_buffer->next = trace_buffers.load();
+        while (!trace_buffers.compare_exchange_weak(trace_buffer->next, trace_buffer)) {
+            // Retry, "next" is updated by failed exchange.
+        }
+    }
+    return trace_buffer;
+}
+
+static TraceEvent* push_trace_event(TraceBuffer* buffer, char phase, const char* category) {
+    auto event = &buffer->events[buffer->count % TraceBuffer::Capacity];
+    event->timestamp = get_current_timestamp();
+    event->category = category;
+    event->phase = phase;
+    event->name[0] = '\0';
+    ++buffer->count;
+    return event;
+}
+
+static void copy_trace_event_name(TraceEvent* event, const char* name, size_t name_length) {
+    if (name_length > sizeof(event->name) - 1) {
+        name_length = sizeof(event->name) - 1;
+    }
+    memcpy(event->name, name, name_length);
+    event->name[name_length] = '\0';
+}
+
+uint64_t trace_begin(const char* category, const char* name, size_t name_length) {
+    const auto buffer = get_trace_buffer();
+    const auto event_index = buffer->count;
+    copy_trace_event_name(push_trace_event(buffer, 'B', category), name, name_length);
+    return event_index;
+}
+
+uint64_t trace_begin(const char* category, const wchar_t* name) {
+    char narrow_name[sizeof(TraceEvent::name)];
+    size_t name_length = 0;
+    for (; name[name_length] && name_length < sizeof(narrow_name) - 1; ++name_length) {
+        const auto c = name[name_length];
+        narrow_name[name_length] = c < 128 ? (char)c : '?';
+    }
+    return trace_begin(category, narrow_name, name_length);
+}
+
+void trace_rename(uint64_t event_index, const char* name, size_t name_length) {
+    const auto buffer = get_trace_buffer();
+    if (buffer->count - event_index <= TraceBuffer::Capacity) {
+        copy_trace_event_name(&buffer->events[event_index % TraceBuffer::Capacity], name, name_length);
+    }
+}
+
+void trace_end() {
+    push_trace_event(get_trace_buffer(), 'E', nullptr);
+}
+
+static void write_json_string(Slice* output, const char* string) {
+    output->write_literal("\"");
+    for (; *string; ++string) {
+        const char c = *string;
+        if (c == '"' || c == '\\') {
+            output->write_value<char>('\\');
+            output->write_value<char>(c);
+        } else if ((unsigned char)c >= 0x20) {
+            output->write_value<char>(c);
+        }
+    }
+    output->write_literal("\"");
+}
+
+// Should be called when other threads don't record events.
+void write_trace(const wchar_t* path) {
+    uint64_t event_count = 0;
+    for (auto buffer = trace_buffers.load(); buffer; buffer = buffer->next) {
+        event_count += buffer->count < TraceBuffer::Capacity ? buffer->count : TraceBuffer::Capacity;
+    }
+
+    // Longest event is around 200 bytes long.
+    auto output = allocate_virtual_memory(event_count * 256 + 64 * 1024);
+    defer(free_virtual_memory(&output));
+
+    const auto append_format = [&output](const char* format, auto... args) {
+        const auto count = snprintf((char*)output.now, output.remaining_size(), format, args...);
+        verify(count > 0 && (size_t)count < output.remaining_size());
+        output.now += count;
+    };
+
+    output.write_literal("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+
+    for (auto buffer = trace_buffers.load(); buffer; buffer = buffer->next) {
+        char thread_name[32];
+        if (buffer->thread_id == 0) {
+            snprintf(thread_name, sizeof(thread_name), "main");
+        } else {
+            snprintf(thread_name, sizeof(thread_name), "worker %u", buffer->thread_id);
+        }
+        append_format(
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n",
+            buffer->thread_id,
+            thread_name
+        );
+        first = false;
+
+        uint64_t begin = 0;
+        if (buffer->count > TraceBuffer::Capacity) {
+            begin = buffer->count - TraceBuffer::Capacity;
+            wprintf(L"warning: trace buffer of thread %u overflowed, %llu oldest events are lost\n", buffer->thread_id, (unsigned long long)begin);
+        }
+
+        for (uint64_t i = begin; i < buffer->count; ++i) {
+            const auto& event = buffer->events[i % TraceBuffer::Capacity];
+            const auto microseconds = timestamp_to_seconds(profiler.trace_start, event.timestamp) * 1000000.0;
+
+            append_format(",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", event.phase, buffer->thread_id, microseconds);
+            if (event.phase == 'B') {
+                output.write_literal(",\"cat\":");
+                write_json_string(&output, event.category);
+                output.write_literal(",\"name\":");
+                write_json_string(&output, event.name);
+            }
+            output.write_literal("}");
+        }
+    }
+
+    output.write_literal("\n]}\n");
+    write_file(path, { output.start, output.size() });
+}
+
+static double megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+static size_t tmpalloc_high_water_bytes() {
+    return tmpalloc.high_water - tmpalloc.start;
+}
+
+void Profiler::print_text(double total_seconds) const {
+    printf("Time elapsed: %f seconds\n", total_seconds);
+    printf("\n");
+    printf("%-20s %12s %14s %10s %10s\n", "Phase", "Time (s)", "Bytes", "MB/s", "Calls");
+
+    double accounted_seconds = 0;
+    for (int i = 0; i < (int)ProfilePhase::Count; ++i) {
+        const auto& stats = phases[i];
+        if (!stats.calls) {
+            continue;
+        }
+
+        const auto seconds = timestamp_to_seconds(0, stats.ticks);
+        accounted_seconds += seconds;
+        printf(
+            "%-20s %12.6f %14llu %10.2f %10llu\n",
+            ProfilePhaseNames[i],
+            seconds,
+            (unsigned long long)stats.bytes,
+            seconds > 0 ? megabytes(stats.bytes) / seconds : 0.0,
+            (unsigned long long)stats.calls
+        );
+    }
+    printf("%-20s %12.6f\n", "other", total_seconds - accounted_seconds);
+
+    printf("\n");
+    printf(
+        "Records: %llu, groups: %llu, fields: %llu, compressed records: %llu\n",
+        (unsigned long long)record_count,
+        (unsigned long long)group_count,
+        (unsigned long long)field_count,
+        (unsigned long long)compressed_record_count
+    );
+    printf("Temporary allocator high-water mark: %.2f MB\n", megabytes(tmpalloc_high_water_bytes()));
+    if (record_lookup_bytes) {
+        printf("Record lookup tables: %.2f MB\n", megabytes(record_lookup_bytes));
+    }
+}
+
+void Profiler::print_json(double total_seconds) const {
+    printf("{\"total_seconds\":%f,\"phases\":{", total_seconds);
+
+    bool first = true;
+    for (int i = 0; i < (int)ProfilePhase::Count; ++i) {
+        const auto& stats = phases[i];
+        printf(
+            "%s\"%s\":{\"seconds\":%f,\"bytes\":%llu,\"calls\":%llu}",
+            first ? "" : ",",
+            ProfilePhaseJsonNames[i],
+            timestamp_to_seconds(0, stats.ticks),
+            (unsigned long long)stats.bytes,
+            (unsigned long long)stats.calls
+        );
+        first = false;
+    }
+
+    printf(
+        "},\"counters\":{\"records\":%llu,\"groups\":%llu,\"fields\":%llu,\"compressed_records\":%llu}",
+        (unsigned long long)record_count,
+        (unsigned long long)group_count,
+        (unsigned long long)field_count,
+        (unsigned long long)compressed_record_count
+    );
+    printf(
+        ",\"memory\":{\"tmpalloc_high_water_bytes\":%zu,\"record_lookup_bytes\":%llu}}\n",
+        tmpalloc_high_water_bytes(),
+        (unsigned long long)record_lookup_bytes
+    );
+}
+
+#if PLUGIN2TEXT_TYPE_PROFILE
+TypeProfile type_profile_write{ "write_type" };
+TypeProfile type_profile_read{ "read_type" };
+
+static const char* type_kind_name(TypeKind kind) {
+    switch (kind) {
+        #define CASE(m_kind) case TypeKind::m_kind: return #m_kind
+        CASE(Unknown);
+        CASE(Struct);
+        CASE(Float);
+        CASE(Integer);
+        CASE(ByteArray);
+        CASE(ByteArrayCompressed);
+        CASE(ByteArrayFixed);
+        CASE(ByteArrayRLE);
+        CASE(ZString);
+        CASE(LString);
+        CASE(WString);
+        CASE(FormID);
+        CASE(FormIDArray);
+        CASE(Enum);
+        CASE(Boolean);
+        CASE(VMAD);
+        CASE(Constant);
+        CASE(Filter);
+        CASE(Vector3);
+        CASE(NVPP);
+        CASE(VTXT);
+        CASE(XCLW);
+        CASE(CTDA);
+        CASE(VHGT);
+        CASE(VNML);
+        CASE(NVNM);
+        #undef CASE
+        case TypeKind::Count: break;
+    }
+    return "?";
+}
+
+FieldTypeCost* TypeProfile::get_field_cost(RecordType record_type, RecordFieldType field_type) {
+    const uint64_t key = ((uint64_t)record_type << 32) | (uint32_t)field_type;
+    uint64_t index = key * 0x9E3779B97F4A7C15ULL >> 52; // 4096 slots.
+
+    for (int probe = 0; probe < FieldSlotCount; ++probe) {
+        auto& slot = fields[(index + probe) % FieldSlotCount];
+        if (slot.record_type == record_type && slot.field_type == field_type) {
+            return &slot;
+        }
+        if (slot.record_type == (RecordType)0) {
+            slot.record_type = record_type;
+            slot.field_type = field_type;
+            return &slot;
+        }
+    }
+
+    verify(false); // Too many distinct field types.
+    return nullptr;
+}
+
+struct TypeCostRow {
+    char name[24];
+    TypeCost cost;
+};
+
+static void print_type_cost_rows(const char* header, Array<TypeCostRow>& rows, uint64_t total_cycles, int max_rows) {
+    qsort(rows.data, rows.count, sizeof(rows.data[0]), [](const void* a, const void* b) -> int {
+        const auto lhs = ((const TypeCostRow*)a)->cost.cycles;
+        const auto rhs = ((const TypeCostRow*)b)->cost.cycles;
+        return lhs < rhs ? 1 : (lhs > rhs ? -1 : 0);
+    });
+
+    fprintf(stderr, "%-20s %16s %7s %12s %14s %12s %10s\n", header, "Cycles", "%", "Calls", "Bytes", "Cycles/call", "Cycles/B");
+    for (int i = 0; i < rows.count && i < max_rows; ++i) {
+        const auto& row = rows.data[i];
+        fprintf(
+            stderr,
+            "%-20s %16llu %6.2f%% %12llu %14llu %12.1f %10.2f\n",
+            row.name,
+            (unsigned long long)row.cost.cycles,
+            total_cycles ? 100.0 * row.cost.cycles / total_cycles : 0.0,
+            (unsigned long long)row.cost.calls,
+            (unsigned long long)row.cost.bytes,
+            row.cost.calls ? (double)row.cost.cycles / row.cost.calls : 0.0,
+            row.cost.bytes ? (double)row.cost.cycles / row.cost.bytes : 0.0
+        );
+    }
+    fprintf(stderr, "\n");
+}
+
+static void add_cost(TypeCost* to, const TypeCost& from) {
+    to->cycles += from.cycles;
+    to->calls += from.calls;
+    to->bytes += from.bytes;
+}
+
+void TypeProfile::print() const {
+    Array<TypeCostRow> rows{ stdalloc };
+    defer(rows.free());
+
+    uint64_t total_cycles = 0;
+    for (int i = 0; i < (int)TypeKind::Count; ++i) {
+        if (kinds[i].calls) {
+            TypeCostRow row;
+            snprintf(row.name, sizeof(row.name), "%s", type_kind_name((TypeKind)i));
+            row.cost = kinds[i];
+            rows.push(row);
+            total_cycles += kinds[i].cycles;
+        }
+    }
+    if (rows.count == 0) {
+        return;
+    }
+
+    fprintf(stderr, "%s: cost per TypeKind (exclusive)\n", name);
+    print_type_cost_rows("TypeKind", rows, total_cycles, INT_MAX);
+
+    // Per record type, summed over record's fields.
+    rows.count = 0;
+    for (const auto& slot : fields) {
+        if (slot.record_type == (RecordType)0) {
+            continue;
+        }
+        TypeCostRow* record_row = nullptr;
+        for (auto& row : rows) {
+            if (memory_equals(row.name, &slot.record_type, 4)) {
+                record_row = &row;
+                break;
+            }
+        }
+        if (!record_row) {
+            TypeCostRow row;
+            snprintf(row.name, sizeof(row.name), "%.4s", (const char*)&slot.record_type);
+            rows.push(row);
+            record_row = &rows.data[rows.count - 1];
+        }
+        add_cost(&record_row->cost, slot.cost);
+    }
+
+    fprintf(stderr, "%s: cost per record type\n", name);
+    print_type_cost_rows("Record", rows, total_cycles, INT_MAX);
+
+    rows.count = 0;
+    for (const auto& slot : fields) {
+        if (slot.record_type != (RecordType)0) {
+            TypeCostRow row;
+            snprintf(row.name, sizeof(row.name), "%.4s.%.4s", (const char*)&slot.record_type, (const char*)&slot.field_type);
+            row.cost = slot.cost;
+            rows.push(row);
+        }
+    }
+
+    fprintf(stderr, "%s: cost per record field (top 50)\n", name);
+    print_type_cost_rows("Field", rows, total_cycles, 50);
+}
+
+void print_type_profile() {
+    type_profile_write.print();
+    type_profile_read.print();
+}
+#endif
@@ -0,0 +1,221 @@
+#pragma once
+#include "common.hpp"
+#include "os.hpp"
+
+enum class ProfilePhase {
+    FileRead,
+    RecordWalk,
+    ZLibInflate,
+    TextFormat,
+    TextParse,
+    ZLibDeflate,
+    ByteArrayCoding,
+    FileWrite,
+    Count,
+};
+
+struct ProfilePhaseStats {
+    int64_t ticks = 0; // Exclusive: time spent in nested phases is not included.
+    uint64_t bytes = 0;
+    uint64_t calls = 0;
+};
+
+struct ProfileScope;
+
+// Collects per-phase timings when "--time" or "--trace" is passed. Counters are always collected, they are cheap.
+struct Profiler {
+    bool enabled = false;
+    bool tracing = false; // Record trace events, see "write_trace".
+    int64_t trace_start = 0;
+    ProfilePhaseStats phases[(int)ProfilePhase::Count];
+
+    uint64_t record_count = 0;
+    uint64_t group_count = 0;
+    uint64_t field_count = 0;
+    uint64_t compressed_record_count = 0;
+    uint64_t record_lookup_bytes = 0; // Memory used by RecordLookup hash tables.
+
+    void print_text(double total_seconds) const;
+    void print_json(double total_seconds) const;
+};
+
+extern Profiler profiler;
+
+// Measures time spent in a phase until the end of C++ scope. "bytes" may be updated before
+// the scope ends if size of processed data is not known beforehand. Phases are also recorded
+// as trace events.
+struct ProfileScope {
+    ProfilePhase phase = ProfilePhase::Count;
+    size_t bytes = 0;
+    int64_t start = 0;
+    int64_t child_ticks = 0;
+    ProfileScope* parent = nullptr;
+
+    inline ProfileScope(ProfilePhase phase, size_t bytes = 0) : phase(phase), bytes(bytes) {
+        if (profiler.enabled) {
+            begin();
+        }
+    }
+
+    inline ~ProfileScope() {
+        if (profiler.enabled) {
+            end();
+        }
+    }
+
+    void begin();
+    void end();
+};
+
+#define PROFILE_SCOPE(m_phase, m_bytes) ProfileScope DEFER_3(_profile_scope_){ ProfilePhase::m_phase, m_bytes }
+
+// Begin/end events in Chrome trace event format, viewable in chrome://tracing or Perfetto.
+// Each thread writes events into its own ring buffer, when it overflows oldest events are lost.
+// "category" must be a string literal, "name" is copied and truncated.
+struct TraceEvent {
+    int64_t timestamp = 0;
+    const char* category = nullptr;
+    char phase = 0; // 'B' or 'E'.
+    char name[47]{ 0 };
+};
+
+uint64_t trace_begin(const char* category, const char* name, size_t name_length);
+uint64_t trace_begin(const char* category, const wchar_t* name);
+void trace_rename(uint64_t event_index, const char* name, size_t name_length);
+void trace_end();
+void write_trace(const wchar_t* path);
+
+struct TraceScope {
+    static constexpr uint64_t NoEvent = UINT64_MAX;
+    uint64_t event_index = NoEvent;
+
+    inline TraceScope(const char* category, const char* name, size_t name_length) {
+        if (profiler.tracing) {
+            event_index = trace_begin(category, name, name_length);
+        }
+    }
+
+    inline TraceScope(const char* category, const wchar_t* name) {
+        if (profiler.tracing) {
+            event_index = trace_begin(category, name);
+        }
+    }
+
+    inline ~TraceScope() {
+        if (event_index != NoEvent) {
+            trace_end();
+        }
+    }
+
+    // Use when name is known only after the work is done.
+    inline void rename(const char* name, size_t name_length) {
+        if (event_index != NoEvent) {
+            trace_rename(event_index, name, name_length);
+        }
+    }
+};
+
+// Define PLUGIN2TEXT_TYPE_PROFILE=1 to collect CPU cycles, calls and produced bytes per TypeKind
+// and per record/field type in TextRecordWriter::write_type and TextRecordReader::read_type.
+// Report is written to stderr at exit. When not defined, instrumentation compiles to nothing.
+#ifndef PLUGIN2TEXT_TYPE_PROFILE
+#define PLUGIN2TEXT_TYPE_PROFILE 0
+#endif
+
+#if PLUGIN2TEXT_TYPE_PROFILE
+#include "tes.hpp"
+#include "typeinfo.hpp"
+#include <intrin.h>
+
+struct TypeCost {
+    uint64_t cycles = 0;
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+};
+
+struct FieldTypeCost {
+    RecordType record_type = (RecordType)0; // 0 if slot is unused.
+    RecordFieldType field_type = (RecordFieldType)0;
+    TypeCost cost;
+};
+
+struct TypeKindProfileScope;
+
+struct TypeProfile {
+    static constexpr int FieldSlotCount = 4096;
+
+    const char* name = nullptr;
+    TypeKindProfileScope* current_scope = nullptr;
+    TypeCost kinds[(int)TypeKind::Count]; // Exclusive: nested write_type/read_type calls are not included.
+    FieldTypeCost fields[FieldSlotCount]; // Open addressing hash table.
+
+    FieldTypeCost* get_field_cost(RecordType record_type, RecordFieldType field_type);
+    void print() const;
+};
+
+extern TypeProfile type_profile_write;
+extern TypeProfile type_profile_read;
+
+void print_type_profile();
+
+// "cursor" points to output pointer, difference between its values at the end and start
+// of the scope is counted as produced bytes.
+struct TypeKindProfileScope {
+    TypeProfile* profile = nullptr;
+    TypeKind kind = TypeKind::Unknown;
+    uint8_t* const* cursor = nullptr;
+    const uint8_t* cursor_start = nullptr;
+    uint64_t start = 0;
+    uint64_t child_cycles = 0;
+    uint64_t child_bytes = 0;
+    TypeKindProfileScope* parent = nullptr;
+
+    inline TypeKindProfileScope(TypeProfile* profile, TypeKind kind, uint8_t* const* cursor)
+        : profile(profile), kind(kind), cursor(cursor), cursor_start(*cursor), parent(profile->current_scope)
+    {
+        profile->current_scope = this;
+        start = __rdtsc();
+    }
+
+    inline ~TypeKindProfileScope() {
+        const uint64_t cycles = __rdtsc() - start;
+        const uint64_t bytes = *cursor - cursor_start;
+
+        auto& cost = profile->kinds[(int)kind];
+        cost.cycles += cycles - child_cycles;
+        cost.bytes += bytes - child_bytes;
+        ++cost.calls;
+
+        if (parent) {
+            parent->child_cycles += cycles;
+            parent->child_bytes += bytes;
+        }
+        profile->current_scope = parent;
+    }
+};
+
+struct FieldTypeProfileScope {
+    FieldTypeCost* cost = nullptr;
+    uint8_t* const* cursor = nullptr;
+    const uint8_t* cursor_start = nullptr;
+    uint64_t start = 0;
+
+    inline FieldTypeProfileScope(TypeProfile* profile, RecordType record_type, RecordFieldType field_type, uint8_t* const* cursor)
+        : cost(profile->get_field_cost(record_type, field_type)), cursor(cursor), cursor_start(*cursor)
+    {
+        start = __rdtsc();
+    }
+
+    inline ~FieldTypeProfileScope() {
+        cost->cost.cycles += __rdtsc() - start;
+        cost->cost.bytes += *cursor - cursor_start;
+        ++cost->cost.calls;
+    }
+};
+
+#define TYPE_PROFILE_KIND(m_profile, m_kind, m_cursor) TypeKindProfileScope DEFER_3(_type_profile_){ &m_profile, m_kind, m_cursor }
+#define TYPE_PROFILE_FIELD(m_profile, m_record_type, m_field_type, m_cursor) FieldTypeProfileScope DEFER_3(_type_profile_){ &m_profile, m_record_type, m_field_type, m_cursor }
+#else
+#define TYPE_PROFILE_KIND(m_profile, m_kind, m_cursor)
+#define TYPE_PROFILE_FIELD(m_profile, m_record_type, m_field_type, m_cursor)
+#endif
@@ -0,0 +1,272 @@
+#include "string_table.hpp"
+#include "array.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// String table file layout:
+//   uint32 count
+//   uint32 data_size
+//   { uint32 id, uint32 offset }[count], offsets are relative to start of string data
+//   string data
+
+constexpr size_t StringTableHeaderSize = sizeof(uint32_t) * 2;
+constexpr size_t StringTableEntrySize = sizeof(uint32_t) * 2;
+static_assert(sizeof(StringTablesBuilder::Entry) == StringTableEntrySize, "invalid string table entry size");
+
+// The same ID may be used by different strings in different tables.
+static uint32_t get_slot_hash(StringTableType type, uint32_t id) {
+    return hash_uint32(id ^ ((uint32_t)type << 30));
+}
+
+// Returns "<plugin folder>\Strings" path and index of plugin file name in "plugin_path".
+static Path get_strings_folder(const wchar_t* plugin_path, int* name_start) {
+    auto separator = string_last_index_of(plugin_path, '\\');
+    if (separator == -1) {
+        separator = string_last_index_of(plugin_path, '/');
+    }
+    *name_start = separator + 1;
+
+    TEMP_SCOPE();
+    const auto folder = substring(tmpalloc, plugin_path, plugin_path + *name_start);
+    return Path{ folder, L"Strings" };
+}
+
+Path get_string_table_path(const wchar_t* plugin_path, const wchar_t* language, StringTableType type) {
+    static const wchar_t* extensions[] = { L"STRINGS", L"DLSTRINGS", L"ILSTRINGS" };
+    static_assert(_countof(extensions) == (size_t)StringTableType::Count, "missing string table extension");
+
+    int name_start = 0;
+    auto path = get_strings_folder(plugin_path, &name_start);
+
+    auto name_end = string_last_index_of(plugin_path, '.');
+    if (name_end < name_start) {
+        name_end = (int)wcslen(plugin_path);
+    }
+
+    wchar_t file_name[260];
+    verify(swprintf_s(file_name, L"%.*s_%s.%s", name_end - name_start, &plugin_path[name_start], language, extensions[(size_t)type]) > 0);
+
+    path.append(file_name);
+    return path;
+}
+
+bool StringTables::load(const wchar_t* plugin_path, const wchar_t* language) {
+    auto found_all = true;
+    size_t total_count = 0;
+    for (size_t i = 0; i < (size_t)StringTableType::Count; ++i) {
+        const auto path = get_string_table_path(plugin_path, language, (StringTableType)i);
+        files[i] = try_map_file(path.path);
+        if (!files[i].count) {
+            found_all = false;
+            continue;
+        }
+
+        verify(files[i].count >= StringTableHeaderSize);
+        const auto count = *(const uint32_t*)files[i].data;
+        verify(StringTableHeaderSize + (size_t)count * StringTableEntrySize <= files[i].count);
+        total_count += count;
+    }
+
+    size_t capacity = 16;
+    while (capacity < total_count * 2) {
+        capacity *= 2;
+    }
+
+    slots = { (Slot*)memalloc(stdalloc, capacity * sizeof(Slot)), capacity };
+    memset(slots.data, 0, capacity * sizeof(Slot));
+
+    // Only directories are decoded here, string data pages are not touched until "find".
+    for (size_t i = 0; i < (size_t)StringTableType::Count; ++i) {
+        const auto& file = files[i];
+        if (!file.count) {
+            continue;
+        }
+
+        const auto count = *(const uint32_t*)file.data;
+        const auto directory = (const uint32_t*)(file.data + StringTableHeaderSize);
+        const auto data_start = StringTableHeaderSize + (size_t)count * StringTableEntrySize;
+
+        for (uint32_t entry = 0; entry < count; ++entry) {
+            const auto id = directory[entry * 2 + 0];
+            const auto offset = data_start + directory[entry * 2 + 1];
+            verify(offset < file.count);
+            if (id == 0) {
+                continue;
+            }
+
+            const auto type = (StringTableType)i;
+            auto index = get_slot_hash(type, id) & (slots.count - 1);
+            while (slots.data[index].id && (slots.data[index].id != id || slots.data[index].type != type)) {
+                index = (index + 1) & (slots.count - 1);
+            }
+
+            if (slots.data[index].id) {
+                continue; // Duplicate ID, first string wins, same as in game.
+            }
+
+            slots.data[index] = { id, type, (uint32_t)offset };
+            ++string_count;
+        }
+    }
+
+    return found_all;
+}
+
+void StringTables::dispose() {
+    for (auto& file : files) {
+        unmap_file(&file);
+    }
+    if (slots.data) {
+        memdelete(stdalloc, slots.data);
+    }
+    *this = StringTables();
+}
+
+const StringTables::Slot* StringTables::find_slot(StringTableType type, uint32_t id) const {
+    auto index = get_slot_hash(type, id) & (slots.count - 1);
+    while (slots.data[index].id) {
+        const auto& slot = slots.data[index];
+        if (slot.id == id && slot.type == type) {
+            return &slot;
+        }
+        index = (index + 1) & (slots.count - 1);
+    }
+    return nullptr;
+}
+
+LocalizedString StringTables::find(StringTableType type, uint32_t id) const {
+    LocalizedString result;
+    if (id == 0 || slots.count == 0) {
+        return result;
+    }
+
+    auto slot = find_slot(type, id);
+    for (size_t i = 0; !slot && i < (size_t)StringTableType::Count; ++i) {
+        if ((StringTableType)i != type) {
+            slot = find_slot((StringTableType)i, id);
+        }
+    }
+    if (!slot) {
+        return result;
+    }
+
+    const auto& file = files[(size_t)slot->type];
+    const auto string = (const char*)file.data + slot->offset;
+    const auto remaining = file.count - slot->offset;
+
+    if (slot->type == StringTableType::Strings) {
+        const auto terminator = (const char*)memchr(string, '\0', remaining);
+        verify(terminator);
+        result.data = string;
+        result.count = terminator - string;
+    } else {
+        verify(remaining >= sizeof(uint32_t));
+        const auto length = *(const uint32_t*)string;
+        verify(length >= 1 && length <= remaining - sizeof(uint32_t));
+        result.data = string + sizeof(uint32_t);
+        result.count = length - 1;
+    }
+
+    result.type = slot->type;
+    return result;
+}
+
+void StringTablesBuilder::init() {
+    for (auto& slice : data) {
+        slice = allocate_virtual_memory(1024 * 1024 * 64);
+    }
+}
+
+void StringTablesBuilder::dispose() {
+    for (auto& list : entries) {
+        list.free();
+    }
+    for (auto& slice : data) {
+        free_virtual_memory(&slice);
+    }
+    *this = StringTablesBuilder();
+}
+
+Slice* StringTablesBuilder::begin_string(StringTableType type, uint32_t id) {
+    auto& slice = data[(size_t)type];
+    entries[(size_t)type].push({ id, (uint32_t)slice.size() });
+    if (type != StringTableType::Strings) {
+        slice.write_value<uint32_t>(0); // Patched in "end_string".
+    }
+    return &slice;
+}
+
+void StringTablesBuilder::end_string(StringTableType type) {
+    auto& slice = data[(size_t)type];
+    slice.write_literal("\0");
+
+    if (type != StringTableType::Strings) {
+        const auto& list = entries[(size_t)type];
+        const auto length_start = slice.start + list.data[list.count - 1].offset;
+        const auto length = (uint32_t)(slice.now - length_start - sizeof(uint32_t));
+        slice.write_bytes_at(length_start, &length, sizeof(length));
+    }
+
+    ++string_count;
+}
+
+void StringTablesBuilder::write(const wchar_t* plugin_path, const wchar_t* language) {
+    {
+        int name_start = 0;
+        auto folder = get_strings_folder(plugin_path, &name_start);
+
+        // "create_folder" requires absolute path.
+        const auto is_absolute = folder.path[0] == L'\\' || folder.path[0] == L'/' || (folder.path[0] && folder.path[1] == L':');
+        if (!is_absolute) {
+            folder = Path{ get_current_directory(), folder.path };
+        }
+        create_folder(folder.path);
+    }
+
+    for (size_t i = 0; i < (size_t)StringTableType::Count; ++i) {
+        auto& list = entries[i];
+        const auto& slice = data[i];
+        const auto path = get_string_table_path(plugin_path, language, (StringTableType)i);
+
+        if (!list.count) {
+            // Game needs all three tables, but existing table may have strings of fields that were not converted.
+            auto existing = try_map_file(path.path);
+            const auto exists = existing.count != 0;
+            unmap_file(&existing);
+            if (exists) {
+                continue;
+            }
+        }
+
+        qsort(list.data, list.count, sizeof(list.data[0]), [](void const* aa, void const* bb) -> int {
+            const auto a = (const Entry*)aa;
+            const auto b = (const Entry*)bb;
+            if (a->id != b->id) {
+                return a->id < b->id ? -1 : 1;
+            }
+            return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+        });
+
+        int unique_count = 0;
+        for (int entry = 0; entry < list.count; ++entry) {
+            if (unique_count == 0 || list.data[unique_count - 1].id != list.data[entry].id) {
+                list.data[unique_count++] = list.data[entry];
+            }
+        }
+        list.count = unique_count;
+
+        const auto directory_size = StringTableHeaderSize + (size_t)list.count * StringTableEntrySize;
+        const auto file_size = directory_size + slice.size();
+        const auto file = (uint8_t*)memalloc(stdalloc, file_size);
+        defer(memdelete(stdalloc, file));
+
+        const uint32_t header[] = { (uint32_t)list.count, (uint32_t)slice.size() };
+        memcpy(file, header, sizeof(header));
+        memcpy(file + StringTableHeaderSize, list.data, (size_t)list.count * StringTableEntrySize);
+        memcpy(file + directory_size, slice.start, slice.size());
+
+        write_file(path.path, { file, file_size });
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "common.hpp"
+#include "parseutils.hpp"
+#include "os.hpp"
+
+// Localized plugins (TES4_Localized flag) store LString fields as string IDs, strings are stored
+// in "Strings\<plugin name>_<language>.STRINGS", ".DLSTRINGS" and ".ILSTRINGS" files next to plugin.
+enum class StringTableType : uint8_t {
+    Strings,   // Null terminated strings.
+    DLStrings, // Strings prefixed with uint32 length (including null terminator). Used for descriptions.
+    ILStrings, // Same format as DLStrings. Used for dialogue.
+    Count,
+};
+
+Path get_string_table_path(const wchar_t* plugin_path, const wchar_t* language, StringTableType type);
+
+struct LocalizedString {
+    const char* data = nullptr; // Not null terminated. Null if string was not found.
+    size_t count = 0;
+    StringTableType type = StringTableType::Strings;
+};
+
+// String tables of a plugin. Files are memory mapped, only directories are read on load, strings are
+// located when requested and point into mapped data.
+struct StringTables {
+    struct Slot {
+        uint32_t id = 0; // Zero is never used as string ID, it marks empty slot.
+        StringTableType type = StringTableType::Strings;
+        uint32_t offset = 0; // Offset of string from start of file.
+    };
+
+    StaticArray<uint8_t> files[(size_t)StringTableType::Count];
+    StaticArray<Slot> slots; // Open addressing by (type, id), count is power of two.
+    size_t string_count = 0;
+
+    // Returns false if any of string table files is missing.
+    bool load(const wchar_t* plugin_path, const wchar_t* language);
+    void dispose();
+
+    // Looks up string in table of "type" first. Other tables are tried if it's not there, because fields
+    // may be defined with table type that doesn't match plugin, "LocalizedString::type" is table where
+    // string was found.
+    LocalizedString find(StringTableType type, uint32_t id) const;
+
+private:
+    const Slot* find_slot(StringTableType type, uint32_t id) const;
+};
+
+// Collects strings of LString fields while converting text to ESP and writes them as string tables.
+struct StringTablesBuilder {
+    struct Entry {
+        uint32_t id;
+        uint32_t offset; // Offset of string from start of string data.
+    };
+
+    Array<Entry> entries[(size_t)StringTableType::Count];
+    Slice data[(size_t)StringTableType::Count];
+    size_t string_count = 0;
+
+    void init();
+    void dispose();
+
+    // Returns slice where string must be written without null terminator, then "end_string" must be called.
+    Slice* begin_string(StringTableType type, uint32_t id);
+    void end_string(StringTableType type);
+
+    // Writes string tables which have strings. Empty tables are written only if their files don't exist,
+    // so tables which were not touched by converted text are kept. Duplicate string IDs are written once,
+    // first string wins.
+    void write(const wchar_t* plugin_path, const wchar_t* language);
+};
@@ -48,11 +48,11 @@ int short_string_to_month(const char* str) {
     return 0; 
 }
 
-Array<VMAD_Script> VMAD_Field::parse_scripts(BinaryReader& r, uint16_t script_count, bool preserve_property_order) {
-    Array<VMAD_Script> scripts{ tmpalloc };
+Array<VMAD_Script> VMAD_Field::parse_scripts(Allocator& allocator, BinaryReader& r, uint16_t script_count, bool preserve_property_order) {
+    Array<VMAD_Script> scripts{ allocator };
     for (int i = 0; i < script_count; ++i) {
         VMAD_Script script;
-        script.parse(r, this, preserve_property_order);
+        script.parse(allocator, r, this, preserve_property_order);
         scripts.push(script);
     }
     return scripts;
@@ -60,10 +60,9 @@ Array<VMAD_Script> VMAD_Field::parse_scripts(BinaryReader& r, uint16_t script_co
 
 VMAD_Field::VMAD_Field() {
     memset(this, 0, sizeof(this));
-    scripts = Array<VMAD_Script>(tmpalloc);
 }
 
-void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type, bool preserve_property_order) {
+void VMAD_Field::parse(Allocator& allocator, const uint8_t* value, size_t size, RecordType record_type, bool preserve_property_order) {
     BinaryReader r;
     r.start = value;
     r.now = r.start;
@@ -75,7 +74,7 @@ void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type
 
     this->version = header->version;
     this->object_format = header->object_format;
-    this->scripts = parse_scripts(r, header->script_count, preserve_property_order);
+    this->scripts = parse_scripts(allocator, r, header->script_count, preserve_property_order);
     this->contains_record_specific_info = r.now != r.end;
 
     if (contains_record_specific_info) {
@@ -100,7 +99,7 @@ void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type
                 auto fragment_count = (int)r.read<uint16_t>();
                 qust.file_name = r.advance_wstring();
 
-                qust.fragments = Array<VMAD_QUST_Fragment>{ tmpalloc };
+                qust.fragments = Array<VMAD_QUST_Fragment>{ allocator };
                 for (int frag_index = 0; frag_index < fragment_count; ++frag_index) {
                     VMAD_QUST_Fragment fragment;
                     fragment.parse(r);
@@ -108,19 +107,19 @@ void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type
                 };
 
                 auto alias_count = (int)r.read<uint16_t>();
-                qust.aliases = Array<VMAD_QUST_Alias>{ tmpalloc }; // @TODO: Use StaticArray
+                qust.aliases = Array<VMAD_QUST_Alias>{ allocator }; // @TODO: Use StaticArray
                 for (int alias_index = 0; alias_index < alias_count; ++alias_index) {
                     VMAD_QUST_Alias alias;
                     
                     VMAD_ScriptPropertyValue value;
-                    value.parse(r, this, PapyrusPropertyType::Object);
+                    value.parse(allocator, r, this, PapyrusPropertyType::Object);
                     alias.object = value.as_object;
                     
                     verify(r.read<uint16_t>() == header->version);
                     verify(r.read<uint16_t>() == header->object_format);
 
                     const auto script_count = r.read<uint16_t>();
-                    alias.scripts = parse_scripts(r, script_count, preserve_property_order);
+                    alias.scripts = parse_scripts(allocator, r, script_count, preserve_property_order);
                 }
             } break;
 
@@ -149,7 +148,7 @@ void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type
                 perk.file_name = r.advance_wstring();
                 const auto fragment_count = r.read<uint16_t>();
 
-                perk.fragments = Array<VMAD_PERK_Fragment>{ tmpalloc }; // @TODO: Use StaticArray
+                perk.fragments = Array<VMAD_PERK_Fragment>{ allocator }; // @TODO: Use StaticArray
                 for (int i = 0; i < fragment_count; ++i) {
                     VMAD_PERK_Fragment fragment;
                     fragment.parse(r);
@@ -172,7 +171,7 @@ void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type
                 }
 
                 const auto phase_count = r.read<uint16_t>();
-                scen.phase_fragments = Array<VMAD_SCEN_PhaseFragment>{ tmpalloc };
+                scen.phase_fragments = Array<VMAD_SCEN_PhaseFragment>{ allocator };
                 for (int i = 0; i < phase_count; ++i) {
                     VMAD_SCEN_PhaseFragment fragment;
                     fragment.parse(r);
@@ -185,8 +184,9 @@ void VMAD_Field::parse(const uint8_t* value, size_t size, RecordType record_type
     verify(r.now == r.end);
 }
 
-void VMAD_Script::parse(BinaryReader& r, const VMAD_Field* vmad, bool preserve_property_order) {
+void VMAD_Script::parse(Allocator& allocator, BinaryReader& r, const VMAD_Field* vmad, bool preserve_property_order) {
     name = r.advance_wstring();
+    properties = Array<VMAD_ScriptProperty>{ allocator };
     if (vmad->version >= 4) {
         status = r.read<uint8_t>();
     }
@@ -194,7 +194,7 @@ void VMAD_Script::parse(BinaryReader& r, const VMAD_Field* vmad, bool preserve_p
     auto property_count = r.read<uint16_t>();
     for (int prop_index = 0; prop_index < property_count; ++prop_index) {
         VMAD_ScriptProperty property;
-        property.parse(r, vmad);
+        property.parse(allocator, r, vmad);
         properties.push(property);
     }
 
@@ -209,20 +209,20 @@ void VMAD_Script::parse(BinaryReader& r, const VMAD_Field* vmad, bool preserve_p
     }
 }
 
-void VMAD_ScriptProperty::parse(BinaryReader& r, const VMAD_Field* vmad) {
+void VMAD_ScriptProperty::parse(Allocator& allocator, BinaryReader& r, const VMAD_Field* vmad) {
     name = r.advance_wstring();
     type = r.read<PapyrusPropertyType>();
     if (vmad->version >= 4) {
         status = r.read<uint8_t>();
     }
-    value.parse(r, vmad, type);
+    value.parse(allocator, r, vmad, type);
 }
 
 VMAD_ScriptPropertyValue::VMAD_ScriptPropertyValue() {
     memset(this, 0, sizeof(*this));
 }
 
-void VMAD_ScriptPropertyValue::parse(BinaryReader& r, const VMAD_Field* vmad, PapyrusPropertyType type) {
+void VMAD_ScriptPropertyValue::parse(Allocator& allocator, BinaryReader& r, const VMAD_Field* vmad, PapyrusPropertyType type) {
     verify(vmad->object_format == 2);
     switch (type) {
         case PapyrusPropertyType::Object: {
@@ -255,9 +255,9 @@ void VMAD_ScriptPropertyValue::parse(BinaryReader& r, const VMAD_Field* vmad, Pa
         case PapyrusPropertyType::BoolArray: {
             const auto inner_type = (PapyrusPropertyType)((uint32_t)type - 10);
             as_array.count = r.read<uint32_t>();
-            as_array.values = new VMAD_ScriptPropertyValue[as_array.count];
+            as_array.values = memnew(allocator) VMAD_ScriptPropertyValue[as_array.count];
             for (uint32_t i = 0; i < as_array.count; ++i) {
-                as_array.values[i].parse(r, vmad, inner_type);
+                as_array.values[i].parse(allocator, r, vmad, inner_type);
             }
         } break;
 
@@ -304,6 +304,272 @@ void VMAD_SCEN_PhaseFragment::parse(BinaryReader& r) {
     fragment_name = r.advance_wstring();
 }
 
+// Returns size of encoded property value, or 0 if value has variable size.
+static size_t get_papyrus_value_size(PapyrusPropertyType type) {
+    switch (type) {
+        case PapyrusPropertyType::Object: return sizeof(VMAD_PropertyObjectV2);
+        case PapyrusPropertyType::Int: return sizeof(int);
+        case PapyrusPropertyType::Float: return sizeof(float);
+        case PapyrusPropertyType::Bool: return sizeof(bool);
+        case PapyrusPropertyType::String: return 0;
+    }
+    verify(false);
+    return 0;
+}
+
+// Callbacks of VMAD walk, null callbacks are not called.
+struct VMAD_ScanCallbacks {
+    VMAD_ScriptNameCallback script_name = nullptr;
+    VMAD_ScriptNameCallback property_name = nullptr;
+    VMAD_ObjectCallback object = nullptr;
+    void* context = nullptr;
+};
+
+static void scan_vmad_object(BinaryReader& r, int16_t object_format, const VMAD_ScanCallbacks& callbacks) {
+    // Format 1 is Form ID, alias and unused, format 2 is unused, alias and Form ID.
+    const auto value = r.advance<VMAD_PropertyObjectV2>();
+    if (callbacks.object) {
+        callbacks.object(callbacks.context, object_format == 1 ? (const FormID*)value : &value->form_id);
+    }
+}
+
+static void skip_vmad_property_value(BinaryReader& r, PapyrusPropertyType type, int16_t object_format, const VMAD_ScanCallbacks& callbacks) {
+    const auto is_array = type >= PapyrusPropertyType::ObjectArray;
+    const auto element_type = is_array ? (PapyrusPropertyType)((uint32_t)type - 10) : type;
+    const auto element_count = is_array ? r.read<uint32_t>() : 1;
+    const auto element_size = get_papyrus_value_size(element_type);
+
+    if (element_type == PapyrusPropertyType::Object && callbacks.object) {
+        for (uint32_t i = 0; i < element_count; ++i) {
+            scan_vmad_object(r, object_format, callbacks);
+        }
+    } else if (element_size) {
+        r.advance(element_size * element_count);
+    } else {
+        for (uint32_t i = 0; i < element_count; ++i) {
+            r.advance_wstring();
+        }
+    }
+}
+
+static void scan_vmad_scripts(BinaryReader& r, const VMAD_Header& header, const VMAD_ScanCallbacks& callbacks) {
+    for (int i = 0; i < header.script_count; ++i) {
+        const auto name = r.advance_wstring();
+        if (callbacks.script_name) {
+            callbacks.script_name(callbacks.context, name);
+        }
+        if (header.version >= 4) {
+            r.advance(sizeof(uint8_t)); // status
+        }
+
+        const auto property_count = r.read<uint16_t>();
+        for (int j = 0; j < property_count; ++j) {
+            const auto property_name = r.advance_wstring();
+            if (callbacks.property_name) {
+                callbacks.property_name(callbacks.context, property_name);
+            }
+            const auto type = r.read<PapyrusPropertyType>();
+            if (header.version >= 4) {
+                r.advance(sizeof(uint8_t)); // status
+            }
+            skip_vmad_property_value(r, type, header.object_format, callbacks);
+        }
+    }
+}
+
+// Fragment which consists of script name and fragment name, preceded by "prefix_size" bytes.
+static void scan_vmad_fragment(BinaryReader& r, size_t prefix_size, const VMAD_ScanCallbacks& callbacks) {
+    r.advance(prefix_size);
+    const auto name = r.advance_wstring();
+    if (callbacks.script_name) {
+        callbacks.script_name(callbacks.context, name);
+    }
+    r.advance_wstring(); // fragment name
+}
+
+static void scan_vmad(const uint8_t* value, size_t size, RecordType record_type, const VMAD_ScanCallbacks& callbacks) {
+    BinaryReader r{ value, size };
+
+    const auto header = r.advance<VMAD_Header>();
+    verify(header->version >= 2 && header->version <= 5);
+    verify(header->object_format >= 1 && header->object_format <= 2);
+
+    scan_vmad_scripts(r, *header, callbacks);
+    if (r.now == r.end) {
+        return;
+    }
+
+    // Layouts are the same as in "VMAD_Field::parse".
+    switch (record_type) {
+        case RecordType::INFO: {
+            verify(r.read<uint8_t>() == 2);
+            const auto flags = r.read<PapyrusFragmentFlags>();
+            r.advance_wstring(); // file name
+
+            if (is_bit_set(flags, PapyrusFragmentFlags::HasBeginScript)) {
+                scan_vmad_fragment(r, sizeof(uint8_t), callbacks);
+            }
+            if (is_bit_set(flags, PapyrusFragmentFlags::HasEndScript)) {
+                scan_vmad_fragment(r, sizeof(uint8_t), callbacks);
+            }
+        } break;
+
+        case RecordType::QUST: {
+            verify(r.read<uint8_t>() == 2);
+            const auto fragment_count = r.read<uint16_t>();
+            r.advance_wstring(); // file name
+
+            for (int i = 0; i < fragment_count; ++i) {
+                r.advance(sizeof(uint16_t) * 2 + sizeof(uint32_t)); // index, unused, log entry
+                scan_vmad_fragment(r, sizeof(uint8_t), callbacks);
+            }
+
+            const auto alias_count = r.read<uint16_t>();
+            for (int i = 0; i < alias_count; ++i) {
+                scan_vmad_object(r, header->object_format, callbacks);
+                const auto alias_header = r.advance<VMAD_Header>();
+                scan_vmad_scripts(r, *alias_header, callbacks);
+            }
+        } break;
+
+        case RecordType::PACK: {
+            verify(r.read<uint8_t>() == 2);
+            const auto flags = r.read<VMAD_PACK_Flags>();
+            r.advance_wstring(); // file name
+
+            if (is_bit_set(flags, VMAD_PACK_Flags::OnBegin)) {
+                scan_vmad_fragment(r, sizeof(uint8_t), callbacks);
+            }
+            if (is_bit_set(flags, VMAD_PACK_Flags::OnEnd)) {
+                scan_vmad_fragment(r, sizeof(uint8_t), callbacks);
+            }
+            if (is_bit_set(flags, VMAD_PACK_Flags::OnChange)) {
+                scan_vmad_fragment(r, sizeof(uint8_t), callbacks);
+            }
+        } break;
+
+        case RecordType::PERK: {
+            verify(r.read<uint8_t>() == 2);
+            r.advance_wstring(); // file name
+
+            const auto fragment_count = r.read<uint16_t>();
+            for (int i = 0; i < fragment_count; ++i) {
+                scan_vmad_fragment(r, sizeof(uint16_t) + sizeof(int16_t) + sizeof(int8_t), callbacks);
+            }
+        } break;
+
+        case RecordType::SCEN: {
+            verify(r.read<uint8_t>() == 2);
+            const auto flags = r.read<PapyrusFragmentFlags>();
+            r.advance_wstring(); // file name
+
+            if (is_bit_set(flags, PapyrusFragmentFlags::HasBeginScript)) {
+                scan_vmad_fragment(r, sizeof(int8_t), callbacks);
+            }
+            if (is_bit_set(flags, PapyrusFragmentFlags::HasEndScript)) {
+                scan_vmad_fragment(r, sizeof(int8_t), callbacks);
+            }
+
+            const auto phase_count = r.read<uint16_t>();
+            for (int i = 0; i < phase_count; ++i) {
+                scan_vmad_fragment(r, sizeof(int8_t) + sizeof(uint32_t) + sizeof(int8_t), callbacks);
+            }
+        } break;
+
+        default: {
+            return; // Layout of record specific data is not known for other record types, report only attached scripts.
+        } break;
+    }
+
+    verify(r.now == r.end);
+}
+
+void scan_vmad_script_names(const uint8_t* value, size_t size, RecordType record_type, VMAD_ScriptNameCallback callback, void* context) {
+    VMAD_ScanCallbacks callbacks;
+    callbacks.script_name = callback;
+    callbacks.context = context;
+    scan_vmad(value, size, record_type, callbacks);
+}
+
+void scan_vmad_property_names(const uint8_t* value, size_t size, RecordType record_type, VMAD_ScriptNameCallback callback, void* context) {
+    VMAD_ScanCallbacks callbacks;
+    callbacks.property_name = callback;
+    callbacks.context = context;
+    scan_vmad(value, size, record_type, callbacks);
+}
+
+void scan_vmad_objects(const uint8_t* value, size_t size, RecordType record_type, VMAD_ObjectCallback callback, void* context) {
+    VMAD_ScanCallbacks callbacks;
+    callbacks.object = callback;
+    callbacks.context = context;
+    scan_vmad(value, size, record_type, callbacks);
+}
+
+bool NVNM_Field::parse(const uint8_t* value, size_t size) {
+    auto now = value;
+    const auto end = value + size;
+
+    // Unlike BinaryReader, doesn't fail if data is malformed.
+    auto read = [&now, end](void* out, size_t size) {
+        if ((size_t)(end - now) < size) {
+            return false;
+        }
+        memcpy(out, now, size);
+        now += size;
+        return true;
+    };
+
+    auto read_array = [&now, end]<typename T>(StaticArray<T>* array) {
+        uint32_t count = 0;
+        if ((size_t)(end - now) < sizeof(count)) {
+            return false;
+        }
+        memcpy(&count, now, sizeof(count));
+        now += sizeof(count);
+
+        if ((size_t)(end - now) / sizeof(T) < count) {
+            return false;
+        }
+        *array = { (T*)now, count };
+        now += sizeof(T) * count;
+        return true;
+    };
+
+    if (!read(&version, sizeof(version)) || version != 12) {
+        return false;
+    }
+
+    if (!read(&crc, sizeof(crc)) ||
+        !read(&worldspace, sizeof(worldspace)) ||
+        !read(&cell, sizeof(cell)) ||
+        !read_array(&vertices) ||
+        !read_array(&triangles) ||
+        !read_array(&edge_links) ||
+        !read_array(&door_triangles) ||
+        !read_array(&cover_triangles) ||
+        !read(&grid_size, sizeof(grid_size)) ||
+        !read(&max_x_distance, sizeof(max_x_distance)) ||
+        !read(&max_y_distance, sizeof(max_y_distance)) ||
+        !read(&min, sizeof(min)) ||
+        !read(&max, sizeof(max))) {
+        return false;
+    }
+
+    const auto grid_cells_start = now;
+    if (grid_size > 0xffff) {
+        return false;
+    }
+    for (uint32_t i = 0; i < grid_size * grid_size; ++i) {
+        StaticArray<int16_t> triangles;
+        if (!read_array(&triangles)) {
+            return false;
+        }
+    }
+    grid_cells = { (uint8_t*)grid_cells_start, (size_t)(now - grid_cells_start) };
+
+    return now == end;
+}
+
 void NVPP_Field::parse(const uint8_t* value, size_t size) {
     BinaryReader r{ value, size };
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.hpp"
+#include <tuple>
 
 constexpr uint32_t fourcc(char const p[5]) {
     return (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
@@ -18,12 +19,15 @@ enum class RecordType : uint32_t {
     SCEN = fourcc("SCEN"),
     DLBR = fourcc("DLBR"),
     ACTI = fourcc("ACTI"),
+    REFR = fourcc("REFR"),
+    ACHR = fourcc("ACHR"),
 };
 
 enum class RecordFlags : uint32_t {
     None = 0,
     TES4_Master = 0x1,
     TES4_Localized = 0x80,
+    TES4_Light = 0x200,
     Compressed = 0x40000,
 };
 ENUM_BIT_OPS(uint32_t, RecordFlags);
@@ -38,6 +42,12 @@ struct FormID {
     uint32_t value = 0;
 };
 
+struct Vector3 {
+    float x = 0;
+    float y = 0;
+    float z = 0;
+};
+
 struct RawRecord {
     RecordType type = (RecordType)0;
     uint32_t data_size = 0;
@@ -58,6 +68,9 @@ struct RawRecordCompressed : RawRecord {
 };
 static_assert(sizeof(RawRecordCompressed) == 28, "sizeof(RawRecordCompressed) == 28");
 
+// zlib compression level of data of compressed records.
+constexpr int SkyrimZLibCompressionLevel = 7;
+
 enum class RecordGroupType : uint32_t {
     Top = 0,
     WorldChildren = 1,
@@ -94,8 +107,20 @@ struct RawGrupRecord {
 static_assert(sizeof(RawGrupRecord) == 24, "sizeof(GrupRecord) == 24");
 
 enum class RecordFieldType : uint32_t {
+    EDID = fourcc("EDID"),
+    MAST = fourcc("MAST"),
     DNAM = fourcc("DNAM"),
     VMAD = fourcc("VMAD"),
+    NAME = fourcc("NAME"),
+    DATA = fourcc("DATA"),
+    XSCL = fourcc("XSCL"),
+    XLKR = fourcc("XLKR"),
+    XTEL = fourcc("XTEL"),
+    XNDP = fourcc("XNDP"),
+    OBND = fourcc("OBND"),
+    XCLC = fourcc("XCLC"),
+    ACBS = fourcc("ACBS"),
+    HEDR = fourcc("HEDR"),
 };
 
 #pragma pack(push, 1)
@@ -168,7 +193,7 @@ union VMAD_ScriptPropertyValue {
 
     VMAD_ScriptPropertyValue();
 
-    void parse(BinaryReader& r, const VMAD_Field* vmad, PapyrusPropertyType type);
+    void parse(Allocator& allocator, BinaryReader& r, const VMAD_Field* vmad, PapyrusPropertyType type);
 };
 
 struct VMAD_ScriptProperty {
@@ -177,16 +202,16 @@ struct VMAD_ScriptProperty {
     PapyrusPropertyType type = PapyrusPropertyType::None;
     VMAD_ScriptPropertyValue value;
 
-    void parse(BinaryReader& r, const VMAD_Field* vmad);
+    void parse(Allocator& allocator, BinaryReader& r, const VMAD_Field* vmad);
 };
 
 struct VMAD_Script {
     const WString* name = nullptr;
     uint8_t status = 0;
 
-    Array<VMAD_ScriptProperty> properties{ tmpalloc };
+    Array<VMAD_ScriptProperty> properties;
 
-    void parse(BinaryReader& r, const VMAD_Field* vmad, bool preserve_property_order);
+    void parse(Allocator& allocator, BinaryReader& r, const VMAD_Field* vmad, bool preserve_property_order);
 };
 
 struct VMAD_INFO_Fragment {
@@ -295,11 +320,51 @@ struct VMAD_Field {
 
     VMAD_Field();
 
-    void parse(const uint8_t* value, size_t size, RecordType record_type, bool preserve_property_order);
+    // Arrays of parsed field are allocated from "allocator", strings point into "value".
+    void parse(Allocator& allocator, const uint8_t* value, size_t size, RecordType record_type, bool preserve_property_order);
 private:
-    Array<VMAD_Script> parse_scripts(BinaryReader& r, uint16_t script_count, bool preserve_property_order);
+    Array<VMAD_Script> parse_scripts(Allocator& allocator, BinaryReader& r, uint16_t script_count, bool preserve_property_order);
 };
 
+using VMAD_ScriptNameCallback = void(*)(void* context, const WString* name);
+
+// Walks VMAD field without building VMAD_Field: property values are skipped by their encoded sizes
+// and "callback" is called for names of attached scripts, fragment scripts and quest alias scripts.
+// Names point into field data and may repeat, nothing is allocated.
+void scan_vmad_script_names(const uint8_t* value, size_t size, RecordType record_type, VMAD_ScriptNameCallback callback, void* context);
+
+template<typename Func>
+void scan_vmad_script_names(const uint8_t* value, size_t size, RecordType record_type, Func func) {
+    scan_vmad_script_names(value, size, record_type, [](void* context, const WString* name) {
+        (*(Func*)context)(name);
+    }, &func);
+}
+
+// Walks VMAD field like "scan_vmad_script_names", but "callback" is called for names of properties of
+// attached scripts and quest alias scripts.
+void scan_vmad_property_names(const uint8_t* value, size_t size, RecordType record_type, VMAD_ScriptNameCallback callback, void* context);
+
+template<typename Func>
+void scan_vmad_property_names(const uint8_t* value, size_t size, RecordType record_type, Func func) {
+    scan_vmad_property_names(value, size, record_type, [](void* context, const WString* name) {
+        (*(Func*)context)(name);
+    }, &func);
+}
+
+using VMAD_ObjectCallback = void(*)(void* context, const FormID* form_id);
+
+// Walks VMAD field like "scan_vmad_script_names", but "callback" is called for Form IDs of object
+// properties, elements of object array properties and quest alias objects. "form_id" points into
+// field data and may be unaligned.
+void scan_vmad_objects(const uint8_t* value, size_t size, RecordType record_type, VMAD_ObjectCallback callback, void* context);
+
+template<typename Func>
+void scan_vmad_objects(const uint8_t* value, size_t size, RecordType record_type, Func func) {
+    scan_vmad_objects(value, size, record_type, [](void* context, const FormID* form_id) {
+        (*(Func*)context)(form_id);
+    }, &func);
+}
+
 struct NVPP_Path {
     Array<FormID> formids;
 };
@@ -316,6 +381,215 @@ struct NVPP_Field {
     void parse(const uint8_t* value, size_t size);
 };
 
+#pragma pack(push, 1)
+struct NVNM_Vertex {
+    float x;
+    float y;
+    float z;
+};
+
+struct NVNM_Triangle {
+    uint16_t vertices[3];
+    int16_t edges[3]; // Index of triangle on other side of edge, -1 if there is none.
+    uint16_t flags;
+    uint16_t cover_flags;
+};
+static_assert(sizeof(NVNM_Triangle) == 16, "invalid NVNM_Triangle size");
+
+struct NVNM_EdgeLink {
+    uint32_t type;
+    FormID navmesh;
+    int16_t triangle;
+};
+static_assert(sizeof(NVNM_EdgeLink) == 10, "invalid NVNM_EdgeLink size");
+
+struct NVNM_DoorTriangle {
+    int16_t triangle;
+    uint32_t crc;
+    FormID door;
+};
+static_assert(sizeof(NVNM_DoorTriangle) == 10, "invalid NVNM_DoorTriangle size");
+#pragma pack(pop)
+
+// Navmesh geometry. Arrays point into field data.
+struct NVNM_Field {
+    uint32_t version = 0;
+    uint32_t crc = 0;
+    FormID worldspace;
+    union {
+        FormID cell; // If "worldspace" is zero.
+        struct {
+            int16_t grid_y;
+            int16_t grid_x;
+        };
+    };
+    StaticArray<NVNM_Vertex> vertices;
+    StaticArray<NVNM_Triangle> triangles;
+    StaticArray<NVNM_EdgeLink> edge_links;
+    StaticArray<NVNM_DoorTriangle> door_triangles;
+    StaticArray<int16_t> cover_triangles;
+    uint32_t grid_size = 0;
+    float max_x_distance = 0;
+    float max_y_distance = 0;
+    NVNM_Vertex min{};
+    NVNM_Vertex max{};
+    // "grid_size * grid_size" cells, each cell is uint32 count followed by int16 triangle indices.
+    StaticArray<uint8_t> grid_cells;
+
+    inline NVNM_Field() : cell() { }
+
+    // Returns false if field has unknown version or data does not match layout.
+    bool parse(const uint8_t* value, size_t size);
+};
+
+constexpr bool is_placed_reference(RecordType type) {
+    return type == RecordType::REFR || type == RecordType::ACHR;
+}
+
+// Field views are packed structs that can be read from field data in place, see "Record::get". Each view has
+// record types and field type it belongs to, layout must match field definition in typeinfo.cpp, which is
+// checked by "matches_field_view". Views with "members" list every member in order of definition, such views
+// are converted to text member by member without walking type info, see "TextRecordWriter::write_field_view".
+#pragma pack(push, 1)
+enum class QUST_Flags : uint16_t {
+    StartGameEnabled = 0x1,
+};
+ENUM_BIT_OPS(uint16_t, QUST_Flags);
+
+struct TES4_HEDR {
+    static constexpr RecordType record_types[] = { RecordType::TES4 };
+    static constexpr RecordFieldType field_type = RecordFieldType::HEDR;
+
+    float version;
+    int32_t record_count;
+    uint32_t next_object_id;
+};
+static_assert(sizeof(TES4_HEDR) == 12, "invalid TES4_HEDR size");
+
+struct QUST_DNAM {
+    static constexpr RecordType record_types[] = { RecordType::QUST };
+    static constexpr RecordFieldType field_type = RecordFieldType::DNAM;
+
+    QUST_Flags flags;
+    uint8_t priority;
+    uint8_t unknown;
+    uint32_t unused;
+    uint32_t type;
+};
+static_assert(sizeof(QUST_DNAM) == 12, "invalid QUST_DNAM size");
+
+struct REFR_DATA {
+    static constexpr RecordType record_types[] = { RecordType::REFR, RecordType::ACHR };
+    static constexpr RecordFieldType field_type = RecordFieldType::DATA;
+    static constexpr auto members() { return std::make_tuple(&REFR_DATA::position, &REFR_DATA::rotation); }
+
+    Vector3 position;
+    Vector3 rotation;
+};
+static_assert(sizeof(REFR_DATA) == 24, "invalid REFR_DATA size");
+
+struct REFR_XLKR {
+    static constexpr RecordType record_types[] = { RecordType::REFR };
+    static constexpr RecordFieldType field_type = RecordFieldType::XLKR;
+    static constexpr auto members() { return std::make_tuple(&REFR_XLKR::keyword, &REFR_XLKR::reference); }
+
+    FormID keyword;
+    FormID reference;
+};
+static_assert(sizeof(REFR_XLKR) == 8, "invalid REFR_XLKR size");
+
+struct REFR_XNDP {
+    static constexpr RecordType record_types[] = { RecordType::REFR };
+    static constexpr RecordFieldType field_type = RecordFieldType::XNDP;
+    static constexpr auto members() { return std::make_tuple(&REFR_XNDP::navmesh, &REFR_XNDP::triangle, &REFR_XNDP::unknown); }
+
+    FormID navmesh;
+    uint16_t triangle;
+    uint16_t unknown;
+};
+static_assert(sizeof(REFR_XNDP) == 8, "invalid REFR_XNDP size");
+
+struct REFR_XTEL {
+    static constexpr RecordType record_types[] = { RecordType::REFR };
+    static constexpr RecordFieldType field_type = RecordFieldType::XTEL;
+    static constexpr auto members() { return std::make_tuple(&REFR_XTEL::door, &REFR_XTEL::position, &REFR_XTEL::rotation, &REFR_XTEL::flags); }
+
+    FormID door;
+    Vector3 position;
+    Vector3 rotation;
+    uint32_t flags;
+};
+static_assert(sizeof(REFR_XTEL) == 32, "invalid REFR_XTEL size");
+
+struct CELL_XCLC {
+    static constexpr RecordType record_types[] = { RecordType::CELL };
+    static constexpr RecordFieldType field_type = RecordFieldType::XCLC;
+    static constexpr auto members() { return std::make_tuple(&CELL_XCLC::x, &CELL_XCLC::y, &CELL_XCLC::flags); }
+
+    int32_t x;
+    int32_t y;
+    uint32_t flags;
+};
+static_assert(sizeof(CELL_XCLC) == 12, "invalid CELL_XCLC size");
+
+struct NPC__ACBS {
+    static constexpr RecordType record_types[] = { RecordType::NPC_ };
+    static constexpr RecordFieldType field_type = RecordFieldType::ACBS;
+    static constexpr auto members() {
+        return std::make_tuple(
+            &NPC__ACBS::flags, &NPC__ACBS::magicka_offset, &NPC__ACBS::stamina_offset, &NPC__ACBS::level,
+            &NPC__ACBS::calc_min_level, &NPC__ACBS::calc_max_level, &NPC__ACBS::speed_multiplier,
+            &NPC__ACBS::disposition_base, &NPC__ACBS::template_flags, &NPC__ACBS::health_offset,
+            &NPC__ACBS::bleedout_override);
+    }
+
+    uint32_t flags;
+    int16_t magicka_offset;
+    int16_t stamina_offset;
+    uint16_t level;
+    uint16_t calc_min_level;
+    uint16_t calc_max_level;
+    uint16_t speed_multiplier;
+    uint16_t disposition_base;
+    uint16_t template_flags;
+    int16_t health_offset;
+    uint16_t bleedout_override;
+};
+static_assert(sizeof(NPC__ACBS) == 24, "invalid NPC__ACBS size");
+
+// Object bounds of base objects. Defined in "Record_Common", so it has no record types and can't be used with
+// "Record::get".
+struct Common_OBND {
+    static constexpr auto members() {
+        return std::make_tuple(&Common_OBND::x1, &Common_OBND::y1, &Common_OBND::z1, &Common_OBND::x2, &Common_OBND::y2, &Common_OBND::z2);
+    }
+
+    int16_t x1;
+    int16_t y1;
+    int16_t z1;
+    int16_t x2;
+    int16_t y2;
+    int16_t z2;
+};
+static_assert(sizeof(Common_OBND) == 12, "invalid Common_OBND size");
+#pragma pack(pop)
+
+// Landscape record stores data for 33x33 grid of vertices.
+constexpr int LAND_GridSize = 33;
+
+struct VHGT_Field {
+    float offset; // Height of first vertex.
+    // First vertex of a row is relative to first vertex of previous row, other vertices are relative to previous vertex.
+    int8_t gradients[LAND_GridSize][LAND_GridSize];
+    uint8_t unused[3];
+};
+static_assert(sizeof(VHGT_Field) == 1096, "invalid VHGT_Field size");
+
+struct VNML_Field {
+    int8_t normals[LAND_GridSize][LAND_GridSize][3]; // X, Y, Z.
+};
+static_assert(sizeof(VNML_Field) == 3267, "invalid VNML_Field size");
+
 enum class CTDA_Operator : uint8_t {
     Equal = 0,
     NotEqual = 1,
@@ -1,25 +1,32 @@
 #include "text_to_esp.hpp"
 #include "os.hpp"
 #include "common.hpp"
+#include "profiler.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 #include "base64.hpp"
 #include <zlib-ng.h>
 #include <charconv>
+#include <bit>
+#include <emmintrin.h>
 
 void TextRecordReader::init() {
     esp_buffer = allocate_virtual_memory(1024 * 1024 * 1024);
     compression_buffer = allocate_virtual_memory(1024 * 1024 * 32);
     buffer = &esp_buffer;
+    string_tables.init();
 }
 
 void TextRecordReader::dispose() {
     free_virtual_memory(&esp_buffer);
     free_virtual_memory(&compression_buffer);
+    string_tables.dispose();
     *this = TextRecordReader();
 }
 
 void TextRecordReader::read_records(const char* start, const char* end) {
+    PROFILE_SCOPE(TextParse, end - start);
+
     this->start = start;
     this->now = start;
     this->end = end;
@@ -27,7 +34,11 @@ void TextRecordReader::read_records(const char* start, const char* end) {
     verify(expect("plugin2text version 1.00\n---\n"));
 
     while (now < end) {
-        read_record();
+        // Top group label is known only after its first record is read.
+        TraceScope trace{ "group", "GRUP", 4 };
+        const auto record = read_record();
+        const auto label = record->type == RecordType::GRUP ? ((const RawGrupRecord*)record)->label : (uint32_t)record->type;
+        trace.rename((const char*)&label, sizeof(label));
     }
 }
 
@@ -207,7 +218,7 @@ RecordFlags TextRecordReader::read_record_flags(RecordDef* def) {
                 const auto current_def = defs[def_index];
                 for (int i = 0; i < current_def->flags.count; ++i) {
                     const auto& flag = current_def->flags.data[i];
-                    if (strlen(flag.name) == count && memory_equals(flag.name, now, count)) {
+                    if (flag.name_length == count && memory_equals(flag.name, now, count)) {
                         flags |= (RecordFlags)flag.bit;
                         goto ok;
                     }
@@ -240,10 +251,12 @@ RawRecord* TextRecordReader::read_record() {
     current_record_type = record->type;
 
     if (record->type == RecordType::GRUP) {
+        ++profiler.group_count;
         read_grup_record((RawGrupRecord*)record);
         return record;
     }
 
+    ++profiler.record_count;
     verify(expect(" "));
     record->id = read_formid();
 
@@ -269,12 +282,16 @@ RawRecord* TextRecordReader::read_record() {
 
     auto def = get_record_def(record->type);
     record->flags = read_record_flags(def);
+    if (record->type == RecordType::TES4) {
+        localized_strings = is_bit_set(record->flags, RecordFlags::TES4_Localized);
+    }
     if (!def) {
         def = &Record_Common;
     }
 
     const bool use_compression_buffer = record->is_compressed();
     if (use_compression_buffer) {
+        ++profiler.compressed_record_count;
         verify(!inside_compressed_record);
         inside_compressed_record = true;
         buffer = &compression_buffer;
@@ -302,14 +319,13 @@ RawRecord* TextRecordReader::read_record() {
     --indent;
 
     if (use_compression_buffer) {
-        constexpr int SkyrimZLibCompressionLevel = 7;
-
         auto uncompressed_data_size = static_cast<uLong>(compression_buffer.now - compression_buffer.start);
         verify(uncompressed_data_size > 0);
 
         const auto record_compressed = (RawRecordCompressed*)record;
 
         size_t compressed_size = esp_buffer.end - esp_buffer.now; // remaining ESP size
+        PROFILE_SCOPE(ZLibDeflate, uncompressed_data_size);
         const auto result = ::zng_compress2((uint8_t*)(record_compressed + 1), &compressed_size, buffer->start, uncompressed_data_size, SkyrimZLibCompressionLevel);
         verify(result == Z_OK);
 
@@ -340,12 +356,12 @@ static uint8_t parse_hex_char(char c) {
 }
 
 FormID TextRecordReader::read_formid() {
-    // @TODO: Use std::from_chars
-    int nread = 0;
     FormID formid;
-    int count = _snscanf_s(now, end - now, "[%08X]%n", &formid.value, &nread);
-    verify(count == 1);
-    verify(nread == 1 + 8 + 1); // [DEADBEEF]
+    verify(now + 1 + 8 + 1 <= end); // [DEADBEEF]
+    verify(now[0] == '[' && now[9] == ']');
+    const auto result = std::from_chars(now + 1, now + 9, formid.value, 16);
+    verify(result.ec == std::errc{});
+    verify(result.ptr == now + 9);
     now += 1 + 8 + 1;
     return formid;
 }
@@ -373,7 +389,29 @@ void TextRecordReader::read_formid_line(Slice* slice) {
     now = line_end + 1; // +1 for '\n'.
 }
 
+uint64_t TextRecordReader::read_integer_line(bool is_unsigned) {
+    auto line_end = peek_end_of_current_line();
+    uint64_t value = 0;
+
+    // Not using "sscanf", it calls "strlen" on the rest of the text every time. Negative values of unsigned
+    // integers are accepted the same way "sscanf" accepts them.
+    std::from_chars_result result;
+    if (is_unsigned && (now >= line_end || now[0] != '-')) {
+        result = std::from_chars(now, line_end, value);
+    } else {
+        int64_t signed_value = 0;
+        result = std::from_chars(now, line_end, signed_value);
+        value = static_cast<uint64_t>(signed_value);
+    }
+    verify(result.ec == std::errc{});
+    verify(result.ptr == line_end);
+
+    now = line_end + 1; // +1 for '\n'.
+    return value;
+}
+
 void TextRecordReader::read_byte_array(Slice* slice, size_t count) {
+    PROFILE_SCOPE(ByteArrayCoding, count);
     verify(slice->remaining_size() >= count);
 
     for (int i = 0; i < count; ++i) {
@@ -393,6 +431,9 @@ static bool has_custom_indent_rules(TypeKind kind) {
         case TypeKind::Filter:
         case TypeKind::XCLW:
         case TypeKind::CTDA:
+        case TypeKind::VHGT:
+        case TypeKind::VNML:
+        case TypeKind::NVNM:
             return true;
     }
     return false;
@@ -517,6 +558,35 @@ PapyrusFragmentFlags TextRecordReader::read_papyrus_info_record_fragment(Slice*
     return flags;
 }
 
+// Returns pointer to first '"', '\\', '\r' or '\n' character, or "end" if there are none.
+static const char* find_string_special_char(const char* now, const char* end) {
+    const auto quote = _mm_set1_epi8('"');
+    const auto backslash = _mm_set1_epi8('\\');
+    const auto cr = _mm_set1_epi8('\r');
+    const auto lf = _mm_set1_epi8('\n');
+    while (end - now >= 16) {
+        const auto chars = _mm_loadu_si128((const __m128i*)now);
+        const auto special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chars, cr), _mm_cmpeq_epi8(chars, lf))
+        );
+        const auto mask = (uint32_t)_mm_movemask_epi8(special);
+        if (mask) {
+            return now + std::countr_zero(mask);
+        }
+        now += 16;
+    }
+
+    for (; now < end; ++now) {
+        const auto c = *now;
+        if (c == '"' || c == '\\' || c == '\r' || c == '\n') {
+            return now;
+        }
+    }
+    return end;
+}
+
+// String bytes are copied as is, including bytes >= 128 which are not escaped by "TextRecordWriter::write_string".
 void TextRecordReader::read_string(Slice* slice) {
     if (expect("\"\"\"")) {
         verify(expect("\n"));
@@ -535,6 +605,13 @@ void TextRecordReader::read_string(Slice* slice) {
             }
 
             while (now < end) {
+                const auto special = find_string_special_char(now, end);
+                slice->write_bytes(now, special - now);
+                now = special;
+                if (now == end) {
+                    break;
+                }
+
                 char c = *now++;
                 if (c == '"') {
                     verify(false); // should be prefixed with backslash
@@ -544,12 +621,10 @@ void TextRecordReader::read_string(Slice* slice) {
                     slice->write_literal("\r\n");
                     had_at_least_one_newline = true;
                     goto next_line;
-                } else if (c == '\\') {
-                    verify(now < end && *now == '"');
+                } else {
+                    verify(c == '\\' && now < end && *now == '"');
                     slice->write_literal("\"");
                     ++now;
-                } else {
-                    slice->write_bytes(&c, 1);
                 }
             }
 
@@ -570,6 +645,7 @@ void TextRecordReader::read_string(Slice* slice) {
 }
 
 size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
+    TYPE_PROFILE_KIND(type_profile_read, type->kind, &slice->now);
     ++indent;
 
     if (!has_custom_indent_rules(type->kind)) {
@@ -597,14 +673,20 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
             const auto count = line_end - now;
 
             const auto base64_buffer = tmpalloc.now;
-            const auto base64_size = (uLong)base64_decode(now, line_end - now, base64_buffer, tmpalloc.remaining_size());
-            tmpalloc.now += base64_size;
+            uLong base64_size = 0;
+            {
+                PROFILE_SCOPE(ByteArrayCoding, count);
+                base64_size = (uLong)base64_decode(now, line_end - now, base64_buffer, tmpalloc.remaining_size());
+            }
+            memalloc(tmpalloc, base64_size); // Advance tmpalloc.
                
             const auto uncompressed_buffer = tmpalloc.now;
             auto result_size = tmpalloc.remaining_size();
 
+            ProfileScope profile{ ProfilePhase::ZLibInflate };
             const auto result = ::zng_uncompress(uncompressed_buffer, &result_size, base64_buffer, base64_size);
             verify(result == Z_OK);
+            profile.bytes = result_size;
 
             slice->write_bytes(uncompressed_buffer, result_size);
                 
@@ -630,6 +712,7 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
             const auto count = (line_end - now) / 2;
             verify(((line_end - now) % 2) == 0);
 
+            PROFILE_SCOPE(ByteArrayCoding, count);
             const auto buffer = compression_buffer.now;
             auto buffer_now = buffer;
 
@@ -654,13 +737,37 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
             now = line_end + 1; // +1 for '\n'.
         } break;
 
-        case TypeKind::ZString:
-        case TypeKind::LString: {
-            // @TODO @Test: localized LString
+        case TypeKind::ZString: {
+            zstring:
             read_string(slice);
             slice->write_literal("\0");
         } break;
 
+        case TypeKind::LString: {
+            if (!localized_strings) {
+                goto zstring;
+            }
+
+            const auto id = (uint32_t)read_int32();
+            slice->write_value(id);
+
+            if (expect(" ")) {
+                auto string_type = static_cast<const TypeLString*>(type)->table_type;
+                if (expect("DL ")) {
+                    string_type = StringTableType::DLStrings;
+                } else if (expect("IL ")) {
+                    string_type = StringTableType::ILStrings;
+                } else if (expect("ST ")) {
+                    string_type = StringTableType::Strings;
+                }
+
+                read_string(string_tables.begin_string(string_type, id));
+                string_tables.end_string(string_type);
+            } else {
+                verify(expect("\n"));
+            }
+        } break;
+
         case TypeKind::WString: {
             auto count_small = slice->advance<uint16_t>();
             const auto string_start = slice->now;
@@ -695,23 +802,7 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
 
         case TypeKind::Integer: {
             const auto integer_type = (const TypeInteger*)type;
-            auto line_end = peek_end_of_current_line();
-            int nread = 0;
-            uint64_t value = 0;
-
-            if (integer_type->is_unsigned) {
-                int count = sscanf_s(now, "%llu%n", &value, &nread);
-                verify(count == 1);
-                verify(nread == line_end - now);
-            } else {
-                int count = sscanf_s(now, "%lld%n", &value, &nread);
-                verify(count == 1);
-                verify(nread == line_end - now);
-            }
-
-            slice->write_integer_of_size(value, integer_type->size);
-
-            now = line_end + 1; // +1 for '\n'.
+            slice->write_integer_of_size(read_integer_line(integer_type->is_unsigned), integer_type->size);
         } break;
 
         case TypeKind::Struct: {
@@ -724,7 +815,7 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
                     continue;
                 }
                 expect_indent();
-                verify(expect(field.name));
+                verify(expect(field.name, field.name_length));
                 verify(expect("\n"));
                 read_type(slice, field.type);
             }
@@ -761,7 +852,7 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
 
                     for (int i = 0; i < enum_type->field_count; ++i) {
                         const auto& flag = enum_type->fields[i];
-                        if (strlen(flag.name) == count && memory_equals(flag.name, now, count)) {
+                        if (flag.name_length == count && memory_equals(flag.name, now, count)) {
                             result |= flag.value;
                             goto parse_flag_ok;
                         }
@@ -788,7 +879,7 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
                 
                 for (int i = 0; i < enum_type->field_count; ++i) {
                     const auto& field = enum_type->fields[i];
-                    if (strlen(field.name) == count && 0 == memcmp(now, field.name, count)) {
+                    if (field.name_length == count && memory_equals(now, field.name, count)) {
                         result = field.value;
                         now = line_end + 1; // +1 for '\n'.
                         goto parse_ok;
@@ -980,6 +1071,53 @@ size_t TextRecordReader::read_type(Slice* slice, const Type* type) {
             now = line_end + 1; // Skip \n.
         } break;
 
+        case TypeKind::VHGT: {
+            // Field with unexpected size is written as byte array.
+            if (!expect_indented("Offset\n")) {
+                --indent;
+                read_type(slice, &Type_ByteArray);
+                ++indent;
+                break;
+            }
+
+            read_type(slice, &Type_float);
+
+            verify(try_begin_custom_struct("Gradients"));
+            for (int row = 0; row < LAND_GridSize; ++row) {
+                read_grid_row(slice, LAND_GridSize, 1);
+            }
+            end_custom_struct();
+
+            read_custom_field(slice, "Unused", &Type_ByteArray);
+            verify(slice->now - slice_now_before_parsing == sizeof(VHGT_Field));
+        } break;
+
+        case TypeKind::VNML: {
+            if (!try_begin_custom_struct("Normals")) {
+                --indent;
+                read_type(slice, &Type_ByteArray);
+                ++indent;
+                break;
+            }
+
+            for (int row = 0; row < LAND_GridSize; ++row) {
+                read_grid_row(slice, LAND_GridSize, 3);
+            }
+            end_custom_struct();
+        } break;
+
+        case TypeKind::NVNM: {
+            // Field with unknown layout is written as byte array.
+            if (!expect_indented("Version\n")) {
+                --indent;
+                read_type(slice, &Type_ByteArrayRLE);
+                ++indent;
+                break;
+            }
+
+            read_nvnm(slice);
+        } break;
+
         default: {
             verify(false);
         } break;
@@ -1025,23 +1163,164 @@ void TextRecordReader::read_custom_field(Slice* slice, const char* field_name, c
 void TextRecordReader::read_field(const RecordFieldDef* field_def) {
     expect_indent();
     
+    ++profiler.field_count;
     const auto field = buffer->advance<RawRecordField>();
     field->type = read_record_field_type();
+    TYPE_PROFILE_FIELD(type_profile_read, current_record_type, field->type, &buffer->now);
     
     skip_to_next_line();
 
-    read_type(buffer, field_def ? field_def->data_type : &Type_ByteArray);
+    if (!field_def || !read_direct_field_value(field->type, field_def)) {
+        read_type(buffer, field_def ? field_def->data_type : &Type_ByteArray);
+    }
 
     const auto size = buffer->now - reinterpret_cast<const uint8_t*>(field) - sizeof(*field);
     verify(size <= 0xffff);
     field->size = static_cast<uint16_t>(size);
 }
 
+// "read_direct_value" reads values the same way as "read_type" does for corresponding types.
+template<typename T>
+void TextRecordReader::read_direct_value(Slice* slice) {
+    static_assert(is_direct_type<T>, "not a direct type");
+
+    if constexpr (std::is_same_v<T, Vector3>) {
+        read_direct_value<float>(slice);
+        read_direct_value<float>(slice);
+        read_direct_value<float>(slice);
+    } else {
+        ++indent;
+        expect_indent();
+        if constexpr (std::is_same_v<T, FormID>) {
+            read_formid_line(slice);
+        } else if constexpr (std::is_same_v<T, float>) {
+            slice->write_value(read_float());
+            verify(expect("\n"));
+        } else {
+            slice->write_value(static_cast<T>(read_integer_line(std::is_unsigned_v<T>)));
+        }
+        --indent;
+    }
+}
+
+template<typename T>
+void TextRecordReader::read_direct_field(Slice* slice, const TypeStructField& field) {
+    expect_indent();
+    verify(expect(field.name, field.name_length));
+    verify(expect("\n"));
+    read_direct_value<T>(slice);
+}
+
+// Counterpart of "TextRecordWriter::write_field_view_member". Constant with fallback is read only if text has
+// member with its name, otherwise constant is written.
+template<typename T, typename M>
+void TextRecordReader::read_field_view_member(Slice* slice, const TypeStructField& field, M T::*) {
+    auto type = field.type;
+    if (type->kind == TypeKind::Constant) {
+        const auto constant_type = static_cast<const TypeConstant*>(type);
+        if (!constant_type->fallback || !try_begin_custom_struct(field.name)) {
+            slice->write_bytes(constant_type->bytes, constant_type->size);
+            return;
+        }
+        end_custom_struct();
+
+        type = constant_type->fallback;
+    } else {
+        expect_indent();
+        verify(expect(field.name, field.name_length));
+        verify(expect("\n"));
+    }
+
+    if constexpr (is_direct_type<M>) {
+        if (type == resolve_type<M>()) {
+            read_direct_value<M>(slice);
+            return;
+        }
+    }
+
+    read_type(slice, type);
+}
+
+// Counterpart of "TextRecordWriter::write_field_view".
+template<typename T>
+bool TextRecordReader::read_field_view(Slice* slice, const Type* type) {
+    if (!is_field_view_layout<T>(type)) {
+        return false;
+    }
+
+    const auto fields = static_cast<const TypeStruct*>(type)->fields;
+
+    ++indent;
+    std::apply([&](auto... members) {
+        size_t i = 0;
+        (read_field_view_member(slice, fields[i++], members), ...);
+    }, T::members());
+    --indent;
+
+    return true;
+}
+
+// Counterpart of "TextRecordWriter::write_direct_field_value".
+bool TextRecordReader::read_direct_field_value(RecordFieldType type, const RecordFieldDef* field_def) {
+    const auto data_type = field_def->data_type;
+
+    switch (type) {
+        case RecordFieldType::OBND: {
+            return read_field_view<Common_OBND>(buffer, data_type);
+        }
+
+        case RecordFieldType::NAME: {
+            if (!is_placed_reference(current_record_type) || data_type != &Type_FormID) {
+                return false;
+            }
+            read_direct_value<FormID>(buffer);
+            return true;
+        }
+
+        case RecordFieldType::XSCL: {
+            if (!is_placed_reference(current_record_type) || data_type != &Type_float) {
+                return false;
+            }
+            read_direct_value<float>(buffer);
+            return true;
+        }
+
+        case RecordFieldType::DATA: {
+            return is_placed_reference(current_record_type) && read_field_view<REFR_DATA>(buffer, data_type);
+        }
+
+        case RecordFieldType::XLKR: {
+            return is_placed_reference(current_record_type) && read_field_view<REFR_XLKR>(buffer, data_type);
+        }
+
+        case RecordFieldType::XNDP: {
+            return is_placed_reference(current_record_type) && read_field_view<REFR_XNDP>(buffer, data_type);
+        }
+
+        case RecordFieldType::XTEL: {
+            return is_placed_reference(current_record_type) && read_field_view<REFR_XTEL>(buffer, data_type);
+        }
+
+        case RecordFieldType::XCLC: {
+            return current_record_type == RecordType::CELL && read_field_view<CELL_XCLC>(buffer, data_type);
+        }
+
+        case RecordFieldType::ACBS: {
+            return current_record_type == RecordType::NPC_ && read_field_view<NPC__ACBS>(buffer, data_type);
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
+
 void TextRecordReader::read_subrecord_fields(const RecordFieldDefSubrecord* field_def) {
     for (const auto inner_field_def : field_def->fields) {
         if (inner_field_def->data_type->kind == TypeKind::Constant) {
             const auto constant_type = (const TypeConstant*)inner_field_def->data_type;
 
+            ++profiler.field_count;
             buffer->write_value<RawRecordField>({ inner_field_def->type, static_cast<uint16_t>(constant_type->size) });
             buffer->write_bytes(constant_type->bytes, constant_type->size);
 
@@ -1067,8 +1346,11 @@ RecordFieldType TextRecordReader::read_record_field_type() {
 }
 
 bool TextRecordReader::expect(const char* string) {
+    return expect(string, strlen(string));
+}
+
+bool TextRecordReader::expect(const char* string, size_t count) {
     // @TODO: rename to consume, expect should crash if string is not expected.
-    auto count = strlen(string);
     if (now + count > end) {
         return false;
     }
@@ -1118,16 +1400,8 @@ int TextRecordReader::peek_indents() {
 }
 
 const char* TextRecordReader::peek_end_of_current_line() {
-    auto curr = now;
-    while (curr < end) {
-        char c = *curr;
-        if (c == '\n') {
-            return curr;
-        } else {
-            ++curr;
-        }
-    }
-    return end;
+    const auto line_end = (const char*)memchr(now, '\n', end - now);
+    return line_end ? line_end : end;
 }
 
 void TextRecordReader::expect_indent() {
@@ -1138,15 +1412,8 @@ void TextRecordReader::expect_indent() {
 }
 
 void TextRecordReader::skip_to_next_line() {
-    while (now < end) {
-        char c = *now;
-        if (c == '\n') {
-            ++now;
-            break;
-        } else {
-            ++now;
-        }
-    }
+    const auto line_end = peek_end_of_current_line();
+    now = line_end < end ? line_end + 1 : end;
 }
 
 CTDA_Argument TextRecordReader::read_ctda_argument(CTDA_ArgumentType type) {
@@ -1198,6 +1465,184 @@ CTDA_Operator TextRecordReader::read_ctda_operator() {
     return (CTDA_Operator)0;
 }
 
+void TextRecordReader::read_grid_row(Slice* slice, int count, int element_size) {
+    expect_indent();
+    const auto line_end = peek_end_of_current_line();
+
+    int read_count = 0;
+    while (now < line_end) {
+        if (read_count != 0) {
+            verify(expect(" "));
+        }
+
+        const auto element = slice->now;
+        for (int j = 0; j < element_size; ++j) {
+            if (j != 0) {
+                verify(expect(","));
+            }
+            const auto value = read_int32();
+            verify(value >= INT8_MIN && value <= INT8_MAX);
+            slice->write_value((int8_t)value);
+        }
+
+        int repeat = 1;
+        if (expect("*")) {
+            repeat = read_int32();
+            verify(repeat > 1);
+        }
+        verify(repeat <= count - read_count);
+
+        for (int i = 1; i < repeat; ++i) {
+            slice->write_bytes(element, element_size);
+        }
+        read_count += repeat;
+    }
+
+    verify(now == line_end);
+    verify(read_count == count);
+    now = line_end + 1; // Skip \n.
+}
+
+template<typename T>
+size_t TextRecordReader::read_numbers(Slice* slice, size_t max_count) {
+    size_t count = 0;
+    while (count < max_count && now < end && *now != '\n') {
+        if (count != 0) {
+            verify(expect(" "));
+        }
+
+        T value;
+        const auto result = std::from_chars(now, end, value);
+        verify(result.ec == std::errc{});
+        now = result.ptr;
+
+        slice->write_value(value);
+        ++count;
+    }
+    return count;
+}
+
+void TextRecordReader::read_nvnm(Slice* slice) {
+    // "Version" line is already consumed.
+    read_type(slice, &Type_uint32_t);
+    passthrough_custom_field<uint32_t>(slice, "CRC");
+
+    const auto worldspace = read_custom_field<FormID>("Parent Worldspace");
+    slice->write_value(worldspace);
+    if (worldspace.value == 0) {
+        passthrough_custom_field<FormID>(slice, "Parent Cell");
+    } else {
+        const auto grid_x = read_custom_field<int16_t>("Grid X");
+        const auto grid_y = read_custom_field<int16_t>("Grid Y");
+        slice->write_value(grid_y);
+        slice->write_value(grid_x);
+    }
+
+    verify(try_begin_custom_struct("Vertices"));
+    const auto vertex_count = slice->advance<uint32_t>();
+    while (try_continue_current_indent()) {
+        expect_indent();
+        verify(read_numbers<float>(slice, 3) == 3);
+        verify(expect("\n"));
+        ++*vertex_count;
+    }
+    end_custom_struct();
+
+    verify(try_begin_custom_struct("Triangles"));
+    const auto triangle_count = slice->advance<uint32_t>();
+    while (try_continue_current_indent()) {
+        expect_indent();
+        verify(read_numbers<uint16_t>(slice, 3) == 3);
+        verify(expect(" "));
+        verify(read_numbers<int16_t>(slice, 3) == 3);
+        verify(expect(" "));
+        verify(read_numbers<uint16_t>(slice, 2) == 2);
+        verify(expect("\n"));
+        ++*triangle_count;
+    }
+    end_custom_struct();
+
+    verify(try_begin_custom_struct("Edge Links"));
+    const auto edge_link_count = slice->advance<uint32_t>();
+    while (try_continue_current_indent()) {
+        expect_indent();
+        verify(read_numbers<uint32_t>(slice, 1) == 1);
+        verify(expect(" "));
+        slice->write_value(read_formid());
+        verify(expect(" "));
+        verify(read_numbers<int16_t>(slice, 1) == 1);
+        verify(expect("\n"));
+        ++*edge_link_count;
+    }
+    end_custom_struct();
+
+    verify(try_begin_custom_struct("Door Triangles"));
+    const auto door_triangle_count = slice->advance<uint32_t>();
+    while (try_continue_current_indent()) {
+        expect_indent();
+        verify(read_numbers<int16_t>(slice, 1) == 1);
+        verify(expect(" "));
+        verify(read_numbers<uint32_t>(slice, 1) == 1);
+        verify(expect(" "));
+        slice->write_value(read_formid());
+        verify(expect("\n"));
+        ++*door_triangle_count;
+    }
+    end_custom_struct();
+
+    verify(try_begin_custom_struct("Cover Triangles"));
+    const auto cover_triangle_count = slice->advance<uint32_t>();
+    while (try_continue_current_indent()) {
+        expect_indent();
+        *cover_triangle_count += (uint32_t)read_numbers<int16_t>(slice, SIZE_MAX);
+        verify(expect("\n"));
+    }
+    end_custom_struct();
+
+    const auto grid_size = read_custom_field<uint32_t>("Grid Size");
+    verify(grid_size <= 0xffff);
+    slice->write_value(grid_size);
+    passthrough_custom_field<float>(slice, "Max X Distance");
+    passthrough_custom_field<float>(slice, "Max Y Distance");
+
+    verify(try_begin_custom_struct("Min"));
+    expect_indent();
+    verify(read_numbers<float>(slice, 3) == 3);
+    verify(expect("\n"));
+    end_custom_struct();
+
+    verify(try_begin_custom_struct("Max"));
+    expect_indent();
+    verify(read_numbers<float>(slice, 3) == 3);
+    verify(expect("\n"));
+    end_custom_struct();
+
+    // Only cells that have triangles are written.
+    verify(try_begin_custom_struct("Grid Cells"));
+    const auto cell_count = grid_size * grid_size;
+    uint32_t next_cell = 0;
+    while (try_continue_current_indent()) {
+        expect_indent();
+        const auto cell = (uint32_t)read_int32();
+        verify(cell >= next_cell && cell < cell_count);
+        verify(expect(": "));
+
+        for (; next_cell < cell; ++next_cell) {
+            slice->write_value<uint32_t>(0);
+        }
+
+        const auto count = slice->advance<uint32_t>();
+        *count = (uint32_t)read_numbers<int16_t>(slice, SIZE_MAX);
+        verify(*count > 0);
+        verify(expect("\n"));
+        ++next_cell;
+    }
+    for (; next_cell < cell_count; ++next_cell) {
+        slice->write_value<uint32_t>(0);
+    }
+    end_custom_struct();
+}
+
 bool TextRecordReader::expect_indented(const char* str) {
     const auto count = strlen(str);
     if (try_continue_current_indent()) {
@@ -1210,7 +1655,7 @@ bool TextRecordReader::expect_indented(const char* str) {
     return false;
 }
 
-void text_to_esp(const wchar_t* text_path, const wchar_t* esp_path) {
+void text_to_esp(const wchar_t* text_path, const wchar_t* esp_path, const wchar_t* language) {
     TextRecordReader reader;
     reader.init();
     defer(reader.dispose());
@@ -1219,4 +1664,9 @@ void text_to_esp(const wchar_t* text_path, const wchar_t* esp_path) {
     reader.read_records((const char*)text.data, (const char*)text.data + text.count);
 
     write_file(esp_path, { reader.buffer->start, reader.buffer->size() });
+
+    // Text without localized strings has only string IDs, keep existing string tables in that case.
+    if (reader.string_tables.string_count) {
+        reader.string_tables.write(esp_path, language);
+    }
 }
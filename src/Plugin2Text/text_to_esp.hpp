@@ -1,6 +1,7 @@
 #pragma once
 #include "parseutils.hpp"
 #include "typeinfo.hpp"
+#include "string_table.hpp"
 
 struct TextRecordReader {
     // Current buffer. If writing compressed data, then points to "compression_buffer", otherwise to "esp_buffer".
@@ -24,6 +25,9 @@ struct TextRecordReader {
 
     RecordType current_record_type = (RecordType)0;
 
+    bool localized_strings = false; // LString fields are string IDs, set from TES4 record flags.
+    StringTablesBuilder string_tables; // Localized strings written next to string IDs.
+
     void init();
     void dispose();
 
@@ -38,6 +42,7 @@ struct TextRecordReader {
     int read_int32();
     float read_float();
     void read_formid_line(Slice* slice);
+    uint64_t read_integer_line(bool is_unsigned);
     void read_byte_array(Slice* slice, size_t count);
     PapyrusPropertyType read_papyrus_object(Slice* slice, const VMAD_Header* header, PapyrusPropertyType expect_type = PapyrusPropertyType::None);
     uint16_t read_papyrus_scripts(Slice* slice, const VMAD_Header* header);
@@ -79,6 +84,7 @@ struct TextRecordReader {
     RecordType read_record_type();
     RecordFieldType read_record_field_type();
     bool expect(const char* string);
+    bool expect(const char* string, size_t count);
     bool try_continue_current_indent();
     int peek_indents();
     const char* peek_end_of_current_line();
@@ -87,7 +93,30 @@ struct TextRecordReader {
     bool try_read_formid(FormID* formid);
     CTDA_Argument read_ctda_argument(CTDA_ArgumentType type);
     CTDA_Operator read_ctda_operator();
+    void read_grid_row(Slice* slice, int count, int element_size);
+    void read_nvnm(Slice* slice);
+
+    // Reads value of frequent field without going through "read_type". Returns false if field should be
+    // read with "read_type".
+    bool read_direct_field_value(RecordFieldType type, const RecordFieldDef* field_def);
+
+    template<typename T>
+    bool read_field_view(Slice* slice, const Type* type);
+
+    template<typename T, typename M>
+    void read_field_view_member(Slice* slice, const TypeStructField& field, M T::* member);
+
+    template<typename T>
+    void read_direct_value(Slice* slice);
+
+    template<typename T>
+    void read_direct_field(Slice* slice, const TypeStructField& field);
+
+    // Reads up to "max_count" numbers separated by spaces, stops at end of line.
+    template<typename T>
+    size_t read_numbers(Slice* slice, size_t max_count);
     bool expect_indented(const char* str);
 };
 
-void text_to_esp(const wchar_t* text_path, const wchar_t* esp_path);
+// If text has localized strings, string tables for "language" are written to "Strings" folder next to ESP.
+void text_to_esp(const wchar_t* text_path, const wchar_t* esp_path, const wchar_t* language);
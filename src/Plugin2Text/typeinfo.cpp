@@ -5,14 +5,17 @@
 
 #define CONCAT(a, b) a##b
 
-#define rf_field(m_type, m_name, m_data_type)                       \
-    ([]() -> const RecordFieldDef* {                                \
-        static RecordFieldDef field{ m_type, m_data_type, m_name }; \
-        return &field;                                              \
+#define rf_field(m_type, m_name, m_data_type)                               \
+    ([]() -> const RecordFieldDef* {                                        \
+        static constexpr RecordFieldHeader header{ m_type, m_name };        \
+        static RecordFieldDef field{ m_type, m_data_type, m_name, header }; \
+        return &field;                                                      \
     })()
 
 #define rf_zstring(m_type, m_name)      rf_field(m_type, m_name, &Type_ZString)
 #define rf_lstring(m_type, m_name)      rf_field(m_type, m_name, &Type_LString)
+#define rf_dlstring(m_type, m_name)     rf_field(m_type, m_name, &Type_DLString)
+#define rf_ilstring(m_type, m_name)     rf_field(m_type, m_name, &Type_ILString)
 #define rf_float(m_type, m_name)        rf_field(m_type, m_name, &Type_float)
 #define rf_int8(m_type, m_name)         rf_field(m_type, m_name, &Type_int8_t)
 #define rf_int16(m_type, m_name)        rf_field(m_type, m_name, &Type_int16_t)
@@ -29,20 +32,22 @@
 #define rf_bytes_rle(m_type, m_name)    rf_field(m_type, m_name, &Type_ByteArrayRLE)
 #define rf_bool(m_type, m_name)         rf_field(m_type, m_name, &Type_bool)
 
-#define rf_struct(m_type, m_name, m_size, ...)                \
-    ([]() -> const RecordFieldDef* {                          \
-        static TypeStructField fields[]{ __VA_ARGS__ };       \
-        static TypeStruct type{ m_name, m_size, fields };     \
-        static RecordFieldDef field{ m_type, &type, m_name }; \
-        return &field;                                        \
+#define rf_struct(m_type, m_name, m_size, ...)                        \
+    ([]() -> const RecordFieldDef* {                                  \
+        static TypeStructField fields[]{ __VA_ARGS__ };               \
+        static TypeStruct type{ m_name, m_size, fields };             \
+        static constexpr RecordFieldHeader header{ m_type, m_name };  \
+        static RecordFieldDef field{ m_type, &type, m_name, header }; \
+        return &field;                                                \
     })()
 
-#define rf_enum(m_type, m_name, m_size, m_flags, ...)            \
-    ([]() -> const RecordFieldDef* {                             \
-        static TypeEnumField fields[]{ __VA_ARGS__ };            \
-        static TypeEnum type{ m_name, m_size, fields, m_flags }; \
-        static RecordFieldDef field{ m_type, &type, m_name };    \
-        return &field;                                           \
+#define rf_enum(m_type, m_name, m_size, m_flags, ...)                 \
+    ([]() -> const RecordFieldDef* {                                  \
+        static TypeEnumField fields[]{ __VA_ARGS__ };                 \
+        static TypeEnum type{ m_name, m_size, fields, m_flags };      \
+        static constexpr RecordFieldHeader header{ m_type, m_name };  \
+        static RecordFieldDef field{ m_type, &type, m_name, header }; \
+        return &field;                                                \
     })()
 
 #define rf_enum_uint8(m_type, m_name, ...)   rf_enum(m_type, m_name, 1, false, __VA_ARGS__)
@@ -63,16 +68,18 @@
     ([]() -> const RecordFieldDef* {                                                               \
         static m_decltype the_value = { __VA_ARGS__ };                                             \
         static TypeConstant constant{ "Constant", sizeof(the_value), (const uint8_t*)&the_value }; \
-        static RecordFieldDef field{ m_type, &constant, m_name };                                  \
+        static constexpr RecordFieldHeader header{ m_type, m_name };                               \
+        static RecordFieldDef field{ m_type, &constant, m_name, header };                          \
         return &field;                                                                             \
     })()
 
 
-#define rf_filter(m_type, m_name, m_inner, m_preprocess)      \
-    ([]() -> const RecordFieldDef* {                          \
-        static TypeFilter type{ m_inner, m_preprocess };      \
-        static RecordFieldDef field{ m_type, &type, m_name }; \
-        return &field;                                        \
+#define rf_filter(m_type, m_name, m_inner, m_preprocess)              \
+    ([]() -> const RecordFieldDef* {                                  \
+        static TypeFilter type{ m_inner, m_preprocess };              \
+        static constexpr RecordFieldHeader header{ m_type, m_name };  \
+        static RecordFieldDef field{ m_type, &type, m_name, header }; \
+        return &field;                                                \
     })()
 
 constexpr TypeStructField sf_int8(const char* name) {
@@ -193,7 +200,9 @@ constexpr TypeStructField sf_fixed_bytes(const char* name) {
     })()
 
 Type Type_ZString{ TypeKind::ZString, "CString", 0 };
-Type Type_LString{ TypeKind::LString, "LString", 0 };
+TypeLString Type_LString{ "LString", StringTableType::Strings };
+TypeLString Type_DLString{ "DLString", StringTableType::DLStrings };
+TypeLString Type_ILString{ "ILString", StringTableType::ILStrings };
 Type Type_WString{ TypeKind::WString, "WString", 0 };
 Type Type_ByteArray{ TypeKind::ByteArray, "Byte Array", 0 };
 Type Type_ByteArrayCompressed{ TypeKind::ByteArrayCompressed, "Byte Array (Compressed)", 0 };
@@ -207,6 +216,9 @@ Type Type_NVPP{ TypeKind::NVPP, "NVPP", 0 };
 Type Type_VTXT{ TypeKind::VTXT, "VTXT", 0 };
 Type Type_XCLW{ TypeKind::XCLW, "XCLW", sizeof(float) };
 Type Type_CTDA{ TypeKind::CTDA, "CTDA", 0 };
+Type Type_VHGT{ TypeKind::VHGT, "VHGT", 0 };
+Type Type_VNML{ TypeKind::VNML, "VNML", 0 };
+Type Type_NVNM{ TypeKind::NVNM, "NVNM", 0 };
 TypeInteger Type_int8_t{ "int8", sizeof(int8_t), false };
 TypeInteger Type_int16_t{ "int16", sizeof(int16_t), false };
 TypeInteger Type_int32_t{ "int32", sizeof(int32_t), false };
@@ -229,6 +241,25 @@ const RecordFieldDefBase* RecordDef::get_field_def(RecordFieldType type) const {
     return nullptr;
 }
 
+const RecordFieldDef* RecordDef::get_value_field_def(RecordFieldType type) const {
+    const auto field_def = get_field_def(type);
+    if (field_def && field_def->def_type == RecordFieldDefType::Field) {
+        return static_cast<const RecordFieldDef*>(field_def);
+    }
+
+    for (const auto block_def : fields) {
+        if (block_def->def_type != RecordFieldDefType::Subrecord) {
+            continue;
+        }
+        for (const auto inner_field_def : static_cast<const RecordFieldDefSubrecord*>(block_def)->fields) {
+            if (inner_field_def->type == type && inner_field_def->data_type->kind != TypeKind::Constant) {
+                return inner_field_def;
+            }
+        }
+    }
+    return nullptr;
+}
+
 #define TYPE_ENUM(m_type, m_name, m_size, ...)           \
     static TypeEnumField CONCAT(Type_, m_type)_Fields[]{ \
         __VA_ARGS__                                      \
@@ -396,7 +427,7 @@ static RecordDef Record_WEAP{
         rf_formid("ETYP", "Equipment Type"),
         rf_formid("BIDS", "Block Bash Impact Data Set"),
         rf_formid("BAMT", "Alternate Block Material"),
-        rf_lstring("DESC", "Description"),
+        rf_dlstring("DESC", "Description"),
         rf_formid("INAM", "Impact Data Set"),
         rf_formid("WNAM", "1st Person Model Object"),
         rf_formid("TNAM", "Attack Fail Sound"),
@@ -491,7 +522,7 @@ static RecordDef Record_QUST{
             ),
             sf_int8("Unknown"),
         ),
-        rf_lstring("CNAM", "Journal Entry"),
+        rf_dlstring("CNAM", "Journal Entry"),
         rf_flags_uint8("QSDT", "Flags",
             { 0x1, "Complete Quest" },
             { 0x2, "Fail Quest" },
@@ -965,7 +996,7 @@ static RecordDef Record_INFO{
         rf_formid("PNAM", "Previous Info"),
         rf_uint8("CNAM", "Favor Level"),
         rf_formid("TCLT", "Topic Links"),
-        rf_lstring("NAM1", "Response"), // @TODO: ilstring
+        rf_ilstring("NAM1", "Response"),
         rf_zstring("NAM2", "Notes"),
         rf_zstring("NAM3", "Edits"),
         rf_lstring("RNAM", "Player Response"),
@@ -1105,7 +1136,7 @@ static RecordDef Record_MGEF{
     .type = record_type("MGEF"),
     .comment = "Magic Effect",
     .fields = record_fields(
-        rf_lstring("DNAM", "Description"),
+        rf_dlstring("DNAM", "Description"),
     ),
 };
 
@@ -1114,7 +1145,7 @@ static RecordDef Record_SPEL{
     .comment = "Spell",
     .fields = record_fields(
         rf_formid("ETYP", "Equipment Type"),
-        rf_lstring("DESC", "Description"),
+        rf_dlstring("DESC", "Description"),
         rf_formid("EFID", "Magic Effect Form ID"),
         rf_struct("EFIT", "Magic Effect", 12,
             sf_float("Magnitude"),
@@ -1227,8 +1258,8 @@ static RecordDef Record_LAND{
     .type = record_type("LAND"),
     .comment = "Landscape",
     .fields = record_fields(
-        rf_bytes("VNML", "Vertex Normals"),
-        rf_bytes("VHGT", "Vertex Height"),
+        rf_field("VNML", "Vertex Normals", &Type_VNML),
+        rf_field("VHGT", "Vertex Height", &Type_VHGT),
         rf_compressed("VCLR", "Vertex Color"),
         rf_struct("BTXT", "Base Layer Header", 8,
             sf_formid("Land Texture"),
@@ -1278,7 +1309,7 @@ static RecordDef Record_NAVM{
     .type = record_type("NAVM"),
     .comment = "NavMesh",
     .fields = record_fields(
-        rf_bytes_rle("NVNM", "Geometry"),
+        rf_field("NVNM", "Geometry", &Type_NVNM),
     ),
 };
 
@@ -1401,7 +1432,7 @@ static RecordDef Record_BOOK{
     .comment = "Book",
     .fields = record_fields(
         Field_MODL,
-        rf_lstring("DESC", "Text"),
+        rf_dlstring("DESC", "Text"),
         rf_struct("DATA", "Data", 16, 
             sf_flags_uint8("Flags", 
                 { 0x1, "Teaches Skill" },
@@ -1414,7 +1445,7 @@ static RecordDef Record_BOOK{
             sf_float("Weight"),
         ),
         rf_formid("INAM", "Inventory Art"),
-        rf_lstring("CNAM", "Description"),
+        rf_dlstring("CNAM", "Description"),
     ),
 };
 
@@ -1432,48 +1463,94 @@ static RecordDef Record_SCEN{
     ),
 };
 
+// Every record definition, "get_record_def" and "get_record_defs" are generated from this list.
+#define RECORD_DEFS(X) \
+    X(TES4) \
+    X(WEAP) \
+    X(QUST) \
+    X(CELL) \
+    X(REFR) \
+    X(CONT) \
+    X(NPC_) \
+    X(NAVI) \
+    X(DLVW) \
+    X(DLBR) \
+    X(INFO) \
+    X(ACHR) \
+    X(DIAL) \
+    X(KYWD) \
+    X(TXST) \
+    X(GLOB) \
+    X(FACT) \
+    X(SOUN) \
+    X(MGEF) \
+    X(SPEL) \
+    X(FLST) \
+    X(STAT) \
+    X(MISC) \
+    X(FURN) \
+    X(WRLD) \
+    X(LAND) \
+    X(LCTN) \
+    X(NAVM) \
+    X(PACK) \
+    X(LCRT) \
+    X(ACTI) \
+    X(KEYM) \
+    X(BOOK) \
+    X(SCEN)
+
 RecordDef* get_record_def(RecordType type) {
-    #define CASE(rec) case (RecordType)fourcc(#rec): return &Record_##rec
+    #define CASE(rec) case (RecordType)fourcc(#rec): return &Record_##rec;
     switch (type) {
-        CASE(TES4);
-        CASE(WEAP);
-        CASE(QUST);
-        CASE(CELL);
-        CASE(REFR);
-        CASE(CONT);
-        CASE(NPC_);
-        CASE(NAVI);
-        CASE(DLVW);
-        CASE(DLBR);
-        CASE(INFO);
-        CASE(ACHR);
-        CASE(DIAL);
-        CASE(KYWD);
-        CASE(TXST);
-        CASE(GLOB);
-        CASE(FACT);
-        CASE(SOUN);
-        CASE(MGEF);
-        CASE(SPEL);
-        CASE(FLST);
-        CASE(STAT);
-        CASE(MISC);
-        CASE(FURN);
-        CASE(WRLD);
-        CASE(LAND);
-        CASE(LCTN);
-        CASE(NAVM);
-        CASE(PACK);
-        CASE(LCRT);
-        CASE(ACTI);
-        CASE(KEYM);
-        CASE(BOOK);
-        CASE(SCEN);
+        RECORD_DEFS(CASE)
     }
     #undef CASE
     return nullptr;
 }
 
+StaticArray<RecordDef*> get_record_defs() {
+    #define DEF(rec) &Record_##rec,
+    static RecordDef* defs[]{
+        RECORD_DEFS(DEF)
+    };
+    #undef DEF
+    return { defs, _countof(defs) };
+}
+
+bool matches_field_view(StaticArray<const RecordType> record_types, RecordFieldType field_type, size_t size, StaticArray<const size_t> offsets) {
+    for (const auto record_type : record_types) {
+        const auto def = get_record_def(record_type);
+        if (!def) {
+            return false;
+        }
+
+        const auto field_def = def->get_field_def(field_type);
+        if (!field_def || field_def->def_type != RecordFieldDefType::Field) {
+            return false;
+        }
+
+        const auto type = static_cast<const RecordFieldDef*>(field_def)->data_type;
+        if (!is_struct_layout(type, size, offsets.count)) {
+            return false;
+        }
+
+        const auto struct_type = static_cast<const TypeStruct*>(type);
+        size_t offset = 0;
+        for (size_t i = 0; i < struct_type->field_count; ++i) {
+            if (offsets.data[i] != offset) {
+                return false;
+            }
+            offset += struct_type->fields[i].type->size;
+        }
+
+        if (offset != size) {
+            return false;
+        }
+    }
+    return true;
+}
+
 const TypeEnumField* TypeEnum::get_field_by_value(uint32_t value) const {
     for (size_t i = 0; i < field_count; ++i) {
         const auto& field = fields[i];
@@ -1,7 +1,9 @@
 #pragma once
 #include <stdint.h>
+#include <type_traits>
 #include "tes.hpp"
 #include "common.hpp"
+#include "string_table.hpp"
 
 enum class TypeKind {
     Unknown,
@@ -27,8 +29,22 @@ enum class TypeKind {
     VTXT,
     XCLW,
     CTDA,
+    VHGT,
+    VNML,
+    NVNM,
+    Count,
 };
 
+// Same as "strlen", but can be used in constant expressions, so name lengths of type definitions are
+// computed at compile time instead of every time name is written or matched.
+constexpr size_t const_strlen(const char* str) {
+    size_t count = 0;
+    while (str[count]) {
+        ++count;
+    }
+    return count;
+}
+
 struct Type {
     TypeKind kind = TypeKind::Unknown;
     const char* name = nullptr;
@@ -37,6 +53,13 @@ struct Type {
     constexpr Type(TypeKind kind, const char* name, size_t size) : kind(kind), name(name), size(size) { }
 };
 
+// Localized string, "table_type" is string table where game looks up strings of field.
+struct TypeLString : Type {
+    StringTableType table_type = StringTableType::Strings;
+
+    constexpr TypeLString(const char* name, StringTableType table_type) : Type(TypeKind::LString, name, 0), table_type(table_type) { }
+};
+
 struct TypeInteger : Type {
     bool is_unsigned = false;
 
@@ -49,6 +72,9 @@ struct TypeSpecial : Type {
 struct TypeStructField {
     const Type* type = nullptr;
     const char* name = nullptr;
+    size_t name_length = 0;
+
+    constexpr TypeStructField(const Type* type, const char* name) : type(type), name(name), name_length(const_strlen(name)) { }
 };
 
 struct TypeStruct : Type {
@@ -59,9 +85,17 @@ struct TypeStruct : Type {
     constexpr TypeStruct(const char* name, size_t size, const TypeStructField(&fields)[N]) : Type(TypeKind::Struct, name, size), field_count(N), fields(fields) { }
 };
 
+// Returns true if "type" is struct of specified size and field count.
+inline bool is_struct_layout(const Type* type, size_t size, size_t field_count) {
+    return type->kind == TypeKind::Struct && type->size == size && static_cast<const TypeStruct*>(type)->field_count == field_count;
+}
+
 struct TypeEnumField {
     uint32_t value = 0;
     const char* name = 0;
+    size_t name_length = 0;
+
+    constexpr TypeEnumField(uint32_t value, const char* name) : value(value), name(name), name_length(const_strlen(name)) { }
 };
 
 struct TypeEnum : Type {
@@ -103,14 +137,10 @@ struct TypeFilter : Type {
     { }
 };
 
-struct Vector3 {
-    float x = 0;
-    float y = 0;
-    float z = 0;
-};
-
 extern Type Type_ZString;
-extern Type Type_LString;
+extern TypeLString Type_LString;
+extern TypeLString Type_DLString;
+extern TypeLString Type_ILString;
 extern Type Type_WString;
 extern Type Type_ByteArray;
 extern Type Type_ByteArrayCompressed;
@@ -156,6 +186,7 @@ RESOLVE_TYPE(uint64_t);
 RESOLVE_TYPE(PapyrusPropertyType);
 RESOLVE_TYPE(PapyrusFragmentFlags);
 RESOLVE_TYPE(FormID);
+RESOLVE_TYPE(Vector3);
 RESOLVE_TYPE(WString);
 RESOLVE_TYPE(CTDA_Flags);
 RESOLVE_TYPE(CTDA_RunOnType);
@@ -174,11 +205,44 @@ struct RecordFieldDefBase {
     constexpr RecordFieldDefBase(RecordFieldDefType def_type, RecordFieldType type, const char* comment) : def_type(def_type), type(type), comment(comment) { }
 };
 
+// Line "<type> - <comment>\n" that is written before field value in text format, built at compile time.
+template<size_t N>
+struct RecordFieldHeader {
+    char chars[N] = {};
+
+    template<size_t M>
+    constexpr RecordFieldHeader(char const (&type)[5], char const (&comment)[M]) {
+        for (size_t i = 0; i < 4; ++i) {
+            chars[i] = type[i];
+        }
+        chars[4] = ' ';
+        chars[5] = '-';
+        chars[6] = ' ';
+        for (size_t i = 0; i < M - 1; ++i) {
+            chars[7 + i] = comment[i];
+        }
+        chars[N - 2] = '\n';
+    }
+};
+
+template<size_t M>
+RecordFieldHeader(char const (&type)[5], char const (&comment)[M]) -> RecordFieldHeader<4 + 3 + (M - 1) + 2>;
+
 struct RecordFieldDef : RecordFieldDefBase {
     const Type* data_type = nullptr;
+    const char* header = nullptr; // May be null, then header is assembled from type and comment.
+    size_t header_length = 0;
 
     constexpr RecordFieldDef(char const type[5], const Type* data_type, const char* comment) : RecordFieldDefBase(RecordFieldDefType::Field, type, comment), data_type(data_type) { }
     constexpr RecordFieldDef(RecordFieldType type, const Type* data_type, const char* comment) : RecordFieldDefBase(RecordFieldDefType::Field, type, comment), data_type(data_type) { }
+
+    template<size_t N>
+    constexpr RecordFieldDef(char const type[5], const Type* data_type, const char* comment, const RecordFieldHeader<N>& header)
+        : RecordFieldDefBase(RecordFieldDefType::Field, type, comment)
+        , data_type(data_type)
+        , header(header.chars)
+        , header_length(N - 1)
+    { }
 };
 
 struct RecordFieldDefSubrecord : RecordFieldDefBase {
@@ -190,9 +254,10 @@ struct RecordFieldDefSubrecord : RecordFieldDefBase {
 struct RecordFlagDef {
     RecordFlags bit = RecordFlags::None;
     const char* name = nullptr;
+    size_t name_length = 0;
 
-    constexpr RecordFlagDef(RecordFlags bit, const char* name) : bit(bit), name(name) { }
-    constexpr RecordFlagDef(uint32_t bit, const char* name) : bit((RecordFlags)bit), name(name) { }
+    constexpr RecordFlagDef(RecordFlags bit, const char* name) : bit(bit), name(name), name_length(const_strlen(name)) { }
+    constexpr RecordFlagDef(uint32_t bit, const char* name) : bit((RecordFlags)bit), name(name), name_length(const_strlen(name)) { }
 };
 
 struct RecordDef {
@@ -202,11 +267,54 @@ struct RecordDef {
     StaticArray<RecordFlagDef> flags;
 
     const RecordFieldDefBase* get_field_def(RecordFieldType type) const;
+
+    // Returns definition of field value, fields which are defined only inside of subrecords are found too.
+    const RecordFieldDef* get_value_field_def(RecordFieldType type) const;
 };
 
 extern RecordDef Record_Common;
 
 RecordDef* get_record_def(RecordType type);
+StaticArray<RecordDef*> get_record_defs();
+
+// Returns true if field is defined as struct of "size" bytes with fields at "offsets" in all of "record_types".
+bool matches_field_view(StaticArray<const RecordType> record_types, RecordFieldType field_type, size_t size, StaticArray<const size_t> offsets);
+
+template<typename T>
+bool matches_field_view(StaticArray<const size_t> offsets) {
+    return matches_field_view({ T::record_types, _countof(T::record_types) }, T::field_type, sizeof(T), offsets);
+}
+
+template<typename P>
+struct MemberPointer;
+
+template<typename T, typename M>
+struct MemberPointer<M T::*> {
+    using Member = M;
+};
+
+template<typename P>
+constexpr size_t member_size = sizeof(typename MemberPointer<P>::Member);
+
+// Returns true if "type" is struct with members of the same sizes as "T::members", so data of "type" can be read
+// as "T". Names and types of members are still taken from "type".
+template<typename T>
+bool is_field_view_layout(const Type* type) {
+    return std::apply([type](auto... members) {
+        static_assert((member_size<decltype(members)> + ...) == sizeof(T), "field view members don't cover whole view");
+        if (!is_struct_layout(type, sizeof(T), sizeof...(members))) {
+            return false;
+        }
+        const auto fields = static_cast<const TypeStruct*>(type)->fields;
+        size_t i = 0;
+        return ((fields[i++].type->size == member_size<decltype(members)>) && ...);
+    }, T::members());
+}
+
+// Values of these types are written on a single line and can be converted without looking at type info when type
+// info is "resolve_type<T>()", see "TextRecordWriter::write_direct_value".
+template<typename T>
+constexpr bool is_direct_type = std::is_same_v<T, FormID> || std::is_same_v<T, float> || std::is_same_v<T, Vector3> || (std::is_integral_v<T> && !std::is_same_v<T, bool>);
 
 constexpr char ByteArrayRLE_StreamStart = '!';
 constexpr size_t ByteArrayRLE_MaxStreamValue = '~' - ByteArrayRLE_StreamStart;
@@ -1,6 +1,5 @@
 #include "xml.hpp"
 #include "string.hpp"
-#include "array.hpp"
 #include <stdlib.h> // _countof
 #include <string.h> // memcpy
 
@@ -248,191 +247,143 @@ void XmlParser::skip_whitespace_and_newlines() {
     }
 }
 
-XmlText* parse_text(XmlParser& parser, const XmlToken& thisTextToken) {
-    auto result = memnew(tmpalloc) XmlText();
-    result->type = XmlNodeType::Text;
-    result->text = thisTextToken.text;
-    return result;
-}
-
-XmlElement* parse_element(XmlParser& parser, const XmlToken& thisElementToken) {
-    XmlToken token;
-    auto element = memnew(tmpalloc) XmlElement();
-    element->type = XmlNodeType::Element;
-    element->name = thisElementToken.start_element_name;
-
-    // Attributes
-    while (parser.next(&token)) {
-        switch (token.type) {
-            case XmlTokenType::Attribute: {
-                element->attributes.push(token.attribute);
-            } break;
-            default: {
-                goto finish_attributes;
-            }
-        }
-    }
-
-    finish_attributes:
-
-    do {
-        switch (token.type) {
-            case XmlTokenType::EndElement: {
-                verify(thisElementToken.start_element_name == token.end_element_name);
-                element->self_closing = token.self_closing;
-                return element;
-            }
-            case XmlTokenType::StartElement: {
-                element->children.push(parse_element(parser, token));
-            } break;
-            case XmlTokenType::Text: {
-                element->children.push(parse_text(parser, token));
-            } break;
-            default: {
-                verify(false);
-            } break;
-        }
-    } while (parser.next(&token));
+String XmlFormatter::format(const String& source) {
+    *this = XmlFormatter();
 
-    verify(false);
-    return nullptr;
-}
+    slice.start = tmpalloc.now;
+    slice.now = slice.start;
+    slice.end = slice.start + tmpalloc.remaining_size();
 
-XmlElement* parse_xml(const String& source) {
     XmlToken token;
     XmlParser parser;
     parser.init(source);
-
-    XmlDocument doc;
-    doc.type = XmlNodeType::Document;
-
-    // Skip declaration first.
-    {
-        bool inside_declaration = false;
-        while (parser.next(&token)) {
-            switch (token.type) {
-                case XmlTokenType::StartDeclaration: {
-                    inside_declaration = true;
-                } break;
-                case XmlTokenType::EndDeclaration: {
-                    verify(inside_declaration);
-                    goto declaration_finished;
-                } break;
-                case XmlTokenType::Attribute: {
-                    verify(inside_declaration);
-                } break;
-                default: {
-                    verify(!inside_declaration);
-                    // Missing declaration.
-                    goto continue_with_last_token;
-                } break;
-            }
-        }
-    }
-
-    declaration_finished: {}
-
     while (parser.next(&token)) {
-        continue_with_last_token: {}
-        switch (token.type) {
-            case XmlTokenType::StartElement: {
-                verify(doc.child_count < _countof(doc.children));
-                doc.children[doc.child_count++] = parse_element(parser, token);
-            } break;
-            default: {
-                verify(false);
-            } break;
-        }
+        write_token(token);
     }
 
-    // We can parse multiple elements at root level, but for now we don't need it,
-    // so we return first element.
-    verify(doc.child_count == 1);
-    return doc.children[0];
-}
-
-String XmlFormatter::format(const String& source) {
-    *this = XmlFormatter();
-
-    const auto root = parse_xml(source);
-
-    slice.start = tmpalloc.now;
-    slice.now = slice.start;
-    slice.end = slice.start + tmpalloc.remaining_size();
-
-    format_node(root);
+    // We can parse multiple elements at root level, but for now we don't need it.
+    verify(root_count == 1);
+    verify(depth == 0);
 
-    tmpalloc.now = slice.now;
+    memalloc(tmpalloc, slice.size()); // Advance tmpalloc.
     slice.end = slice.now;
     return { (char*)slice.start, (int)slice.size() };
 }
 
 void XmlFormatter::write_indent() {
-    for (int i = 0; i < indent; ++i) {
+    for (int i = 0; i < depth; ++i) {
         slice.write_literal("  ");
     }
 }
 
-void XmlFormatter::format_node(const XmlNode* node) {
-    switch (node->type) {
-        case XmlNodeType::Element: {
-            const auto element = (const XmlElement*)node;
+void XmlFormatter::write_token(const XmlToken& token) {
+    switch (token.type) {
+        case XmlTokenType::StartDeclaration: {
+            // Declaration is skipped.
+            verify(root_count == 0 && !inside_declaration);
+            inside_declaration = true;
+        } break;
+
+        case XmlTokenType::EndDeclaration: {
+            verify(inside_declaration);
+            inside_declaration = false;
+        } break;
+
+        case XmlTokenType::Attribute: {
+            if (inside_declaration) {
+                break;
+            }
+
+            verify(start_tag_open && !pending_text.chars);
+            slice.write_literal(" ");
+            slice.write_string(token.attribute.key);
+            slice.write_literal("=\"");
+            slice.write_string(token.attribute.value);
+            slice.write_literal("\"");
+        } break;
+
+        case XmlTokenType::StartElement: {
+            verify(!inside_declaration);
+            if (depth == 0) {
+                verify(root_count == 0);
+                ++root_count;
+            } else {
+                begin_child();
+            }
+
+            verify(depth < _countof(element_names));
+            element_names[depth] = token.start_element_name;
+
             write_indent();
             slice.write_literal("<");
-            slice.write_string(element->name);
-
-            for (const auto& attribute : element->attributes) {
-                slice.write_literal(" ");
-                slice.write_string(attribute.key);
-                slice.write_literal("=\"");
-                slice.write_string(attribute.value);
-                slice.write_literal("\"");
+            slice.write_string(token.start_element_name);
+            start_tag_open = true;
+            ++depth;
+        } break;
+
+        case XmlTokenType::Text: {
+            verify(depth > 0);
+            if (start_tag_open && !pending_text.chars) {
+                // Element with single text child is written on one line.
+                pending_text = token.text;
+                break;
             }
 
-            if (element->self_closing) {
+            begin_child();
+            write_indent();
+            slice.write_string(token.text);
+        } break;
+
+        case XmlTokenType::EndElement: {
+            verify(depth > 0);
+            --depth;
+            verify(element_names[depth] == token.end_element_name);
+
+            if (token.self_closing) {
+                verify(start_tag_open);
                 slice.write_literal(" />");
+                start_tag_open = false;
                 break;
             }
 
-            slice.write_literal(">");
-            
-            ++indent;
-            if (element->children.count == 0) {
-                --indent;
-            } else if (element->children.count == 1 && element->children[0]->type == XmlNodeType::Text) {
-                const auto text = (const XmlText*)element->children[0];
-                slice.write_string(text->text);
-
-                --indent;
-            } else {
-                slice.write_literal("\n");
-                for (int i = 0; i < element->children.count; ++i) {
-                    const auto child = element->children[i];
-                    format_node(child);
-                    
-                    if (i != element->children.count - 1) {
-                        slice.write_literal("\n");
-                    }
+            if (start_tag_open) {
+                slice.write_literal(">");
+                if (pending_text.chars) {
+                    slice.write_string(pending_text);
+                    pending_text = String();
                 }
-
-                --indent;
+                start_tag_open = false;
+            } else {
                 slice.write_literal("\n");
                 write_indent();
             }
 
             slice.write_literal("</");
-            slice.write_string(element->name);
+            slice.write_string(token.end_element_name);
             slice.write_literal(">");
         } break;
 
-        case XmlNodeType::Text: {
-            const auto text = (const XmlText*)node;
-            write_indent();
-            slice.write_string(text->text);
-        } break;
-
         default: {
             verify(false);
         } break;
     }
 }
+
+// Writes separator before child of current element. Children of element with more than one child,
+// or with non text child, are written on separate lines.
+void XmlFormatter::begin_child() {
+    if (!start_tag_open) {
+        slice.write_literal("\n");
+        return;
+    }
+
+    slice.write_literal(">\n");
+    start_tag_open = false;
+
+    if (pending_text.chars) {
+        write_indent();
+        slice.write_string(pending_text);
+        slice.write_literal("\n");
+        pending_text = String();
+    }
+}
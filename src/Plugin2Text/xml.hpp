@@ -37,32 +37,6 @@ struct XmlToken {
     void print();
 };
 
-enum class XmlNodeType {
-    Document,
-    Element,
-    Text,
-};
-
-struct XmlNode {
-    XmlNodeType type;
-};
-
-struct XmlElement : public XmlNode {
-    String name;
-    Array<XmlNode*> children{ tmpalloc };
-    Array<XmlAttribute> attributes{ tmpalloc };
-    bool self_closing = false;
-};
-
-struct XmlDocument : public XmlNode {
-    int child_count = 0;
-    XmlElement* children[8]{ 0 };
-};
-
-struct XmlText : public XmlNode {
-    String text;
-};
-
 struct XmlParser {
     char* start = 0;
     char* now = 0;
@@ -87,14 +61,20 @@ private:
     void skip_whitespace_and_newlines();
 };
 
-XmlElement* parse_xml(const String& source);
-
+// Formats XML straight from parser tokens, without building element tree. Only first child of an element
+// is held back until next token shows whether it is the only child, so memory usage does not depend on source size.
 struct XmlFormatter {
     Slice slice;
-    int indent = 0;
+    int depth = 0;
+    int root_count = 0;
+    bool inside_declaration = false;
+    bool start_tag_open = false; // "<name attributes" is written, but ">" is not.
+    String pending_text; // Text after open start tag, written when next token is known.
+    String element_names[32];
 
     String format(const String& source);
 private:
     void write_indent();
-    void format_node(const XmlNode* node);
+    void write_token(const XmlToken& token);
+    void begin_child();
 };
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "esp_generator.hpp"
+#include <args.hpp>
+#include <esp_parser.hpp>
+#include <esp_to_text.hpp>
+#include <text_to_esp.hpp>
+#include <typeinfo.hpp>
+#include <profiler.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void print_usage() {
+    puts(
+        "Usage: Plugin2TextBench.exe [options]\n"
+        "\n"
+        "Generates synthetic plugin from record definitions and measures ESP -> text -> ESP\n"
+        "conversion throughput. Results are written to stdout as JSON, one object per line.\n"
+        "\n"
+        "Options:\n"
+        "\n"
+        "    --size=<MB>                approximate size of generated plugin (default: 16)\n"
+        "    --mix=<TYPE:WEIGHT,...>    record type mix, for example \"REFR:8,NPC_:1,QUST:1\"\n"
+        "                               (default: all record types except TES4 and CELL)\n"
+        "    --compressed=<fraction>    fraction of compressed records (default: 0.1)\n"
+        "    --refs-per-cell=<count>    max records in cell temporary children group (default: 256)\n"
+        "    --seed=<number>            random seed (default: 1)\n"
+        "    --iterations=<count>       how many times to run each phase (default: 5)\n"
+        "    --output=<path>            also write generated plugin to file\n"
+        "    --trace=<path>             write Chrome trace event file with timeline of all iterations\n"
+        "    --lookup                   build Form ID and editor ID lookup tables while parsing\n"
+    );
+}
+
+struct BenchArgs {
+    EspGeneratorOptions generator;
+    Array<EspGeneratorRecordWeight> mix{ tmpalloc };
+    int iterations = 5;
+    const wchar_t* output_file = nullptr;
+    const wchar_t* trace_file = nullptr;
+    ProgramOptions parser_options = ProgramOptions::None;
+
+    void parse_mix(const wchar_t* value) {
+        while (*value) {
+            EspGeneratorRecordWeight entry;
+            for (int i = 0; i < 4; ++i) {
+                if (!value[i] || value[i] > 127) {
+                    exit_error(L"invalid record type in --mix: \"%s\"", value);
+                }
+                entry.type = (RecordType)((uint32_t)entry.type | ((uint32_t)value[i] << (i * 8)));
+            }
+            value += 4;
+
+            if (!get_record_def(entry.type) || entry.type == RecordType::TES4 || entry.type == RecordType::CELL) {
+                exit_error(L"unsupported record type in --mix: \"%.4s\"", value - 4);
+            }
+            for (const auto& other : mix) {
+                if (other.type == entry.type) {
+                    exit_error(L"duplicate record type in --mix: \"%.4s\"", value - 4);
+                }
+            }
+
+            entry.weight = 1;
+            if (*value == ':') {
+                wchar_t* weight_end = nullptr;
+                entry.weight = (int)wcstol(value + 1, &weight_end, 10);
+                value = weight_end;
+            }
+            if (entry.weight <= 0) {
+                exit_error(L"record weight in --mix must be positive");
+            }
+            mix.push(entry);
+
+            if (*value == ',') {
+                ++value;
+            } else if (*value) {
+                exit_error(L"unexpected character in --mix: \"%s\"", value);
+            }
+        }
+    }
+
+    void parse() {
+        ArgParser p;
+        p.parse();
+
+        for (const auto arg : p.arguments) {
+            wprintf(L"warning: unknown argument \"%s\"\n", arg);
+        }
+
+        for (const auto flag : p.flags) {
+            if (string_equals(flag, L"help")) {
+                print_usage();
+                exit(0);
+            } else if (string_equals(flag, L"lookup")) {
+                parser_options |= ProgramOptions::BuildRecordLookup;
+            } else {
+                wprintf(L"warning: unknown switch \"--%s\"\n", flag);
+            }
+        }
+
+        for (const auto option : p.options) {
+            if (string_equals(option.key, L"size")) {
+                generator.target_size = (size_t)(wcstod(option.value, nullptr) * 1024 * 1024);
+            } else if (string_equals(option.key, L"mix")) {
+                parse_mix(option.value);
+            } else if (string_equals(option.key, L"compressed")) {
+                generator.compressed_fraction = (float)wcstod(option.value, nullptr);
+            } else if (string_equals(option.key, L"refs-per-cell")) {
+                generator.references_per_cell = (int)wcstol(option.value, nullptr, 10);
+            } else if (string_equals(option.key, L"seed")) {
+                generator.seed = wcstoull(option.value, nullptr, 10);
+            } else if (string_equals(option.key, L"iterations")) {
+                iterations = (int)wcstol(option.value, nullptr, 10);
+            } else if (string_equals(option.key, L"output")) {
+                output_file = option.value;
+            } else if (string_equals(option.key, L"trace")) {
+                trace_file = option.value;
+            } else {
+                wprintf(L"warning: unknown option \"--%s=%s\"\n", option.key, option.value);
+            }
+        }
+
+        if (mix.count == 0) {
+            for (const auto def : get_record_defs()) {
+                if (def->type != RecordType::TES4 && def->type != RecordType::CELL) {
+                    mix.push({ def->type, 1 });
+                }
+            }
+        }
+        generator.mix = { mix.data, (size_t)mix.count };
+
+        if (generator.target_size == 0) {
+            exit_error(L"--size must be positive");
+        }
+        if (generator.compressed_fraction < 0.0f || generator.compressed_fraction > 1.0f) {
+            exit_error(L"--compressed must be in [0, 1] range");
+        }
+        if (generator.references_per_cell <= 0) {
+            exit_error(L"--refs-per-cell must be positive");
+        }
+        if (iterations <= 0) {
+            exit_error(L"--iterations must be positive");
+        }
+    }
+};
+
+struct PhaseTiming {
+    const char* name = nullptr;
+    size_t bytes = 0; // Input size of the phase.
+    double best = 0;
+    double total = 0;
+
+    void add(double seconds) {
+        if (total == 0 || seconds < best) {
+            best = seconds;
+        }
+        total += seconds;
+    }
+
+    void print(int iterations, size_t record_count) const {
+        printf(
+            "{\"phase\":\"%s\",\"iterations\":%d,\"bytes\":%zu,\"records\":%zu,\"best_seconds\":%.6f,\"mean_seconds\":%.6f,\"mb_per_second\":%.2f,\"records_per_second\":%.0f}\n",
+            name,
+            iterations,
+            bytes,
+            record_count,
+            best,
+            total / iterations,
+            bytes / best / (1024.0 * 1024.0),
+            record_count / best
+        );
+    }
+};
+
+int main() {
+    void memory_init();
+    memory_init();
+
+#if PLUGIN2TEXT_TYPE_PROFILE
+    atexit(print_type_profile);
+#endif
+
+    BenchArgs args;
+    args.parse();
+
+    profiler.enabled = args.trace_file != nullptr;
+    profiler.tracing = args.trace_file != nullptr;
+    profiler.trace_start = get_current_timestamp();
+
+    auto esp_buffer = allocate_virtual_memory(args.generator.target_size * 2 + 64 * 1024 * 1024);
+    defer(free_virtual_memory(&esp_buffer));
+
+    EspGeneratorStats stats;
+    const auto generate_start = get_current_timestamp();
+    const auto esp = generate_esp(&esp_buffer, args.generator, &stats);
+    const auto generate_seconds = timestamp_to_seconds(generate_start, get_current_timestamp());
+
+    printf(
+        "{\"phase\":\"generate\",\"seed\":%llu,\"bytes\":%zu,\"records\":%zu,\"groups\":%zu,\"compressed_records\":%zu,\"seconds\":%.6f}\n",
+        (unsigned long long)args.generator.seed,
+        esp.count,
+        stats.record_count,
+        stats.group_count,
+        stats.compressed_record_count,
+        generate_seconds
+    );
+
+    if (args.output_file) {
+        write_file(args.output_file, esp);
+    }
+
+    PhaseTiming parse{ "parse", esp.count };
+    PhaseTiming write{ "esp_to_text", esp.count };
+    PhaseTiming read{ "text_to_esp" };
+    PhaseTiming round_trip{ "round_trip", esp.count };
+    bool equal = true;
+    size_t lookup_form_id_count = 0;
+    size_t lookup_editor_id_count = 0;
+    size_t lookup_bytes = 0;
+
+    for (int iteration = 0; iteration < args.iterations; ++iteration) {
+        TEMP_SCOPE();
+        TraceScope trace{ "iteration", "iteration", 9 };
+
+        EspParser parser;
+        parser.init(tmpalloc, args.parser_options);
+        defer(parser.dispose());
+
+        TextRecordWriter writer;
+        writer.init(ProgramOptions::None);
+        defer(writer.dispose());
+
+        TextRecordReader reader;
+        reader.init();
+        defer(reader.dispose());
+
+        const auto start = get_current_timestamp();
+        const auto model = parser.parse(esp);
+        const auto parsed = get_current_timestamp();
+        writer.write_records(model.records);
+        const auto written = get_current_timestamp();
+        reader.read_records((const char*)writer.output_buffer.start, (const char*)writer.output_buffer.now);
+        const auto read_back = get_current_timestamp();
+
+        parse.add(timestamp_to_seconds(start, parsed));
+        write.add(timestamp_to_seconds(parsed, written));
+        read.add(timestamp_to_seconds(written, read_back));
+        round_trip.add(timestamp_to_seconds(start, read_back));
+        read.bytes = writer.output_buffer.size();
+
+        if (model.lookup) {
+            lookup_form_id_count = model.lookup->form_id_count;
+            lookup_editor_id_count = model.lookup->editor_id_count;
+            lookup_bytes = model.lookup->memory_size();
+        }
+
+        equal = equal && reader.buffer->size() == esp.count && memory_equals(reader.buffer->start, esp.data, esp.count);
+    }
+
+    parse.print(args.iterations, stats.record_count);
+    write.print(args.iterations, stats.record_count);
+    read.print(args.iterations, stats.record_count);
+    round_trip.print(args.iterations, stats.record_count);
+    if (is_bit_set(args.parser_options, ProgramOptions::BuildRecordLookup)) {
+        printf(
+            "{\"phase\":\"lookup\",\"form_ids\":%zu,\"editor_ids\":%zu,\"bytes\":%zu}\n",
+            lookup_form_id_count,
+            lookup_editor_id_count,
+            lookup_bytes
+        );
+    }
+    printf("{\"phase\":\"verify\",\"equal\":%s}\n", equal ? "true" : "false");
+
+    if (args.trace_file) {
+        write_trace(args.trace_file);
+    }
+
+    return equal ? 0 : 1;
+}
@@ -0,0 +1,762 @@
+#include "esp_generator.hpp"
+#include <typeinfo.hpp>
+#include <array.hpp>
+#include <os.hpp>
+#include <zlib-ng.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* const Words[]{
+    "Iron", "Steel", "Sword", "of", "the", "Dragon", "Whiterun", "Guard",
+    "Ancient", "Nord", "Barrow", "Draugr", "Dwemer", "\"Sanctuary\"", "Bandit", "Chief",
+};
+
+bool is_cell_child_record_type(RecordType type) {
+    switch (type) {
+        case (RecordType)fourcc("REFR"):
+        case (RecordType)fourcc("ACHR"):
+        case (RecordType)fourcc("NAVM"):
+        case (RecordType)fourcc("LAND"):
+            return true;
+    }
+    return false;
+}
+
+static bool is_power_of_two(uint32_t value) {
+    return value && (value & (value - 1)) == 0;
+}
+
+struct EspGenerator {
+    Slice* output = nullptr;
+
+    // Record fields are assembled here when record is going to be compressed.
+    Slice field_buffer;
+
+    EspGeneratorOptions options;
+    EspGeneratorStats stats;
+
+    uint64_t random_state = 0;
+    uint32_t next_formid = 0x800;
+
+    // CTDA functions that have unique name and arguments which can be written to text format.
+    Array<uint16_t> ctda_functions{ tmpalloc };
+
+    void init(Slice* output, const EspGeneratorOptions& options);
+    void dispose();
+
+    uint32_t random();
+    uint32_t random_range(uint32_t min, uint32_t max);
+    bool random_chance(float probability);
+    float random_float();
+    FormID random_formid();
+
+    void write_text(Slice* slice, bool allow_multiline);
+    void write_wstring(Slice* slice, const char* str);
+    void write_random_wstring(Slice* slice);
+    void write_random_bytes(Slice* slice, size_t count);
+    void write_type(Slice* slice, const Type* type);
+    void write_enum(Slice* slice, const TypeEnum* type);
+    void write_papyrus_value(Slice* slice, PapyrusPropertyType type);
+    void write_vmad(Slice* slice);
+    void write_ctda(Slice* slice);
+    void write_nvpp(Slice* slice);
+    void write_nvnm(Slice* slice);
+    void write_field(Slice* slice, const RecordFieldDef* field_def);
+    void write_fields(Slice* slice, const RecordDef* def);
+    RecordFlags random_record_flags(const RecordDef* def);
+    RawRecord* write_record(const RecordDef* def);
+    RawGrupRecord* begin_group(RecordGroupType group_type, uint32_t label);
+    void end_group(RawGrupRecord* group);
+    void write_top_group(const RecordDef* def, size_t target_size);
+    void write_cells(int cell_children_weight, size_t target_size);
+    void write_plugin();
+};
+
+void EspGenerator::init(Slice* output, const EspGeneratorOptions& options) {
+    this->output = output;
+    this->options = options;
+    random_state = options.seed;
+    field_buffer = allocate_virtual_memory(16 * 1024 * 1024);
+
+    for (size_t i = 0; i < _countof(CTDA_Functions); ++i) {
+        const auto& function = CTDA_Functions[i];
+        if (function.index != i) {
+            continue;
+        }
+        if (function.arg1 == CTDA_ArgumentType::None && function.arg2 != CTDA_ArgumentType::None) {
+            continue;
+        }
+        if (find_ctda_function(function.name, strlen(function.name)) != &function) {
+            continue;
+        }
+        ctda_functions.push(static_cast<uint16_t>(i));
+    }
+    verify(ctda_functions.count > 0);
+}
+
+void EspGenerator::dispose() {
+    free_virtual_memory(&field_buffer);
+}
+
+uint32_t EspGenerator::random() {
+    // SplitMix64, so the same seed produces the same plugin everywhere.
+    uint64_t z = (random_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<uint32_t>((z ^ (z >> 31)) >> 32);
+}
+
+uint32_t EspGenerator::random_range(uint32_t min, uint32_t max) {
+    verify(min <= max);
+    return min + random() % (max - min + 1);
+}
+
+bool EspGenerator::random_chance(float probability) {
+    return (random() & 0xFFFFFF) < static_cast<uint32_t>(probability * 0x1000000);
+}
+
+float EspGenerator::random_float() {
+    // Fractions with small denominator are common in real plugins and never produce negative zero.
+    return static_cast<float>(static_cast<int>(random_range(0, 2000000)) - 1000000) / 256.0f;
+}
+
+FormID EspGenerator::random_formid() {
+    return { random_range(0x1, 0x00FFFFFF) };
+}
+
+void EspGenerator::write_text(Slice* slice, bool allow_multiline) {
+    const auto line_count = allow_multiline && random_chance(0.1f) ? random_range(2, 4) : 1;
+    for (uint32_t line = 0; line < line_count; ++line) {
+        if (line) {
+            slice->write_literal("\r\n");
+        }
+
+        const auto word_count = random_range(1, 6);
+        for (uint32_t i = 0; i < word_count; ++i) {
+            if (i) {
+                slice->write_literal(" ");
+            }
+            const auto word = Words[random_range(0, _countof(Words) - 1)];
+            slice->write_bytes(word, strlen(word));
+        }
+    }
+}
+
+void EspGenerator::write_wstring(Slice* slice, const char* str) {
+    const auto count = strlen(str);
+    verify(count <= UINT16_MAX);
+    slice->write_value(static_cast<uint16_t>(count));
+    slice->write_bytes(str, count);
+}
+
+void EspGenerator::write_random_wstring(Slice* slice) {
+    const auto count = slice->advance<uint16_t>();
+    const auto start = slice->now;
+    write_text(slice, false);
+    *count = static_cast<uint16_t>(slice->now - start);
+}
+
+void EspGenerator::write_random_bytes(Slice* slice, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        slice->write_value(static_cast<uint8_t>(random()));
+    }
+}
+
+void EspGenerator::write_enum(Slice* slice, const TypeEnum* type) {
+    verify(type->field_count > 0);
+
+    uint32_t value = 0;
+    if (type->flags) {
+        for (size_t i = 0; i < type->field_count; ++i) {
+            const auto& field = type->fields[i];
+            if (is_power_of_two(field.value) && random_chance(0.3f)) {
+                value |= field.value;
+            }
+        }
+    } else {
+        value = type->fields[random_range(0, static_cast<uint32_t>(type->field_count) - 1)].value;
+    }
+
+    slice->write_integer_of_size(value, type->size);
+}
+
+void EspGenerator::write_type(Slice* slice, const Type* type) {
+    switch (type->kind) {
+        case TypeKind::ZString:
+        case TypeKind::LString: {
+            // Plugin is never localized, so LString is a regular string.
+            write_text(slice, true);
+            slice->write_value('\0');
+        } break;
+
+        case TypeKind::WString: {
+            write_random_wstring(slice);
+        } break;
+
+        case TypeKind::ByteArray: {
+            write_random_bytes(slice, 8 * random_range(1, 8));
+        } break;
+
+        case TypeKind::ByteArrayFixed: {
+            write_random_bytes(slice, type->size);
+        } break;
+
+        case TypeKind::ByteArrayCompressed: {
+            const auto count = 8 * random_range(4, 32);
+            for (uint32_t i = 0; i < count; ++i) {
+                slice->write_value(static_cast<uint8_t>(random_range(0, 3)));
+            }
+        } break;
+
+        case TypeKind::ByteArrayRLE: {
+            // Mix of 0x00/0xFF sequences and noise, like in LAND and NAVM records.
+            const auto count = 8 * random_range(4, 64);
+            const auto end = slice->now + count;
+            while (slice->now < end) {
+                const auto run = random_range(1, static_cast<uint32_t>(end - slice->now));
+                switch (random_range(0, 2)) {
+                    case 0: memset(slice->advance(run), 0x00, run); break;
+                    case 1: memset(slice->advance(run), 0xFF, run); break;
+                    case 2: write_random_bytes(slice, run); break;
+                }
+            }
+        } break;
+
+        case TypeKind::Integer: {
+            write_random_bytes(slice, type->size);
+        } break;
+
+        case TypeKind::Float: {
+            verify(type->size == sizeof(float));
+            slice->write_value(random_float());
+        } break;
+
+        case TypeKind::Boolean: {
+            slice->write_value(static_cast<uint8_t>(random_range(0, 1)));
+        } break;
+
+        case TypeKind::FormID: {
+            slice->write_value(random_formid());
+        } break;
+
+        case TypeKind::FormIDArray: {
+            const auto count = random_range(1, 8);
+            for (uint32_t i = 0; i < count; ++i) {
+                slice->write_value(random_formid());
+            }
+        } break;
+
+        case TypeKind::Enum: {
+            write_enum(slice, static_cast<const TypeEnum*>(type));
+        } break;
+
+        case TypeKind::Struct: {
+            const auto struct_type = static_cast<const TypeStruct*>(type);
+            const auto start = slice->now;
+            for (size_t i = 0; i < struct_type->field_count; ++i) {
+                // "text_to_esp" always writes constant bytes, so fallback values are never generated.
+                write_type(slice, struct_type->fields[i].type);
+            }
+            verify(static_cast<size_t>(slice->now - start) == type->size);
+        } break;
+
+        case TypeKind::Constant: {
+            slice->write_bytes(static_cast<const TypeConstant*>(type)->bytes, type->size);
+        } break;
+
+        case TypeKind::Filter: {
+            const auto filter_type = static_cast<const TypeFilter*>(type);
+            const auto start = slice->now;
+            write_type(slice, filter_type->inner_type);
+            filter_type->preprocess(start, slice->now - start);
+        } break;
+
+        case TypeKind::Vector3: {
+            slice->write_value(random_float());
+            slice->write_value(random_float());
+            slice->write_value(random_float());
+        } break;
+
+        case TypeKind::VMAD: {
+            write_vmad(slice);
+        } break;
+
+        case TypeKind::XCLW: {
+            if (random_chance(0.25f)) {
+                slice->write_value(0x7F7FFFFFu); // No Water
+            } else {
+                slice->write_value(random_float());
+            }
+        } break;
+
+        case TypeKind::CTDA: {
+            write_ctda(slice);
+        } break;
+
+        case TypeKind::NVPP: {
+            write_nvpp(slice);
+        } break;
+
+        case TypeKind::VTXT: {
+            const auto count = random_range(1, 16);
+            for (uint32_t i = 0; i < count; ++i) {
+                slice->write_value(static_cast<uint16_t>(random_range(0, 288)));
+                slice->write_zeros(2);
+                slice->write_value(random_float());
+            }
+        } break;
+
+        case TypeKind::NVNM: {
+            write_nvnm(slice);
+        } break;
+
+        case TypeKind::VHGT: {
+            // Mostly flat terrain with some hills.
+            const auto vhgt = slice->advance<VHGT_Field>();
+            vhgt->offset = random_float();
+            for (auto& row : vhgt->gradients) {
+                const auto flat = random_chance(0.5f);
+                for (auto& gradient : row) {
+                    gradient = static_cast<int8_t>(flat ? 0 : static_cast<int>(random_range(0, 16)) - 8);
+                }
+            }
+        } break;
+
+        case TypeKind::VNML: {
+            const auto vnml = slice->advance<VNML_Field>();
+            for (auto& row : vnml->normals) {
+                const auto flat = random_chance(0.5f);
+                for (auto& normal : row) {
+                    normal[0] = static_cast<int8_t>(flat ? 0 : static_cast<int>(random_range(0, 64)) - 32);
+                    normal[1] = static_cast<int8_t>(flat ? 0 : static_cast<int>(random_range(0, 64)) - 32);
+                    normal[2] = static_cast<int8_t>(flat ? 127 : random_range(96, 127));
+                }
+            }
+        } break;
+
+        default: {
+            verify(false);
+        } break;
+    }
+}
+
+void EspGenerator::write_papyrus_value(Slice* slice, PapyrusPropertyType type) {
+    switch (type) {
+        case PapyrusPropertyType::Object: {
+            VMAD_PropertyObjectV2 object;
+            object.alias = random_chance(0.5f) ? -1 : static_cast<int16_t>(random_range(0, 15));
+            object.form_id = random_formid();
+            slice->write_value(object);
+        } break;
+
+        case PapyrusPropertyType::String: {
+            write_random_wstring(slice);
+        } break;
+
+        case PapyrusPropertyType::Int: {
+            slice->write_value(static_cast<int>(random()));
+        } break;
+
+        case PapyrusPropertyType::Float: {
+            slice->write_value(random_float());
+        } break;
+
+        case PapyrusPropertyType::Bool: {
+            slice->write_value(static_cast<uint8_t>(random_range(0, 1)));
+        } break;
+
+        case PapyrusPropertyType::ObjectArray:
+        case PapyrusPropertyType::StringArray:
+        case PapyrusPropertyType::IntArray:
+        case PapyrusPropertyType::FloatArray:
+        case PapyrusPropertyType::BoolArray: {
+            const auto inner_type = (PapyrusPropertyType)((uint32_t)type - 10);
+            const auto count = random_range(0, 4);
+            slice->write_value(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                write_papyrus_value(slice, inner_type);
+            }
+        } break;
+
+        default: {
+            verify(false);
+        } break;
+    }
+}
+
+void EspGenerator::write_vmad(Slice* slice) {
+    // No record-specific fragments: scripts only.
+    const auto script_count = random_range(1, 2);
+    slice->write_value(VMAD_Header{ 5, 2, static_cast<uint16_t>(script_count) });
+
+    for (uint32_t script_index = 0; script_index < script_count; ++script_index) {
+        char name[32];
+        sprintf_s(name, "BenchScript%02u", random_range(0, 99));
+        write_wstring(slice, name);
+        slice->write_value(static_cast<uint8_t>(random_range(0, 1)));
+
+        // Property names are unique and increasing because "esp_to_text" sorts properties by name.
+        const auto property_count = random_range(0, 6);
+        slice->write_value(static_cast<uint16_t>(property_count));
+        for (uint32_t property_index = 0; property_index < property_count; ++property_index) {
+            sprintf_s(name, "Property%u", property_index);
+            write_wstring(slice, name);
+
+            const auto& type_field = Type_PapyrusPropertyType.fields[random_range(0, static_cast<uint32_t>(Type_PapyrusPropertyType.field_count) - 1)];
+            const auto type = static_cast<PapyrusPropertyType>(type_field.value);
+            slice->write_value(type);
+            slice->write_value(static_cast<uint8_t>(random_range(0, 1)));
+            write_papyrus_value(slice, type);
+        }
+    }
+}
+
+void EspGenerator::write_ctda(Slice* slice) {
+    const auto function_index = ctda_functions[random_range(0, ctda_functions.count - 1)];
+    const auto& function = CTDA_Functions[function_index];
+
+    CTDA_OperatorFlagsUnion opflags;
+    opflags.flags = static_cast<CTDA_Flags>(random_range(0, 0b11111));
+    opflags.op = static_cast<CTDA_Operator>(random_range(0, 5));
+    slice->write_value(opflags);
+    slice->write_zeros(3); // Junk.
+
+    slice->write_value(random_float());
+    slice->write_value(function_index);
+    slice->write_zeros(2); // Junk.
+
+    const CTDA_ArgumentType argument_types[2]{
+        function.arg1,
+        function.arg1 == CTDA_ArgumentType::None ? CTDA_ArgumentType::None : function.arg2,
+    };
+    for (const auto argument_type : argument_types) {
+        CTDA_Argument argument;
+        switch (argument_type) {
+            case CTDA_ArgumentType::FormID: argument.formid = random_formid(); break;
+            case CTDA_ArgumentType::Int: argument.number = static_cast<int>(random_range(0, 1000)); break;
+            case CTDA_ArgumentType::ActorValue: {
+                do {
+                    argument.number = static_cast<int>(random_range(0, _countof(ActorValues) - 1));
+                } while (find_actor_value(ActorValues[argument.number].name, strlen(ActorValues[argument.number].name)) != &ActorValues[argument.number]);
+            } break;
+        }
+        slice->write_value(argument);
+    }
+
+    slice->write_value(static_cast<CTDA_RunOnType>(random_range(0, 7)));
+    slice->write_value(FormID{ 0 }); // Reference.
+    slice->write_value(static_cast<int>(random_range(0, 1000)));
+}
+
+void EspGenerator::write_nvpp(Slice* slice) {
+    const auto path_count = random_range(0, 4);
+    slice->write_value(path_count);
+    for (uint32_t i = 0; i < path_count; ++i) {
+        const auto formid_count = random_range(1, 4);
+        slice->write_value(formid_count);
+        for (uint32_t j = 0; j < formid_count; ++j) {
+            slice->write_value(random_formid());
+        }
+    }
+
+    // Nodes are sorted by index, same as "sort_nvpp" does.
+    const auto node_count = random_range(0, 4);
+    slice->write_value(node_count);
+    for (uint32_t i = 0; i < node_count; ++i) {
+        slice->write_value(random_formid());
+        slice->write_value(i * 3);
+    }
+}
+
+void EspGenerator::write_nvnm(Slice* slice) {
+    slice->write_value<uint32_t>(12); // Version
+    slice->write_value(random()); // CRC
+    const auto worldspace = random_chance(0.5f) ? FormID{} : random_formid();
+    slice->write_value(worldspace);
+    if (worldspace.value) {
+        slice->write_value(static_cast<int16_t>(static_cast<int>(random_range(0, 64)) - 32)); // Grid Y
+        slice->write_value(static_cast<int16_t>(static_cast<int>(random_range(0, 64)) - 32)); // Grid X
+    } else {
+        slice->write_value(random_formid()); // Parent Cell
+    }
+
+    const auto vertex_count = random_range(3, 64);
+    slice->write_value(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; ++i) {
+        slice->write_value(NVNM_Vertex{ random_float(), random_float(), random_float() });
+    }
+
+    const auto triangle_count = random_range(1, 64);
+    slice->write_value(triangle_count);
+    for (uint32_t i = 0; i < triangle_count; ++i) {
+        NVNM_Triangle triangle;
+        for (int j = 0; j < 3; ++j) {
+            triangle.vertices[j] = static_cast<uint16_t>(random_range(0, vertex_count - 1));
+            triangle.edges[j] = static_cast<int16_t>(random_chance(0.3f) ? -1 : static_cast<int>(random_range(0, triangle_count - 1)));
+        }
+        triangle.flags = static_cast<uint16_t>(random());
+        triangle.cover_flags = static_cast<uint16_t>(random_chance(0.8f) ? 0 : random());
+        slice->write_value(triangle);
+    }
+
+    const auto edge_link_count = random_range(0, 4);
+    slice->write_value(edge_link_count);
+    for (uint32_t i = 0; i < edge_link_count; ++i) {
+        slice->write_value(NVNM_EdgeLink{ random_range(0, 3), random_formid(), static_cast<int16_t>(random_range(0, 1000)) });
+    }
+
+    const auto door_triangle_count = random_range(0, 2);
+    slice->write_value(door_triangle_count);
+    for (uint32_t i = 0; i < door_triangle_count; ++i) {
+        slice->write_value(NVNM_DoorTriangle{ static_cast<int16_t>(random_range(0, triangle_count - 1)), random(), random_formid() });
+    }
+
+    const auto cover_triangle_count = random_range(0, 40);
+    slice->write_value(cover_triangle_count);
+    for (uint32_t i = 0; i < cover_triangle_count; ++i) {
+        slice->write_value(static_cast<int16_t>(random_range(0, triangle_count - 1)));
+    }
+
+    const auto grid_size = random_range(1, 4);
+    slice->write_value(grid_size);
+    slice->write_value(random_float()); // Max X Distance
+    slice->write_value(random_float()); // Max Y Distance
+    slice->write_value(NVNM_Vertex{ random_float(), random_float(), random_float() }); // Min
+    slice->write_value(NVNM_Vertex{ random_float(), random_float(), random_float() }); // Max
+    for (uint32_t i = 0; i < grid_size * grid_size; ++i) {
+        const auto count = random_chance(0.3f) ? 0 : random_range(1, 8);
+        slice->write_value(count);
+        for (uint32_t j = 0; j < count; ++j) {
+            slice->write_value(static_cast<int16_t>(random_range(0, triangle_count - 1)));
+        }
+    }
+}
+
+void EspGenerator::write_field(Slice* slice, const RecordFieldDef* field_def) {
+    const auto field = slice->advance<RawRecordField>();
+    field->type = field_def->type;
+
+    const auto start = slice->now;
+    if (field_def->type == (RecordFieldType)fourcc("NVPP")) {
+        // Stored as compressed byte array in text, but "sort_nvpp" expects valid data.
+        write_nvpp(slice);
+    } else {
+        write_type(slice, field_def->data_type);
+    }
+
+    const auto size = static_cast<size_t>(slice->now - start);
+    verify(size <= UINT16_MAX);
+    field->size = static_cast<uint16_t>(size);
+}
+
+void EspGenerator::write_fields(Slice* slice, const RecordDef* def) {
+    for (size_t i = 0; i < Record_Common.fields.count; ++i) {
+        const auto field_def = Record_Common.fields.data[i];
+        if (def->get_field_def(field_def->type)) {
+            continue;
+        }
+
+        // Always write EDID: every record has at least one field then.
+        if (i == 0 || random_chance(0.25f)) {
+            write_field(slice, static_cast<const RecordFieldDef*>(field_def));
+        }
+    }
+
+    for (size_t i = 0; i < def->fields.count; ++i) {
+        if (!random_chance(0.75f)) {
+            continue;
+        }
+
+        const auto field_def = def->fields.data[i];
+        switch (field_def->def_type) {
+            case RecordFieldDefType::Field: {
+                write_field(slice, static_cast<const RecordFieldDef*>(field_def));
+            } break;
+
+            case RecordFieldDefType::Subrecord: {
+                for (const auto inner_field_def : static_cast<const RecordFieldDefSubrecord*>(field_def)->fields) {
+                    write_field(slice, inner_field_def);
+                }
+            } break;
+
+            default: {
+                verify(false);
+            } break;
+        }
+    }
+}
+
+RecordFlags EspGenerator::random_record_flags(const RecordDef* def) {
+    if (!random_chance(0.05f)) {
+        return RecordFlags::None;
+    }
+
+    const auto flag_defs = random_chance(0.5f) ? def->flags : Record_Common.flags;
+    if (flag_defs.count == 0) {
+        return RecordFlags::None;
+    }
+
+    const auto flag = flag_defs.data[random_range(0, static_cast<uint32_t>(flag_defs.count) - 1)].bit;
+    if (flag == RecordFlags::Compressed || flag == RecordFlags::TES4_Localized) {
+        return RecordFlags::None;
+    }
+    return flag;
+}
+
+RawRecord* EspGenerator::write_record(const RecordDef* def) {
+    const auto compressed = random_chance(options.compressed_fraction);
+    const auto record = (RawRecord*)output->advance(compressed ? sizeof(RawRecordCompressed) : sizeof(RawRecord));
+    *record = RawRecord();
+    record->type = def->type;
+    record->flags = random_record_flags(def);
+    record->id.value = next_formid++;
+    record->version = 44;
+
+    if (compressed) {
+        constexpr int SkyrimZLibCompressionLevel = 7;
+
+        field_buffer.now = field_buffer.start;
+        write_fields(&field_buffer, def);
+
+        const auto record_compressed = (RawRecordCompressed*)record;
+        record_compressed->flags |= RecordFlags::Compressed;
+        record_compressed->uncompressed_data_size = static_cast<uint32_t>(field_buffer.size());
+
+        size_t compressed_size = output->remaining_size();
+        const auto result = ::zng_compress2(output->now, &compressed_size, field_buffer.start, field_buffer.size(), SkyrimZLibCompressionLevel);
+        verify(result == Z_OK);
+
+        output->now += compressed_size;
+        record->data_size = static_cast<uint32_t>(compressed_size + sizeof(uint32_t));
+        ++stats.compressed_record_count;
+    } else {
+        write_fields(output, def);
+        record->data_size = static_cast<uint32_t>(output->now - (uint8_t*)(record + 1));
+    }
+
+    ++stats.record_count;
+    return record;
+}
+
+RawGrupRecord* EspGenerator::begin_group(RecordGroupType group_type, uint32_t label) {
+    const auto group = output->advance<RawGrupRecord>();
+    group->type = RecordType::GRUP;
+    group->group_type = group_type;
+    group->label = label;
+    ++stats.group_count;
+    return group;
+}
+
+void EspGenerator::end_group(RawGrupRecord* group) {
+    group->group_size = static_cast<uint32_t>(output->now - (uint8_t*)group);
+}
+
+void EspGenerator::write_top_group(const RecordDef* def, size_t target_size) {
+    const auto group = begin_group(RecordGroupType::Top, (uint32_t)def->type);
+    const auto start = output->now;
+    do {
+        write_record(def);
+    } while (static_cast<size_t>(output->now - start) < target_size);
+    end_group(group);
+}
+
+void EspGenerator::write_cells(int cell_children_weight, size_t target_size) {
+    const auto cell_def = get_record_def(RecordType::CELL);
+    verify(cell_def);
+
+    const auto top = begin_group(RecordGroupType::Top, (uint32_t)RecordType::CELL);
+    const auto block = begin_group(RecordGroupType::InteriorCellBlock, 0);
+    const auto sub_block = begin_group(RecordGroupType::InteriorCellSubBlock, 0);
+
+    const auto start = output->now;
+    do {
+        const auto cell = write_record(cell_def);
+        const auto children = begin_group(RecordGroupType::CellChildren, cell->id.value);
+        const auto temporary = begin_group(RecordGroupType::CellTemporaryChildren, cell->id.value);
+
+        for (int i = 0; i < options.references_per_cell; ++i) {
+            auto weight = static_cast<int>(random_range(0, cell_children_weight - 1));
+            for (const auto& entry : options.mix) {
+                if (!is_cell_child_record_type(entry.type)) {
+                    continue;
+                }
+                if (weight < entry.weight) {
+                    write_record(get_record_def(entry.type));
+                    break;
+                }
+                weight -= entry.weight;
+            }
+
+            if (static_cast<size_t>(output->now - start) >= target_size) {
+                break;
+            }
+        }
+
+        end_group(temporary);
+        end_group(children);
+    } while (static_cast<size_t>(output->now - start) < target_size);
+
+    end_group(sub_block);
+    end_group(block);
+    end_group(top);
+}
+
+void EspGenerator::write_plugin() {
+    const auto header = output->advance<RawRecord>();
+    header->type = RecordType::TES4;
+    header->version = 44;
+
+    const auto hedr = output->advance<RawRecordField>();
+    hedr->type = (RecordFieldType)fourcc("HEDR");
+    hedr->size = 12;
+    output->write_value(1.71f);
+    const auto number_of_records = output->advance<int32_t>();
+    const auto next_object_id = output->advance<FormID>();
+
+    const auto cnam = output->advance<RawRecordField>();
+    cnam->type = (RecordFieldType)fourcc("CNAM");
+    cnam->size = sizeof("plugin2text");
+    output->write_bytes("plugin2text", sizeof("plugin2text"));
+
+    header->data_size = static_cast<uint32_t>(output->now - (uint8_t*)(header + 1));
+
+    int total_weight = 0;
+    int cell_children_weight = 0;
+    for (const auto& entry : options.mix) {
+        verify(entry.weight > 0);
+        total_weight += entry.weight;
+        if (is_cell_child_record_type(entry.type)) {
+            cell_children_weight += entry.weight;
+        }
+    }
+    verify(total_weight > 0);
+
+    for (const auto& entry : options.mix) {
+        if (is_cell_child_record_type(entry.type)) {
+            continue;
+        }
+
+        const auto def = get_record_def(entry.type);
+        verify(def);
+        write_top_group(def, options.target_size / total_weight * entry.weight);
+    }
+
+    if (cell_children_weight) {
+        write_cells(cell_children_weight, options.target_size / total_weight * cell_children_weight);
+    }
+
+    *number_of_records = static_cast<int32_t>(stats.record_count + stats.group_count);
+    next_object_id->value = next_formid;
+}
+
+StaticArray<uint8_t> generate_esp(Slice* output, const EspGeneratorOptions& options, EspGeneratorStats* stats) {
+    EspGenerator generator;
+    generator.init(output, options);
+    defer(generator.dispose());
+
+    const auto start = output->now;
+    generator.write_plugin();
+
+    *stats = generator.stats;
+    return { start, static_cast<size_t>(output->now - start) };
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <tes.hpp>
+#include <parseutils.hpp>
+
+struct EspGeneratorRecordWeight {
+    RecordType type = (RecordType)0;
+    int weight = 0;
+};
+
+struct EspGeneratorOptions {
+    size_t target_size = 16 * 1024 * 1024;
+    uint64_t seed = 1;
+    float compressed_fraction = 0.1f;
+    int references_per_cell = 256;
+    StaticArray<EspGeneratorRecordWeight> mix;
+};
+
+struct EspGeneratorStats {
+    size_t record_count = 0;
+    size_t group_count = 0;
+    size_t compressed_record_count = 0;
+};
+
+// Generates plugin which survives ESP -> text -> ESP conversion without any changes:
+// junk fields are pre-cleared, fields are pre-sorted, records are ordered by Form ID
+// and compressed records use same zlib settings as "text_to_esp".
+StaticArray<uint8_t> generate_esp(Slice* output, const EspGeneratorOptions& options, EspGeneratorStats* stats);
+bool is_cell_child_record_type(RecordType type);
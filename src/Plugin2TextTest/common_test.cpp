@@ -0,0 +1,36 @@
+#include <CppUnitTest.h>
+#include <common.hpp>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CommonTest
+{
+    TEST_CLASS(StringTest) {
+public:
+    TEST_METHOD(TestIndexOf) {
+        const String text = "0123456789abcdefghijklmnopqrstuvwxyz;END CODE";
+
+        Assert::AreEqual(0, text.index_of("0123"));
+        Assert::AreEqual(10, text.index_of("a"));
+        Assert::AreEqual(35, text.index_of("z"));
+        Assert::AreEqual(30, text.index_of("uvwxyz;"));
+        Assert::AreEqual(36, text.index_of(";END CODE"), L"match at end of string");
+        Assert::AreEqual(-1, text.index_of(";END CODE;"));
+        Assert::AreEqual(-1, text.index_of("za"));
+        Assert::AreEqual(-1, String{ "a" }.index_of("ab"));
+    }
+
+    TEST_METHOD(TestIndexOfFalseCandidates) {
+        // First and last bytes match at many positions, rest does not.
+        char buffer[100];
+        memset(buffer, 'a', sizeof(buffer));
+        buffer[97] = 'b';
+        const String text{ buffer, (int)sizeof(buffer) };
+
+        Assert::AreEqual(95, text.index_of("aaba"));
+        Assert::AreEqual(-1, text.index_of("abba"));
+        Assert::AreEqual(97, text.index_of("baa"));
+    }
+    };
+}
@@ -4,6 +4,7 @@
 #include <esp_to_text.hpp>
 #include <text_to_esp.hpp>
 #include <xml.hpp>
+#include <string_table.hpp>
 #include "test_common.hpp"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -57,6 +58,46 @@ public:
         );
     }
 
+    TEST_METHOD(TestLocalized) {
+        TEMP_SCOPE();
+        copy_localized_plugin();
+
+        const auto esp = read_file(tmpalloc, L"localized.esp");
+        const auto expect_txt = read_file(tmpalloc, L"../../../../test/localized_expect.txt");
+
+        StringTables strings;
+        defer(strings.dispose());
+        Assert::IsTrue(strings.load(L"localized.esp", L"english"), L"string tables are missing");
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::None);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        TextRecordWriter writer;
+        writer.init(ProgramOptions::None);
+        defer(writer.dispose());
+        writer.strings = &strings;
+        writer.write_records(model.records);
+
+        assert_same_array_content(expect_txt, { writer.output_buffer.start, writer.output_buffer.size() });
+
+        TextRecordReader reader;
+        reader.init();
+        defer(reader.dispose());
+        reader.read_records((const char*)writer.output_buffer.start, (const char*)writer.output_buffer.now);
+
+        assert_same_array_content(esp, { reader.buffer->start, reader.buffer->size() });
+
+        // String tables are rebuilt from text only.
+        reader.string_tables.write(L"localized_roundtrip.esp", L"english");
+        for (size_t i = 0; i < (size_t)StringTableType::Count; ++i) {
+            const auto expect_path = get_string_table_path(L"localized.esp", L"english", (StringTableType)i);
+            const auto actual_path = get_string_table_path(L"localized_roundtrip.esp", L"english", (StringTableType)i);
+            assert_same_array_content(read_file(tmpalloc, expect_path.path), read_file(tmpalloc, actual_path.path));
+        }
+    }
+
     TEST_METHOD(TestVMAD) {
         test_esps(
             ProgramOptions::ExportTimestamp | ProgramOptions::PreserveOrder,
@@ -102,5 +143,32 @@ public:
             nullptr
         );
     }
+
+    TEST_METHOD(TestLAND) {
+        test_esps(
+            ProgramOptions::None,
+            L"../../../../test/land.esp",
+            L"../../../../test/land_expect.txt",
+            nullptr
+        );
+    }
+
+    TEST_METHOD(TestNAVM) {
+        test_esps(
+            ProgramOptions::None,
+            L"../../../../test/navm.esp",
+            L"../../../../test/navm_expect.txt",
+            nullptr
+        );
+    }
+
+    TEST_METHOD(TestREFR) {
+        test_esps(
+            ProgramOptions::None,
+            L"../../../../test/refr.esp",
+            L"../../../../test/refr_expect.txt",
+            nullptr
+        );
+    }
     };
 }
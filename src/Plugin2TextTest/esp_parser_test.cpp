@@ -0,0 +1,193 @@
+#include <CppUnitTest.h>
+#include <esp_parser.hpp>
+#include <typeinfo.hpp>
+#include <os.hpp>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace EspParserTest
+{
+    TEST_CLASS(RecordLookupTest) {
+public:
+    TEST_METHOD(TestFindRecord) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/interior.esp");
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        Assert::IsNotNull(model.lookup);
+        Assert::AreEqual((size_t)14, model.lookup->form_id_count);
+
+        const auto cell = model.lookup->find({ 0x0005EAC7 });
+        Assert::IsNotNull(cell);
+        Assert::AreEqual(RecordType::CELL, cell->type);
+        Assert::IsNull(model.lookup->find({ 0x12345678 }));
+
+        foreach_record(model.records, [&model](Record* record) {
+            Assert::IsTrue(model.lookup->find(record->id) == record, L"record is missing from lookup");
+        });
+    }
+
+    TEST_METHOD(TestFindEditorID) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/interior.esp");
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        FormID id;
+        Assert::IsTrue(model.lookup->find_editor_id("E3demoMarker001", 15, &id));
+        Assert::AreEqual(0x02000D63u, id.value);
+
+        Assert::IsTrue(model.lookup->find_editor_id("e3demomarker001", 15, &id), L"editor IDs must be case-insensitive");
+        Assert::AreEqual(0x02000D63u, id.value);
+
+        Assert::IsFalse(model.lookup->find_editor_id("E3demoMarker", 12, &id));
+    }
+    };
+
+    TEST_CLASS(SortRecordsTest) {
+public:
+    static StaticArray<RecordBase*> make_records(size_t count, uint32_t (*get_id)(size_t index)) {
+        const auto records = (RecordBase**)memalloc(tmpalloc, sizeof(RecordBase*) * count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto record = memnew(tmpalloc) Record(tmpalloc);
+            record->type = RecordType::NPC_;
+            record->id = { get_id(i) };
+            records[i] = record;
+        }
+        return { records, count };
+    }
+
+    static void assert_sorted(const StaticArray<RecordBase*> records) {
+        for (size_t i = 1; i < records.count; ++i) {
+            const auto a = static_cast<const Record*>(records.data[i - 1])->id.value;
+            const auto b = static_cast<const Record*>(records.data[i])->id.value;
+            Assert::IsTrue(a < b, L"records are not sorted by Form ID");
+        }
+    }
+
+    TEST_METHOD(TestFormIDsFarApart) {
+        TEMP_SCOPE();
+
+        // Subtracting these IDs as ints overflows.
+        static const uint32_t ids[] = { 0xFF000001, 0x00000002, 0x80000000, 0x7FFFFFFF, 0x00000001 };
+        const auto records = make_records(_countof(ids), [](size_t index) { return ids[index]; });
+
+        sort_records_by_form_id(records);
+
+        assert_sorted(records);
+        Assert::AreEqual(0x00000001u, static_cast<const Record*>(records.data[0])->id.value);
+        Assert::AreEqual(0xFF000001u, static_cast<const Record*>(records.data[4])->id.value);
+    }
+
+    TEST_METHOD(TestLargeGroup) {
+        TEMP_SCOPE();
+
+        // Large enough to be sorted on several threads. Multiplying by odd constant gives unique shuffled IDs.
+        const auto records = make_records(100000, [](size_t index) { return (uint32_t)index * 2654435761u; });
+
+        sort_records_by_form_id(records);
+
+        assert_sorted(records);
+    }
+    };
+
+    TEST_CLASS(FieldViewTest) {
+public:
+    TEST_METHOD(TestViewsMatchDefinitions) {
+        static const size_t tes4_hedr[] = { offsetof(TES4_HEDR, version), offsetof(TES4_HEDR, record_count), offsetof(TES4_HEDR, next_object_id) };
+        Assert::IsTrue(matches_field_view<TES4_HEDR>({ tes4_hedr, _countof(tes4_hedr) }));
+
+        static const size_t qust_dnam[] = { offsetof(QUST_DNAM, flags), offsetof(QUST_DNAM, priority), offsetof(QUST_DNAM, unknown), offsetof(QUST_DNAM, unused), offsetof(QUST_DNAM, type) };
+        Assert::IsTrue(matches_field_view<QUST_DNAM>({ qust_dnam, _countof(qust_dnam) }));
+
+        static const size_t refr_data[] = { offsetof(REFR_DATA, position), offsetof(REFR_DATA, rotation) };
+        Assert::IsTrue(matches_field_view<REFR_DATA>({ refr_data, _countof(refr_data) }));
+
+        static const size_t refr_xlkr[] = { offsetof(REFR_XLKR, keyword), offsetof(REFR_XLKR, reference) };
+        Assert::IsTrue(matches_field_view<REFR_XLKR>({ refr_xlkr, _countof(refr_xlkr) }));
+
+        static const size_t refr_xndp[] = { offsetof(REFR_XNDP, navmesh), offsetof(REFR_XNDP, triangle), offsetof(REFR_XNDP, unknown) };
+        Assert::IsTrue(matches_field_view<REFR_XNDP>({ refr_xndp, _countof(refr_xndp) }));
+
+        static const size_t refr_xtel[] = { offsetof(REFR_XTEL, door), offsetof(REFR_XTEL, position), offsetof(REFR_XTEL, rotation), offsetof(REFR_XTEL, flags) };
+        Assert::IsTrue(matches_field_view<REFR_XTEL>({ refr_xtel, _countof(refr_xtel) }));
+
+        static const size_t cell_xclc[] = { offsetof(CELL_XCLC, x), offsetof(CELL_XCLC, y), offsetof(CELL_XCLC, flags) };
+        Assert::IsTrue(matches_field_view<CELL_XCLC>({ cell_xclc, _countof(cell_xclc) }));
+
+        static const size_t npc_acbs[] = {
+            offsetof(NPC__ACBS, flags), offsetof(NPC__ACBS, magicka_offset), offsetof(NPC__ACBS, stamina_offset),
+            offsetof(NPC__ACBS, level), offsetof(NPC__ACBS, calc_min_level), offsetof(NPC__ACBS, calc_max_level),
+            offsetof(NPC__ACBS, speed_multiplier), offsetof(NPC__ACBS, disposition_base), offsetof(NPC__ACBS, template_flags),
+            offsetof(NPC__ACBS, health_offset), offsetof(NPC__ACBS, bleedout_override),
+        };
+        Assert::IsTrue(matches_field_view<NPC__ACBS>({ npc_acbs, _countof(npc_acbs) }));
+
+        // Wrong offsets.
+        static const size_t swapped[] = { offsetof(REFR_XLKR, reference), offsetof(REFR_XLKR, keyword) };
+        Assert::IsFalse(matches_field_view<REFR_XLKR>({ swapped, _countof(swapped) }));
+    }
+
+    TEST_METHOD(TestViewMembersMatchDefinitions) {
+        auto get_type = [](const RecordDef* def, RecordFieldType field_type) {
+            const auto field_def = def->get_field_def(field_type);
+            Assert::IsNotNull(field_def);
+            Assert::IsTrue(field_def->def_type == RecordFieldDefType::Field);
+            return static_cast<const RecordFieldDef*>(field_def)->data_type;
+        };
+
+        const auto obnd = get_type(&Record_Common, RecordFieldType::OBND);
+        const auto refr = get_record_def(RecordType::REFR);
+        Assert::IsTrue(is_field_view_layout<Common_OBND>(obnd));
+        Assert::IsTrue(is_field_view_layout<REFR_DATA>(get_type(refr, RecordFieldType::DATA)));
+        Assert::IsTrue(is_field_view_layout<REFR_XLKR>(get_type(refr, RecordFieldType::XLKR)));
+        Assert::IsTrue(is_field_view_layout<REFR_XNDP>(get_type(refr, RecordFieldType::XNDP)));
+        Assert::IsTrue(is_field_view_layout<REFR_XTEL>(get_type(refr, RecordFieldType::XTEL)));
+        Assert::IsTrue(is_field_view_layout<CELL_XCLC>(get_type(get_record_def(RecordType::CELL), RecordFieldType::XCLC)));
+        Assert::IsTrue(is_field_view_layout<NPC__ACBS>(get_type(get_record_def(RecordType::NPC_), RecordFieldType::ACBS)));
+
+        // Same size, but different member count or member sizes.
+        Assert::IsFalse(is_field_view_layout<CELL_XCLC>(obnd));
+        Assert::IsFalse(is_field_view_layout<REFR_XLKR>(get_type(refr, RecordFieldType::XNDP)));
+        Assert::IsFalse(is_field_view_layout<Common_OBND>(&Type_ByteArray));
+    }
+
+    TEST_METHOD(TestGetField) {
+        TEMP_SCOPE();
+        const auto esp = read_file(tmpalloc, L"../../../../test/refr.esp");
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+        const auto door = model.lookup->find({ 0x00000802 });
+        Assert::IsNotNull(door);
+        const auto xtel = door->get<REFR_XTEL>();
+        Assert::IsNotNull(xtel);
+        Assert::AreEqual(0x00000801u, xtel->door.value);
+        Assert::AreEqual(30.5f, xtel->position.z);
+        Assert::AreEqual(3u, xtel->flags);
+        const auto xndp = door->get<REFR_XNDP>();
+        Assert::IsNotNull(xndp);
+        Assert::AreEqual((uint16_t)7, xndp->triangle);
+        Assert::AreEqual((uint16_t)5, xndp->unknown);
+        Assert::IsNull(door->get<QUST_DNAM>());
+        Assert::IsNull(door->find_field(RecordFieldType::EDID));
+        // Record types that view doesn't belong to, or field is missing.
+        const auto actor = model.lookup->find({ 0x00000804 });
+        Assert::IsNotNull(actor);
+        Assert::IsNotNull(actor->get<REFR_DATA>());
+        Assert::IsNull(actor->get<REFR_XLKR>());
+        Assert::IsNull(model.lookup->find({ 0x00000801 })->get<REFR_XLKR>());
+    }
+    };
+}
@@ -0,0 +1,204 @@
+#include <CppUnitTest.h>
+#include <esp_query.hpp>
+#include <array.hpp>
+#include <os.hpp>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace EspQueryTest
+{
+    static Query compile(const wchar_t* text) {
+        Query query;
+        compile_query(text, &query);
+        return query;
+    }
+
+    static void assert_value_text(const char* expected, const QueryValue& value) {
+        Assert::AreEqual(strlen(expected), value.length);
+        Assert::IsTrue(0 == memcmp(expected, value.text, value.length));
+    }
+
+    static void assert_matches(const uint32_t* expected, size_t expected_count, const wchar_t* query_text, const StaticArray<uint8_t>& esp) {
+        const auto query = compile(query_text);
+        Array<const RawRecord*> matches{ tmpalloc };
+        find_query_matches(&query, esp, &matches);
+
+        Assert::AreEqual(expected_count, (size_t)matches.count, query_text);
+        for (size_t i = 0; i < expected_count; ++i) {
+            Assert::AreEqual(expected[i], matches.data[i]->id.value, query_text);
+        }
+    }
+
+    TEST_CLASS(CompileQueryTest) {
+public:
+    TEST_METHOD(TestOperators) {
+        TEMP_SCOPE();
+
+        static const struct {
+            const wchar_t* text;
+            QueryOperator op;
+        } clauses[] = {
+            { L"EDID=Sword", QueryOperator::Equal },
+            { L"EDID!=Sword", QueryOperator::NotEqual },
+            { L"EDID~Sword", QueryOperator::Contains },
+            { L"XSCL<Sword", QueryOperator::Less },
+            { L"XSCL>Sword", QueryOperator::Greater },
+        };
+        for (const auto& expected : clauses) {
+            const auto query = compile(expected.text);
+            Assert::AreEqual(1, query.groups.count);
+            Assert::AreEqual(1, query.groups.data[0].clauses.count);
+
+            const auto& clause = query.groups.data[0].clauses.data[0];
+            Assert::IsTrue(clause.key == QueryKey::Field, expected.text);
+            Assert::IsTrue(clause.op == expected.op, expected.text);
+            Assert::AreEqual((size_t)1, clause.values.count);
+            assert_value_text("Sword", clause.values.data[0]);
+        }
+    }
+
+    TEST_METHOD(TestKeys) {
+        TEMP_SCOPE();
+
+        const auto query = compile(L" type = REFR,ACHR & id=802 & ref=803 & EDID=Door & XTEL.Destination Door=801");
+        Assert::AreEqual(1, query.groups.count);
+        const auto& group = query.groups.data[0];
+        Assert::AreEqual(5, group.clauses.count);
+
+        Assert::IsTrue(group.clauses.data[0].key == QueryKey::RecordType);
+        Assert::AreEqual((size_t)2, group.clauses.data[0].values.count);
+        assert_value_text("REFR", group.clauses.data[0].values.data[0]);
+        assert_value_text("ACHR", group.clauses.data[0].values.data[1]);
+
+        Assert::IsTrue(group.clauses.data[1].key == QueryKey::FormID);
+        Assert::IsTrue(group.clauses.data[2].key == QueryKey::Reference);
+
+        Assert::IsTrue(group.clauses.data[3].key == QueryKey::Field);
+        Assert::AreEqual(RecordFieldType::EDID, group.clauses.data[3].field_type);
+        Assert::IsNull(group.clauses.data[3].member);
+
+        const auto& member_clause = group.clauses.data[4];
+        Assert::IsTrue(member_clause.key == QueryKey::Field);
+        Assert::AreEqual(RecordFieldType::XTEL, member_clause.field_type);
+        Assert::AreEqual(strlen("Destination Door"), member_clause.member_length);
+        Assert::IsTrue(0 == memcmp("Destination Door", member_clause.member, member_clause.member_length));
+        Assert::IsTrue(member_clause.find_field_def(RecordType::REFR) != nullptr);
+        Assert::IsNull(member_clause.find_field_def(RecordType::QUST));
+    }
+
+    TEST_METHOD(TestGroups) {
+        TEMP_SCOPE();
+
+        const auto query = compile(L"NAME=0001B1D8 & type=REFR | id=804");
+        Assert::AreEqual(2, query.groups.count);
+
+        // Header clauses are moved before field clauses.
+        const auto& first = query.groups.data[0];
+        Assert::AreEqual(2, first.clauses.count);
+        Assert::AreEqual(1, first.header_clause_count);
+        Assert::IsTrue(first.clauses.data[0].key == QueryKey::RecordType);
+        Assert::IsTrue(first.clauses.data[1].key == QueryKey::Field);
+
+        const auto& second = query.groups.data[1];
+        Assert::AreEqual(1, second.clauses.count);
+        Assert::IsTrue(second.clauses.data[0].key == QueryKey::FormID);
+    }
+
+    TEST_METHOD(TestValues) {
+        TEMP_SCOPE();
+
+        const auto query = compile(L"EDID=[0001B1D8],10,1.25,-3,true,Sword,\"a, b & c\"");
+        const auto& values = query.groups.data[0].clauses.data[0].values;
+        Assert::AreEqual((size_t)7, values.count);
+
+        Assert::IsTrue(values.data[0].is_formid);
+        Assert::AreEqual(0x0001B1D8u, values.data[0].formid.value);
+        Assert::IsFalse(values.data[0].is_number);
+
+        // "10" can be either Form ID 00000010 or number 10, field type decides which one is compared.
+        Assert::IsTrue(values.data[1].is_formid);
+        Assert::AreEqual(0x10u, values.data[1].formid.value);
+        Assert::IsTrue(values.data[1].is_number);
+        Assert::AreEqual(10.0, values.data[1].number);
+
+        Assert::IsFalse(values.data[2].is_formid);
+        Assert::IsTrue(values.data[2].is_number);
+        Assert::AreEqual(1.25, values.data[2].number);
+
+        Assert::IsFalse(values.data[3].is_formid);
+        Assert::AreEqual(-3.0, values.data[3].number);
+
+        Assert::IsTrue(values.data[4].is_number);
+        Assert::AreEqual(1.0, values.data[4].number);
+
+        Assert::IsFalse(values.data[5].is_formid);
+        Assert::IsFalse(values.data[5].is_number);
+        assert_value_text("Sword", values.data[5]);
+
+        assert_value_text("a, b & c", values.data[6]);
+    }
+    };
+
+    TEST_CLASS(FindQueryMatchesTest) {
+public:
+    TEST_METHOD(TestReferences) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/refr.esp");
+
+        static const uint32_t refrs[] = { 0x802, 0x801 };
+        assert_matches(refrs, _countof(refrs), L"type=REFR", esp);
+        assert_matches(refrs, _countof(refrs), L"NAME=0001B1D8", esp);
+        assert_matches(refrs, _countof(refrs), L"XNDP.NavMesh=[00000803]", esp);
+
+        static const uint32_t persistent[] = { 0x802 };
+        assert_matches(persistent, _countof(persistent), L"ref=801", esp);
+        assert_matches(persistent, _countof(persistent), L"XSCL>1", esp);
+        assert_matches(persistent, _countof(persistent), L"XTEL.X<0", esp);
+        assert_matches(persistent, _countof(persistent), L"XTEL.Flags=no alarm", esp);
+        assert_matches(persistent, _countof(persistent), L"XNDP.NavMesh Triangle Index=7", esp);
+
+        static const uint32_t temporary[] = { 0x801 };
+        assert_matches(temporary, _countof(temporary), L"type=REFR & XTEL.Flags!=No Alarm", esp);
+        assert_matches(temporary, _countof(temporary), L"XNDP.NavMesh Triangle Index=12", esp);
+
+        // Form ID members are compared with Form IDs, not numbers.
+        assert_matches(nullptr, 0, L"XNDP.NavMesh=12", esp);
+        assert_matches(nullptr, 0, L"XNDP.NavMesh Triangle Index=0000000C", esp);
+
+        static const uint32_t cell[] = { 0x800 };
+        assert_matches(cell, _countof(cell), L"EDID~reference", esp);
+        assert_matches(cell, _countof(cell), L"DATA=Interior", esp);
+
+        static const uint32_t any[] = { 0x802, 0x804 };
+        assert_matches(any, _countof(any), L"id=802 | type=ACHR", esp);
+    }
+
+    TEST_METHOD(TestConditions) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/ctda.esp");
+
+        static const uint32_t info[] = { 0x01000D65 };
+        assert_matches(info, _countof(info), L"CTDA.Function=GetIsID", esp);
+        assert_matches(info, _countof(info), L"CTDA.Function~getstage", esp);
+        assert_matches(info, _countof(info), L"CTDA=0001414D", esp);
+        assert_matches(info, _countof(info), L"ref=00095125", esp);
+        assert_matches(info, _countof(info), L"TRDT.Emotion=Neutral", esp);
+        assert_matches(nullptr, 0, L"CTDA.Function=GetInFaction", esp);
+
+        static const uint32_t quest[] = { 0x01000D62 };
+        assert_matches(quest, _countof(quest), L"DNAM.Flags=Run Once", esp);
+        assert_matches(quest, _countof(quest), L"type=QUST & DNAM.Type=none", esp);
+
+        // PNAM is priority number in DIAL and Form ID of previous info in INFO.
+        static const uint32_t topic[] = { 0x01000D64 };
+        assert_matches(topic, _countof(topic), L"PNAM=50", esp);
+        assert_matches(info, _countof(info), L"PNAM=0", esp);
+
+        static const uint32_t branch_refs[] = { 0x01000D64, 0x01000D63 };
+        assert_matches(branch_refs, _countof(branch_refs), L"QNAM=01000D62", esp);
+    }
+    };
+}
@@ -0,0 +1,144 @@
+#include <CppUnitTest.h>
+#include <esp_remap.hpp>
+#include <esp_to_text.hpp>
+#include <text_to_esp.hpp>
+#include <os.hpp>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace EspRemapTest
+{
+    TEST_CLASS(FormIDMapTest) {
+public:
+    TEST_METHOD(TestTranslate) {
+        FormIDMap map;
+        defer(map.dispose());
+
+        for (uint32_t i = 1; i <= 5000; ++i) {
+            Assert::IsTrue(map.add({ 0x01000000 | i }, { 0x02000000 | (i + 0x800) }));
+        }
+        Assert::IsFalse(map.add({ 0x01000010 }, { 0x01000020 }));
+        map.master_indices[1] = 3;
+
+        Assert::AreEqual(0x02000810u, map.translate({ 0x01000010 }).value);
+        Assert::AreEqual(0x02001B88u, map.translate({ 0x01001388 }).value);
+        Assert::AreEqual(0x03001389u, map.translate({ 0x01001389 }).value, L"Form ID without entry must keep object index");
+        Assert::AreEqual(0x00012E46u, map.translate({ 0x00012E46 }).value);
+        Assert::AreEqual(0u, map.translate({ 0 }).value);
+    }
+
+    TEST_METHOD(TestCompactKeepsLightFormIDs) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/ctda.esp");
+
+        FormIDMap map;
+        defer(map.dispose());
+
+        Assert::AreEqual(0xD66u, build_compact_esl_map(&map, esp));
+        Assert::AreEqual((size_t)0, map.count);
+    }
+    };
+
+    // Remapped plugin is written to working folder of test and read back.
+    static StaticArray<uint8_t> remap_plugin(const StaticArray<uint8_t> esp, const FormIDMap& map, EspRemapStats* stats) {
+        const auto path = L"remap_test.esp";
+        *stats = remap_formids(esp, map, 0, path);
+        return read_file(tmpalloc, path);
+    }
+
+    static StaticArray<uint8_t> to_text(ProgramOptions options, const StaticArray<uint8_t> esp) {
+        EspParser parser;
+        parser.init(tmpalloc, options);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        TextRecordWriter writer;
+        writer.init(options);
+        defer(writer.dispose());
+        writer.write_records(model.records);
+
+        const auto text = StaticArray<uint8_t>{ (uint8_t*)memalloc(tmpalloc, writer.output_buffer.size()), writer.output_buffer.size() };
+        memcpy(text.data, writer.output_buffer.start, text.count);
+        return text;
+    }
+
+    // Replaces all occurrences of "from" with "to" of the same length.
+    static void replace_text(StaticArray<uint8_t> text, const char* from, const char* to) {
+        const auto length = strlen(from);
+        verify(strlen(to) == length);
+        for (size_t i = 0; i + length <= text.count; ++i) {
+            if (memory_equals(text.data + i, from, length)) {
+                memcpy(text.data + i, to, length);
+            }
+        }
+    }
+
+    TEST_CLASS(RemapFormIDsTest) {
+public:
+    TEST_METHOD(TestRecompressedRecord) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/npc.esp");
+
+        FormIDMap map;
+        defer(map.dispose());
+        map.add({ 0x0001BDB3 }, { 0x0001BDB4 });
+
+        EspRemapStats stats;
+        const auto remapped = remap_plugin(esp, map, &stats);
+        Assert::AreEqual((size_t)2, stats.record_count);
+        Assert::AreEqual((size_t)2, stats.changed_count);
+        Assert::AreEqual((size_t)1, stats.recompressed_count);
+
+        // The only record of top-level group is compressed, so size of group must follow size of recompressed record.
+        const auto tes4 = (const RawRecord*)remapped.data;
+        const auto group = (const RawGrupRecord*)(remapped.data + sizeof(RawRecord) + tes4->data_size);
+        Assert::AreEqual(RecordType::GRUP, group->type);
+        Assert::AreEqual((size_t)(remapped.data + remapped.count - (const uint8_t*)group), (size_t)group->group_size);
+        Assert::AreNotEqual(esp.count, remapped.count);
+
+        auto expected_text = read_file(tmpalloc, L"../../../../test/npc_expect.txt");
+        replace_text(expected_text, "[0001BDB3]", "[0001BDB4]");
+        assert_same_array_content(expected_text, to_text(ProgramOptions::ExportTimestamp, remapped));
+    }
+
+    TEST_METHOD(TestNavMesh) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/navm.esp");
+
+        FormIDMap map;
+        defer(map.dispose());
+        map.add({ 0x00000800 }, { 0x00000900 });
+        map.add({ 0x00012345 }, { 0x00000901 });
+        map.add({ 0x00054321 }, { 0x00000902 });
+
+        EspRemapStats stats;
+        const auto remapped = remap_plugin(esp, map, &stats);
+        Assert::AreEqual((size_t)0, stats.recompressed_count);
+        Assert::AreEqual(esp.count, remapped.count);
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(remapped);
+
+        const auto geometry = model.lookup->find({ 0x00000801 })->find_field((RecordFieldType)fourcc("NVNM"));
+        NVNM_Field nvnm;
+        Assert::IsTrue(nvnm.parse(geometry->data.data, geometry->data.count));
+        Assert::AreEqual(0x00000900u, nvnm.cell.value);
+        Assert::AreEqual(0x00000901u, nvnm.edge_links.data[0].navmesh.value);
+        Assert::AreEqual(0x00000902u, nvnm.door_triangles.data[0].door.value);
+
+        // Text of remapped plugin must be converted back to the same plugin.
+        const auto text = to_text(ProgramOptions::None, remapped);
+        TextRecordReader reader;
+        reader.init();
+        defer(reader.dispose());
+        reader.read_records((const char*)text.data, (const char*)text.data + text.count);
+        assert_same_array_content(remapped, { reader.buffer->start, reader.buffer->size() });
+    }
+    };
+}
@@ -0,0 +1,131 @@
+#include <CppUnitTest.h>
+#include <esp_table.hpp>
+#include <array.hpp>
+#include <os.hpp>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace EspTableTest
+{
+    // Returns table as null-terminated string.
+    static const char* export_to_string(const StaticArray<uint8_t>& esp, RecordType record_type, RecordFieldType field_type, char separator) {
+        export_table(ProgramOptions::None, esp, nullptr, record_type, field_type, separator, L"table_test.csv");
+
+        const auto table = read_file(tmpalloc, L"table_test.csv");
+        const auto result = (char*)memalloc(tmpalloc, table.count + 1);
+        memcpy(result, table.data, table.count);
+        result[table.count] = '\0';
+        return result;
+    }
+
+    static void append_bytes(Array<uint8_t>* data, const void* bytes, size_t size) {
+        grow(data, (int)size);
+        memcpy(data->data + data->count, bytes, size);
+        data->count += (int)size;
+    }
+
+    static void append_field(Array<uint8_t>* data, RecordFieldType type, const void* value, size_t size) {
+        RawRecordField field;
+        field.type = type;
+        field.size = (uint16_t)size;
+        append_bytes(data, &field, sizeof(field));
+        append_bytes(data, value, size);
+    }
+
+    static void append_record(Array<uint8_t>* esp, RecordType type, uint32_t id, const Array<uint8_t>& fields) {
+        RawRecord record;
+        record.type = type;
+        record.data_size = (uint32_t)fields.count;
+        record.id = { id };
+        append_bytes(esp, &record, sizeof(record));
+        append_bytes(esp, fields.data, fields.count);
+    }
+
+    // Plugin with two REFR records outside of groups, XTEL of second record has only door and position.
+    static StaticArray<uint8_t> make_teleport_plugin() {
+        Array<uint8_t> esp{ tmpalloc };
+        append_record(&esp, RecordType::TES4, 0, Array<uint8_t>{ tmpalloc });
+
+        REFR_XTEL xtel;
+        xtel.door = { 0x802 };
+        xtel.position = { 1, 2, 3 };
+        xtel.rotation = { 4, 5, 6 };
+        xtel.flags = 0;
+
+        Array<uint8_t> first{ tmpalloc };
+        append_field(&first, RecordFieldType::EDID, "Door, Main", sizeof("Door, Main"));
+        append_field(&first, RecordFieldType::XTEL, &xtel, sizeof(xtel));
+        append_record(&esp, RecordType::REFR, 0x801, first);
+
+        Array<uint8_t> second{ tmpalloc };
+        append_field(&second, RecordFieldType::EDID, "Say \"Hi\"", sizeof("Say \"Hi\""));
+        append_field(&second, RecordFieldType::XTEL, &xtel, sizeof(FormID) + sizeof(Vector3));
+        append_record(&esp, RecordType::REFR, 0x802, second);
+
+        return { esp.data, (size_t)esp.count };
+    }
+
+    TEST_CLASS(ExportTableTest) {
+public:
+    TEST_METHOD(TestStructColumns) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/refr.esp");
+
+        // Vector3 members are columns of their own, struct member names are joined with ".".
+        Assert::AreEqual(
+            "Form ID,Editor ID,Destination Door,Pos XYZ.X,Pos XYZ.Y,Pos XYZ.Z,Rot XYZ.X,Rot XYZ.Y,Rot XYZ.Z,Flags\n"
+            "[00000802],,[00000801],-10,-20,30.5,0.1,0.2,0.3,No Alarm|0x2\n"
+            "[00000801],,[00000802],10,20,-30.5,0,0,1.5707964,\n",
+            export_to_string(esp, RecordType::REFR, RecordFieldType::XTEL, ','));
+
+        // Fields that are not structs are written as single column named after field.
+        Assert::AreEqual(
+            "Form ID,Editor ID,NAME\n"
+            "[00000802],,[0001B1D8]\n"
+            "[00000801],,[0001B1D8]\n",
+            export_to_string(esp, RecordType::REFR, RecordFieldType::NAME, ','));
+    }
+
+    TEST_METHOD(TestConstantFallback) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/refr.esp");
+
+        // "Unknown" is written only if it's not equal to constant.
+        Assert::AreEqual(
+            "Form ID,Editor ID,NavMesh,NavMesh Triangle Index,Unknown\n"
+            "[00000802],,[00000803],7,5\n"
+            "[00000801],,[00000803],12,\n",
+            export_to_string(esp, RecordType::REFR, RecordFieldType::XNDP, ','));
+    }
+
+    TEST_METHOD(TestQuoting) {
+        TEMP_SCOPE();
+
+        const auto esp = make_teleport_plugin();
+
+        // Members that are missing from shorter XTEL are left empty.
+        Assert::AreEqual(
+            "Form ID,Editor ID,Destination Door,Pos XYZ.X,Pos XYZ.Y,Pos XYZ.Z,Rot XYZ.X,Rot XYZ.Y,Rot XYZ.Z,Flags\n"
+            "[00000801],\"Door, Main\",[00000802],1,2,3,4,5,6,\n"
+            "[00000802],\"Say \"\"Hi\"\"\",[00000802],1,2,3,,,,\n",
+            export_to_string(esp, RecordType::REFR, RecordFieldType::XTEL, ','));
+
+        // Values with commas are not quoted in TSV.
+        Assert::AreEqual(
+            "Form ID\tEditor ID\tDestination Door\tPos XYZ.X\tPos XYZ.Y\tPos XYZ.Z\tRot XYZ.X\tRot XYZ.Y\tRot XYZ.Z\tFlags\n"
+            "[00000801]\tDoor, Main\t[00000802]\t1\t2\t3\t4\t5\t6\t\n"
+            "[00000802]\t\"Say \"\"Hi\"\"\"\t[00000802]\t1\t2\t3\t\t\t\t\n",
+            export_to_string(esp, RecordType::REFR, RecordFieldType::XTEL, '\t'));
+    }
+
+    TEST_METHOD(TestSeparator) {
+        Assert::AreEqual('\t', get_table_separator(L"C:\\Tables\\weapons.tsv"));
+        Assert::AreEqual(',', get_table_separator(L"C:\\Tables\\weapons.csv"));
+        Assert::AreEqual(',', get_table_separator(L"C:\\Tables.tsv\\weapons"));
+        Assert::AreEqual(',', get_table_separator(nullptr));
+    }
+    };
+}
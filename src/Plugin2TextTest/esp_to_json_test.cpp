@@ -0,0 +1,132 @@
+#include <CppUnitTest.h>
+#include <esp_to_json.hpp>
+#include <array.hpp>
+#include <os.hpp>
+#include <limits>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace EspToJsonTest
+{
+    static StaticArray<uint8_t> export_json(const wchar_t* esp_path) {
+        const auto esp = read_file(tmpalloc, esp_path);
+        esp_to_json(ProgramOptions::None, esp, nullptr, L"json_test.ndjson");
+        return read_file(tmpalloc, L"json_test.ndjson");
+    }
+
+    static void test_json(const wchar_t* esp_path, const wchar_t* expect_json_path) {
+        TEMP_SCOPE();
+        const auto expect_json = read_file(tmpalloc, expect_json_path);
+        assert_same_array_content(expect_json, export_json(esp_path));
+    }
+
+    static void assert_has_line_start(const StaticArray<uint8_t>& json, const char* line_start) {
+        const auto length = strlen(line_start);
+        for (size_t i = 0; i + length <= json.count; ++i) {
+            if ((i == 0 || json.data[i - 1] == '\n') && memory_equals(&json.data[i], line_start, length)) {
+                return;
+            }
+        }
+        Assert::Fail(L"line not found");
+    }
+
+    // Calls "write" with writer that writes to empty output, returns output as null-terminated string.
+    template<typename Func>
+    static const char* write_json(Func write) {
+        Array<uint8_t> output;
+        defer(output.free());
+
+        JsonRecordWriter writer;
+        writer.output = &output;
+        defer(writer.dispose());
+        write(writer);
+
+        const auto result = (char*)memalloc(tmpalloc, output.count + 1);
+        memcpy(result, output.data, output.count);
+        result[output.count] = '\0';
+        return result;
+    }
+
+    TEST_CLASS(JsonRecordWriterTest) {
+public:
+    TEST_METHOD(TestStringEscaping) {
+        TEMP_SCOPE();
+
+        // Long enough for special characters to be found in 16 byte blocks.
+        Assert::AreEqual(
+            "\"Tab\\there \\\"quoted\\\" back\\\\slash\\r\\n\\u0001\\u001f end\"",
+            write_json([](JsonRecordWriter& writer) { writer.write_string("Tab\there \"quoted\" back\\slash\r\n\x01\x1f end"); }));
+
+        Assert::AreEqual("\"\"", write_json([](JsonRecordWriter& writer) { writer.write_string(""); }));
+    }
+
+    TEST_METHOD(TestStringEncoding) {
+        TEMP_SCOPE();
+
+        // Valid UTF-8 sequences are kept, other bytes are converted from Windows-1252.
+        Assert::AreEqual(
+            "\"UTF-8 \xC3\xA9, 1252 \xC3\xA9 \xE2\x82\xAC \xC2\x81, broken \xC3\x83!\"",
+            write_json([](JsonRecordWriter& writer) { writer.write_string("UTF-8 \xC3\xA9, 1252 \xE9 \x80 \x81, broken \xC3!"); }));
+    }
+
+    TEST_METHOD(TestNumbers) {
+        TEMP_SCOPE();
+
+        Assert::AreEqual("1.5", write_json([](JsonRecordWriter& writer) { writer.write_float(1.5f); }));
+        Assert::AreEqual("-2147483648", write_json([](JsonRecordWriter& writer) { writer.write_int32(INT32_MIN); }));
+
+        // NaN and infinity are not allowed in JSON.
+        Assert::AreEqual("\"nan\"", write_json([](JsonRecordWriter& writer) { writer.write_float(std::numeric_limits<float>::quiet_NaN()); }));
+        Assert::AreEqual("\"inf\"", write_json([](JsonRecordWriter& writer) { writer.write_float(std::numeric_limits<float>::infinity()); }));
+    }
+
+    TEST_METHOD(TestNVPP) {
+        TEMP_SCOPE();
+
+        // 2 paths with 2 and 1 Form IDs, 1 node.
+        static const uint32_t nvpp[] = { 2, 2, 0x801, 0x802, 1, 0x803, 1, 0x804, 3 };
+        Assert::AreEqual(
+            "{\"Paths\":[[\"00000801\",\"00000802\"],[\"00000803\"]],\"Nodes\":[{\"Form ID\":\"00000804\",\"Index\":3}]}",
+            write_json([](JsonRecordWriter& writer) { writer.write_type(&Type_NVPP, nvpp, sizeof(nvpp)); }));
+    }
+    };
+
+    TEST_CLASS(ExportJsonTest) {
+public:
+    TEST_METHOD(TestParent) {
+        TEMP_SCOPE();
+
+        // Records of cell, world and topic children groups have Form ID of their owner.
+        const auto cells = export_json(L"../../../../test/xclw.esp");
+        assert_has_line_start(cells, "{\"type\":\"CELL\",\"id\":\"00027D1C\",\"unknown\":12,");
+        assert_has_line_start(cells, "{\"type\":\"REFR\",\"id\":\"0010D179\",\"parent\":\"00027D1C\",");
+        assert_has_line_start(cells, "{\"type\":\"WRLD\",\"id\":\"0000003C\",\"unknown\":12,");
+        assert_has_line_start(cells, "{\"type\":\"CELL\",\"id\":\"000099A2\",\"parent\":\"0000003C\",");
+
+        const auto topics = export_json(L"../../../../test/ctda.esp");
+        assert_has_line_start(topics, "{\"type\":\"DIAL\",\"id\":\"01000D64\",\"fields\":");
+        assert_has_line_start(topics, "{\"type\":\"INFO\",\"id\":\"01000D65\",\"parent\":\"01000D64\",");
+    }
+
+    TEST_METHOD(TestVMAD) {
+        test_json(L"../../../../test/vmad.esp", L"../../../../test/vmad_expect.json");
+    }
+
+    TEST_METHOD(TestCTDA) {
+        test_json(L"../../../../test/ctda.esp", L"../../../../test/ctda_expect.json");
+    }
+
+    TEST_METHOD(TestNVNM) {
+        test_json(L"../../../../test/navm.esp", L"../../../../test/navm_expect.json");
+    }
+
+    TEST_METHOD(TestLAND) {
+        test_json(L"../../../../test/land.esp", L"../../../../test/land_expect.json");
+    }
+
+    TEST_METHOD(TestWorld) {
+        test_json(L"../../../../test/xclw.esp", L"../../../../test/xclw_expect.json");
+    }
+    };
+}
@@ -19,5 +19,18 @@ namespace EspToTextTest
 
             Assert::AreEqual("  ?*\n", (const char*)writer.output_buffer.start, L"reading past provided buffer");
         }
+
+        TEST_METHOD(Test_String_NonAsciiBytes) {
+            TextRecordWriter writer;
+            writer.init(ProgramOptions::None);
+            defer(writer.dispose());
+
+            // Bug: bytes >= 128 (Windows-1252 or UTF-8 string tables) failed verification.
+            const char text[] = "\xC9p\xE9" "e";
+            writer.write_string(text, sizeof(text) - 1);
+            writer.write_literal("\0"); // zero-terminate string.
+
+            Assert::AreEqual("\"\xC9p\xE9" "e\"", (const char*)writer.output_buffer.start, L"bytes >= 128 must be written as is");
+        }
     };
 }
@@ -0,0 +1,118 @@
+#include <CppUnitTest.h>
+#include <esp_parser.hpp>
+#include <formid_layout.hpp>
+#include <array.hpp>
+#include <os.hpp>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FormIDLayoutTest
+{
+    struct FoundFormID {
+        RecordFieldType field_type;
+        uint32_t value;
+    };
+
+    // Fields of uncompressed record are stored one after another in plugin data.
+    static Array<FoundFormID> scan_record(const Record* record) {
+        const auto first = record->fields.data[0];
+        const auto last = record->fields.data[record->fields.count - 1];
+        const auto data = first->data.data - sizeof(RawRecordField);
+        const auto size = (size_t)(last->data.data + last->data.count - data);
+
+        Array<FoundFormID> found{ tmpalloc };
+        scan_record_formids(record->type, data, size, [&found](const FormID* form_id, RecordFieldType field_type) {
+            found.push({ field_type, form_id->value });
+        });
+        return found;
+    }
+
+    static void assert_found(const FoundFormID* expected, size_t expected_count, const Array<FoundFormID>& found) {
+        Assert::AreEqual(expected_count, (size_t)found.count);
+        for (size_t i = 0; i < expected_count; ++i) {
+            Assert::AreEqual(expected[i].field_type, found.data[i].field_type);
+            Assert::AreEqual(expected[i].value, found.data[i].value);
+        }
+    }
+
+    TEST_CLASS(ScanRecordFormIDsTest) {
+public:
+    TEST_METHOD(TestStructMembers) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/refr.esp");
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        static const FoundFormID door[] = {
+            { RecordFieldType::NAME, 0x0001B1D8 },
+            { RecordFieldType::XNDP, 0x00000803 },
+            { RecordFieldType::XTEL, 0x00000801 },
+            { RecordFieldType::XLKR, 0x0001A3B1 },
+            { RecordFieldType::XLKR, 0x00000801 },
+        };
+        assert_found(door, _countof(door), scan_record(model.lookup->find({ 0x00000802 })));
+
+        // XLKR is not defined for ACHR.
+        static const FoundFormID actor[] = {
+            { RecordFieldType::NAME, 0x00013BB9 },
+        };
+        assert_found(actor, _countof(actor), scan_record(model.lookup->find({ 0x00000804 })));
+    }
+
+    TEST_METHOD(TestConditions) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/ctda.esp");
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        Array<uint32_t> condition_formids{ tmpalloc };
+        for (const auto& found : scan_record(model.lookup->find({ 0x01000D65 }))) {
+            if (found.field_type == (RecordFieldType)fourcc("CTDA")) {
+                condition_formids.push(found.value);
+            }
+        }
+
+        Assert::AreEqual(2, condition_formids.count);
+        Assert::AreEqual(0x00095125u, condition_formids.data[0]);
+        Assert::AreEqual(0x0001414Du, condition_formids.data[1]);
+    }
+
+    TEST_METHOD(TestNavMesh) {
+        TEMP_SCOPE();
+
+        const auto esp = read_file(tmpalloc, L"../../../../test/navm.esp");
+
+        EspParser parser;
+        parser.init(tmpalloc, ProgramOptions::BuildRecordLookup);
+        defer(parser.dispose());
+        const auto model = parser.parse(esp);
+
+        constexpr auto NVNM = (RecordFieldType)fourcc("NVNM");
+
+        // Parent cell is reported only if worldspace is not set.
+        static const FoundFormID interior[] = {
+            { NVNM, 0x00000000 },
+            { NVNM, 0x00000800 },
+            { NVNM, 0x00012345 },
+            { NVNM, 0x00054321 },
+        };
+        assert_found(interior, _countof(interior), scan_record(model.lookup->find({ 0x00000801 })));
+
+        static const FoundFormID exterior[] = {
+            { NVNM, 0x0000003C },
+            { NVNM, 0x00012345 },
+            { NVNM, 0x00054321 },
+        };
+        assert_found(exterior, _countof(exterior), scan_record(model.lookup->find({ 0x00000802 })));
+    }
+    };
+}
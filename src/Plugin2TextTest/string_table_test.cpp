@@ -0,0 +1,135 @@
+#include <CppUnitTest.h>
+#include <string_table.hpp>
+#include <os.hpp>
+#include <string.h>
+#include "test_common.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace StringTableTest
+{
+    static void assert_string(const LocalizedString& string, StringTableType type, const char* expected) {
+        Assert::IsNotNull(string.data, L"string was not found");
+        Assert::AreEqual((int)type, (int)string.type, L"string was found in wrong table");
+        Assert::AreEqual(strlen(expected), string.count, L"invalid string length");
+        Assert::IsTrue(memory_equals(expected, string.data, string.count), L"invalid string contents");
+    }
+
+    TEST_CLASS(StringTablesTest) {
+public:
+    TEST_METHOD(TestFind) {
+        copy_localized_plugin();
+
+        StringTables strings;
+        defer(strings.dispose());
+        Assert::IsTrue(strings.load(L"localized.esp", L"english"), L"string tables are missing");
+        Assert::AreEqual((size_t)5, strings.string_count);
+
+        // ID 1 is in both STRINGS and DLSTRINGS, table of field decides which one is used.
+        assert_string(strings.find(StringTableType::Strings, 1), StringTableType::Strings, "\xC9p\xE9" "e");
+        assert_string(strings.find(StringTableType::DLStrings, 1), StringTableType::DLStrings, "Forged in the north.\r\nNa\xC3\xAFve smiths call it \xE2\x80\x9Cthe blade\xE2\x80\x9D.");
+        assert_string(strings.find(StringTableType::Strings, 2), StringTableType::Strings, "Lore Book");
+        assert_string(strings.find(StringTableType::ILStrings, 7), StringTableType::ILStrings, "Se\xF1or's blade");
+
+        // Other tables are tried if string is not in table of field.
+        assert_string(strings.find(StringTableType::DLStrings, 4), StringTableType::Strings, "An old book.");
+        assert_string(strings.find(StringTableType::Strings, 7), StringTableType::ILStrings, "Se\xF1or's blade");
+
+        Assert::IsNull(strings.find(StringTableType::Strings, 3).data, L"missing string was found");
+        Assert::IsNull(strings.find(StringTableType::ILStrings, 11).data, L"missing string was found");
+        Assert::IsNull(strings.find(StringTableType::Strings, 0).data, L"string ID 0 must never be found");
+    }
+
+    TEST_METHOD(TestMissingTables) {
+        StringTables strings;
+        defer(strings.dispose());
+        Assert::IsFalse(strings.load(L"missing.esp", L"english"), L"string tables must be missing");
+        Assert::AreEqual((size_t)0, strings.string_count);
+        Assert::IsNull(strings.find(StringTableType::Strings, 1).data, L"string was found in missing table");
+    }
+
+    TEST_METHOD(TestInvalidDirectory) {
+        create_folder(Path{ get_current_directory(), L"Strings" }.path);
+
+        // String offset is past end of file.
+        uint8_t ilstrings[] = {
+            1, 0, 0, 0,   4, 0, 0, 0,
+            1, 0, 0, 0,   4, 0, 0, 0,
+            1, 0, 0, 0,
+        };
+        write_file(L"Strings\\invalid_directory_english.ILSTRINGS", { ilstrings, sizeof(ilstrings) });
+
+        StringTables strings;
+        defer(strings.dispose());
+        Assert::ExpectException<std::exception>([&]() { strings.load(L"invalid_directory.esp", L"english"); });
+    }
+
+    TEST_METHOD(TestInvalidLengthPrefix) {
+        create_folder(Path{ get_current_directory(), L"Strings" }.path);
+
+        // Length of string 1 is larger than rest of file, length of string 2 is zero.
+        uint8_t dlstrings[] = {
+            2, 0, 0, 0,   12, 0, 0, 0,
+            1, 0, 0, 0,   0, 0, 0, 0,
+            2, 0, 0, 0,   8, 0, 0, 0,
+            10, 0, 0, 0,  'a', 'b', 'c', 0,
+            0, 0, 0, 0,
+        };
+        write_file(L"Strings\\invalid_length_english.DLSTRINGS", { dlstrings, sizeof(dlstrings) });
+
+        StringTables strings;
+        defer(strings.dispose());
+        Assert::IsFalse(strings.load(L"invalid_length.esp", L"english"), L"STRINGS and ILSTRINGS must be missing");
+        Assert::AreEqual((size_t)2, strings.string_count);
+        Assert::ExpectException<std::exception>([&]() { strings.find(StringTableType::DLStrings, 1); });
+        Assert::ExpectException<std::exception>([&]() { strings.find(StringTableType::DLStrings, 2); });
+    }
+    };
+
+    TEST_CLASS(StringTablesBuilderTest) {
+public:
+    TEST_METHOD(TestWrite) {
+        TEMP_SCOPE();
+        create_folder(Path{ get_current_directory(), L"Strings" }.path);
+
+        // Table without strings is kept if it exists and written empty if it doesn't.
+        uint8_t ilstrings[] = {
+            1, 0, 0, 0,   6, 0, 0, 0,
+            9, 0, 0, 0,   0, 0, 0, 0,
+            2, 0, 0, 0,   'H', 'i',
+            0, 0, 0, 0,
+        };
+        write_file(L"Strings\\builder_english.ILSTRINGS", { ilstrings, sizeof(ilstrings) });
+
+        StringTablesBuilder builder;
+        builder.init();
+        defer(builder.dispose());
+
+        const auto add_string = [&](StringTableType type, uint32_t id, const char* text) {
+            builder.begin_string(type, id)->write_bytes(text, strlen(text));
+            builder.end_string(type);
+        };
+        add_string(StringTableType::Strings, 5, "Second");
+        add_string(StringTableType::Strings, 3, "First");
+        add_string(StringTableType::Strings, 5, "Duplicate");
+        builder.write(L"builder.esp", L"english");
+
+        // Directory is sorted by ID, duplicate IDs are written once and first string wins.
+        uint8_t expect_strings[] = {
+            2, 0, 0, 0,   23, 0, 0, 0,
+            3, 0, 0, 0,   7, 0, 0, 0,
+            5, 0, 0, 0,   0, 0, 0, 0,
+            'S', 'e', 'c', 'o', 'n', 'd', 0,
+            'F', 'i', 'r', 's', 't', 0,
+            'D', 'u', 'p', 'l', 'i', 'c', 'a', 't', 'e', 0,
+        };
+        uint8_t expect_dlstrings[] = {
+            0, 0, 0, 0,   0, 0, 0, 0,
+        };
+
+        assert_same_array_content({ expect_strings, sizeof(expect_strings) }, read_file(tmpalloc, L"Strings\\builder_english.STRINGS"));
+        assert_same_array_content({ expect_dlstrings, sizeof(expect_dlstrings) }, read_file(tmpalloc, L"Strings\\builder_english.DLSTRINGS"));
+        assert_same_array_content({ ilstrings, sizeof(ilstrings) }, read_file(tmpalloc, L"Strings\\builder_english.ILSTRINGS"));
+    }
+    };
+}
@@ -16,6 +16,15 @@ void assert_same_array_content(const StaticArray<uint8_t>& expected, const Stati
     Assert::IsTrue(memory_equals(expected.data, actual.data, expected.count), L"invalid array contents");
 }
 
+void copy_localized_plugin() {
+    TEMP_SCOPE();
+    create_folder(Path{ get_current_directory(), L"Strings" }.path);
+    write_file(L"localized.esp", read_file(tmpalloc, L"../../../../test/localized.esp"));
+    write_file(L"Strings\\localized_english.STRINGS", read_file(tmpalloc, L"../../../../test/Strings/localized_english.STRINGS"));
+    write_file(L"Strings\\localized_english.DLSTRINGS", read_file(tmpalloc, L"../../../../test/Strings/localized_english.DLSTRINGS"));
+    write_file(L"Strings\\localized_english.ILSTRINGS", read_file(tmpalloc, L"../../../../test/Strings/localized_english.ILSTRINGS"));
+}
+
 void test_esps(ProgramOptions options, const wchar_t* esp_path, const wchar_t* expect_txt_path, const wchar_t* expect_esp_path) {
     TEMP_SCOPE();
 
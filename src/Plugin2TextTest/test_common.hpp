@@ -12,6 +12,10 @@ template<> inline std::wstring ToString<RecordFlags>(const RecordFlags& q) {
     RETURN_WIDE_STRING((uint32_t)q);
 }
 
+template<> inline std::wstring ToString<RecordFieldType>(const RecordFieldType& q) {
+    RETURN_WIDE_STRING((uint32_t)q);
+}
+
 template<> inline std::wstring ToString<uint16_t>(const uint16_t& q) {
     RETURN_WIDE_STRING(q);
 }
@@ -20,3 +24,5 @@ template<> inline std::wstring ToString<uint16_t>(const uint16_t& q) {
 
 void assert_same_array_content(const StaticArray<uint8_t>& expected, const StaticArray<uint8_t>& actual);
 void test_esps(ProgramOptions options, const wchar_t* esp_path, const wchar_t* expect_txt_path, const wchar_t* expect_esp_path);
+// Copies "test/localized.esp" and its string tables to working directory, tables are looked up next to plugin.
+void copy_localized_plugin();
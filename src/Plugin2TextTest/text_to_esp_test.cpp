@@ -1,5 +1,6 @@
 #include <CppUnitTest.h>
 #include <esp_to_text.hpp>
+#include <text_to_esp.hpp>
 #include "test_common.hpp"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -17,5 +18,57 @@ public:
             L"../../../../test/regression/text_to_esp_byte_array_compressed_expect.esm"
         );
     }
+
+    TEST_METHOD(Test_LocalizedString) {
+        TextRecordReader reader;
+        reader.init();
+        defer(reader.dispose());
+        reader.localized_strings = true;
+
+        const char text[] = "  42 DL \"Description\"\n";
+        reader.start = text;
+        reader.now = text;
+        reader.end = text + sizeof(text) - 1;
+
+        uint32_t id = 0;
+        Slice slice;
+        slice.start = (uint8_t*)&id;
+        slice.now = slice.start;
+        slice.end = slice.start + sizeof(id);
+        reader.read_type(&slice, &Type_LString);
+
+        Assert::AreEqual(42u, id, L"invalid string ID");
+
+        const auto& entries = reader.string_tables.entries[(size_t)StringTableType::DLStrings];
+        const auto& data = reader.string_tables.data[(size_t)StringTableType::DLStrings];
+        Assert::AreEqual(1, entries.count, L"string was not added to DLSTRINGS table");
+        Assert::AreEqual(sizeof(uint32_t) + sizeof("Description"), data.size(), L"invalid string size");
+        Assert::AreEqual((uint32_t)sizeof("Description"), *(uint32_t*)data.start, L"invalid string length prefix");
+        Assert::IsTrue(memory_equals("Description", data.start + sizeof(uint32_t), sizeof("Description")), L"invalid string contents");
+    }
+
+    TEST_METHOD(Test_LocalizedStringTableOfField) {
+        TextRecordReader reader;
+        reader.init();
+        defer(reader.dispose());
+        reader.localized_strings = true;
+
+        // String without table name goes to table of field.
+        const char text[] = "  42 \"Response\"\n";
+        reader.start = text;
+        reader.now = text;
+        reader.end = text + sizeof(text) - 1;
+
+        uint32_t id = 0;
+        Slice slice;
+        slice.start = (uint8_t*)&id;
+        slice.now = slice.start;
+        slice.end = slice.start + sizeof(id);
+        reader.read_type(&slice, &Type_ILString);
+
+        Assert::AreEqual(42u, id, L"invalid string ID");
+        Assert::AreEqual(1, reader.string_tables.entries[(size_t)StringTableType::ILStrings].count, L"string was not added to ILSTRINGS table");
+        Assert::AreEqual(0, reader.string_tables.entries[(size_t)StringTableType::Strings].count, L"string was added to STRINGS table");
+    }
     };
 }
@@ -5,6 +5,8 @@
 
 ..\src\Plugin2Text\x64\Debug\Plugin2Text.exe multiline_string.esp multiline_string_expect.txt
 
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe localized.esp localized_expect.txt
+
 ..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --export-timestamp npc.esp npc_expect.txt
 ..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --export-timestamp npc_expect.txt npc_expect.esp
 
@@ -21,3 +23,13 @@
 ..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --export-timestamp ctda.esp ctda_expect.txt
 
 ..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --export-timestamp --preserve-junk xclw.esp xclw_expect.txt
+
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe land.esp land_expect.txt
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe navm.esp navm_expect.txt
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe refr.esp refr_expect.txt
+
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --json vmad.esp vmad_expect.json
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --json ctda.esp ctda_expect.json
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --json navm.esp navm_expect.json
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --json land.esp land_expect.json
+..\src\Plugin2Text\x64\Debug\Plugin2Text.exe --json xclw.esp xclw_expect.json